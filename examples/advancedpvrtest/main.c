@@ -235,6 +235,9 @@ void main()
         ta_draw_text(32, 105, font_12pt, rgb(0, 255, 244), "Hello, world!");
 #endif
 
+        /* Draw some debugging text using the TA instead of the framebuffer. */
+        ta_draw_debug_text(32, 32, rgb(255, 255, 255), "Rendering with TA...\nLiveness counter: %d", count++);
+
         /* Mark the end of the command list */
         ta_commit_end();
 
@@ -247,9 +250,6 @@ void main()
         video_draw_text(32, 65, font_12pt, rgb(0, 255, 244), "Hello, world!");
 #endif
 
-        /* Now, display some debugging on top of the TA. */
-        video_draw_debug_text(32, 32, rgb(255, 255, 255), "Rendering with TA...\nLiveness counter: %d", count++);
-
 #ifndef FEATURE_FREETYPE
         video_draw_debug_text(32, 48, rgb(255, 0, 0), "Font rendering missing due to missing freetype library!");
         video_draw_debug_text(32, 56, rgb(255, 0, 0), "Compile 3rd party libs and then recompile libnaomi.");
@@ -5,6 +5,7 @@
 #include "naomi/console.h"
 #include "naomi/posix.h"
 #include "naomi/video.h"
+#include "naomi/ta.h"
 #include "naomi/interrupt.h"
 #include "irqinternal.h"
 
@@ -50,9 +51,15 @@ static uint16_t saved_attr = 0;
 static int saved_pos = 0;
 static char *response_buffer = 0;
 static int response_pos = 0;
+static unsigned int console_ta_rendered = 0;
 
 #define TAB_WIDTH 4
 
+/* Prototypes for the batched debug font drawing found in ta.c. */
+int _ta_debug_font_begin(color_t color);
+void _ta_debug_font_character(int x, int y, float z, char ch);
+float __ta_quad_z_location();
+
 static void __write_response( const char * const resp, unsigned int len )
 {
     // Note, this expects interrupts to be disabled by the calling function to be
@@ -738,10 +745,32 @@ color_t attr_to_color(uint8_t attr)
     return rgb(255, 255, 255);
 }
 
+static void __console_attr_colors(uint16_t render_attr, color_t *fgcolor, color_t *bgcolor)
+{
+    if (render_attr & REVERSE)
+    {
+        *fgcolor = attr_to_color(render_attr >> 4);
+        *bgcolor = attr_to_color(render_attr);
+    }
+    else
+    {
+        *bgcolor = attr_to_color(render_attr >> 4);
+        *fgcolor = attr_to_color(render_attr);
+    }
+}
+
 void console_render()
 {
     uint32_t old_irq = irq_disable();
 
+    if (console_ta_rendered)
+    {
+        /* The TA already drew the console for this frame, don't draw it twice. */
+        console_ta_rendered = 0;
+        irq_restore(old_irq);
+        return;
+    }
+
     if (render_buffer && render_attrs && console_visible)
     {
         /* Ensure data is flushed before rendering */
@@ -755,16 +784,7 @@ void console_render()
             color_t bgcolor;
             color_t fgcolor;
 
-            if (render_attr & REVERSE)
-            {
-                fgcolor = attr_to_color(render_attr >> 4);
-                bgcolor = attr_to_color(render_attr);
-            }
-            else
-            {
-                bgcolor = attr_to_color(render_attr >> 4);
-                fgcolor = attr_to_color(render_attr);
-            }
+            __console_attr_colors(render_attr, &fgcolor, &bgcolor);
 
             if (bgcolor.r != black.r && bgcolor.g != black.g && bgcolor.b != black.b)
             {
@@ -805,6 +825,92 @@ void console_render()
     irq_restore(old_irq);
 }
 
+void console_render_ta()
+{
+    uint32_t old_irq = irq_disable();
+
+    if (render_buffer && render_attrs && console_visible)
+    {
+        /* Ensure data is flushed before rendering */
+        fflush( stdout );
+
+        /* Draw backgrounds and underscores first so that characters end up on top of them. */
+        color_t black = rgb(0, 0, 0);
+        float z = __ta_quad_z_location();
+        for (int pos = 0; pos < console_width * console_height; pos++)
+        {
+            uint16_t render_attr = render_attrs[pos];
+            color_t bgcolor;
+            color_t fgcolor;
+            float x = (float)(console_overscan + ((pos % console_width) * 8));
+            float y = (float)(console_overscan + ((pos / console_width) * 8));
+
+            __console_attr_colors(render_attr, &fgcolor, &bgcolor);
+
+            if (bgcolor.r != black.r && bgcolor.g != black.g && bgcolor.b != black.b)
+            {
+                // Only draw background if it is not black (our transparent color).
+                vertex_t box[4] = {
+                    { x, y + 8.0, z },
+                    { x, y, z },
+                    { x + 8.0, y, z },
+                    { x + 8.0, y + 8.0, z },
+                };
+                ta_fill_box(TA_CMD_POLYGON_TYPE_TRANSPARENT, box, bgcolor);
+            }
+
+            if (render_attr & UNDERSCORE)
+            {
+                vertex_t line[4] = {
+                    { x, y + 9.0, z },
+                    { x, y + 8.0, z },
+                    { x + 8.0, y + 8.0, z },
+                    { x + 8.0, y + 9.0, z },
+                };
+                ta_fill_box(TA_CMD_POLYGON_TYPE_TRANSPARENT, line, fgcolor);
+            }
+        }
+
+        /* Now draw the characters, only sending a new sprite header when the color changes. */
+        int started = 0;
+        color_t curcolor = black;
+        z = __ta_quad_z_location();
+        for (int pos = 0; pos < console_width * console_height; pos++)
+        {
+            if (render_buffer[pos] > 0x20 && render_buffer[pos] < 0x80)
+            {
+                color_t bgcolor;
+                color_t fgcolor;
+
+                __console_attr_colors(render_attrs[pos], &fgcolor, &bgcolor);
+
+                if (!started || fgcolor.r != curcolor.r || fgcolor.g != curcolor.g || fgcolor.b != curcolor.b)
+                {
+                    if (!_ta_debug_font_begin(fgcolor))
+                    {
+                        // Couldn't get texture RAM for the font.
+                        break;
+                    }
+
+                    started = 1;
+                    curcolor = fgcolor;
+                }
+
+                _ta_debug_font_character(
+                    console_overscan + ((pos % console_width) * 8),
+                    console_overscan + ((pos / console_width) * 8),
+                    z,
+                    render_buffer[pos]
+                );
+            }
+        }
+
+        console_ta_rendered = 1;
+    }
+
+    irq_restore(old_irq);
+}
+
 void console_set_visible(unsigned int visibility)
 {
     console_visible = visibility;
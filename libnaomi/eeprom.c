@@ -317,8 +317,10 @@ void unparse_eeprom(uint8_t *data, eeprom_t *eeprom)
     // First, make sure that we set up the full data, even bytes we don't touch.
     memset(data, 0xFF, 128);
 
-    // Now, unparse the system settings.
+    // Now, unparse the system settings. Start from the same blank state as the rest of the
+    // data, since some fields below only update half of a byte and one byte isn't used.
     uint8_t system[16];
+    memset(system, 0xFF, sizeof(system));
 
     if (eeprom->system.attract_sounds == ATTRACT_SOUNDS_ON) {
         system[0] = 0x10 | (system[0] & 0x0F);
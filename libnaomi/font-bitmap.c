@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "naomi/font.h"
+#include "font-internal.h"
+
+// Pre-rasterized bitmap fonts, as generated by tools/fontgen.py. Everything is
+// little-endian and every offset is from the start of the file. The layout is:
+//
+// Header, 16 bytes:
+//     char magic[4] = "NFNT"
+//     uint32_t version = 1
+//     uint32_t strike_count
+//     uint32_t reserved
+//
+// Strike table, one 12-byte entry per baked size:
+//     uint32_t size (the pixel size, which is also the line height)
+//     uint32_t glyph_count
+//     uint32_t glyph_offset (where this strike's glyph records start)
+//
+// Glyph records, 20 bytes each, sorted by codepoint so we can binary search:
+//     uint32_t codepoint
+//     int16_t advancex, advancey, bitmap_left, bitmap_top
+//     uint16_t width, height
+//     uint32_t bitmap_offset (8-bit grayscale, width * height bytes)
+//
+// Codepoint 0 is reserved for the font's missing glyph, which gets drawn for
+// anything not baked into the strike, much like freetype does. Bitmaps are kept
+// per glyph instead of in an atlas so that they can be handed to the glyph cache
+// as-is, see font_add_bitmap() in naomi/font.h.
+#define FONT_BITMAP_MAGIC 0x544E464E
+#define FONT_BITMAP_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t strike_count;
+    uint32_t reserved;
+} font_bitmap_header_t;
+
+typedef struct
+{
+    uint32_t size;
+    uint32_t glyph_count;
+    uint32_t glyph_offset;
+} font_bitmap_strike_t;
+
+typedef struct
+{
+    uint32_t codepoint;
+    int16_t advancex;
+    int16_t advancey;
+    int16_t bitmap_left;
+    int16_t bitmap_top;
+    uint16_t width;
+    uint16_t height;
+    uint32_t bitmap_offset;
+} font_bitmap_glyph_t;
+
+typedef struct
+{
+    uint8_t *data;
+    unsigned int length;
+    font_bitmap_strike_t *strikes;
+    unsigned int strike_count;
+    font_bitmap_strike_t *strike;
+} font_bitmap_t;
+
+font_bitmap_glyph_t *_font_bitmap_find(font_bitmap_t *bitmap, uint32_t ch)
+{
+    font_bitmap_glyph_t *glyphs = (font_bitmap_glyph_t *)(bitmap->data + bitmap->strike->glyph_offset);
+    int low = 0;
+    int high = (int)bitmap->strike->glyph_count - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if (glyphs[mid].codepoint == ch)
+        {
+            return &glyphs[mid];
+        }
+        else if (glyphs[mid].codepoint < ch)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    return 0;
+}
+
+int _font_bitmap_load_glyph(font_t *fontface, uint32_t ch, font_glyph_t *glyph)
+{
+    font_bitmap_t *bitmap = fontface->bitmap;
+    font_bitmap_glyph_t *found = _font_bitmap_find(bitmap, ch);
+    if (found == 0)
+    {
+        // Display the missing glyph instead, if the font has one.
+        found = _font_bitmap_find(bitmap, 0);
+        if (found == 0)
+        {
+            return -1;
+        }
+    }
+
+    glyph->advancex = found->advancex;
+    glyph->advancey = found->advancey;
+    glyph->bitmap_left = found->bitmap_left;
+    glyph->bitmap_top = found->bitmap_top;
+    glyph->width = found->width;
+    glyph->height = found->height;
+    glyph->mode = FONT_PIXEL_MODE_GRAY;
+    glyph->buffer = bitmap->data + found->bitmap_offset;
+
+    return 0;
+}
+
+int _font_bitmap_set_size(font_t *fontface, unsigned int size)
+{
+    font_bitmap_t *bitmap = fontface->bitmap;
+    for (unsigned int i = 0; i < bitmap->strike_count; i++)
+    {
+        if (bitmap->strikes[i].size == size)
+        {
+            bitmap->strike = &bitmap->strikes[i];
+            return 0;
+        }
+    }
+
+    // We can't scale pre-rasterized glyphs, so this size isn't available.
+    return -1;
+}
+
+void _font_bitmap_free(font_t *fontface)
+{
+    // The data itself belongs to the caller, we only own our bookkeeping.
+    free(fontface->bitmap);
+}
+
+static const font_backend_t bitmap_backend = {
+    &_font_bitmap_load_glyph,
+    &_font_bitmap_set_size,
+    &_font_bitmap_free,
+};
+
+int _font_bitmap_validate(uint8_t *data, unsigned int length)
+{
+    if (((uint32_t)data) & 3 || length < sizeof(font_bitmap_header_t))
+    {
+        return 0;
+    }
+
+    font_bitmap_header_t *header = (font_bitmap_header_t *)data;
+    if (header->magic != FONT_BITMAP_MAGIC || header->version != FONT_BITMAP_VERSION || header->strike_count == 0)
+    {
+        return 0;
+    }
+    if (header->strike_count > ((length - sizeof(font_bitmap_header_t)) / sizeof(font_bitmap_strike_t)))
+    {
+        return 0;
+    }
+
+    // Make sure every glyph points inside the file so a truncated or corrupt
+    // font can't have us reading random memory later. Sizes are all checked by
+    // dividing the space left so that huge counts can't wrap around and pass.
+    font_bitmap_strike_t *strikes = (font_bitmap_strike_t *)(data + sizeof(font_bitmap_header_t));
+    for (unsigned int i = 0; i < header->strike_count; i++)
+    {
+        if ((strikes[i].glyph_offset & 3) || strikes[i].glyph_offset > length)
+        {
+            return 0;
+        }
+        if (strikes[i].glyph_count > ((length - strikes[i].glyph_offset) / sizeof(font_bitmap_glyph_t)))
+        {
+            return 0;
+        }
+
+        font_bitmap_glyph_t *glyphs = (font_bitmap_glyph_t *)(data + strikes[i].glyph_offset);
+        for (unsigned int j = 0; j < strikes[i].glyph_count; j++)
+        {
+            if (glyphs[j].bitmap_offset > length)
+            {
+                return 0;
+            }
+            if (glyphs[j].height > 0 && glyphs[j].width > ((length - glyphs[j].bitmap_offset) / glyphs[j].height))
+            {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+font_t *font_add_bitmap(void *buffer, unsigned int size)
+{
+    if (buffer == 0 || !_font_bitmap_validate(buffer, size))
+    {
+        return 0;
+    }
+
+    font_bitmap_t *bitmap = malloc(sizeof(font_bitmap_t));
+    if (bitmap == 0)
+    {
+        return 0;
+    }
+
+    bitmap->data = buffer;
+    bitmap->length = size;
+    bitmap->strike_count = ((font_bitmap_header_t *)buffer)->strike_count;
+    bitmap->strikes = (font_bitmap_strike_t *)(bitmap->data + sizeof(font_bitmap_header_t));
+    bitmap->strike = &bitmap->strikes[0];
+
+    font_t *font = _font_alloc(&bitmap_backend);
+    if (font == 0)
+    {
+        free(bitmap);
+        return 0;
+    }
+
+    font->bitmap = bitmap;
+    font->lineheight = bitmap->strike->size;
+
+    return font;
+}
@@ -0,0 +1,170 @@
+#ifdef FEATURE_FREETYPE
+// Only build this stuff if freetype is installed. Otherwise just don't do anything with it.
+// This is so that stage 1 libnaomi.a can be built, and then freetype built against it, before
+// libnaomi is built again.
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "naomi/font.h"
+#include "font-internal.h"
+
+FT_Library * __freetype_init()
+{
+    static FT_Library library;
+    static int init = 0;
+
+    if (!init)
+    {
+        FT_Init_FreeType(&library);
+    }
+
+    return &library;
+}
+
+int _font_freetype_load_glyph(font_t *fontface, uint32_t ch, font_glyph_t *glyph)
+{
+    // Grab the actual unicode glyph, searching through all fallbacks if we need to.
+    // faces[0] is always guaranteed to be valid, since that's our original non-fallback
+    // fontface. If none of the fonts has this glyph, then we fall back even further to
+    // the original font selected, and display the unicode error glyph.
+    FT_Face *face = (FT_Face *)fontface->faces[0];
+    for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
+    {
+        if (fontface->faces[i] != 0)
+        {
+            FT_UInt glyph_index = FT_Get_Char_Index(*((FT_Face *)fontface->faces[i]), ch);
+            if (glyph_index != 0)
+            {
+                // This font has this glyph. Use this instead of the original.
+                face = (FT_Face *)fontface->faces[i];
+                break;
+            }
+        }
+    }
+    int error = FT_Load_Char(*face, ch, FT_LOAD_RENDER);
+    if (error)
+    {
+        return error;
+    }
+
+    FT_GlyphSlot slot = (*face)->glyph;
+    glyph->advancex = slot->advance.x >> 6;
+    glyph->advancey = slot->advance.y >> 6;
+    glyph->bitmap_left = slot->bitmap_left;
+    glyph->bitmap_top = slot->bitmap_top;
+    glyph->width = slot->bitmap.width;
+    glyph->height = slot->bitmap.rows;
+    glyph->mode = slot->bitmap.pixel_mode;
+    glyph->buffer = slot->bitmap.buffer;
+
+    return 0;
+}
+
+int _font_freetype_set_size(font_t *fontface, unsigned int size)
+{
+    for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
+    {
+        if (fontface->faces[i] != 0)
+        {
+            int error = FT_Set_Pixel_Sizes(*((FT_Face *)fontface->faces[i]), 0, size);
+            if (error)
+            {
+                return error;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void _font_freetype_free(font_t *fontface)
+{
+    for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
+    {
+        if (fontface->faces[i] != 0)
+        {
+            FT_Done_Face(*((FT_Face *)fontface->faces[i]));
+            free(fontface->faces[i]);
+        }
+    }
+    free(fontface->faces);
+}
+
+static const font_backend_t freetype_backend = {
+    &_font_freetype_load_glyph,
+    &_font_freetype_set_size,
+    &_font_freetype_free,
+};
+
+font_t * font_add(void *buffer, unsigned int size)
+{
+    FT_Library *library = __freetype_init();
+    font_t *font = _font_alloc(&freetype_backend);
+    if (font == 0)
+    {
+        return 0;
+    }
+    font->faces = malloc(sizeof(void *) * MAX_FALLBACK_SIZE);
+    if (font->faces == 0)
+    {
+        _font_free(font);
+        return 0;
+    }
+    memset(font->faces, 0, sizeof(void *) * MAX_FALLBACK_SIZE);
+    font->faces[0] = malloc(sizeof(FT_Face));
+    if (font->faces[0] == 0)
+    {
+        free(font->faces);
+        _font_free(font);
+        return 0;
+    }
+
+    if (FT_New_Memory_Face(*library, buffer, size, 0, (FT_Face *)font->faces[0]))
+    {
+        free(font->faces[0]);
+        free(font->faces);
+        _font_free(font);
+        return 0;
+    }
+    FT_Select_Charmap(*((FT_Face *)font->faces[0]), FT_ENCODING_UNICODE);
+
+    font_set_size(font, 12);
+
+    return font;
+}
+
+int font_add_fallback(font_t *font, void *buffer, unsigned int size)
+{
+    for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
+    {
+        if (font->faces[i] == 0)
+        {
+            FT_Library *library = __freetype_init();
+            font->faces[i] = malloc(sizeof(FT_Face));
+            if (font->faces[i] == 0)
+            {
+                return -1;
+            }
+            int error = FT_New_Memory_Face(*library, buffer, size, 0, (FT_Face *)font->faces[i]);
+            if (error)
+            {
+                free(font->faces[i]);
+                font->faces[i] = 0;
+                return error;
+            }
+            FT_Select_Charmap(*((FT_Face *)font->faces[i]), FT_ENCODING_UNICODE);
+            font_set_size(font, font->lineheight);
+
+            // Anything we cached before might have been the unicode error glyph
+            // that this fallback now covers, so start over.
+            _font_cache_discard(font);
+
+            return 0;
+        }
+    }
+
+    return -1;
+}
+#endif
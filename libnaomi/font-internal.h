@@ -2,11 +2,13 @@
 #define __FONT_INTERNAL_H
 
 #include "naomi/video.h"
+#include "naomi/font.h"
 
-typedef struct
+typedef struct font_cache_entry
 {
     uint32_t index;
     int cache_namespace;
+    unsigned int size;
     int advancex;
     int advancey;
     int bitmap_left;
@@ -15,9 +17,70 @@ typedef struct
     int height;
     int mode;
     void *data;
+
+    // Called when this entry gets evicted, so the namespace that created it can
+    // give back whatever resources data points at before the entry is freed.
+    void (*discard)(struct font_cache_entry *entry);
+
+    // Called before evicting this entry, so the namespace that created it can say that
+    // hardware might still read what data points at, such as a glyph in a display list
+    // that hasn't been rendered yet. Busy entries are skipped just like pinned ones. This
+    // can be NULL for entries that are only ever read by the CPU.
+    int (*busy)(struct font_cache_entry *entry);
+
+    // Chain for the hash bucket this entry lives in, and links in the LRU list.
+    struct font_cache_entry *hashnext;
+    struct font_cache_entry *lrunext;
+    struct font_cache_entry *lruprev;
+
+    // How many long-lived users (such as prebuilt text objects) are holding on to
+    // this entry. Pinned entries are skipped when evicting to make room.
+    unsigned int pins;
 } font_cache_entry_t;
 
+// A single rasterized glyph, as handed back by a font backend. The buffer is
+// only guaranteed to be valid until the next glyph is loaded from the same font.
+typedef struct
+{
+    int advancex;
+    int advancey;
+    int bitmap_left;
+    int bitmap_top;
+    int width;
+    int height;
+    int mode;
+    uint8_t *buffer;
+} font_glyph_t;
+
+// The operations that differ between FreeType fonts and pre-rasterized bitmap
+// fonts. The drawing and caching code in font.c only ever goes through these,
+// so that using bitmap fonts doesn't drag FreeType into the binary.
+typedef struct
+{
+    int (*load_glyph)(font_t *fontface, uint32_t ch, font_glyph_t *glyph);
+    int (*set_size)(font_t *fontface, unsigned int size);
+    void (*free)(font_t *fontface);
+} font_backend_t;
+
+// Matches FT_PIXEL_MODE_GRAY so FreeType glyphs can be passed through untouched.
+#define FONT_PIXEL_MODE_GRAY 2
+
+// Shared between font backends for setting up and tearing down a font_t.
+font_t *_font_alloc(const font_backend_t *backend);
+void _font_free(font_t *fontface);
+void _font_cache_discard(font_t *fontface);
+
 typedef font_cache_entry_t * (*cache_func_t)(uint32_t index, int advancex, int advancey, int bitmap_left, int bitmap_top, int width, int height, int mode, uint8_t *buffer);
+// Cache lookups and additions are normally keyed on the font's current size, but
+// renderers that rasterize at a fixed size regardless (such as SDF text) can use
+// these to key on a specific size instead.
+font_cache_entry_t *_font_cache_lookup_size(font_t *fontface, int cache_namespace, uint32_t index, unsigned int size);
+int _font_cache_add_size(font_t *fontface, font_cache_entry_t *entry, unsigned int size);
+
+// Look up a glyph in the cache, loading and caching it if it isn't there yet. Returns
+// zero if the glyph couldn't be loaded or cached.
+font_cache_entry_t *_font_cache_get(font_t *fontface, uint32_t ch, cache_func_t cache_func, int cache_namespace);
+
 typedef void (*cached_draw_func_t)(int x, int y, unsigned int width, unsigned int height, void *data, color_t color);
 typedef void (*uncached_draw_func_t)(int x, int y, unsigned int width, unsigned int height, uint8_t *data, color_t color);
 
@@ -50,5 +113,6 @@ int _font_draw_calc_text(
 #define FONT_CACHE_ANY 0
 #define FONT_CACHE_VIDEO 1
 #define FONT_CACHE_TA 2
+#define FONT_CACHE_TA_SDF 3
 
 #endif
@@ -1,11 +1,8 @@
-#ifdef FEATURE_FREETYPE
-// Only build this stuff if freetype is installed. Otherwise just don't do anything with it.
-// This is so that stage 1 libnaomi.a can be built, and then freetype built against it, before
-// libnaomi is built again.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
 #include "naomi/utf8.h"
 #include "naomi/font.h"
 #include "font-internal.h"
@@ -15,171 +12,233 @@
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 #endif
 
-FT_Library * __freetype_init()
+font_t *_font_alloc(const font_backend_t *backend)
 {
-    static FT_Library library;
-    static int init = 0;
+    font_t *font = malloc(sizeof(font_t));
+    if (font == 0)
+    {
+        return 0;
+    }
 
-    if (!init)
+    memset(font, 0, sizeof(font_t));
+    font->backend = backend;
+    font->cachesize = FONT_CACHE_SIZE;
+    font->cache = malloc(sizeof(void *) * FONT_CACHE_BUCKETS);
+    if (font->cache == 0)
     {
-        FT_Init_FreeType(&library);
+        free(font);
+        return 0;
     }
+    memset(font->cache, 0, sizeof(void *) * FONT_CACHE_BUCKETS);
 
-    return &library;
+    return font;
 }
 
-font_t * font_add(void *buffer, unsigned int size)
+void _font_free(font_t *fontface)
 {
-    FT_Library *library = __freetype_init();
-    font_t *font = malloc(sizeof(font_t));
-    if (font == 0)
+    _font_cache_discard(fontface);
+    free(fontface->cache);
+    free(fontface);
+}
+
+unsigned int _font_cache_hash(uint32_t index, unsigned int size)
+{
+    // Multiplicative hash so that runs of nearby codepoints spread across buckets.
+    return ((index * 2654435761U) ^ (size * 40503U)) & (FONT_CACHE_BUCKETS - 1);
+}
+
+void _font_cache_lru_unlink(font_t *fontface, font_cache_entry_t *entry)
+{
+    if (entry->lruprev)
     {
-        return 0;
+        entry->lruprev->lrunext = entry->lrunext;
     }
-    font->faces = malloc(sizeof(void *) * MAX_FALLBACK_SIZE);
-    if (font->faces == 0)
+    else
     {
-        free(font);
-        return 0;
+        fontface->cachehead = entry->lrunext;
     }
-    memset(font->faces, 0, sizeof(void *) * MAX_FALLBACK_SIZE);
-    font->faces[0] = malloc(sizeof(FT_Face));
-    if (font->faces[0] == 0)
+
+    if (entry->lrunext)
     {
-        free(font->faces);
-        free(font);
-        return 0;
+        entry->lrunext->lruprev = entry->lruprev;
     }
-
-    font->cachesize = FONT_CACHE_SIZE;
-    font->cacheloc = 0;
-    font->cache = malloc(sizeof(void *) * font->cachesize);
-    if (font->cache == 0)
+    else
     {
-        free(font->faces[0]);
-        free(font->faces);
-        free(font);
-        return 0;
+        fontface->cachetail = entry->lruprev;
     }
-    memset(font->cache, 0, sizeof(void *) * font->cachesize);
 
-    if (FT_New_Memory_Face(*library, buffer, size, 0, (FT_Face *)font->faces[0]))
+    entry->lrunext = 0;
+    entry->lruprev = 0;
+}
+
+void _font_cache_lru_push(font_t *fontface, font_cache_entry_t *entry)
+{
+    // The head of the list is the most recently used entry.
+    entry->lruprev = 0;
+    entry->lrunext = fontface->cachehead;
+    if (fontface->cachehead)
     {
-        free(font->cache);
-        free(font->faces[0]);
-        free(font->faces);
-        free(font);
-        return 0;
+        ((font_cache_entry_t *)fontface->cachehead)->lruprev = entry;
     }
-    FT_Select_Charmap(*((FT_Face *)font->faces[0]), FT_ENCODING_UNICODE);
-
-    font_set_size(font, 12);
+    else
+    {
+        fontface->cachetail = entry;
+    }
+    fontface->cachehead = entry;
+}
 
-    return font;
+void _font_cache_entry_free(font_cache_entry_t *entry)
+{
+    // Give the namespace that created this a chance to release things like texture
+    // sheet space, and then get rid of the entry itself.
+    if (entry->discard)
+    {
+        entry->discard(entry);
+    }
+    else
+    {
+        free(entry->data);
+    }
+    free(entry);
 }
 
-int font_add_fallback(font_t *font, void *buffer, unsigned int size)
+void _font_cache_evict(font_t *fontface, font_cache_entry_t *entry)
 {
-    for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
+    // Pull it out of its hash bucket.
+    font_cache_entry_t **link = (font_cache_entry_t **)&fontface->cache[_font_cache_hash(entry->index, entry->size)];
+    while (*link)
     {
-        if (font->faces[i] == 0)
+        if (*link == entry)
         {
-            FT_Library *library = __freetype_init();
-            font->faces[i] = malloc(sizeof(FT_Face));
-            if (font->faces[i] == 0)
-            {
-                return -1;
-            }
-            int error = FT_New_Memory_Face(*library, buffer, size, 0, (FT_Face *)font->faces[i]);
-            if (error)
-            {
-                free(font->faces[i]);
-                font->faces[i] = 0;
-                return error;
-            }
-            FT_Select_Charmap(*((FT_Face *)font->faces[i]), FT_ENCODING_UNICODE);
-            font_set_size(font, font->lineheight);
-
-            return 0;
+            *link = entry->hashnext;
+            break;
         }
+
+        link = &((*link)->hashnext);
     }
 
-    return -1;
+    _font_cache_lru_unlink(fontface, entry);
+    _font_cache_entry_free(entry);
+    fontface->cacheloc--;
 }
 
-// Prototypes for various font rendering systems that might need to do
-// some cleanup. This is the best I could come up with, unfortunately,
-// and still keep things simple.
-void __video_font_cache_discard();
-void __ta_font_cache_discard();
-
 void _font_cache_discard(font_t *fontface)
 {
-    // Ask the various subsystems that use us to do any discarding
-    // that they might need to do.
-    __video_font_cache_discard();
-    __ta_font_cache_discard();
-
     // Discard each entry that exists, reset the location back to zero.
-    for (int i = 0; i < fontface->cacheloc; i++)
+    font_cache_entry_t *entry = fontface->cachehead;
+    while (entry)
     {
-        free(((font_cache_entry_t *)fontface->cache[i])->data);
-        free(fontface->cache[i]);
-        fontface->cache[i] = 0;
+        font_cache_entry_t *next = entry->lrunext;
+        _font_cache_entry_free(entry);
+        entry = next;
     }
 
+    memset(fontface->cache, 0, sizeof(void *) * FONT_CACHE_BUCKETS);
+    fontface->cachehead = 0;
+    fontface->cachetail = 0;
     fontface->cacheloc = 0;
 }
 
-font_cache_entry_t *_font_cache_lookup(font_t *fontface, int cache_namespace, uint32_t index)
+font_cache_entry_t *_font_cache_lookup_size(font_t *fontface, int cache_namespace, uint32_t index, unsigned int size)
 {
-    // This is linear and we could make it a lot better if we sorted by index
-    // and then did a binary search. The lion's share of this module's compute
-    // time goes to drawing glyphs to the screen however, so I didn't bother.
-    for (int i = 0; i < fontface->cacheloc; i++)
-    {
-        font_cache_entry_t *entry = (font_cache_entry_t *)fontface->cache[i];
+    font_cache_entry_t *entry = fontface->cache[_font_cache_hash(index, size)];
 
-        if(entry->index == index && (cache_namespace == FONT_CACHE_ANY || entry->cache_namespace == cache_namespace))
+    while (entry)
+    {
+        if(entry->index == index && entry->size == size && (cache_namespace == FONT_CACHE_ANY || entry->cache_namespace == cache_namespace))
         {
-            return fontface->cache[i];
+            // Mark this as most recently used so it is the last thing to get evicted.
+            if (fontface->cachehead != entry)
+            {
+                _font_cache_lru_unlink(fontface, entry);
+                _font_cache_lru_push(fontface, entry);
+            }
+            return entry;
         }
+
+        entry = entry->hashnext;
     }
 
     return 0;
 }
 
-int _font_cache_add(font_t *fontface, void *entry)
+font_cache_entry_t *_font_cache_lookup(font_t *fontface, int cache_namespace, uint32_t index)
 {
-    if (fontface->cacheloc == fontface->cachesize)
+    return _font_cache_lookup_size(fontface, cache_namespace, index, fontface->lineheight);
+}
+
+int _font_cache_add_size(font_t *fontface, font_cache_entry_t *entry, unsigned int size)
+{
+    if (entry == 0)
     {
         return 0;
     }
-    if (entry == 0)
+
+    // Make room by throwing out whatever hasn't been drawn in the longest time. Pinned
+    // entries are still in use elsewhere and busy entries are still waiting to be read by
+    // the hardware, so the cache is allowed to grow past its size rather than pull them out
+    // from under their users. It shrinks back down on later additions once they are free.
+    font_cache_entry_t *victim = fontface->cachetail;
+    while (fontface->cacheloc >= fontface->cachesize && victim != 0)
     {
-        return 0;
+        font_cache_entry_t *prev = victim->lruprev;
+        if (victim->pins == 0 && (victim->busy == 0 || !victim->busy(victim)))
+        {
+            _font_cache_evict(fontface, victim);
+        }
+        victim = prev;
     }
 
-    fontface->cache[fontface->cacheloc++] = entry;
+    unsigned int bucket = _font_cache_hash(entry->index, size);
+    entry->size = size;
+    entry->pins = 0;
+    entry->hashnext = fontface->cache[bucket];
+    fontface->cache[bucket] = entry;
+    _font_cache_lru_push(fontface, entry);
+    fontface->cacheloc++;
+
     return 1;
 }
 
-void font_discard(font_t *fontface)
+int _font_cache_add(font_t *fontface, font_cache_entry_t *entry)
 {
-    if (fontface)
+    return _font_cache_add_size(fontface, entry, fontface->lineheight);
+}
+
+font_cache_entry_t *_font_cache_get(font_t *fontface, uint32_t ch, cache_func_t cache_func, int cache_namespace)
+{
+    font_cache_entry_t *entry = _font_cache_lookup(fontface, cache_namespace, ch);
+    if (entry == 0)
     {
-        for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
+        font_glyph_t glyph;
+        if (((const font_backend_t *)fontface->backend)->load_glyph(fontface, ch, &glyph))
         {
-            if (fontface->faces[i] != 0)
-            {
-                FT_Done_Face(*((FT_Face *)fontface->faces[i]));
-                free(fontface->faces[i]);
-            }
+            return 0;
         }
-        _font_cache_discard(fontface);
-        free(fontface->cache);
-        free(fontface->faces);
-        free(fontface);
+
+        entry = cache_func(
+            ch,
+            glyph.advancex,
+            glyph.advancey,
+            glyph.bitmap_left,
+            glyph.bitmap_top,
+            glyph.width,
+            glyph.height,
+            glyph.mode,
+            glyph.buffer
+        );
+        _font_cache_add(fontface, entry);
+    }
+
+    return entry;
+}
+
+void font_discard(font_t *fontface)
+{
+    if (fontface)
+    {
+        ((const font_backend_t *)fontface->backend)->free(fontface);
+        _font_free(fontface);
     }
 }
 
@@ -187,20 +246,14 @@ int font_set_size(font_t *fontface, unsigned int size)
 {
     if (fontface)
     {
-        for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
+        int error = ((const font_backend_t *)fontface->backend)->set_size(fontface, size);
+        if (error)
         {
-            if (fontface->faces[i] != 0)
-            {
-                int error = FT_Set_Pixel_Sizes(*((FT_Face *)fontface->faces[i]), 0, size);
-                if (error)
-                {
-                    return error;
-                }
-            }
+            return error;
         }
 
+        // The cache is keyed by size as well, so glyphs for other sizes can stay put.
         fontface->lineheight = size;
-        _font_cache_discard(fontface);
 
         return 0;
     }
@@ -236,7 +289,7 @@ int _font_draw_calc_character(
             x += entry->bitmap_left;
             y += lineheight - entry->bitmap_top;
 
-            if (cached_draw && entry->mode == FT_PIXEL_MODE_GRAY)
+            if (cached_draw && entry->mode == FONT_PIXEL_MODE_GRAY)
             {
                 cached_draw(x, y, entry->width, entry->height, entry->data, color);
             }
@@ -248,64 +301,51 @@ int _font_draw_calc_character(
         }
         else
         {
-            // Grab the actual unicode glyph, searching through all fallbacks if we need to.
-            // faces[0] is always guaranteed to be valid, since that's our original non-fallback
-            // fontface. If none of the fonts has this glyph, then we fall back even further to
-            // the original font selected, and display the unicode error glyph.
-            FT_Face *face = (FT_Face *)fontface->faces[0];
-            for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
-            {
-                if (fontface->faces[i] != 0)
-                {
-                    FT_UInt glyph_index = FT_Get_Char_Index( *((FT_Face *)fontface->faces[i]), ch );
-                    if (glyph_index != 0)
-                    {
-                        // This font has this glyph. Use this instead of the original.
-                        face = (FT_Face *)fontface->faces[i];
-                        break;
-                    }
-                }
-            }
-            int error = FT_Load_Char(*face, ch, FT_LOAD_RENDER);
+            // Grab the actual unicode glyph from the font backend, which takes care of
+            // fallbacks and missing glyphs for us.
+            font_glyph_t glyph;
+            int error = ((const font_backend_t *)fontface->backend)->load_glyph(fontface, ch, &glyph);
             if (error)
             {
                 return error;
             }
 
-            // Copy it out onto our buffer.
-            FT_GlyphSlot slot = (*face)->glyph;
-            x += slot->bitmap_left;
-            y += lineheight - slot->bitmap_top;
+            x += glyph.bitmap_left;
+            y += lineheight - glyph.bitmap_top;
 
             // Add it to the cache so we can render faster next time.
-            if (cache_func && fontface->cacheloc < fontface->cachesize)
+            if (cache_func)
             {
                 entry = cache_func(
                     ch,
-                    slot->advance.x >> 6,
-                    slot->advance.y >> 6,
-                    slot->bitmap_left,
-                    slot->bitmap_top,
-                    slot->bitmap.width,
-                    slot->bitmap.rows,
-                    slot->bitmap.pixel_mode,
-                    slot->bitmap.buffer
+                    glyph.advancex,
+                    glyph.advancey,
+                    glyph.bitmap_left,
+                    glyph.bitmap_top,
+                    glyph.width,
+                    glyph.height,
+                    glyph.mode,
+                    glyph.buffer
                  );
                 _font_cache_add(fontface, entry);
-                if (cached_draw && entry->mode == FT_PIXEL_MODE_GRAY)
+            }
+
+            if (entry)
+            {
+                if (cached_draw && entry->mode == FONT_PIXEL_MODE_GRAY)
                 {
                     cached_draw(x, y, entry->width, entry->height, entry->data, color);
                 }
             }
-            else if (uncached_draw && slot->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY)
+            else if (uncached_draw && glyph.mode == FONT_PIXEL_MODE_GRAY)
             {
                 // Alpha-composite the grayscale bitmap, treating it as an alpha map.
-                uncached_draw(x, y, slot->bitmap.width, slot->bitmap.rows, slot->bitmap.buffer, color);
+                uncached_draw(x, y, glyph.width, glyph.height, glyph.buffer, color);
             }
 
             if (metrics)
             {
-                metrics->width = slot->advance.x >> 6;
+                metrics->width = glyph.advancex;
                 metrics->height = lineheight;
             }
         }
@@ -378,31 +418,30 @@ int _font_draw_calc_text(
                     }
                     else
                     {
-                        // Every font should have a space, I'm not doing a fallack for that one.
-                        FT_Face *face = (FT_Face *)fontface->faces[0];
-                        int error = FT_Load_Char(*face, ' ', FT_LOAD_RENDER);
+                        // Every font should have a space, so size tabs based on that.
+                        font_glyph_t glyph;
+                        int error = ((const font_backend_t *)fontface->backend)->load_glyph(fontface, ' ', &glyph);
                         if (error)
                         {
                             return error;
                         }
 
-                        FT_GlyphSlot slot = (*face)->glyph;
-                        tx += (slot->advance.x >> 6) * 5;
-                        ty += (slot->advance.y >> 6) * 5;
+                        tx += glyph.advancex * 5;
+                        ty += glyph.advancey * 5;
 
                         // Add it to the cache so we can render faster next time.
-                        if (cache_func && fontface->cacheloc < fontface->cachesize)
+                        if (cache_func)
                         {
                             entry = cache_func(
                                 *text,
-                                slot->advance.x >> 6,
-                                slot->advance.y >> 6,
-                                slot->bitmap_left,
-                                slot->bitmap_top,
-                                slot->bitmap.width,
-                                slot->bitmap.rows,
-                                slot->bitmap.pixel_mode,
-                                slot->bitmap.buffer
+                                glyph.advancex,
+                                glyph.advancey,
+                                glyph.bitmap_left,
+                                glyph.bitmap_top,
+                                glyph.width,
+                                glyph.height,
+                                glyph.mode,
+                                glyph.buffer
                              );
                             _font_cache_add(fontface, entry);
                         }
@@ -419,7 +458,7 @@ int _font_draw_calc_text(
                     font_cache_entry_t *entry = _font_cache_lookup(fontface, cache_namespace, *text);
                     if (entry)
                     {
-                        if (cached_draw && entry->mode == FT_PIXEL_MODE_GRAY)
+                        if (cached_draw && entry->mode == FONT_PIXEL_MODE_GRAY)
                         {
                             cached_draw(tx + entry->bitmap_left, ty + lineheight - entry->bitmap_top, entry->width, entry->height, entry->data, color);
                         }
@@ -430,70 +469,57 @@ int _font_draw_calc_text(
                     }
                     else
                     {
-                        // Grab the actual unicode glyph, searching through all fallbacks if we need to.
-                        // faces[0] is always guaranteed to be valid, since that's our original non-fallback
-                        // fontface. If none of the fonts has this glyph, then we fall back even further to
-                        // the original font selected, and display the unicode error glyph.
-                        FT_Face *face = (FT_Face *)fontface->faces[0];
-                        for (int i = 0; i < MAX_FALLBACK_SIZE; i++)
-                        {
-                            if (fontface->faces[i] != 0)
-                            {
-                                FT_UInt glyph_index = FT_Get_Char_Index(*((FT_Face *)fontface->faces[i]), *text);
-                                if (glyph_index != 0)
-                                {
-                                    // This font has this glyph. Use this instead of the original.
-                                    face = (FT_Face *)fontface->faces[i];
-                                    break;
-                                }
-                            }
-                        }
-                        int error = FT_Load_Char(*face, *text, FT_LOAD_RENDER);
+                        // Grab the actual unicode glyph from the font backend, which takes care of
+                        // fallbacks and missing glyphs for us.
+                        font_glyph_t glyph;
+                        int error = ((const font_backend_t *)fontface->backend)->load_glyph(fontface, *text, &glyph);
                         if (error)
                         {
                             return error;
                         }
 
-                        // Copy it out onto our buffer.
-                        FT_GlyphSlot slot = (*face)->glyph;
 
                         // Add it to the cache so we can render faster next time.
-                        if (cache_func && fontface->cacheloc < fontface->cachesize)
+                        if (cache_func)
                         {
                             entry = cache_func(
                                 *text,
-                                slot->advance.x >> 6,
-                                slot->advance.y >> 6,
-                                slot->bitmap_left,
-                                slot->bitmap_top,
-                                slot->bitmap.width,
-                                slot->bitmap.rows,
-                                slot->bitmap.pixel_mode,
-                                slot->bitmap.buffer
+                                glyph.advancex,
+                                glyph.advancey,
+                                glyph.bitmap_left,
+                                glyph.bitmap_top,
+                                glyph.width,
+                                glyph.height,
+                                glyph.mode,
+                                glyph.buffer
                              );
                             _font_cache_add(fontface, entry);
-                            if (cached_draw && entry->mode == FT_PIXEL_MODE_GRAY)
+                        }
+
+                        if (entry)
+                        {
+                            if (cached_draw && entry->mode == FONT_PIXEL_MODE_GRAY)
                             {
                                 cached_draw(tx + entry->bitmap_left, ty + lineheight - entry->bitmap_top, entry->width, entry->height, entry->data, color);
                             }
                         }
-                        else if (uncached_draw && slot->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY)
+                        else if (uncached_draw && glyph.mode == FONT_PIXEL_MODE_GRAY)
                         {
                             // Alpha-composite the grayscale bitmap, treating it as an
                             // alpha map.
                             uncached_draw(
-                                tx + slot->bitmap_left,
-                                ty + (lineheight - slot->bitmap_top),
-                                slot->bitmap.width,
-                                slot->bitmap.rows,
-                                slot->bitmap.buffer,
+                                tx + glyph.bitmap_left,
+                                ty + (lineheight - glyph.bitmap_top),
+                                glyph.width,
+                                glyph.height,
+                                glyph.buffer,
                                 color
                             );
                         }
 
                         // Advance the pen based on this glyph.
-                        tx += (slot->advance.x >> 6);
-                        ty += (slot->advance.y >> 6);
+                        tx += glyph.advancex;
+                        ty += glyph.advancey;
                     }
                     if (metrics)
                     {
@@ -564,4 +590,3 @@ font_metrics_t font_get_text_metrics(font_t *fontface, const char * const msg, .
         return metrics;
     }
 }
-#endif
@@ -21,6 +21,7 @@
 #define HOLLY_INTERNAL_INTERRUPT_MAPLE_DMA_FINISHED 0x00001000
 #define HOLLY_INTERNAL_INTERRUPT_MAPLE_VBLANK_FINISHED 0x00002000
 #define HOLLY_INTERNAL_INTERRUPT_AICA_DMA_FINISHED 0x00008000
+#define HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED 0x00080000
 #define HOLLY_INTERNAL_INTERRUPT_TRANSFER_PUNCHTHRU_FINISHED 0x00200000
 #define HOLLY_INTERNAL_INTERRUPT_CHECK_EXTERNAL 0x40000000
 #define HOLLY_INTERNAL_INTERRUPT_CHECK_ERROR 0x80000000
@@ -39,4 +40,10 @@
 #define HOLLY_ERROR_IRQ_4_MASK *((volatile uint32_t *)0xA05F6928)
 #define HOLLY_ERROR_IRQ_6_MASK *((volatile uint32_t *)0xA05F6938)
 
+// Channel 2 DMA, fed from the SH-4 DMAC channel 2 into the TA FIFO or VRAM.
+#define HOLLY_CH2_DMA_DEST *((volatile uint32_t *)0xA05F6800)
+#define HOLLY_CH2_DMA_LEN *((volatile uint32_t *)0xA05F6804)
+#define HOLLY_CH2_DMA_START *((volatile uint32_t *)0xA05F6808)
+#define HOLLY_CH2_DMA_LMMODE0 *((volatile uint32_t *)0xA05F6884)
+
 #endif
@@ -8,6 +8,7 @@
 #include "naomi/video.h"
 #include "naomi/console.h"
 #include "naomi/thread.h"
+#include "naomi/trace.h"
 #include "irqstate.h"
 #include "holly.h"
 
@@ -53,6 +54,20 @@ static irq_stats_t stats;
 // If we should refuse to allow debugging in exception loops.
 static int disable_debugging;
 
+// The trace ring buffer, which is a power of two in size so the write count can be used
+// directly as a position. Events are only ever written with interrupts masked, either from
+// inside the interrupt handler or by briefly disabling interrupts from a thread, so writers
+// never race each other. Readers never hold up writers at all, and instead use the write
+// count to throw away anything that was overwritten while they were copying it out.
+static trace_event_t *trace_events = 0;
+static uint32_t trace_mask = 0;
+static volatile uint32_t trace_written = 0;
+
+// Interrupt latency and duration histograms, along with what HOLLY serviced during the
+// current interrupt so we can attribute the time spent to vblanks.
+static irq_timing_t timings[IRQ_TIMING_MAX];
+static uint32_t timing_serviced = 0;
+
 // Prototype for passing the signal on to GDB if it connects.
 void _gdb_set_haltreason(int reason, irq_state_t *state);
 
@@ -64,6 +79,9 @@ int _gdb_breakpoint_halt(irq_state_t *cur_state);
 // re-enabling interrupts to capture registers on an abort call.
 void _thread_disable_switching();
 
+// Prototype for finding out what thread an interrupt landed on, for tracing.
+uint32_t _thread_current_id(irq_state_t *cur_state);
+
 // Prototype for polling DIMM commands so we can keep the communication
 // channel open even in a halted state. This is so GDB can connect and
 // debug us properly.
@@ -72,6 +90,16 @@ int _dimm_command_handler(int halted, irq_state_t *cur_state);
 // Prototypes of functions we don't want in the public headers.
 void _irq_set_vector_table();
 int _timer_interrupt(int timer);
+
+// Prototype for recording where we interrupted for the sampling profiler.
+void _profile_sample(irq_state_t *cur_state);
+
+// Prototypes for cheaply timing interrupts, and for finding out how long ago the hardware
+// raised an interrupt for sources that let us work that out.
+uint32_t _profile_ticks();
+uint32_t _profile_ticks_elapsed(uint32_t start, uint32_t end);
+uint32_t _timer_latency(int timer);
+uint32_t _video_vblank_latency(int out);
 uint32_t _irq_read_sr();
 uint32_t _irq_read_vbr();
 
@@ -270,6 +298,70 @@ void _dimm_comms_init();
 void _dimm_comms_free();
 void _vblank_init();
 void _vblank_free();
+int _video_background_dma_finished();
+
+void _irq_histogram_add(irq_histogram_t *histogram, uint32_t microseconds)
+{
+    unsigned int bucket = 0;
+    uint32_t value = microseconds;
+    while (value > 1 && bucket < (IRQ_HISTOGRAM_BUCKETS - 1))
+    {
+        value >>= 1;
+        bucket++;
+    }
+
+    histogram->count++;
+    histogram->total += microseconds;
+    histogram->buckets[bucket]++;
+    if (microseconds > histogram->max)
+    {
+        histogram->max = microseconds;
+    }
+}
+
+void _irq_timing_duration(uint32_t source, uint32_t event, uint32_t microseconds)
+{
+    if (source == IRQ_SOURCE_INTERRUPT)
+    {
+        switch(event)
+        {
+            case IRQ_EVENT_TMU0:
+            {
+                _irq_histogram_add(&timings[IRQ_TIMING_TMU0].duration, microseconds);
+                break;
+            }
+            case IRQ_EVENT_TMU1:
+            {
+                _irq_histogram_add(&timings[IRQ_TIMING_TMU1].duration, microseconds);
+                break;
+            }
+            case IRQ_EVENT_TMU2:
+            {
+                _irq_histogram_add(&timings[IRQ_TIMING_TMU2].duration, microseconds);
+                break;
+            }
+            case IRQ_EVENT_HOLLY_LEVEL2:
+            case IRQ_EVENT_HOLLY_LEVEL4:
+            case IRQ_EVENT_HOLLY_LEVEL6:
+            {
+                _irq_histogram_add(&timings[IRQ_TIMING_HOLLY].duration, microseconds);
+                if (timing_serviced & HOLLY_SERVICED_VBLANK_IN)
+                {
+                    _irq_histogram_add(&timings[IRQ_TIMING_VBLANK_IN].duration, microseconds);
+                }
+                if (timing_serviced & HOLLY_SERVICED_VBLANK_OUT)
+                {
+                    _irq_histogram_add(&timings[IRQ_TIMING_VBLANK_OUT].duration, microseconds);
+                }
+                break;
+            }
+        }
+    }
+    else if (event == IRQ_EVENT_TRAPA)
+    {
+        _irq_histogram_add(&timings[IRQ_TIMING_SYSCALL].duration, microseconds);
+    }
+}
 
 uint32_t _holly_interrupt(irq_state_t *cur_state)
 {
@@ -384,11 +476,27 @@ uint32_t _holly_interrupt(irq_state_t *cur_state)
             HOLLY_INTERNAL_IRQ_STATUS = HOLLY_INTERNAL_INTERRUPT_AICA_DMA_FINISHED;
             handled |= HOLLY_INTERNAL_INTERRUPT_AICA_DMA_FINISHED;
         }
+        if (requested & HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED)
+        {
+            // Request to clear the interrupt.
+            HOLLY_INTERNAL_IRQ_STATUS = HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED;
+            handled |= HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED;
+
+            // Let the video system chain the next chunk of a deferred background clear,
+            // and wake anything waiting to draw once the whole clear is done.
+            if (_video_background_dma_finished())
+            {
+                serviced |= HOLLY_SERVICED_BACKGROUND_DMA_FINISHED;
+            }
+        }
 
         // Handle vblank in/out by making a request to the scheduler to wake
         // any threads waiting for this.
         if (requested & HOLLY_INTERNAL_INTERRUPT_VBLANK_IN)
         {
+            // See how far the beam got past the vblank line before we noticed.
+            _irq_histogram_add(&timings[IRQ_TIMING_VBLANK_IN].latency, _video_vblank_latency(0));
+
             // Request to clear the interrupt.
             HOLLY_INTERNAL_IRQ_STATUS = HOLLY_INTERNAL_INTERRUPT_VBLANK_IN;
             handled |= HOLLY_INTERNAL_INTERRUPT_VBLANK_IN;
@@ -398,6 +506,9 @@ uint32_t _holly_interrupt(irq_state_t *cur_state)
         }
         if (requested & HOLLY_INTERNAL_INTERRUPT_VBLANK_OUT)
         {
+            // See how far the beam got past the vblank line before we noticed.
+            _irq_histogram_add(&timings[IRQ_TIMING_VBLANK_OUT].latency, _video_vblank_latency(1));
+
             // Request to clear the interrupt.
             HOLLY_INTERNAL_IRQ_STATUS = HOLLY_INTERNAL_INTERRUPT_VBLANK_OUT;
             handled |= HOLLY_INTERNAL_INTERRUPT_VBLANK_OUT;
@@ -444,6 +555,53 @@ uint32_t _holly_interrupt(irq_state_t *cur_state)
     return serviced;
 }
 
+void _trace_holly(irq_state_t *cur_state, uint32_t serviced)
+{
+    uint32_t thread = _thread_current_id(cur_state);
+
+    if (serviced & HOLLY_SERVICED_VBLANK_IN)
+    {
+        _trace_record(TRACE_EVENT_VIDEO, thread, TRACE_VIDEO_VBLANK_IN, 0);
+    }
+    if (serviced & HOLLY_SERVICED_VBLANK_OUT)
+    {
+        _trace_record(TRACE_EVENT_VIDEO, thread, TRACE_VIDEO_VBLANK_OUT, 0);
+    }
+    if (serviced & HOLLY_SERVICED_TSP_FINISHED)
+    {
+        _trace_record(TRACE_EVENT_TA, thread, TRACE_TA_RENDER_FINISHED, 0);
+    }
+    if (serviced & HOLLY_SERVICED_TA_LOAD_OPAQUE_FINISHED)
+    {
+        _trace_record(TRACE_EVENT_TA, thread, TRACE_TA_LOAD_OPAQUE_FINISHED, 0);
+    }
+    if (serviced & HOLLY_SERVICED_TA_LOAD_TRANSPARENT_FINISHED)
+    {
+        _trace_record(TRACE_EVENT_TA, thread, TRACE_TA_LOAD_TRANSPARENT_FINISHED, 0);
+    }
+    if (serviced & HOLLY_SERVICED_TA_LOAD_PUNCHTHRU_FINISHED)
+    {
+        _trace_record(TRACE_EVENT_TA, thread, TRACE_TA_LOAD_PUNCHTHRU_FINISHED, 0);
+    }
+}
+
+irq_state_t * _irq_timer_interrupt(irq_state_t *cur_state, int timer)
+{
+    // The timer kept counting after it fired, so we know exactly how late we are.
+    _irq_histogram_add(&timings[IRQ_TIMING_TMU0 + timer].latency, _timer_latency(timer));
+
+    int ret = _timer_interrupt(timer);
+    if (ret > 0)
+    {
+        // The sampling profiler wants to know where we were before the scheduler gets a
+        // chance to switch threads. This isn't a scheduler request, so don't pass it on.
+        _profile_sample(cur_state);
+        ret = 0;
+    }
+
+    return _syscall_timer(cur_state, ret);
+}
+
 irq_state_t * _irq_external_interrupt(irq_state_t *cur_state)
 {
     stats.last_event = INTEVT;
@@ -452,20 +610,17 @@ irq_state_t * _irq_external_interrupt(irq_state_t *cur_state)
     {
         case IRQ_EVENT_TMU0:
         {
-            int ret = _timer_interrupt(0);
-            cur_state = _syscall_timer(cur_state, ret);
+            cur_state = _irq_timer_interrupt(cur_state, 0);
             break;
         }
         case IRQ_EVENT_TMU1:
         {
-            int ret = _timer_interrupt(1);
-            cur_state = _syscall_timer(cur_state, ret);
+            cur_state = _irq_timer_interrupt(cur_state, 1);
             break;
         }
         case IRQ_EVENT_TMU2:
         {
-            int ret = _timer_interrupt(2);
-            cur_state = _syscall_timer(cur_state, ret);
+            cur_state = _irq_timer_interrupt(cur_state, 2);
             break;
         }
         case IRQ_EVENT_HOLLY_LEVEL2:
@@ -473,6 +628,11 @@ irq_state_t * _irq_external_interrupt(irq_state_t *cur_state)
         case IRQ_EVENT_HOLLY_LEVEL6:
         {
             uint32_t serviced = _holly_interrupt(cur_state);
+            timing_serviced = serviced;
+            if (trace_events)
+            {
+                _trace_holly(cur_state, serviced);
+            }
             cur_state = _syscall_holly(cur_state, serviced);
             break;
         }
@@ -493,10 +653,28 @@ void _irq_handler(uint32_t source)
     // Mark that we're in interrupt context.
     _irq_in_interrupt = 1;
 
+    // Keep track of how long we spend in here, see irq_timing().
+    uint32_t timing_start = _profile_ticks();
+    uint32_t event = source == IRQ_SOURCE_INTERRUPT ? INTEVT : EXPEVT;
+    timing_serviced = 0;
+
     // Keep track of stats for debugging purposes.
     stats.last_source = source;
     stats.num_interrupts ++;
 
+    // Record what we interrupted, and what syscall it was for if it was one.
+    uint32_t trace_event = 0;
+    uint32_t trace_syscall = 0;
+    if (trace_events)
+    {
+        trace_event = event;
+        if (source != IRQ_SOURCE_INTERRUPT && trace_event == IRQ_EVENT_TRAPA)
+        {
+            trace_syscall = ((TRA) >> 2) & 0xFF;
+        }
+        _trace_record(TRACE_EVENT_IRQ_ENTER, _thread_current_id(irq_state), trace_event, trace_syscall);
+    }
+
     if (source == IRQ_SOURCE_GENERAL_EXCEPTION || source == IRQ_SOURCE_TLB_EXCEPTION)
     {
         // Regular exceptions as well as TLB miss exceptions.
@@ -514,6 +692,15 @@ void _irq_handler(uint32_t source)
         halted = _dimm_command_handler(halted, irq_state);
     }
 
+    // The thread we return to may not be the one we interrupted.
+    if (trace_events)
+    {
+        _trace_record(TRACE_EVENT_IRQ_EXIT, _thread_current_id(irq_state), trace_event, trace_syscall);
+    }
+
+    // Attribute the time we spent to whatever brought us here.
+    _irq_timing_duration(source, event, _profile_ticks_elapsed(timing_start, _profile_ticks()));
+
     // No longer need to mark this.
     _irq_in_interrupt = 0;
 }
@@ -542,6 +729,8 @@ void _irq_init()
     stats.last_source = 0;
     stats.last_event = 0;
     stats.num_interrupts = 0;
+    memset(timings, 0, sizeof(timings));
+    timing_serviced = 0;
 
     // Allocate space for our interrupt state.
     irq_state = malloc(sizeof(irq_state_t));
@@ -711,7 +900,168 @@ irq_stats_t irq_stats()
     return statscopy;
 }
 
+int irq_timing(unsigned int source, irq_timing_t *timing)
+{
+    if (source >= IRQ_TIMING_MAX)
+    {
+        return 0;
+    }
+
+    if (timing)
+    {
+        uint32_t saved_interrupts = irq_disable();
+        memcpy(timing, &timings[source], sizeof(irq_timing_t));
+        irq_restore(saved_interrupts);
+    }
+
+    return 1;
+}
+
+void irq_timing_reset()
+{
+    uint32_t saved_interrupts = irq_disable();
+    memset(timings, 0, sizeof(timings));
+    irq_restore(saved_interrupts);
+}
+
 int _irq_is_disabled(uint32_t sr)
 {
     return (sr & 0x10000000) != 0 ? 1 : 0;
 }
+
+void _trace_record(uint32_t type, uint32_t thread, uint32_t arg0, uint32_t arg1)
+{
+    if (trace_events == 0)
+    {
+        return;
+    }
+
+    // This is a no-op when called from inside the interrupt handler, and otherwise keeps
+    // an interrupt from recording its own event halfway through ours.
+    uint32_t old_interrupts = irq_disable();
+
+    if (trace_events)
+    {
+        trace_event_t *event = &trace_events[trace_written & trace_mask];
+        event->timestamp = _profile_get_current();
+        event->type = type;
+        event->thread = thread;
+        event->arg0 = arg0;
+        event->arg1 = arg1;
+        trace_written = trace_written + 1;
+    }
+
+    irq_restore(old_interrupts);
+}
+
+void trace_init(unsigned int events)
+{
+    // Round up to a power of two so that positions are just a mask away.
+    unsigned int size = 256;
+    while (size < events && size < 0x80000000)
+    {
+        size <<= 1;
+    }
+
+    trace_event_t *buffer = malloc(sizeof(trace_event_t) * size);
+    if (buffer == 0)
+    {
+        _irq_display_invariant("memory failure", "could not get memory for trace buffer!");
+    }
+
+    uint32_t old_interrupts = irq_disable();
+    trace_event_t *old_buffer = trace_events;
+    trace_events = buffer;
+    trace_mask = size - 1;
+    trace_written = 0;
+    irq_restore(old_interrupts);
+
+    if (old_buffer)
+    {
+        free(old_buffer);
+    }
+}
+
+void trace_free()
+{
+    uint32_t old_interrupts = irq_disable();
+    trace_event_t *old_buffer = trace_events;
+    trace_events = 0;
+    trace_mask = 0;
+    trace_written = 0;
+    irq_restore(old_interrupts);
+
+    if (old_buffer)
+    {
+        free(old_buffer);
+    }
+}
+
+void trace_marker(uint32_t id, uint32_t value)
+{
+    _trace_record(TRACE_EVENT_MARKER, thread_id(), id, value);
+}
+
+void trace_marker_begin(uint32_t id)
+{
+    _trace_record(TRACE_EVENT_MARKER_BEGIN, thread_id(), id, 0);
+}
+
+void trace_marker_end(uint32_t id)
+{
+    _trace_record(TRACE_EVENT_MARKER_END, thread_id(), id, 0);
+}
+
+unsigned int trace_read(uint32_t *cursor, trace_event_t *events, unsigned int max, uint32_t *dropped)
+{
+    uint32_t lost = 0;
+    unsigned int count = 0;
+
+    if (trace_events && cursor && events)
+    {
+        uint32_t size = trace_mask + 1;
+        uint32_t written = trace_written;
+        uint32_t start = *cursor;
+
+        // Skip anything that has already been overwritten.
+        if ((written - start) > size)
+        {
+            lost = (written - start) - size;
+            start = written - size;
+        }
+
+        count = written - start;
+        if (count > max)
+        {
+            count = max;
+        }
+        for (unsigned int i = 0; i < count; i++)
+        {
+            events[i] = trace_events[(start + i) & trace_mask];
+        }
+
+        // Writers may have lapped us while we were copying, in which case the oldest of
+        // what we copied could be a mix of old and new events, so throw those away.
+        written = trace_written;
+        if ((written - start) > size)
+        {
+            uint32_t bad = (written - start) - size;
+            if (bad > count)
+            {
+                bad = count;
+            }
+            memmove(events, events + bad, sizeof(trace_event_t) * (count - bad));
+            count -= bad;
+            lost += bad;
+            start += bad;
+        }
+
+        *cursor = start + count;
+    }
+
+    if (dropped)
+    {
+        *dropped = lost;
+    }
+    return count;
+}
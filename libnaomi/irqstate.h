@@ -56,6 +56,7 @@ uint32_t _irq_enable();
 #define HOLLY_SERVICED_TA_LOAD_OPAQUE_FINISHED 0x00000020
 #define HOLLY_SERVICED_TA_LOAD_TRANSPARENT_FINISHED 0x00000040
 #define HOLLY_SERVICED_TA_LOAD_PUNCHTHRU_FINISHED 0x00000080
+#define HOLLY_SERVICED_BACKGROUND_DMA_FINISHED 0x00000100
 
 irq_state_t *_syscall_trapa(irq_state_t *state, unsigned int which);
 irq_state_t *_syscall_timer(irq_state_t *state, int timer);
@@ -65,6 +66,15 @@ void _thread_create_idle();
 void _thread_register_main(irq_state_t *state);
 uint64_t _profile_get_current();
 
+// Program the next preemption interrupt to happen the given number of microseconds from
+// now, or stop preemption interrupts entirely if this is zero. Used by the scheduler to only
+// take an interrupt when it has a reason to, such as time slicing or a sleep deadline.
+void _preempt_next(uint32_t microseconds);
+
+// Record an event into the trace buffer, if tracing is enabled. See naomi/trace.h for
+// the event types and what their arguments mean.
+void _trace_record(uint32_t type, uint32_t thread, uint32_t arg0, uint32_t arg1);
+
 void _irq_display_exception(int signal, irq_state_t *cur_state, char *failure, int code);
 
 // Prototype to force thread system to disable preemption, used for safely
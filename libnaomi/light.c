@@ -0,0 +1,232 @@
+#include "naomi/matrix.h"
+#include "naomi/vector.h"
+#include "naomi/light.h"
+
+// Lights as we actually evaluate them, with everything that doesn't change per
+// vertex worked out ahead of time.
+typedef struct
+{
+    int type;
+    float r;
+    float g;
+    float b;
+    float x;
+    float y;
+    float z;
+    float invradius;
+} light_prepared_t;
+
+typedef struct
+{
+    light_prepared_t lights[LIGHT_MAX];
+    int count;
+    float ambient[3];
+} light_setup_t;
+
+void _light_prepare(light_setup_t *setup, light_t *lights, int numlights)
+{
+    setup->count = 0;
+    setup->ambient[0] = 0.0;
+    setup->ambient[1] = 0.0;
+    setup->ambient[2] = 0.0;
+
+    if (numlights > LIGHT_MAX)
+    {
+        numlights = LIGHT_MAX;
+    }
+
+    for (int i = 0; i < numlights; i++)
+    {
+        float r = lights[i].color.r / 255.0;
+        float g = lights[i].color.g / 255.0;
+        float b = lights[i].color.b / 255.0;
+
+        if (lights[i].type == LIGHT_TYPE_AMBIENT)
+        {
+            // Ambient lights all add up to a single constant term.
+            setup->ambient[0] += r;
+            setup->ambient[1] += g;
+            setup->ambient[2] += b;
+            continue;
+        }
+
+        light_prepared_t *light = &setup->lights[setup->count];
+        light->type = lights[i].type;
+        light->r = r;
+        light->g = g;
+        light->b = b;
+
+        if (lights[i].type == LIGHT_TYPE_DIRECTIONAL)
+        {
+            // Store the direction towards the light so N.L is positive when lit.
+            vector_t direction = lights[i].vector;
+            vector_normalize(&direction);
+            light->x = -direction.x;
+            light->y = -direction.y;
+            light->z = -direction.z;
+            light->invradius = 0.0;
+        }
+        else if (lights[i].type == LIGHT_TYPE_POINT)
+        {
+            if (lights[i].radius <= 0.0)
+            {
+                continue;
+            }
+
+            light->x = lights[i].vector.x;
+            light->y = lights[i].vector.y;
+            light->z = lights[i].vector.z;
+            light->invradius = 1.0 / lights[i].radius;
+        }
+        else
+        {
+            continue;
+        }
+
+        setup->count++;
+    }
+}
+
+void _light_evaluate(light_setup_t *setup, vertex_t *vertex, vector_t *normal, float *lit)
+{
+    float r = setup->ambient[0];
+    float g = setup->ambient[1];
+    float b = setup->ambient[2];
+
+    for (int i = 0; i < setup->count; i++)
+    {
+        light_prepared_t *light = &setup->lights[i];
+
+        register float nx asm("fr0") = normal->x;
+        register float ny asm("fr1") = normal->y;
+        register float nz asm("fr2") = normal->z;
+        register float nw asm("fr3") = 0.0;
+        float factor;
+
+        if (light->type == LIGHT_TYPE_DIRECTIONAL)
+        {
+            register float lx asm("fr4") = light->x;
+            register float ly asm("fr5") = light->y;
+            register float lz asm("fr6") = light->z;
+            register float lw asm("fr7") = 0.0;
+
+            asm volatile(" \
+                fipr fv4,fv0\n \
+                " :
+                "+f" (nw) :
+                "f" (nx), "f" (ny), "f" (nz), "f" (lx), "f" (ly), "f" (lz), "f" (lw)
+            );
+
+            factor = nw;
+        }
+        else
+        {
+            register float lx asm("fr4") = light->x - vertex->x;
+            register float ly asm("fr5") = light->y - vertex->y;
+            register float lz asm("fr6") = light->z - vertex->z;
+            register float lw asm("fr7") = 0.0;
+            register float distsq asm("fr8");
+
+            // Get N.L against the unnormalized light vector, and its squared length
+            // so we can both normalize it and work out how far away the light is.
+            asm volatile(" \
+                fipr fv4,fv0\n \
+                fipr fv4,fv4\n \
+                fmov fr7,fr8\n \
+                fsrra fr7\n \
+                " :
+                "+f" (nw), "+f" (lw), "=f" (distsq) :
+                "f" (nx), "f" (ny), "f" (nz), "f" (lx), "f" (ly), "f" (lz)
+            );
+
+            if (nw <= 0.0)
+            {
+                continue;
+            }
+
+            float attenuation = 1.0 - ((distsq * lw) * light->invradius);
+            if (attenuation <= 0.0)
+            {
+                continue;
+            }
+
+            factor = nw * lw * attenuation;
+        }
+
+        if (factor > 0.0)
+        {
+            r += light->r * factor;
+            g += light->g * factor;
+            b += light->b * factor;
+        }
+    }
+
+    lit[0] = r > 1.0 ? 1.0 : r;
+    lit[1] = g > 1.0 ? 1.0 : g;
+    lit[2] = b > 1.0 ? 1.0 : b;
+}
+
+uint32_t _light_pack(float *lit, color_t base)
+{
+    unsigned int r = (unsigned int)((lit[0] * base.r) + 0.5);
+    unsigned int g = (unsigned int)((lit[1] * base.g) + 0.5);
+    unsigned int b = (unsigned int)((lit[2] * base.b) + 0.5);
+
+    return (b & 0xFF) | ((g << 8) & 0xFF00) | ((r << 16) & 0xFF0000) | ((base.a << 24) & 0xFF000000);
+}
+
+void light_vertex_colors(light_t *lights, int numlights, color_t base, vertex_t *verticies, vector_t *normals, uint32_t *colors, int n)
+{
+    light_setup_t setup;
+    _light_prepare(&setup, lights, numlights);
+
+    for (int i = 0; i < n; i++)
+    {
+        float lit[3];
+        _light_evaluate(&setup, &verticies[i], &normals[i], lit);
+        colors[i] = _light_pack(lit, base);
+    }
+}
+
+void light_vertex_intensities(light_t *lights, int numlights, vertex_t *verticies, vector_t *normals, float *intensities, int n)
+{
+    light_setup_t setup;
+    _light_prepare(&setup, lights, numlights);
+
+    for (int i = 0; i < n; i++)
+    {
+        float lit[3];
+        _light_evaluate(&setup, &verticies[i], &normals[i], lit);
+        intensities[i] = (lit[0] + lit[1] + lit[2]) * (1.0 / 3.0);
+    }
+}
+
+void light_perspective_transform_vertex(light_t *lights, int numlights, color_t base, vertex_t *src, vector_t *normals, vertex_t *dest, uint32_t *colors, int n)
+{
+    light_setup_t setup;
+    _light_prepare(&setup, lights, numlights);
+
+    for (int i = 0; i < n; i++)
+    {
+        // Light in model space first, since dest may be the same array as src.
+        float lit[3];
+        _light_evaluate(&setup, &src[i], &normals[i], lit);
+        colors[i] = _light_pack(lit, base);
+
+        register float x asm("fr0") = src[i].x;
+        register float y asm("fr1") = src[i].y;
+        register float z asm("fr2") = src[i].z;
+        register float w asm("fr3") = 1.0;
+
+        asm volatile(" \
+            ftrv xmtrx,fv0\n \
+            " :
+            "+f" (x), "+f" (y), "+f" (z), "+f" (w)
+        );
+
+        float invw = 1.0 / w;
+        dest[i].x = x * invw;
+        dest[i].y = y * invw;
+        dest[i].z = z * invw;
+    }
+}
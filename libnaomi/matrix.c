@@ -1,6 +1,5 @@
 #include <stdlib.h>
 #include <math.h>
-#include "naomi/interrupt.h"
 #include "naomi/matrix.h"
 #include "naomi/video.h"
 
@@ -11,8 +10,6 @@ static matrix_t sysmatrix[MAX_MATRIXES];
 
 void matrix_init_identity()
 {
-    uint32_t old_irq = irq_disable();
-
     // Set up the identity matrix in XMTRX, which will look like the following:
     // 1.0, 0.0, 0.0, 0.0
     // 0.0, 1.0, 0.0, 0.0
@@ -47,8 +44,6 @@ void matrix_init_identity()
         /* No inputs */ :
         "fr0", "fr1", "fr2", "fr3", "fr4", "fr5"
     );
-
-    irq_restore(old_irq);
 }
 
 void matrix_init_perspective(float fovy, float zNear, float zFar)
@@ -113,8 +108,6 @@ void matrix_init_perspective(float fovy, float zNear, float zFar)
 
 void matrix_apply(matrix_t *matrix)
 {
-    uint32_t old_irq = irq_disable();
-
     // Apply a 4x4 matrix in the input to the XMTRX accumulated viewport matrix.
     register matrix_t *matrix_param asm("r4") = matrix;
     asm(" \
@@ -153,14 +146,10 @@ void matrix_apply(matrix_t *matrix)
         "r" (matrix_param) :
         "fr0", "fr1", "fr2", "fr3", "fr4", "fr5", "fr6", "fr7", "fr8", "fr9", "fr10", "fr11", "fr12", "fr13", "fr14", "fr15"
     );
-
-    irq_restore(old_irq);
 }
 
 void matrix_set(matrix_t *matrix)
 {
-    uint32_t old_irq = irq_disable();
-
     // Set a 4x4 matrix into the XMTRX register.
     register matrix_t *matrix_param asm("r4") = matrix;
     asm(" \
@@ -195,14 +184,10 @@ void matrix_set(matrix_t *matrix)
         "r" (matrix_param) :
         "fr0", "fr1", "fr2", "fr3", "fr4", "fr5", "fr6", "fr7", "fr8", "fr9", "fr10", "fr11", "fr12", "fr13", "fr14", "fr15"
     );
-
-    irq_restore(old_irq);
 }
 
 void matrix_get(matrix_t *matrix)
 {
-    uint32_t old_irq = irq_disable();
-
     // Set a 4x4 matrix into the XMTRX register.
     register matrix_t *matrix_param asm("r4") = matrix;
     asm(" \
@@ -238,8 +223,6 @@ void matrix_get(matrix_t *matrix)
         "r" (matrix_param) :
         "fr0", "fr1", "fr2", "fr3", "fr4", "fr5", "fr6", "fr7", "fr8", "fr9", "fr10", "fr11", "fr12", "fr13", "fr14", "fr15"
     );
-
-    irq_restore(old_irq);
 }
 
 void matrix_push()
@@ -333,8 +316,6 @@ void matrix_affine_transform_vertex(vertex_t *src, vertex_t *dest, int n)
     // Let's do some bounds checking!
     if (n <= 0) { return; }
 
-    uint32_t old_irq = irq_disable();
-
     // Given a pre-set XMTRX (use matrix_clear() and matrix_apply() to get here),
     // multiply it by a set of points to transform them from world space to screen space.
     // These are extended to homogenous coordinates by assuming a "w" value of 1.0.
@@ -362,8 +343,6 @@ void matrix_affine_transform_vertex(vertex_t *src, vertex_t *dest, int n)
         "r" (src_param), "r" (dst_param), "r" (n_param) :
         "fr0", "fr1", "fr2", "fr3"
     );
-
-    irq_restore(old_irq);
 }
 
 void matrix_perspective_transform_vertex(vertex_t *src, vertex_t *dest, int n)
@@ -371,8 +350,6 @@ void matrix_perspective_transform_vertex(vertex_t *src, vertex_t *dest, int n)
     // Let's do some bounds checking!
     if (n <= 0) { return; }
 
-    uint32_t old_irq = irq_disable();
-
     // Given a pre-set XMTRX (use matrix_clear() and matrix_apply() to get here),
     // multiply it by a set of points to transform them from world space to screen space.
     // These are extended to homogenous coordinates by assuming a "w" value of 1.0.
@@ -403,8 +380,6 @@ void matrix_perspective_transform_vertex(vertex_t *src, vertex_t *dest, int n)
         "r" (src_param), "r" (dst_param), "r" (n_param) :
         "fr0", "fr1", "fr2", "fr3"
     );
-
-    irq_restore(old_irq);
 }
 
 int matrix_perspective_transform_and_cull_vertex(vertex_t *src, vertex_t *dest, int n)
@@ -412,8 +387,6 @@ int matrix_perspective_transform_and_cull_vertex(vertex_t *src, vertex_t *dest,
     // Let's do some bounds checking!
     if (n <= 0) { return 0; }
 
-    uint32_t old_irq = irq_disable();
-
     // Given a pre-set XMTRX (use matrix_clear() and matrix_apply() to get here),
     // multiply it by a set of points to transform them from world space to screen space.
     // These are extended to homogenous coordinates by assuming a "w" value of 1.0.
@@ -449,8 +422,6 @@ int matrix_perspective_transform_and_cull_vertex(vertex_t *src, vertex_t *dest,
         "fr0", "fr1", "fr2", "fr3"
     );
 
-    irq_restore(old_irq);
-
     int oob = 0;
     int visible = 0;
     for (int i = 0; i < n; i++)
@@ -476,8 +447,6 @@ void matrix_affine_transform_textured_vertex(textured_vertex_t *src, textured_ve
     // Let's do some bounds checking!
     if (n <= 0) { return; }
 
-    uint32_t old_irq = irq_disable();
-
     // Given a pre-set XMTRX (use matrix_clear() and matrix_apply() to get here),
     // multiply it by a set of points to transform them from world space to screen space.
     // These are extended to homogenous coordinates by assuming a "w" value of 1.0.
@@ -511,8 +480,6 @@ void matrix_affine_transform_textured_vertex(textured_vertex_t *src, textured_ve
         "r" (src_param), "r" (dst_param), "r" (n_param) :
         "fr0", "fr1", "fr2", "fr3"
     );
-
-    irq_restore(old_irq);
 }
 
 void matrix_perspective_transform_textured_vertex(textured_vertex_t *src, textured_vertex_t *dest, int n)
@@ -520,8 +487,6 @@ void matrix_perspective_transform_textured_vertex(textured_vertex_t *src, textur
     // Let's do some bounds checking!
     if (n <= 0) { return; }
 
-    uint32_t old_irq = irq_disable();
-
     // Given a pre-set XMTRX (use matrix_clear() and matrix_apply() to get here),
     // multiply it by a set of points to transform them from world space to screen space.
     // These are extended to homogenous coordinates by assuming a "w" value of 1.0.
@@ -558,8 +523,6 @@ void matrix_perspective_transform_textured_vertex(textured_vertex_t *src, textur
         "r" (src_param), "r" (dst_param), "r" (n_param) :
         "fr0", "fr1", "fr2", "fr3"
     );
-
-    irq_restore(old_irq);
 }
 
 int matrix_perspective_transform_and_cull_textured_vertex(textured_vertex_t *src, textured_vertex_t *dest, int n)
@@ -567,8 +530,6 @@ int matrix_perspective_transform_and_cull_textured_vertex(textured_vertex_t *src
     // Let's do some bounds checking!
     if (n <= 0) { return 0; }
 
-    uint32_t old_irq = irq_disable();
-
     // Given a pre-set XMTRX (use matrix_clear() and matrix_apply() to get here),
     // multiply it by a set of points to transform them from world space to screen space.
     // These are extended to homogenous coordinates by assuming a "w" value of 1.0.
@@ -610,8 +571,6 @@ int matrix_perspective_transform_and_cull_textured_vertex(textured_vertex_t *src
         "fr0", "fr1", "fr2", "fr3"
     );
 
-    irq_restore(old_irq);
-
     int oob = 0;
     int visible = 0;
     for (int i = 0; i < n; i++)
@@ -632,48 +591,78 @@ int matrix_perspective_transform_and_cull_textured_vertex(textured_vertex_t *src
     return oob ? 0 : visible;
 }
 
+void matrix_sincos(float degrees, float *sine, float *cosine)
+{
+    // fsca takes a 16.16 fixed point angle where 0x10000 is one full turn, and hands
+    // back the sine and cosine together, so this is far cheaper than libm's double
+    // precision sin() and cos().
+    int angle = (int)(degrees * (65536.0 / 360.0));
+    register float sinval asm("fr0");
+    register float cosval asm("fr1");
+    asm(" \
+        lds %2,fpul\n \
+        fsca fpul,dr0\n \
+        " :
+        "=f" (sinval), "=f" (cosval) :
+        "r" (angle) :
+        "fpul"
+    );
+
+    *sine = sinval;
+    *cosine = cosval;
+}
+
 void matrix_rotate_x(float degrees)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
         0.0, 0.0, 0.0, 1.0
     };
-    matrix.a22 = matrix.a33 = cos((degrees / 180.0) * M_PI);
-    matrix.a23 = -(matrix.a32 = sin((degrees / 180.0) * M_PI));
+    float sine;
+    float cosine;
+    matrix_sincos(degrees, &sine, &cosine);
+    matrix.a22 = matrix.a33 = cosine;
+    matrix.a23 = -(matrix.a32 = sine);
     matrix_apply(&matrix);
 }
 
 void matrix_rotate_y(float degrees)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
         0.0, 0.0, 0.0, 1.0
     };
-    matrix.a11 = matrix.a33 = cos((degrees / 180.0) * M_PI);
-    matrix.a31 = -(matrix.a13 = sin((degrees / 180.0) * M_PI));
+    float sine;
+    float cosine;
+    matrix_sincos(degrees, &sine, &cosine);
+    matrix.a11 = matrix.a33 = cosine;
+    matrix.a31 = -(matrix.a13 = sine);
     matrix_apply(&matrix);
 }
 
 void matrix_rotate_z(float degrees)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
         0.0, 0.0, 0.0, 1.0
     };
-    matrix.a11 = matrix.a22 = cos((degrees / 180.0) * M_PI);
-    matrix.a12 = -(matrix.a21 = sin((degrees / 180.0) * M_PI));
+    float sine;
+    float cosine;
+    matrix_sincos(degrees, &sine, &cosine);
+    matrix.a11 = matrix.a22 = cosine;
+    matrix.a12 = -(matrix.a21 = sine);
     matrix_apply(&matrix);
 }
 
 void matrix_scale(float xamount, float yamount, float zamount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -687,7 +676,7 @@ void matrix_scale(float xamount, float yamount, float zamount)
 
 void matrix_scale_x(float amount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -699,7 +688,7 @@ void matrix_scale_x(float amount)
 
 void matrix_scale_y(float amount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -711,7 +700,7 @@ void matrix_scale_y(float amount)
 
 void matrix_scale_z(float amount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -723,7 +712,7 @@ void matrix_scale_z(float amount)
 
 void matrix_translate(float xamount, float yamount, float zamount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -737,7 +726,7 @@ void matrix_translate(float xamount, float yamount, float zamount)
 
 void matrix_translate_x(float amount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -749,7 +738,7 @@ void matrix_translate_x(float amount)
 
 void matrix_translate_y(float amount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -761,7 +750,7 @@ void matrix_translate_y(float amount)
 
 void matrix_translate_z(float amount)
 {
-    static matrix_t matrix = {
+    matrix_t matrix = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -773,7 +762,7 @@ void matrix_translate_z(float amount)
 
 void matrix_rotate_origin_x(vertex_t *origin, float amount)
 {
-    static matrix_t backagain = {
+    matrix_t backagain = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -785,7 +774,7 @@ void matrix_rotate_origin_x(vertex_t *origin, float amount)
     matrix_apply(&backagain);
     matrix_rotate_x(amount);
 
-    static matrix_t there = {
+    matrix_t there = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -799,7 +788,7 @@ void matrix_rotate_origin_x(vertex_t *origin, float amount)
 
 void matrix_rotate_origin_y(vertex_t *origin, float amount)
 {
-    static matrix_t backagain = {
+    matrix_t backagain = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -811,7 +800,7 @@ void matrix_rotate_origin_y(vertex_t *origin, float amount)
     matrix_apply(&backagain);
     matrix_rotate_y(amount);
 
-    static matrix_t there = {
+    matrix_t there = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -825,7 +814,7 @@ void matrix_rotate_origin_y(vertex_t *origin, float amount)
 
 void matrix_rotate_origin_z(vertex_t *origin, float amount)
 {
-    static matrix_t backagain = {
+    matrix_t backagain = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -837,7 +826,7 @@ void matrix_rotate_origin_z(vertex_t *origin, float amount)
     matrix_apply(&backagain);
     matrix_rotate_z(amount);
 
-    static matrix_t there = {
+    matrix_t there = {
         1.0, 0.0, 0.0, 0.0,
         0.0, 1.0, 0.0, 0.0,
         0.0, 0.0, 1.0, 0.0,
@@ -848,3 +837,167 @@ void matrix_rotate_origin_z(vertex_t *origin, float amount)
     there.a43 = -origin->z;
     matrix_apply(&there);
 }
+
+void quaternion_identity(quaternion_t *quat)
+{
+    quat->x = 0.0;
+    quat->y = 0.0;
+    quat->z = 0.0;
+    quat->w = 1.0;
+}
+
+void quaternion_from_axis_angle(quaternion_t *quat, vertex_t *axis, float degrees)
+{
+    float sine;
+    float cosine;
+    matrix_sincos(degrees / 2.0, &sine, &cosine);
+
+    quat->x = axis->x * sine;
+    quat->y = axis->y * sine;
+    quat->z = axis->z * sine;
+    quat->w = cosine;
+}
+
+void quaternion_multiply(quaternion_t *result, quaternion_t *a, quaternion_t *b)
+{
+    // Work on a copy so that result can be the same as one of the inputs.
+    quaternion_t out;
+    out.x = (a->w * b->x) + (a->x * b->w) + (a->y * b->z) - (a->z * b->y);
+    out.y = (a->w * b->y) - (a->x * b->z) + (a->y * b->w) + (a->z * b->x);
+    out.z = (a->w * b->z) + (a->x * b->y) - (a->y * b->x) + (a->z * b->w);
+    out.w = (a->w * b->w) - (a->x * b->x) - (a->y * b->y) - (a->z * b->z);
+    *result = out;
+}
+
+float _quaternion_dot(quaternion_t *a, quaternion_t *b)
+{
+    register float ax asm("fr0") = a->x;
+    register float ay asm("fr1") = a->y;
+    register float az asm("fr2") = a->z;
+    register float aw asm("fr3") = a->w;
+    register float bx asm("fr4") = b->x;
+    register float by asm("fr5") = b->y;
+    register float bz asm("fr6") = b->z;
+    register float bw asm("fr7") = b->w;
+
+    asm(" \
+        fipr fv4,fv0\n \
+        " :
+        "+f" (aw) :
+        "f" (ax), "f" (ay), "f" (az), "f" (bx), "f" (by), "f" (bz), "f" (bw)
+    );
+
+    return aw;
+}
+
+void quaternion_normalize(quaternion_t *quat)
+{
+    register float x asm("fr0") = quat->x;
+    register float y asm("fr1") = quat->y;
+    register float z asm("fr2") = quat->z;
+    register float w asm("fr3") = quat->w;
+    float origw = quat->w;
+
+    // The dot product of fv0 with itself lands in fr3, and fsrra turns that into
+    // the reciprocal of the length.
+    asm(" \
+        fipr fv0,fv0\n \
+        fsrra fr3\n \
+        " :
+        "+f" (w) :
+        "f" (x), "f" (y), "f" (z)
+    );
+
+    quat->x = x * w;
+    quat->y = y * w;
+    quat->z = z * w;
+    quat->w = origw * w;
+}
+
+void quaternion_slerp(quaternion_t *result, quaternion_t *a, quaternion_t *b, float t)
+{
+    float cosom = _quaternion_dot(a, b);
+    float sign = 1.0;
+
+    // Take the short way around.
+    if (cosom < 0.0)
+    {
+        cosom = -cosom;
+        sign = -1.0;
+    }
+
+    float scalea;
+    float scaleb;
+    if (cosom > 0.9995)
+    {
+        // Close enough that a normalized linear interpolation is indistinguishable
+        // and avoids dividing by a tiny sine.
+        scalea = 1.0 - t;
+        scaleb = t;
+    }
+    else
+    {
+        float omega = acosf(cosom) * (180.0 / M_PI);
+        float sinom;
+        float cosine;
+        float sina;
+        float sinb;
+
+        matrix_sincos(omega, &sinom, &cosine);
+        matrix_sincos((1.0 - t) * omega, &sina, &cosine);
+        matrix_sincos(t * omega, &sinb, &cosine);
+
+        scalea = sina / sinom;
+        scaleb = sinb / sinom;
+    }
+
+    scaleb *= sign;
+    result->x = (scalea * a->x) + (scaleb * b->x);
+    result->y = (scalea * a->y) + (scaleb * b->y);
+    result->z = (scalea * a->z) + (scaleb * b->z);
+    result->w = (scalea * a->w) + (scaleb * b->w);
+
+    if (cosom > 0.9995)
+    {
+        quaternion_normalize(result);
+    }
+}
+
+void quaternion_to_matrix(matrix_t *matrix, quaternion_t *quat)
+{
+    float xx = quat->x * quat->x;
+    float yy = quat->y * quat->y;
+    float zz = quat->z * quat->z;
+    float xy = quat->x * quat->y;
+    float xz = quat->x * quat->z;
+    float yz = quat->y * quat->z;
+    float wx = quat->w * quat->x;
+    float wy = quat->w * quat->y;
+    float wz = quat->w * quat->z;
+
+    // Laid out the same way as matrix_rotate_x/y/z() so that a quaternion made from
+    // an axis and angle produces the exact same matrix as rotating about that axis.
+    matrix->a11 = 1.0 - (2.0 * (yy + zz));
+    matrix->a12 = 2.0 * (xy - wz);
+    matrix->a13 = 2.0 * (xz + wy);
+    matrix->a14 = 0.0;
+    matrix->a21 = 2.0 * (xy + wz);
+    matrix->a22 = 1.0 - (2.0 * (xx + zz));
+    matrix->a23 = 2.0 * (yz - wx);
+    matrix->a24 = 0.0;
+    matrix->a31 = 2.0 * (xz - wy);
+    matrix->a32 = 2.0 * (yz + wx);
+    matrix->a33 = 1.0 - (2.0 * (xx + yy));
+    matrix->a34 = 0.0;
+    matrix->a41 = 0.0;
+    matrix->a42 = 0.0;
+    matrix->a43 = 0.0;
+    matrix->a44 = 1.0;
+}
+
+void matrix_rotate_quaternion(quaternion_t *quat)
+{
+    matrix_t matrix;
+    quaternion_to_matrix(&matrix, quat);
+    matrix_apply(&matrix);
+}
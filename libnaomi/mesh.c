@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "naomi/matrix.h"
+#include "naomi/ta.h"
+#include "naomi/mesh.h"
+
+// Per-vertex flags from the last transform, used for culling strips.
+#define MESH_VERTEX_VISIBLE 0x1
+#define MESH_VERTEX_OUT_OF_BOUNDS 0x2
+
+// Per-strip flag, stashed at the end of the vertex flags.
+#define MESH_STRIP_CULLED 0x1
+
+// Pre-stripified meshes, as generated by tools/meshgen.py. Everything is little-endian
+// and every offset is from the start of the file. The layout is:
+//
+// Header, 56 bytes:
+//     char magic[4] = "NMSH"
+//     uint32_t version = 1
+//     uint32_t vertex_count
+//     uint32_t strip_count
+//     uint32_t index_count
+//     uint32_t position_offset (vertex_t per vertex)
+//     uint32_t uv_offset (uint32_t per vertex, 16-bit U in the high half and V in the low)
+//     uint32_t normal_offset (vector_t per vertex, or 0 if the mesh has no normals)
+//     uint32_t strip_offset (uint16_t length per strip)
+//     uint32_t index_offset (uint16_t per index, strips laid end to end)
+//     float center_x, center_y, center_z, radius (the bounding sphere)
+//
+// Verticies are ordered by their first use in the strips, so that transforming and
+// drawing walks memory mostly in order.
+#define MESH_ASSET_MAGIC 0x48534D4E
+#define MESH_ASSET_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t strip_count;
+    uint32_t index_count;
+    uint32_t position_offset;
+    uint32_t uv_offset;
+    uint32_t normal_offset;
+    uint32_t strip_offset;
+    uint32_t index_offset;
+    float center_x;
+    float center_y;
+    float center_z;
+    float radius;
+} mesh_asset_header_t;
+
+mesh_t *_mesh_alloc(unsigned int vertexcount, uint16_t *indices, uint16_t *strips, unsigned int stripcount)
+{
+    if (indices == 0 || strips == 0 || vertexcount == 0 || stripcount == 0)
+    {
+        return 0;
+    }
+
+    // Make sure every strip makes sense and every index is in bounds, so we never
+    // read garbage when drawing.
+    unsigned int indexcount = 0;
+    for (unsigned int i = 0; i < stripcount; i++)
+    {
+        if (strips[i] < 3)
+        {
+            return 0;
+        }
+
+        indexcount += strips[i];
+    }
+    for (unsigned int i = 0; i < indexcount; i++)
+    {
+        if (indices[i] >= vertexcount)
+        {
+            return 0;
+        }
+    }
+
+    mesh_t *mesh = malloc(sizeof(mesh_t));
+    if (mesh == 0)
+    {
+        return 0;
+    }
+
+    memset(mesh, 0, sizeof(mesh_t));
+    mesh->vertexcount = vertexcount;
+    mesh->indices = indices;
+    mesh->strips = strips;
+    mesh->stripcount = stripcount;
+    mesh->indexcount = indexcount;
+    mesh->transformed = malloc(sizeof(vertex_t) * vertexcount);
+    mesh->flags = malloc(vertexcount + stripcount);
+
+    // Worst case, one polygon header plus one vertex command per index.
+    mesh->commands = malloc(sizeof(struct polygon_list_packed_color) + (sizeof(struct vertex_list_packed_color_32bit_uv) * indexcount));
+
+    if (mesh->transformed == 0 || mesh->flags == 0 || mesh->commands == 0)
+    {
+        mesh_free(mesh);
+        return 0;
+    }
+
+    memset(mesh->flags, 0, vertexcount + stripcount);
+    return mesh;
+}
+
+mesh_t *mesh_create(textured_vertex_t *verticies, unsigned int vertexcount, uint16_t *indices, uint16_t *strips, unsigned int stripcount)
+{
+    if (verticies == 0)
+    {
+        return 0;
+    }
+
+    mesh_t *mesh = _mesh_alloc(vertexcount, indices, strips, stripcount);
+    if (mesh == 0)
+    {
+        return 0;
+    }
+
+    mesh->verticies = verticies;
+
+    // Work out a bounding sphere centered on the bounding box. It isn't the tightest
+    // possible sphere, but it is cheap and good enough for visibility checks.
+    vertex_t low = { verticies[0].x, verticies[0].y, verticies[0].z };
+    vertex_t high = low;
+    for (unsigned int i = 1; i < vertexcount; i++)
+    {
+        if (verticies[i].x < low.x) { low.x = verticies[i].x; }
+        if (verticies[i].y < low.y) { low.y = verticies[i].y; }
+        if (verticies[i].z < low.z) { low.z = verticies[i].z; }
+        if (verticies[i].x > high.x) { high.x = verticies[i].x; }
+        if (verticies[i].y > high.y) { high.y = verticies[i].y; }
+        if (verticies[i].z > high.z) { high.z = verticies[i].z; }
+    }
+
+    mesh->center.x = (low.x + high.x) / 2.0;
+    mesh->center.y = (low.y + high.y) / 2.0;
+    mesh->center.z = (low.z + high.z) / 2.0;
+
+    float radiussq = 0.0;
+    for (unsigned int i = 0; i < vertexcount; i++)
+    {
+        float dx = verticies[i].x - mesh->center.x;
+        float dy = verticies[i].y - mesh->center.y;
+        float dz = verticies[i].z - mesh->center.z;
+        float distsq = (dx * dx) + (dy * dy) + (dz * dz);
+        if (distsq > radiussq)
+        {
+            radiussq = distsq;
+        }
+    }
+    mesh->radius = sqrtf(radiussq);
+
+    return mesh;
+}
+
+int _mesh_asset_fits(uint32_t offset, unsigned int count, unsigned int elementsize, unsigned int alignment, unsigned int length)
+{
+    if (offset & (alignment - 1) || offset > length)
+    {
+        return 0;
+    }
+
+    return count <= ((length - offset) / elementsize);
+}
+
+mesh_t *mesh_load(void *buffer, unsigned int size)
+{
+    if (buffer == 0 || ((uint32_t)buffer) & 3 || size < sizeof(mesh_asset_header_t))
+    {
+        return 0;
+    }
+
+    // Make sure every array lives inside the buffer so a truncated or corrupt mesh
+    // can't have us reading random memory later. Indexes are checked when allocating.
+    mesh_asset_header_t *header = buffer;
+    if (header->magic != MESH_ASSET_MAGIC || header->version != MESH_ASSET_VERSION || header->vertex_count > 65536)
+    {
+        return 0;
+    }
+    if (
+        !_mesh_asset_fits(header->position_offset, header->vertex_count, sizeof(vertex_t), 4, size) ||
+        !_mesh_asset_fits(header->uv_offset, header->vertex_count, sizeof(uint32_t), 4, size) ||
+        (header->normal_offset != 0 && !_mesh_asset_fits(header->normal_offset, header->vertex_count, sizeof(vector_t), 4, size)) ||
+        !_mesh_asset_fits(header->strip_offset, header->strip_count, sizeof(uint16_t), 2, size) ||
+        !_mesh_asset_fits(header->index_offset, header->index_count, sizeof(uint16_t), 2, size)
+    )
+    {
+        return 0;
+    }
+
+    uint8_t *data = buffer;
+    uint16_t *strips = (uint16_t *)(data + header->strip_offset);
+    unsigned int indexcount = 0;
+    for (unsigned int i = 0; i < header->strip_count; i++)
+    {
+        indexcount += strips[i];
+    }
+    if (indexcount != header->index_count)
+    {
+        return 0;
+    }
+
+    mesh_t *mesh = _mesh_alloc(header->vertex_count, (uint16_t *)(data + header->index_offset), strips, header->strip_count);
+    if (mesh == 0)
+    {
+        return 0;
+    }
+
+    mesh->positions = (vertex_t *)(data + header->position_offset);
+    mesh->uvs = (uint32_t *)(data + header->uv_offset);
+    mesh->normals = header->normal_offset ? (vector_t *)(data + header->normal_offset) : 0;
+    mesh->center.x = header->center_x;
+    mesh->center.y = header->center_y;
+    mesh->center.z = header->center_z;
+    mesh->radius = header->radius;
+
+    return mesh;
+}
+
+void mesh_free(mesh_t *mesh)
+{
+    if (mesh)
+    {
+        free(mesh->transformed);
+        free(mesh->flags);
+        free(mesh->commands);
+        free(mesh);
+    }
+}
+
+int mesh_transform(mesh_t *mesh)
+{
+    // Positions are either the start of each textured vertex or packed on their own.
+    float *src = mesh->verticies ? &mesh->verticies[0].x : &mesh->positions[0].x;
+    unsigned int stride = mesh->verticies ? (sizeof(textured_vertex_t) / sizeof(float)) : (sizeof(vertex_t) / sizeof(float));
+    vertex_t *dest = mesh->transformed;
+    uint8_t *flags = mesh->flags;
+
+    // Given a pre-set XMTRX, transform each unique vertex exactly once. This is the
+    // same math as matrix_perspective_transform_and_cull_vertex(), but we keep the
+    // per-vertex cull state around so each strip can be judged on its own.
+    for (unsigned int i = 0; i < mesh->vertexcount; i++)
+    {
+        register float x asm("fr0") = src[0];
+        register float y asm("fr1") = src[1];
+        register float z asm("fr2") = src[2];
+        register float w asm("fr3") = 1.0;
+        src += stride;
+
+        asm volatile(" \
+            ftrv xmtrx,fv0\n \
+            " :
+            "+f" (x), "+f" (y), "+f" (z), "+f" (w)
+        );
+
+        float invw = 1.0 / w;
+        dest[i].x = x * invw;
+        dest[i].y = y * invw;
+        dest[i].z = z * invw;
+
+        flags[i] = (z < 0.0 ? MESH_VERTEX_VISIBLE : 0) | (dest[i].z < 0.0 ? MESH_VERTEX_OUT_OF_BOUNDS : 0);
+    }
+
+    // Never display a strip if one or more point is out of bounds. Otherwise,
+    // display it if any one point is visible.
+    uint8_t *stripflags = &flags[mesh->vertexcount];
+    uint16_t *indices = mesh->indices;
+    int visible = 0;
+    for (unsigned int i = 0; i < mesh->stripcount; i++)
+    {
+        uint8_t combined = 0;
+        for (unsigned int j = 0; j < mesh->strips[i]; j++)
+        {
+            combined |= flags[indices[j]];
+        }
+        indices += mesh->strips[i];
+
+        if ((combined & MESH_VERTEX_OUT_OF_BOUNDS) || !(combined & MESH_VERTEX_VISIBLE))
+        {
+            stripflags[i] = MESH_STRIP_CULLED;
+        }
+        else
+        {
+            stripflags[i] = 0;
+            visible++;
+        }
+    }
+
+    return visible;
+}
+
+void ta_draw_mesh(uint32_t type, mesh_t *mesh, texture_description_t *texture)
+{
+    struct polygon_list_packed_color *mypoly = mesh->commands;
+    struct vertex_list_packed_color_32bit_uv *myvertex = (struct vertex_list_packed_color_32bit_uv *)(mypoly + 1);
+
+    mypoly->cmd =
+        TA_CMD_POLYGON |
+        type |
+        TA_CMD_POLYGON_SUBLIST |
+        TA_CMD_POLYGON_STRIPLENGTH_2 |
+        TA_CMD_POLYGON_PACKED_COLOR |
+        TA_CMD_POLYGON_TEXTURED |
+        (mesh->uvs ? TA_CMD_POLYGON_16BIT_UV : 0);
+    mypoly->mode1 =
+        TA_POLYMODE1_Z_GREATEREQUAL |
+        TA_POLYMODE1_CULL_CW;
+    mypoly->mode2 =
+        TA_POLYMODE2_MIPMAP_D_1_00 |
+        TA_POLYMODE2_TEXTURE_DECAL |
+        texture->uvsize |
+        TA_POLYMODE2_TEXTURE_CLAMP_U |
+        TA_POLYMODE2_TEXTURE_CLAMP_V |
+        TA_POLYMODE2_FOG_DISABLED |
+        TA_POLYMODE2_SRC_BLEND_SRC_ALPHA |
+        TA_POLYMODE2_DST_BLEND_INV_SRC_ALPHA;
+    mypoly->texture =
+        texture->texture_mode |
+        TA_TEXTUREMODE_ADDRESS(texture->vram_location);
+
+    // Build every visible strip straight out of the post-transform cache, so that
+    // the whole mesh goes to the TA in one go.
+    uint8_t *stripflags = &mesh->flags[mesh->vertexcount];
+    uint16_t *indices = mesh->indices;
+    int emitted = 0;
+    for (unsigned int i = 0; i < mesh->stripcount; i++)
+    {
+        unsigned int striplen = mesh->strips[i];
+        if (stripflags[i] & MESH_STRIP_CULLED)
+        {
+            indices += striplen;
+            continue;
+        }
+
+        for (unsigned int j = 0; j < striplen; j++)
+        {
+            uint16_t index = *indices++;
+            myvertex->cmd = (j == striplen - 1) ? (TA_CMD_VERTEX | TA_CMD_VERTEX_END_OF_STRIP) : TA_CMD_VERTEX;
+            myvertex->x = mesh->transformed[index].x;
+            myvertex->y = mesh->transformed[index].y;
+            myvertex->z = mesh->transformed[index].z;
+            if (mesh->uvs)
+            {
+                // Same layout as a 32-bit UV vertex apart from the texture coordinates,
+                // which are already packed the way the TA wants them.
+                struct vertex_list_packed_color_16bit_uv *packed = (struct vertex_list_packed_color_16bit_uv *)myvertex;
+                packed->uv = mesh->uvs[index];
+                packed->not_used = 0;
+            }
+            else
+            {
+                myvertex->u = mesh->verticies[index].u;
+                myvertex->v = mesh->verticies[index].v;
+            }
+            myvertex->mult_color = mesh->colors ? mesh->colors[index] : 0xffffffff;
+            myvertex->add_color = 0;
+            myvertex++;
+            emitted++;
+        }
+    }
+
+    if (emitted)
+    {
+        ta_commit_list(mesh->commands, sizeof(struct polygon_list_packed_color) + (sizeof(struct vertex_list_packed_color_32bit_uv) * emitted));
+    }
+}
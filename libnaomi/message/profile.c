@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "naomi/interrupt.h"
+#include "naomi/thread.h"
+#include "naomi/timer.h"
+#include "naomi/message/message.h"
+#include "naomi/message/packet.h"
+#include "../irqinternal.h"
+
+#define MESSAGE_HOST_PROFILE 0x7FFC
+
+// What kind of record a profile message holds, as the first word of the message.
+#define PROFILE_RECORD_SAMPLES 1
+#define PROFILE_RECORD_THREAD_NAME 2
+
+// How many histogram entries we send in one message, and how often we send them.
+#define PROFILE_SAMPLES_PER_MESSAGE 256
+#define PROFILE_SEND_INTERVAL 1000000
+
+// How long to back off when the host hasn't caught up with what we already sent.
+#define PROFILE_BACKOFF_INTERVAL 10000
+
+typedef struct
+{
+    uint32_t kind;
+    uint32_t dropped;
+    profile_sample_t samples[PROFILE_SAMPLES_PER_MESSAGE];
+} profile_samples_message_t;
+
+void _message_send_thread_names(uint16_t type, uint32_t kind);
+
+static uint32_t profile_thread = 0;
+static volatile int profile_running = 0;
+static unsigned int profile_entries = 0;
+
+static void __send_samples(profile_sample_t *samples, unsigned int count, profile_samples_message_t *msg)
+{
+    // Always send at least one message so that dropped samples are reported.
+    uint32_t dropped = msg->dropped;
+    unsigned int loc = 0;
+    do
+    {
+        unsigned int amount = count - loc;
+        if (amount > PROFILE_SAMPLES_PER_MESSAGE)
+        {
+            amount = PROFILE_SAMPLES_PER_MESSAGE;
+        }
+
+        // Unlike a trace, these samples are already out of the histogram, so wait for
+        // the host to catch up instead of throwing them away.
+        while (packetlib_stats().packets_pending_send >= (MAX_OUTSTANDING_PACKETS / 2))
+        {
+            thread_sleep(PROFILE_BACKOFF_INTERVAL);
+        }
+
+        msg->kind = PROFILE_RECORD_SAMPLES;
+        msg->dropped = dropped;
+        memcpy(msg->samples, samples + loc, sizeof(profile_sample_t) * amount);
+
+        uint32_t old_interrupts = irq_disable();
+        message_send(MESSAGE_HOST_PROFILE, msg, sizeof(uint32_t) * 2 + sizeof(profile_sample_t) * amount);
+        irq_restore(old_interrupts);
+
+        dropped = 0;
+        loc += amount;
+    } while (loc < count);
+}
+
+static void *__profile_thread(void *param)
+{
+    profile_sample_t *samples = malloc(sizeof(profile_sample_t) * profile_entries);
+    profile_samples_message_t *msg = malloc(sizeof(profile_samples_message_t));
+    if (samples == 0 || msg == 0)
+    {
+        _irq_display_invariant("memory failure", "could not get memory for profile redirect buffer!");
+    }
+
+    while (profile_running)
+    {
+        thread_sleep(PROFILE_SEND_INTERVAL);
+
+        // Names first, so the host knows about threads that only just showed up.
+        _message_send_thread_names(MESSAGE_HOST_PROFILE, PROFILE_RECORD_THREAD_NAME);
+
+        unsigned int count = profile_sample_read(samples, profile_entries, &msg->dropped);
+        if (count > 0 || msg->dropped > 0)
+        {
+            __send_samples(samples, count, msg);
+        }
+    }
+
+    free(msg);
+    free(samples);
+    return 0;
+}
+
+int message_profile_redirect_init(unsigned int rate, unsigned int flags, unsigned int entries)
+{
+    if (profile_thread)
+    {
+        // Already running.
+        return -1;
+    }
+
+    if (profile_sample_start(rate, flags, entries) != 0)
+    {
+        return -2;
+    }
+
+    profile_entries = entries;
+    profile_running = 1;
+    profile_thread = thread_create("profile redirect", __profile_thread, 0);
+    thread_start(profile_thread);
+    return 0;
+}
+
+void message_profile_redirect_free()
+{
+    if (profile_thread)
+    {
+        profile_running = 0;
+        thread_join(profile_thread);
+        profile_thread = 0;
+        profile_sample_stop();
+    }
+}
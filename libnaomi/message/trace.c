@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "naomi/interrupt.h"
+#include "naomi/thread.h"
+#include "naomi/trace.h"
+#include "naomi/message/message.h"
+#include "naomi/message/packet.h"
+#include "../irqinternal.h"
+
+#define MESSAGE_HOST_TRACE 0x7FFD
+
+// What kind of record a trace message holds, as the first word of the message.
+#define TRACE_RECORD_EVENTS 1
+#define TRACE_RECORD_THREAD_NAME 2
+
+// How many events we send in one message, and how often we check for more.
+#define TRACE_EVENTS_PER_MESSAGE 128
+#define TRACE_POLL_INTERVAL 50000
+
+// How often, in polling rounds, we resend the names of all threads.
+#define TRACE_NAME_INTERVAL 20
+
+typedef struct
+{
+    uint32_t kind;
+    uint32_t dropped;
+    trace_event_t events[TRACE_EVENTS_PER_MESSAGE];
+} trace_events_message_t;
+
+typedef struct
+{
+    uint32_t kind;
+    uint32_t id;
+    char name[64];
+} thread_name_message_t;
+
+static uint32_t trace_thread = 0;
+static volatile int trace_running = 0;
+
+static void __send(void *data, unsigned int length)
+{
+    uint32_t old_interrupts = irq_disable();
+    message_send(MESSAGE_HOST_TRACE, data, length);
+    irq_restore(old_interrupts);
+}
+
+// Send the name of every thread as a record of the given kind, so that host tools can
+// show names instead of thread IDs. Shared with the profile redirect.
+void _message_send_thread_names(uint16_t type, uint32_t kind)
+{
+    task_scheduler_info_t sched;
+    task_scheduler_info(&sched);
+
+    for (unsigned int i = 0; i < sched.num_threads; i++)
+    {
+        thread_info_t info;
+        if (thread_info(sched.thread_ids[i], &info))
+        {
+            thread_name_message_t msg;
+            msg.kind = kind;
+            msg.id = sched.thread_ids[i];
+            memcpy(msg.name, info.name, sizeof(msg.name));
+            msg.name[sizeof(msg.name) - 1] = 0;
+
+            uint32_t old_interrupts = irq_disable();
+            message_send(type, &msg, sizeof(msg));
+            irq_restore(old_interrupts);
+        }
+    }
+}
+
+static void *__trace_thread(void *param)
+{
+    trace_events_message_t *msg = malloc(sizeof(trace_events_message_t));
+    if (msg == 0)
+    {
+        _irq_display_invariant("memory failure", "could not get memory for trace redirect buffer!");
+    }
+
+    uint32_t cursor = 0;
+    unsigned int rounds = 0;
+    while (trace_running)
+    {
+        if ((rounds % TRACE_NAME_INTERVAL) == 0)
+        {
+            _message_send_thread_names(MESSAGE_HOST_TRACE, TRACE_RECORD_THREAD_NAME);
+        }
+        rounds++;
+
+        // Drain whatever the buffer has, but leave the host room to catch up if we have
+        // already queued up a lot of packets. Anything we fall behind on shows up as
+        // dropped events rather than stalling the program we are tracing.
+        while (trace_running && packetlib_stats().packets_pending_send < (MAX_OUTSTANDING_PACKETS / 2))
+        {
+            uint32_t dropped = 0;
+            unsigned int count = trace_read(&cursor, msg->events, TRACE_EVENTS_PER_MESSAGE, &dropped);
+            if (count == 0 && dropped == 0)
+            {
+                break;
+            }
+
+            msg->kind = TRACE_RECORD_EVENTS;
+            msg->dropped = dropped;
+            __send(msg, sizeof(uint32_t) * 2 + sizeof(trace_event_t) * count);
+        }
+
+        thread_sleep(TRACE_POLL_INTERVAL);
+    }
+
+    free(msg);
+    return 0;
+}
+
+void message_trace_redirect_init()
+{
+    if (!trace_thread)
+    {
+        trace_running = 1;
+        trace_thread = thread_create("trace redirect", __trace_thread, 0);
+        thread_start(trace_thread);
+    }
+}
+
+void message_trace_redirect_free()
+{
+    if (trace_thread)
+    {
+        trace_running = 0;
+        thread_join(trace_thread);
+        trace_thread = 0;
+    }
+}
@@ -20,6 +20,12 @@ void console_free();
 // manually call it for some reason.
 void console_render();
 
+// Render the console using the TA instead of drawing it in software. This must be called
+// inside a ta_commit_begin() and ta_commit_end() pair for the transparent list, before
+// calling ta_render(). If you call this in a frame, the software render that normally
+// happens in video_display_on_vblank() will be skipped for that frame.
+void console_render_ta();
+
 // Show or hide an initialized console. Note that setting a console visibility to 0 will
 // make calls to console_render() into a no-op. Setting visibility to 0 will also cause
 // video_display_on_vblank() to skip rendering the console.
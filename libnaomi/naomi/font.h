@@ -1,7 +1,3 @@
-#ifdef FEATURE_FREETYPE
-// Only provide this stuff if freetype is installed. Otherwise just don't do anything with it.
-// This is so that stage 1 libnaomi.a can be built, and then freetype built against it, before
-// libnaomi is built again.
 #ifndef __FONT_H
 #define __FONT_H
 
@@ -12,6 +8,7 @@ extern "C" {
 #include <stdint.h>
 
 #define FONT_CACHE_SIZE 4096
+#define FONT_CACHE_BUCKETS 1024
 #define MAX_FALLBACK_SIZE 10
 
 typedef struct
@@ -21,6 +18,11 @@ typedef struct
     void **cache;
     unsigned int cachesize;
     unsigned int cacheloc;
+    void *cachehead;
+    void *cachetail;
+    const void *backend;
+    void *bitmap;
+    unsigned int sdfsize;
 } font_t;
 
 typedef struct
@@ -29,22 +31,46 @@ typedef struct
     unsigned int height;
 } font_metrics_t;
 
-// API that can be used to load and interact with fonts using the freetype library.
+// API that can be used to load and interact with fonts. Fonts can either come
+// from TTF/OTF files rasterized at runtime using the freetype library, or from
+// pre-rasterized bitmap font files generated offline by tools/fontgen.py.
+
+#ifdef FEATURE_FREETYPE
+// Only provide this stuff if freetype is installed. This is so that stage 1 libnaomi.a
+// can be built, and then freetype built against it, before libnaomi is built again.
 
 // Load a new fontface and return a handle to it. If there was not enough memory for
 // this fontface, returns a null pointer, so be sure to check for that.
 font_t *font_add(void *buffer, unsigned int size);
 
-// Discard a previously loaded fontface.
-void font_discard(font_t *fontface);
-
 // Add a fallback fontface to a previously created font for rendering
 // characters that do not appear in the original font. Returns zero
 // on success or a negative error value on failure.
 int font_add_fallback(font_t *fontface, void *buffer, unsigned int size);
+#endif
+
+// Load a pre-rasterized bitmap font generated by tools/fontgen.py and return a
+// handle to it. The font can be used anywhere a freetype font can, including
+// video_draw_text(), ta_draw_text() and font_get_text_metrics(), but never calls
+// into freetype so it doesn't pull it into your binary. The buffer must be 4-byte
+// aligned and must stay valid until you discard the font since glyphs are drawn
+// directly out of it. The font starts out at the first size baked into the file.
+// Returns a null pointer if the buffer isn't a valid font or there wasn't enough memory.
+//
+// Glyphs are stored as individual tightly packed 8-bit bitmaps rather than as one
+// atlas image per size. Nothing reads a whole atlas at once: video_draw_text() blits
+// glyph by glyph, and ta_draw_text() already converts each glyph to 4444 and packs
+// it into shared texture sheets the first time it is drawn. Per-glyph bitmaps cost
+// width * height bytes each with no packing slack, and cost the TA the same single
+// sprite upload per glyph that an atlas would.
+font_t *font_add_bitmap(void *buffer, unsigned int size);
+
+// Discard a previously loaded fontface.
+void font_discard(font_t *fontface);
 
 // Set the pixel size for a particular font. Returns zero on success
-// or a negative error value on failure.
+// or a negative error value on failure. For bitmap fonts, the size must
+// be one of the sizes baked into the font file.
 int font_set_size(font_t *fontface, unsigned int size);
 
 // Given a previously set up font, return the metrics for a character.
@@ -60,4 +86,3 @@ font_metrics_t font_get_text_metrics(font_t *fontface, const char *msg, ...);
 #endif
 
 #endif
-#endif
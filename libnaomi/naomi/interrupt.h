@@ -70,6 +70,59 @@ typedef struct
 // of detail necessary to make much use of it.
 irq_stats_t irq_stats();
 
+// Interrupt timing, for tracking down things like vblank jitter or audio hiccups caused by
+// code that runs for a long time with interrupts disabled or by slow interrupt handlers.
+// Each histogram bucket counts events that took a range of microseconds. Bucket 0 counts
+// anything under 2us, and every bucket after that counts from 2^n up to 2^(n+1) us, with
+// the last bucket also counting anything longer.
+#define IRQ_HISTOGRAM_BUCKETS 16
+
+typedef struct
+{
+    // The number of events measured.
+    uint32_t count;
+
+    // The longest event measured, in microseconds.
+    uint32_t max;
+
+    // The sum of all events measured in microseconds, for working out an average.
+    uint64_t total;
+
+    // The number of events that landed in each bucket.
+    uint32_t buckets[IRQ_HISTOGRAM_BUCKETS];
+} irq_histogram_t;
+
+typedef struct
+{
+    // The time from the hardware raising the interrupt to us handling it. This is only
+    // measured for sources whose hardware lets us work out when that happened, and the
+    // count will stay at zero for the rest.
+    irq_histogram_t latency;
+
+    // The time spent inside the interrupt handler for this source, including any
+    // scheduling that happened as a result.
+    irq_histogram_t duration;
+} irq_timing_t;
+
+// Sources that timing is kept for. The three hardware timers are used by the profile
+// timer, the scheduler's preemption and the sampling profiler. Everything that HOLLY
+// raises is counted under IRQ_TIMING_HOLLY, and vblank in and out are also counted
+// on their own so that their latency can be seen. Syscalls are counted for how long
+// they take, since they run as an exception with interrupts disabled.
+#define IRQ_TIMING_TMU0 0
+#define IRQ_TIMING_TMU1 1
+#define IRQ_TIMING_TMU2 2
+#define IRQ_TIMING_HOLLY 3
+#define IRQ_TIMING_VBLANK_IN 4
+#define IRQ_TIMING_VBLANK_OUT 5
+#define IRQ_TIMING_SYSCALL 6
+#define IRQ_TIMING_MAX 7
+
+// Grab the timing histograms for one of the above sources since startup or the last
+// irq_timing_reset(). Returns nonzero on success, or zero if the source is invalid.
+int irq_timing(unsigned int source, irq_timing_t *timing);
+void irq_timing_reset();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,62 @@
+#ifndef __LIGHT_H
+#define __LIGHT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "naomi/color.h"
+#include "naomi/matrix.h"
+#include "naomi/vector.h"
+
+// The types of light that can be evaluated. Ambient lights light every vertex equally,
+// directional lights shine from infinitely far away in one direction, and point lights
+// shine outward from a position and fade out to nothing at their radius.
+#define LIGHT_TYPE_AMBIENT 0
+#define LIGHT_TYPE_DIRECTIONAL 1
+#define LIGHT_TYPE_POINT 2
+
+// The most lights that can be evaluated in a single call.
+#define LIGHT_MAX 8
+
+typedef struct
+{
+    // One of the above LIGHT_TYPE_* defines.
+    int type;
+
+    // The color of the light. Alpha is ignored.
+    color_t color;
+
+    // For directional lights, the direction the light is travelling in, which does
+    // not need to be normalized. For point lights, the position of the light. Ignored
+    // for ambient lights. This should be in the same space as the verticies and normals
+    // being lit, which is usually model space.
+    vector_t vector;
+
+    // For point lights, the distance at which the light has faded out entirely.
+    float radius;
+} light_t;
+
+// Given up to LIGHT_MAX lights, a set of verticies and a normalized normal for each
+// vertex, light each vertex and write a packed ARGB color suitable for the mult_color
+// of a packed color TA vertex into colors. The lit color is clamped and then multiplied
+// with base, whose alpha is passed through untouched.
+void light_vertex_colors(light_t *lights, int numlights, color_t base, vertex_t *verticies, vector_t *normals, uint32_t *colors, int n);
+
+// The same as light_vertex_colors(), but writes a single intensity from 0.0 to 1.0 per
+// vertex for use with intensity color TA polygons, where the polygon header supplies the
+// color. Colored lights contribute the average of their red, green and blue channels.
+void light_vertex_intensities(light_t *lights, int numlights, vertex_t *verticies, vector_t *normals, float *intensities, int n);
+
+// The same as light_vertex_colors(), but also transforms each vertex from model space to
+// screen space with the system matrix and writes the result to dest, the same as
+// matrix_perspective_transform_vertex() would. Each vertex and normal is only read once,
+// so this is cheaper than lighting and transforming as separate passes.
+void light_perspective_transform_vertex(light_t *lights, int numlights, color_t base, vertex_t *src, vector_t *normals, vertex_t *dest, uint32_t *colors, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -45,10 +45,27 @@ typedef struct
     float v;
 } textured_vertex_t;
 
+// Type definition for a rotation quaternion.
+typedef struct
+{
+    float x;
+    float y;
+    float z;
+    float w;
+} quaternion_t;
+
 // Dirty trick to make indexing programatically into matrixes possible.
 // This is zero indexed, so a11 would be matrix_index(m, 0, 0).
 #define matrix_index(matrix, row, col) (*((&(matrix).a11) + ((row) * 4) + (col)))
 
+// The system matrix lives in the SH-4's XMTRX registers, which are saved and restored
+// along with the rest of the floating point registers on every interrupt and thread
+// switch. That means each thread has its own system matrix, and none of the functions
+// here need to disable interrupts while they work, so large batches of transforms don't
+// hold up vblank, audio or timer interrupts. A newly created thread starts with an all
+// zero system matrix. Note that the matrix stack used by matrix_push() and matrix_pop()
+// is shared between every thread.
+
 // Initialize the system matrix with a 4x4 identity matrix.
 void matrix_init_identity();
 
@@ -87,6 +104,14 @@ void matrix_rotate_x(float degrees);
 void matrix_rotate_y(float degrees);
 void matrix_rotate_z(float degrees);
 
+// Compute the sine and cosine of an angle in degrees using the hardware's fsca
+// instruction, which is far faster than sin() and cos() but only accurate to
+// about 1 part in a million. The rotation functions above use this internally.
+void matrix_sincos(float degrees, float *sine, float *cosine);
+
+// Rotate the system matrix by a unit quaternion.
+void matrix_rotate_quaternion(quaternion_t *quat);
+
 // Rotate the system matrix about a given axis with a given origin and given degrees, where 0.0 is identity rotation.
 void matrix_rotate_origin_x(vertex_t *origin, float degrees);
 void matrix_rotate_origin_y(vertex_t *origin, float degrees);
@@ -104,6 +129,29 @@ void matrix_translate_x(float amount);
 void matrix_translate_y(float amount);
 void matrix_translate_z(float amount);
 
+// Set a quaternion to the identity rotation.
+void quaternion_identity(quaternion_t *quat);
+
+// Make a quaternion that rotates the given number of degrees about an axis,
+// which should be normalized.
+void quaternion_from_axis_angle(quaternion_t *quat, vertex_t *axis, float degrees);
+
+// Multiply two quaternions, storing a * b in result. This combines the two
+// rotations such that b is applied first. Result can be the same as a or b.
+void quaternion_multiply(quaternion_t *result, quaternion_t *a, quaternion_t *b);
+
+// Normalize a quaternion so that it is a pure rotation again. Repeatedly
+// multiplying quaternions slowly drifts away from unit length.
+void quaternion_normalize(quaternion_t *quat);
+
+// Spherically interpolate between two unit quaternions, where a t of 0.0 gives
+// a and a t of 1.0 gives b. This always takes the shortest path between them.
+void quaternion_slerp(quaternion_t *result, quaternion_t *a, quaternion_t *b, float t);
+
+// Convert a unit quaternion into a 4x4 rotation matrix. This produces the same
+// matrix as matrix_rotate_x/y/z() would for the same axis and angle.
+void quaternion_to_matrix(matrix_t *matrix, quaternion_t *quat);
+
 // Transform a series of x, y, z coordinates from one worldspace to another (useful for
 // rotating/transforming/scaling objects in worldspace) by extending them to homogenous
 // coordinates and then multiplying them by the system matrix. Note that this does not
@@ -0,0 +1,94 @@
+#ifndef __MESH_H
+#define __MESH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "naomi/matrix.h"
+#include "naomi/vector.h"
+#include "naomi/ta.h"
+
+// An indexed triangle strip mesh. Verticies shared between strips are stored
+// once, and the strips refer to them by index. Transforming the mesh runs each
+// unique vertex through the system matrix exactly once, and drawing it emits
+// every strip straight out of that post-transform cache, so a typical closed
+// mesh needs far fewer matrix multiplies than drawing its strips one by one.
+typedef struct
+{
+    // The unique verticies making up this mesh, in model space.
+    textured_vertex_t *verticies;
+    unsigned int vertexcount;
+
+    // Meshes loaded with mesh_load() instead keep positions and texture coordinates
+    // in separate arrays, with each texture coordinate pair packed into the TA's 16-bit
+    // UV format. In that case, verticies is a null pointer. Normals are only available
+    // if the mesh asset was generated with them, and are otherwise a null pointer.
+    vertex_t *positions;
+    uint32_t *uvs;
+    vector_t *normals;
+
+    // Optional packed ARGB colors, one per vertex, that each vertex's texture is multiplied
+    // by when drawing. Point this at the output of light_vertex_colors() to draw a lit mesh,
+    // or at a constant color for every vertex to tint it. This is never allocated or freed
+    // for you, and when it is a null pointer the mesh is drawn unlit.
+    uint32_t *colors;
+
+    // Every strip's indexes into verticies, laid end to end, along with how
+    // many indexes each of the stripcount strips uses.
+    uint16_t *indices;
+    uint16_t *strips;
+    unsigned int stripcount;
+    unsigned int indexcount;
+
+    // A sphere in model space that contains every vertex in the mesh, useful for
+    // deciding whether to bother transforming and drawing it at all.
+    vertex_t center;
+    float radius;
+
+    // Screen space positions of each vertex from the last mesh_transform().
+    vertex_t *transformed;
+
+    // Internal bookkeeping, do not modify.
+    uint8_t *flags;
+    void *commands;
+} mesh_t;
+
+// Create a mesh from a vertex array, a list of strip indexes and a list of strip
+// lengths. The arrays are not copied, so they must remain valid until the mesh is
+// freed, but they can be modified in between draws to animate the mesh. Every strip
+// must be at least 3 indexes long and every index must refer to a valid vertex.
+// Returns a null pointer if the mesh is invalid or we ran out of memory.
+mesh_t *mesh_create(textured_vertex_t *verticies, unsigned int vertexcount, uint16_t *indices, uint16_t *strips, unsigned int stripcount);
+
+// Load a mesh that was generated with tools/meshgen.py, which converts OBJ and glTF
+// models into pre-stripified, vertex cache ordered triangle strips. The positions,
+// texture coordinates and strips are used in place, so the buffer must be 4-byte
+// aligned and must remain valid until the mesh is freed. This makes it suitable for
+// loading straight out of a file read from romfs or data linked into the executable.
+// Returns a null pointer if the data is not a valid mesh or we ran out of memory.
+mesh_t *mesh_load(void *buffer, unsigned int size);
+
+// Free a mesh created with mesh_create() or mesh_load(). This does not free the
+// arrays or buffer that were passed in.
+void mesh_free(mesh_t *mesh);
+
+// Transform every unique vertex in the mesh from model space to screen space using
+// the system matrix, the same as matrix_perspective_transform_textured_vertex().
+// Returns the number of strips that are possibly visible, culling strips that have
+// a vertex behind the camera the same way matrix_perspective_transform_and_cull_vertex()
+// would.
+int mesh_transform(mesh_t *mesh);
+
+// Draw a mesh that was transformed with mesh_transform() to the TA in a single batch.
+// The type should be one of TA_CMD_POLYGON_TYPE_OPAQUE, TA_CMD_POLYGON_TYPE_TRANSPARENT
+// or TA_CMD_POLYGON_TYPE_PUNCHTHRU. Culled strips are skipped. Each vertex is colored
+// from the mesh's colors array if it has one.
+void ta_draw_mesh(uint32_t type, mesh_t *mesh, texture_description_t *texture);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
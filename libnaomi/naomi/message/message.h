@@ -33,6 +33,21 @@ int message_recv(uint16_t *type, void ** data, unsigned int *length);
 void message_stdio_redirect_init();
 void message_stdio_redirect_free();
 
+// Stream the scheduler trace to a host program such as tracedump, which turns it into
+// a Chrome trace you can load in a browser. This starts a background thread that sends
+// whatever has been recorded every so often, along with the names of all threads. Call
+// trace_init() yourself first to choose how large the buffer is and start recording.
+void message_trace_redirect_init();
+void message_trace_redirect_free();
+
+// Run the sampling profiler from timer.h and stream its samples to a host program such
+// as profiledump, which symbolizes them and writes folded stacks for a flame graph. The
+// rate, flags and entries are passed on to profile_sample_start(). This starts a background
+// thread that sends the samples collected so far about once a second. Returns 0 on success
+// or a negative value if the profiler is already running or could not be started.
+int message_profile_redirect_init(unsigned int rate, unsigned int flags, unsigned int entries);
+void message_profile_redirect_free();
+
 #ifdef __cplusplus
 }
 #endif
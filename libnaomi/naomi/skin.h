@@ -0,0 +1,66 @@
+#ifndef __SKIN_H
+#define __SKIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "naomi/matrix.h"
+
+// The most bones a single vertex can be influenced by, and the most bones a
+// single skin can be bound to.
+#define SKIN_MAX_INFLUENCES 4
+#define SKIN_MAX_BONES 256
+
+// Which bones influence a single vertex and by how much. Unused influences should
+// have a weight of 0.0. Weights don't need to add up to 1.0 since they are normalized
+// when the skin is created, but a vertex with no weight at all is left in its bind pose.
+typedef struct
+{
+    uint8_t bones[SKIN_MAX_INFLUENCES];
+    float weights[SKIN_MAX_INFLUENCES];
+} skin_weight_t;
+
+// A skin binding a set of verticies to a set of bones. When created, the per-vertex
+// weights are regrouped by bone, so that transforming only needs to load each bone
+// matrix into XMTRX once and then run every vertex it influences through it.
+typedef struct
+{
+    unsigned int vertexcount;
+    unsigned int bonecount;
+
+    // Internal bookkeeping, do not modify.
+    void *influences;
+    unsigned int *offsets;
+    uint8_t *skinned;
+} skin_t;
+
+// Create a skin for vertexcount verticies, given a skin_weight_t for each of them, bound
+// to bonecount bones. The weights are copied so they do not need to outlive the skin.
+// Returns a null pointer if any influence refers to a bone past bonecount or if we ran
+// out of memory.
+skin_t *skin_create(skin_weight_t *weights, unsigned int vertexcount, unsigned int bonecount);
+
+// Free a skin created with skin_create().
+void skin_free(skin_t *skin);
+
+// Blend the bind pose verticies in src against the current bone matrices, writing the
+// posed verticies to dest. Each bone matrix should take a vertex from bind pose to its
+// posed position in model space, which usually means the bone's current transform
+// multiplied by the inverse of its bind transform. Texture coordinates are copied from
+// src untouched. This makes use of XMTRX for each bone in turn, so the system matrix
+// is saved and restored around the call. The dest array can be the verticies of a
+// mesh_t, which then only needs a mesh_transform() and ta_draw_mesh() to display.
+void skin_transform(skin_t *skin, matrix_t *bones, textured_vertex_t *src, textured_vertex_t *dest);
+
+// The same as skin_transform(), but implemented in plain C without touching XMTRX. This
+// is much slower, but gives results that do not depend on the SH-4 FPU, so it is useful
+// as a reference for verifying the fast path or when building for the host.
+void skin_transform_reference(skin_t *skin, matrix_t *bones, textured_vertex_t *src, textured_vertex_t *dest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,7 +1,3 @@
-#ifdef FEATURE_FREETYPE
-// Only provide this stuff if freetype is installed. Otherwise just don't do anything with it.
-// This is so that stage 1 libnaomi.a can be built, and then freetype built against it, before
-// libnaomi is built again.
 #ifndef __TA_FREETYPE_H
 #define __TA_FREETYPE_H
 
@@ -26,9 +22,95 @@ int ta_draw_character(int x, int y, font_t *fontface, color_t color, int ch);
 // orientation aware. It also takes standard printf-style format strings.
 int ta_draw_text(int x, int y, font_t *fontface, color_t color, const char * const msg, ...);
 
+// Glyphs drawn with the TA are packed into shared texture sheets in TEXRAM, which
+// are allocated as needed and given back once every glyph on them is evicted.
+// This sets the UV size of sheets allocated from now on, and must be a valid
+// texture size between 8 and 1024. Larger sheets mean fewer sprite headers when
+// drawing but more TEXRAM spent up front. Defaults to 256. Returns 0 on success
+// or a negative value if the size isn't valid.
+int ta_font_set_sheet_size(int uvsize);
+
+typedef struct
+{
+    // The UV size of this sheet.
+    int uvsize;
+    // How many glyphs currently live on this sheet.
+    int glyphs;
+    // Pixels covered by live glyphs, pixels the packer has given out (including
+    // gaps it can no longer fill) and the total pixels on the sheet.
+    unsigned int used;
+    unsigned int allocated;
+    unsigned int total;
+} ta_font_sheet_stats_t;
+
+// Fill in occupancy statistics for up to maxsheets glyph sheets, newest first.
+// Returns the total number of sheets currently allocated, which may be more than
+// maxsheets. Pass a null pointer for stats to only get the count.
+int ta_font_sheet_stats(ta_font_sheet_stats_t *stats, int maxsheets);
+
+// Given a previously set up font, draw a character or string using signed distance
+// field glyphs. Instead of rasterizing a new glyph set for every size, each glyph is
+// rasterized once at the font's sdfsize (32 pixels if left at zero) and converted to
+// a distance field, which can then be drawn at any size without touching the cache.
+// This makes it suitable for animated or zooming text. The size is the line height
+// to draw at and can be fractional, and the font's own size is left untouched. For
+// pre-rasterized bitmap fonts, sdfsize must be one of the baked sizes. Note that SDF
+// glyphs go to the punch-through list, so they must be drawn in their own
+// ta_commit_begin() section apart from transparent polygons such as ta_draw_text(),
+// and they rely on the half alpha punch-through cutoff described in ta.h.
+int ta_draw_sdf_character(int x, int y, font_t *fontface, float size, color_t color, int ch);
+int ta_draw_sdf_text(int x, int y, font_t *fontface, float size, color_t color, const char * const msg, ...);
+
+// A prebuilt text object, for strings that get drawn every frame but rarely change,
+// such as HUD labels and score counters. The string is laid out once into a ready to
+// submit sprite buffer, and updating it only rebuilds the glyphs that actually changed.
+// Note that the font used to create a text object must outlive it, and the text object
+// must be freed before font_add_fallback() or font_discard() is called on that font.
+typedef struct
+{
+    // The font this text object lays out glyphs with.
+    font_t *fontface;
+
+    // The maximum number of codepoints this text object can hold, and how many
+    // it currently holds. Longer strings are truncated.
+    unsigned int maxlength;
+    unsigned int length;
+
+    // Where and in what color the text was last laid out.
+    int x;
+    int y;
+    color_t color;
+
+    // Internal bookkeeping, do not modify.
+    void *glyphs;
+    void *commands;
+    unsigned int commandlength;
+    float z;
+    int vertical;
+    int dirty;
+} ta_text_t;
+
+// Create a text object that can hold up to maxlength unicode codepoints, using
+// a previously set up font. Returns a pointer to the text object on success or
+// a NULL pointer if we couldn't allocate memory.
+ta_text_t *ta_text_create(font_t *fontface, unsigned int maxlength);
+
+// Lay out a string into a text object. This takes the same arguments as ta_draw_text(),
+// but only glyphs that differ from the previous string (or that moved) are rebuilt, so
+// calling this every frame with a counter only costs as much as the digits that changed.
+// Returns 0 on success or a negative value on failure.
+int ta_text_set(ta_text_t *text, int x, int y, color_t color, const char * const msg, ...);
+
+// Draw a text object that was laid out with ta_text_set(). The entire string is
+// submitted to the TA in one batch. Like ta_draw_text(), this must be called
+// inside a ta_commit_begin() section and is monitor orientation aware.
+void ta_text_draw(ta_text_t *text);
+
+// Free a text object created with ta_text_create().
+void ta_text_free(ta_text_t *text);
+
 #ifdef __cplusplus
 }
 #endif
 
 #endif
-#endif
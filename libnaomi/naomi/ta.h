@@ -99,6 +99,25 @@ struct vertex_list_packed_color_32bit_uv
     unsigned int add_color;
 };
 
+/*
+ * Command: Vertex
+ *
+ * Usable with packed color polygons as well as intensity polygons, when
+ * the polygon header requests 16-bit UVs.
+ */
+struct vertex_list_packed_color_16bit_uv
+{
+    unsigned int cmd;
+    float x;
+    float y;
+    float z;
+    /* The upper 16 bits of the U and V floats, with U in the high half. */
+    unsigned int uv;
+    int not_used;
+    unsigned int mult_color;
+    unsigned int add_color;
+};
+
 /*
  * Command: Vertex
  *
@@ -142,6 +161,12 @@ struct vertex_list_quad
 #define TA_CMD_MODIFIER_TYPE_TRANSPARENT  0x03000000
 #define TA_CMD_POLYGON_TYPE_PUNCHTHRU     0x04000000
 
+// Punch-through polygons are drawn fully opaque where their alpha is at or above a single
+// global cutoff, and not at all below it. libnaomi sets that cutoff to 0x80 (half alpha)
+// at startup instead of leaving the hardware default, since that is where the signed
+// distance field text in ta-freetype.h puts the edges of its glyphs. Keep this in mind
+// when authoring punch-through textures, since pixels under half alpha will be dropped.
+
 // Defines for the next byte of the TA cmd.
 #define TA_CMD_POLYGON_SUBLIST            0x00800000
 #define TA_CMD_POLYGON_STRIPLENGTH_1      (0<<18)
@@ -454,6 +479,17 @@ void ta_draw_triangle_strip_uv(uint32_t type, uint32_t striplen, vertex_t *verti
 void ta_draw_colored_triangle_strip(uint32_t type, uint32_t striplen, textured_vertex_t *verticies, texture_description_t *texture, color_t addcolor, color_t multcolor);
 void ta_draw_colored_triangle_strip_uv(uint32_t type, uint32_t striplen, vertex_t *verticies, uv_t *uvcoords, texture_description_t *texture, color_t addcolor, color_t multcolor);
 
+// Draw a debug character, string or formatted string of a certain color to the screen using
+// the TA. This uses the same built-in 8x8 fixed-width font as video_draw_debug_character()
+// and video_draw_debug_text(), but instead of drawing pixel by pixel to the framebuffer, the
+// font is uploaded once to texture RAM and each character is submitted as a sprite. All of
+// the characters in a single ta_draw_debug_text() call share one sprite header. These are
+// drawn as transparent polygons, so they must be called inside a ta_commit_begin() and
+// ta_commit_end() pair for the transparent list. This is orientation aware. Note that this
+// only supports ASCII printable characters.
+void ta_draw_debug_character(int x, int y, color_t color, char ch);
+void ta_draw_debug_text(int x, int y, color_t color, const char * const msg, ...);
+
 // Include the freetype extensions for you, so you don't have to include ta-freetype.h yourself.
 #include "ta-freetype.h"
 
@@ -25,9 +25,11 @@ void global_counter_free(void *counter);
 // semaphore will block until the semaphore is available. Calling release on a semaphore
 // signals that we no longer need the resource. Semaphores cooperate with the thread
 // scheduler so blocking on an acquire will schedule other threads to run, as will releasing
-// a semaphore schedule any blocked threads to run.
-#define MAX_SEMAPHORES 64
-
+// a semaphore schedule any blocked threads to run. semaphore_acquire_timeout() gives up
+// after the specified number of microseconds, returning nonzero if it acquired the
+// semaphore and zero if it timed out. A timeout of zero waits forever. There is no fixed
+// limit on the number of semaphores, mutexes and conditions that can exist at once, they
+// are allocated as needed and are only limited by available memory.
 typedef struct
 {
     uint32_t id;
@@ -35,6 +37,7 @@ typedef struct
 
 void semaphore_init(semaphore_t *semaphore, uint32_t count);
 void semaphore_acquire(semaphore_t *semaphore);
+int semaphore_acquire_timeout(semaphore_t *semaphore, uint32_t us);
 void semaphore_release(semaphore_t *semaphore);
 void semaphore_free(semaphore_t *semaphore);
 
@@ -50,9 +53,9 @@ void semaphore_free(semaphore_t *semaphore);
 // context. Not also that you can recursively call mutex_lock() as mutexes support
 // recursive locking. So, within a single thread, you can lock and unlock a mutex
 // multiple times without deadlock. This also goes for mutex_trylock() which will
-// succeed if recursively called.
-#define MAX_MUTEXES 64
-
+// succeed if recursively called. Much like semaphores, mutex_lock_timeout() gives up
+// after the specified number of microseconds, returning nonzero if it locked the mutex
+// and zero if it timed out. A timeout of zero waits forever.
 typedef struct
 {
     uint32_t id;
@@ -61,14 +64,36 @@ typedef struct
 void mutex_init(mutex_t *mutex);
 int mutex_try_lock(mutex_t *mutex);
 void mutex_lock(mutex_t *mutex);
+int mutex_lock_timeout(mutex_t *mutex, uint32_t us);
 void mutex_unlock(mutex_t *mutex);
 void mutex_free(mutex_t *mutex);
 
+// Condition variables, for blocking until some state protected by a mutex changes. You
+// must hold the mutex when calling condition_wait(), which gives up the mutex and puts
+// the thread to sleep in one step, and takes the mutex back before returning once another
+// thread calls condition_signal() to wake the longest waiting thread or condition_broadcast()
+// to wake all of them. As with any condition variable, always re-check your state in a loop
+// after waking up. condition_wait_timeout() additionally gives up after the specified number
+// of microseconds, returning nonzero if it was signalled and zero if it timed out. A timeout
+// of zero waits forever. Never free a condition that threads are still waiting on.
+typedef struct
+{
+    uint32_t id;
+} condition_t;
+
+void condition_init(condition_t *condition);
+void condition_wait(condition_t *condition, mutex_t *mutex);
+int condition_wait_timeout(condition_t *condition, mutex_t *mutex, uint32_t us);
+void condition_signal(condition_t *condition);
+void condition_broadcast(condition_t *condition);
+void condition_free(condition_t *condition);
+
 // Simple threads. We do not enable the MMU nor do we have any other process isolation.
 // Threads share the same global memory space and heap, although malloc/free are thread
 // safe.
 #define MAX_THREADS 64
 #define THREAD_STACK_SIZE (128 * 1024)
+#define THREAD_STACK_SIZE_MIN (4 * 1024)
 
 typedef struct
 {
@@ -89,6 +114,10 @@ typedef struct
 
     // The percentage of CPU this thread has consumed recently, between 0 and 1 inclusive.
     float cpu_percentage;
+
+    // The size in bytes of the stack that was allocated for this thread, or 0 for the
+    // main thread which runs on the stack set up at boot.
+    uint32_t stack_size;
 } thread_info_t;
 
 // Sentinel value returned by thread_join() if the thread was cancelled instead of exiting
@@ -102,9 +131,23 @@ typedef struct
 // value, call thread_join() in the thread that you created the thread in. This will block
 // until the thread is done, and return the value that the thread function returned.
 uint32_t thread_create(char *name, thread_func_t function, void *param);
+
+// Identical to thread_create(), but with control over the size of the thread's stack
+// instead of getting THREAD_STACK_SIZE. Sizes up to THREAD_STACK_SIZE are rounded up to
+// a power of two no smaller than THREAD_STACK_SIZE_MIN, larger sizes are only rounded up
+// to a multiple of THREAD_STACK_SIZE_MIN, and a stack_size of zero gets the default. A
+// few stacks of destroyed threads up to THREAD_STACK_SIZE are kept around and handed to
+// new threads of the same size, so creating and destroying short-lived worker threads
+// does not churn the heap.
+uint32_t thread_create_ex(char *name, thread_func_t function, void *param, uint32_t stack_size);
 void *thread_join(uint32_t tid);
 void thread_destroy(uint32_t tid);
 
+// Give every stack that is being kept around for reuse back to the heap, returning the
+// number of bytes freed. Useful after a burst of worker threads is done, or before a
+// large allocation.
+uint32_t thread_stack_trim();
+
 // The minimum and maximum priorities allowed for threads.
 #define MAX_PRIORITY 1000
 #define MIN_PRIORITY -1000
@@ -170,6 +213,22 @@ void thread_wait_vblank_out();
 // to return yourself to normal priority after finishing vblank-dependent work.
 void thread_wait_hblank();
 
+// Wait for whichever of several things happens first: acquiring a semaphore, any of the
+// interrupts in the interrupts mask, or the specified number of microseconds elapsing. Pass
+// a NULL semaphore, a zero mask or a zero timeout to leave any of them out. Returns which
+// one woke the thread up, so for instance thread_wait_any(&work, WAIT_ANY_VBLANK_IN, 2000)
+// will return WAIT_ANY_SEMAPHORE if it acquired the semaphore (which you must then release
+// as normal), WAIT_ANY_VBLANK_IN if we entered vblank, or WAIT_ANY_TIMEOUT if 2ms passed
+// without either. Much like the individual waits, if woken by an interrupt your thread is
+// guaranteed priority for PRIORITY_INVERSION_TIME microseconds.
+#define WAIT_ANY_TIMEOUT 0
+#define WAIT_ANY_SEMAPHORE 1
+#define WAIT_ANY_VBLANK_IN 2
+#define WAIT_ANY_VBLANK_OUT 4
+#define WAIT_ANY_HBLANK 8
+
+int thread_wait_any(semaphore_t *semaphore, unsigned int interrupts, uint32_t us);
+
 // Exit a thread early, returning return value. Identical to letting control reach the end
 // of the thread function with a return statement.
 void thread_exit(void *retval);
@@ -45,6 +45,46 @@ int profile_start();
 // and still return accurate results. This is why the return value is a 64-bit integer.
 uint64_t profile_end(int profile);
 
+// Statistical sampling profiler. Once started, a hardware timer interrupts the system at
+// the requested rate and records where the running thread was, building up a histogram of
+// where time is actually being spent without needing to know where to put profile_start()
+// and profile_end() calls ahead of time. Code that runs with interrupts disabled can't be
+// sampled until it re-enables them, so it shows up as the spot where that happens. Use
+// message_profile_redirect_init() from libnaomimessage along with the profiledump host
+// tool to turn the samples into folded stacks for a flame graph.
+typedef struct
+{
+    // The thread that was running when the sample was taken.
+    uint32_t thread;
+
+    // The address the thread was executing.
+    uint32_t pc;
+
+    // The procedure return address at that point, if PROFILE_SAMPLE_CALLER was requested,
+    // or 0 otherwise. This is exact for leaf functions, but functions that call others
+    // reuse the register so it can point at something they called earlier instead.
+    uint32_t pr;
+
+    // How many samples landed on this thread, pc and pr.
+    uint32_t count;
+} profile_sample_t;
+
+// Record the caller along with each sample, at the cost of more histogram entries.
+#define PROFILE_SAMPLE_CALLER 0x1
+
+// Start sampling the given number of times a second, with room for the given number of
+// distinct locations. Samples that don't fit are counted as dropped. Returns 0 on success
+// or a negative value if the sampler is already running or no hardware timer is free.
+int profile_sample_start(unsigned int rate, unsigned int flags, unsigned int entries);
+void profile_sample_stop();
+
+// Copy out everything sampled since the last call and start over with an empty histogram.
+// Returns the number of entries copied. Pass room for as many entries as were given to
+// profile_sample_start() to get all of them, anything that doesn't fit is counted as
+// dropped along with samples that didn't fit in the histogram. The number dropped is
+// written to dropped if it is not NULL.
+unsigned int profile_sample_read(profile_sample_t *samples, unsigned int max, uint32_t *dropped);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,117 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Scheduler and interrupt tracing. Once enabled with trace_init(), the system records
+// every context switch, every time a waiting thread is woken and why, every interrupt
+// and syscall entry and exit, TA and vblank events and any markers you add yourself
+// into a ring buffer, timestamped in microseconds using the same timer as profile_start().
+// This is meant for figuring out things like why a frame missed vblank when several
+// threads are active. Tracing costs nothing but a single check per event until it is
+// enabled. The buffer holds the most recent events, so older events are lost if nobody
+// reads them fast enough. Use message_trace_redirect_init() from libnaomimessage along
+// with the tracedump host tool to stream the trace to a host and view it in a browser
+// as a Chrome trace.
+typedef struct
+{
+    // The profile timer time that the event happened at, in microseconds.
+    uint64_t timestamp;
+
+    // One of the TRACE_EVENT_* values below.
+    uint32_t type;
+
+    // The ID of the thread the event is about, or the thread that was running when the
+    // event happened for interrupts, TA events and video events.
+    uint32_t thread;
+
+    // Event-specific arguments, documented alongside each event type.
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_event_t;
+
+// A context switch away from thread to the thread in arg0. arg1 is the TRACE_STATE_*
+// that thread was left in, so you can tell a preemption from blocking on something.
+#define TRACE_EVENT_SWITCH 1
+
+// A waiting thread was woken. arg0 is one of the TRACE_WAKE_* reasons below, and arg1
+// depends on the reason.
+#define TRACE_EVENT_WAKE 2
+
+// Entry and exit of the interrupt handler. arg0 is the IRQ_EVENT_* from interrupt.h, and
+// arg1 is the syscall number for IRQ_EVENT_TRAPA.
+#define TRACE_EVENT_IRQ_ENTER 3
+#define TRACE_EVENT_IRQ_EXIT 4
+
+// Something happened on the TA or PVR. arg0 is one of the TRACE_TA_* values below.
+#define TRACE_EVENT_TA 5
+
+// A vblank in or vblank out interrupt fired. arg0 is one of the TRACE_VIDEO_* values below.
+#define TRACE_EVENT_VIDEO 6
+
+// User markers, see trace_marker(), trace_marker_begin() and trace_marker_end().
+// arg0 is the marker ID and arg1 is the value given for instant markers.
+#define TRACE_EVENT_MARKER 7
+#define TRACE_EVENT_MARKER_BEGIN 8
+#define TRACE_EVENT_MARKER_END 9
+
+// States a thread can be left in when it is switched away from.
+#define TRACE_STATE_STOPPED 0
+#define TRACE_STATE_RUNNING 1
+#define TRACE_STATE_FINISHED 2
+#define TRACE_STATE_ZOMBIE 3
+#define TRACE_STATE_WAITING 4
+
+// Reasons a thread was woken. For semaphores and mutexes, arg1 is the handle ID. For
+// conditions, arg1 is nonzero if the condition was signalled and zero if it timed out.
+// For interrupts, arg1 is the WAIT_ANY_* mask of the interrupt that fired.
+#define TRACE_WAKE_TIMER 1
+#define TRACE_WAKE_TIMEOUT 2
+#define TRACE_WAKE_SEMAPHORE 3
+#define TRACE_WAKE_CONDITION 4
+#define TRACE_WAKE_JOIN 5
+#define TRACE_WAKE_INTERRUPT 6
+#define TRACE_WAKE_TA 7
+
+// TA and PVR events.
+#define TRACE_TA_RENDER_BEGIN 1
+#define TRACE_TA_RENDER_FINISHED 2
+#define TRACE_TA_LOAD_OPAQUE_FINISHED 3
+#define TRACE_TA_LOAD_TRANSPARENT_FINISHED 4
+#define TRACE_TA_LOAD_PUNCHTHRU_FINISHED 5
+
+// Video events.
+#define TRACE_VIDEO_VBLANK_IN 1
+#define TRACE_VIDEO_VBLANK_OUT 2
+
+// Enable tracing with room for at least the given number of events, or disable tracing
+// and free the buffer. Calling trace_init() while tracing is already enabled throws away
+// anything recorded so far. Do not call either while another thread is inside trace_read().
+void trace_init(unsigned int events);
+void trace_free();
+
+// Record a marker from the current thread. trace_marker() records a single point in time,
+// while trace_marker_begin() and trace_marker_end() with the same ID bracket a span of
+// work, such as building a frame. IDs are yours to choose, and the host tool can be told
+// what to call them.
+void trace_marker(uint32_t id, uint32_t value);
+void trace_marker_begin(uint32_t id);
+void trace_marker_end(uint32_t id);
+
+// Copy up to max events, oldest first, that were recorded since the position in cursor
+// and advance the cursor past them. Start with a cursor of zero to read everything that
+// is still in the buffer. Returns the number of events copied. If the buffer wrapped
+// around and overwrote events before they could be read, the number lost is written to
+// dropped if it is not NULL. This never blocks the interrupts and threads that record
+// events, so it is safe to call at any time while tracing is enabled.
+unsigned int trace_read(uint32_t *cursor, trace_event_t *events, unsigned int max, uint32_t *dropped);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
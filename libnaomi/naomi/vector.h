@@ -35,6 +35,26 @@ void vector_cross(vector_t *cross, vector_t *a, vector_t *b);
 // unit length).
 void vector_normalize(vector_t *vec);
 
+// Batched versions of the above, for when you have a lot of vectors to work
+// through every frame. These are considerably faster than calling the single
+// vector versions in a loop, but the normalization uses the hardware's
+// approximate reciprocal square root, so results are accurate to roughly
+// 1 part in a million rather than to the last bit. Zero length vectors
+// normalize to NaN just like vector_normalize().
+
+// Normalize count vectors in place.
+void vector_normalize_array(vector_t *vecs, unsigned int count);
+
+// Compute the dot products of count pairs of vectors, so that dots[i] is
+// the dot product of a[i] and b[i].
+void vector_dot_array(float *dots, vector_t *a, vector_t *b, unsigned int count);
+
+// Compute normalized face normals for count triangles. Each triangle is three
+// consecutive entries in indices which index into positions, and its normal
+// follows the right-hand rule in the order the verticies are given. normals
+// must have room for count entries.
+void vector_face_normals(vector_t *normals, vector_t *positions, uint16_t *indices, unsigned int count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,7 +1,3 @@
-#ifdef FEATURE_FREETYPE
-// Only provide this stuff if freetype is installed. Otherwise just don't do anything with it.
-// This is so that stage 1 libnaomi.a can be built, and then freetype built against it, before
-// libnaomi is built again.
 #ifndef __VIDEO_FREETYPE_H
 #define __VIDEO_FREETYPE_H
 
@@ -28,4 +24,3 @@ int video_draw_text(int x, int y, font_t *fontface, color_t color, const char *
 #endif
 
 #endif
-#endif
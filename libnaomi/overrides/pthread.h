@@ -36,6 +36,12 @@ extern "C" {
 #ifndef _POSIX_SPIN_LOCKS
 #define _POSIX_SPIN_LOCKS
 #endif
+#ifndef _POSIX_BARRIERS
+#define _POSIX_BARRIERS
+#endif
+#ifndef _POSIX_READER_WRITER_LOCKS
+#define _POSIX_READER_WRITER_LOCKS
+#endif
 
 struct _pthread_cleanup_context {
   void (*_routine)(void *);
@@ -86,6 +92,8 @@ int	pthread_mutex_destroy (pthread_mutex_t *__mutex);
 int	pthread_mutex_lock (pthread_mutex_t *__mutex);
 int	pthread_mutex_trylock (pthread_mutex_t *__mutex);
 int	pthread_mutex_unlock (pthread_mutex_t *__mutex);
+int	pthread_mutex_timedlock (pthread_mutex_t *__mutex,
+				 const struct timespec *__timeout);
 
 /* Condition Variable Initialization Attributes, P1003.1c/Draft 10, p. 96 */
  
@@ -280,6 +288,51 @@ int	pthread_spin_lock (pthread_spinlock_t *__spinlock);
 int	pthread_spin_trylock (pthread_spinlock_t *__spinlock);
 int	pthread_spin_unlock (pthread_spinlock_t *__spinlock);
 
+/* POSIX Barriers */
+
+int	pthread_barrierattr_init (pthread_barrierattr_t *__attr);
+int	pthread_barrierattr_destroy (pthread_barrierattr_t *__attr);
+int	pthread_barrierattr_getpshared (const pthread_barrierattr_t *__attr,
+					int *__pshared);
+int	pthread_barrierattr_setpshared (pthread_barrierattr_t *__attr,
+					int __pshared);
+
+#define PTHREAD_BARRIER_SERIAL_THREAD -1
+
+int	pthread_barrier_init (pthread_barrier_t *__barrier,
+			      const pthread_barrierattr_t *__attr, unsigned __count);
+int	pthread_barrier_destroy (pthread_barrier_t *__barrier);
+int	pthread_barrier_wait (pthread_barrier_t *__barrier);
+
+/* POSIX Reader/Writer Locks */
+
+int	pthread_rwlockattr_init (pthread_rwlockattr_t *__attr);
+int	pthread_rwlockattr_destroy (pthread_rwlockattr_t *__attr);
+int	pthread_rwlockattr_getpshared (const pthread_rwlockattr_t *__attr,
+				       int *__pshared);
+int	pthread_rwlockattr_setpshared (pthread_rwlockattr_t *__attr,
+				       int __pshared);
+
+/* This is used to statically initialize a pthread_rwlock_t. Example:
+
+    pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+ */
+
+#define PTHREAD_RWLOCK_INITIALIZER _PTHREAD_RWLOCK_INITIALIZER
+
+int	pthread_rwlock_init (pthread_rwlock_t *__rwlock,
+			     const pthread_rwlockattr_t *__attr);
+int	pthread_rwlock_destroy (pthread_rwlock_t *__rwlock);
+int	pthread_rwlock_rdlock (pthread_rwlock_t *__rwlock);
+int	pthread_rwlock_tryrdlock (pthread_rwlock_t *__rwlock);
+int	pthread_rwlock_timedrdlock (pthread_rwlock_t *__rwlock,
+				    const struct timespec *__abstime);
+int	pthread_rwlock_wrlock (pthread_rwlock_t *__rwlock);
+int	pthread_rwlock_trywrlock (pthread_rwlock_t *__rwlock);
+int	pthread_rwlock_timedwrlock (pthread_rwlock_t *__rwlock,
+				    const struct timespec *__abstime);
+int	pthread_rwlock_unlock (pthread_rwlock_t *__rwlock);
+
 #ifdef __cplusplus
 }
 #endif
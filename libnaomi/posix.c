@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <sys/reent.h>
 #include <sys/errno.h>
+#include <sys/time.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -1685,9 +1686,9 @@ int pthread_attr_getstacksize(const pthread_attr_t *attr, size_t *stacksize)
 
 int pthread_attr_setstacksize(pthread_attr_t *attr, size_t stacksize)
 {
-    if (stacksize != THREAD_STACK_SIZE)
+    if (stacksize < THREAD_STACK_SIZE_MIN)
     {
-        // Don't support changing stack size!
+        // Too small to safely run a thread on.
         return EINVAL;
     }
     attr->stacksize = stacksize;
@@ -1869,6 +1870,7 @@ int pthread_create(
     void *arg
 ) {
     int create_detached = 0;
+    size_t stacksize = THREAD_STACK_SIZE;
 
     if (attr)
     {
@@ -1880,7 +1882,7 @@ int pthread_create(
         {
             return EINVAL;
         }
-        if (attr->stacksize != THREAD_STACK_SIZE)
+        if (attr->stacksize < THREAD_STACK_SIZE_MIN)
         {
             return EINVAL;
         }
@@ -1889,11 +1891,12 @@ int pthread_create(
             return EINVAL;
         }
 
-        // Only attribute we really support right now.
+        // Only attributes we really support right now.
         create_detached = attr->detachstate == PTHREAD_CREATE_DETACHED;
+        stacksize = attr->stacksize;
     }
 
-    uint32_t new_thread = thread_create("pthread", start_routine, arg);
+    uint32_t new_thread = thread_create_ex("pthread", start_routine, arg, stacksize);
     if (new_thread)
     {
         int retval = 0;
@@ -2127,12 +2130,13 @@ int pthread_getattr_np(pthread_t pthread, pthread_attr_t *attr)
     uint32_t actual_tid = (uint32_t)pthread;
 
     int retval = 0;
+    thread_info_t info;
 
-    if (thread_info(actual_tid, NULL))
+    if (thread_info(actual_tid, &info))
     {
         memset(attr, 0, sizeof(pthread_attr_t));
         attr->is_initialized = 1;
-        attr->stacksize = THREAD_STACK_SIZE;
+        attr->stacksize = info.stack_size ? info.stack_size : THREAD_STACK_SIZE;
         attr->contentionscope = PTHREAD_SCOPE_SYSTEM;
         attr->detachstate = PTHREAD_CREATE_JOINABLE;
 
@@ -2426,6 +2430,727 @@ int pthread_mutex_unlock (pthread_mutex_t *mutex)
     return 0;
 }
 
+// Convert an absolute CLOCK_REALTIME deadline, as used by all of the pthread timed
+// waits, into a number of microseconds from now. Returns 0 if the deadline has passed.
+// Deadlines too far out for our timeouts are capped, so callers must treat a timed out
+// wait as a reason to call this again rather than as having reached the deadline.
+uint32_t _pthread_abstime_to_us(const struct timespec *abstime)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    int64_t deadline = ((int64_t)abstime->tv_sec * 1000000) + (abstime->tv_nsec / 1000);
+    int64_t current = ((int64_t)now.tv_sec * 1000000) + now.tv_usec;
+    if (deadline <= current)
+    {
+        return 0;
+    }
+    if ((deadline - current) > 0xFFFFFFFF)
+    {
+        // Longer than we can represent, which is over an hour, so wait in chunks.
+        return 0xFFFFFFFF;
+    }
+    return deadline - current;
+}
+
+int pthread_mutex_timedlock (pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+    if (mutex == NULL || abstime == NULL || abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000)
+    {
+        return EINVAL;
+    }
+
+    // First, figure out if we need to initialize this mutex.
+    mutex_lock(&static_mutex);
+    if (*mutex == PTHREAD_MUTEX_INITIALIZER)
+    {
+        pthread_mutex_init(mutex, NULL);
+    }
+    mutex_unlock(&static_mutex);
+
+    if (*mutex == PTHREAD_MUTEX_INITIALIZER)
+    {
+        return EINVAL;
+    }
+
+    // Alias back to a pointer.
+    mutex_t *lnmutex = (mutex_t *)(*mutex);
+
+    // Per the spec, if we can get the mutex immediately the deadline doesn't matter.
+    if (mutex_try_lock(lnmutex))
+    {
+        return 0;
+    }
+
+    while (1)
+    {
+        // Only give up once the real deadline passes, not when a capped wait runs out.
+        uint32_t us = _pthread_abstime_to_us(abstime);
+        if (us == 0)
+        {
+            return ETIMEDOUT;
+        }
+        if (mutex_lock_timeout(lnmutex, us))
+        {
+            return 0;
+        }
+    }
+}
+
+int pthread_condattr_init (pthread_condattr_t *attr)
+{
+    memset(attr, 0, sizeof(pthread_condattr_t));
+    attr->is_initialized = 1;
+    attr->clock = CLOCK_REALTIME;
+    return 0;
+}
+
+int pthread_condattr_destroy (pthread_condattr_t *attr)
+{
+    attr->is_initialized = 0;
+    return 0;
+}
+
+int pthread_condattr_getclock (const pthread_condattr_t *attr, clockid_t *clock_id)
+{
+    if (clock_id)
+    {
+        *clock_id = attr->clock;
+    }
+    return 0;
+}
+
+int pthread_condattr_setclock (pthread_condattr_t *attr, clockid_t clock_id)
+{
+    // We only support timeouts relative to the realtime clock.
+    if (clock_id != CLOCK_REALTIME)
+    {
+        return EINVAL;
+    }
+    attr->clock = clock_id;
+    return 0;
+}
+
+int pthread_condattr_getpshared (const pthread_condattr_t *attr, int *pshared)
+{
+    // We don't support pshared attributes, since we don't have processes.
+    return EINVAL;
+}
+
+int pthread_condattr_setpshared (pthread_condattr_t *attr, int pshared)
+{
+    // We don't support pshared attributes, since we don't have processes.
+    return EINVAL;
+}
+
+int pthread_cond_init (pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+    if (cond == NULL)
+    {
+        return EINVAL;
+    }
+
+    if (attr)
+    {
+        if (attr->is_initialized == 0)
+        {
+            return EINVAL;
+        }
+    }
+
+    condition_t *lncond = malloc(sizeof(condition_t));
+    if (lncond == 0)
+    {
+        return ENOMEM;
+    }
+
+    // Initialize the condition.
+    condition_init(lncond);
+
+    // Return a pointer aliased to the condition type.
+    *cond = (pthread_cond_t)lncond;
+    return 0;
+}
+
+int pthread_cond_destroy (pthread_cond_t *cond)
+{
+    if (cond == NULL)
+    {
+        return EINVAL;
+    }
+    if (*cond == PTHREAD_COND_INITIALIZER)
+    {
+        return 0;
+    }
+
+    // Alias back to a pointer.
+    condition_t *lncond = (condition_t *)(*cond);
+
+    // Free the underlying condition.
+    condition_free(lncond);
+
+    // Free the memory for the condition.
+    free(lncond);
+    return 0;
+}
+
+condition_t *_pthread_cond_get(pthread_cond_t *cond)
+{
+    // First, figure out if we need to initialize this condition.
+    mutex_lock(&static_mutex);
+    if (*cond == PTHREAD_COND_INITIALIZER)
+    {
+        pthread_cond_init(cond, NULL);
+    }
+    mutex_unlock(&static_mutex);
+
+    if (*cond == PTHREAD_COND_INITIALIZER)
+    {
+        return 0;
+    }
+
+    // Alias back to a pointer.
+    return (condition_t *)(*cond);
+}
+
+int pthread_cond_signal (pthread_cond_t *cond)
+{
+    if (cond == NULL)
+    {
+        return EINVAL;
+    }
+    if (*cond == PTHREAD_COND_INITIALIZER)
+    {
+        // Nobody could possibly be waiting on this.
+        return 0;
+    }
+
+    condition_signal((condition_t *)(*cond));
+    return 0;
+}
+
+int pthread_cond_broadcast (pthread_cond_t *cond)
+{
+    if (cond == NULL)
+    {
+        return EINVAL;
+    }
+    if (*cond == PTHREAD_COND_INITIALIZER)
+    {
+        // Nobody could possibly be waiting on this.
+        return 0;
+    }
+
+    condition_broadcast((condition_t *)(*cond));
+    return 0;
+}
+
+int pthread_cond_wait (pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    if (cond == NULL || mutex == NULL || *mutex == PTHREAD_MUTEX_INITIALIZER)
+    {
+        return EINVAL;
+    }
+
+    condition_t *lncond = _pthread_cond_get(cond);
+    if (lncond == 0)
+    {
+        return EINVAL;
+    }
+
+    condition_wait(lncond, (mutex_t *)(*mutex));
+    return 0;
+}
+
+int pthread_cond_timedwait (pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+    if (cond == NULL || mutex == NULL || abstime == NULL || *mutex == PTHREAD_MUTEX_INITIALIZER)
+    {
+        return EINVAL;
+    }
+    if (abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000)
+    {
+        return EINVAL;
+    }
+
+    condition_t *lncond = _pthread_cond_get(cond);
+    if (lncond == 0)
+    {
+        return EINVAL;
+    }
+
+    while (1)
+    {
+        // Only give up once the real deadline passes, not when a capped wait runs out.
+        // We hold the mutex again in between waits, so no signal can slip past us.
+        uint32_t us = _pthread_abstime_to_us(abstime);
+        if (us == 0)
+        {
+            return ETIMEDOUT;
+        }
+        if (condition_wait_timeout(lncond, (mutex_t *)(*mutex), us))
+        {
+            return 0;
+        }
+    }
+}
+
+int pthread_barrierattr_init (pthread_barrierattr_t *attr)
+{
+    memset(attr, 0, sizeof(pthread_barrierattr_t));
+    attr->is_initialized = 1;
+    return 0;
+}
+
+int pthread_barrierattr_destroy (pthread_barrierattr_t *attr)
+{
+    attr->is_initialized = 0;
+    return 0;
+}
+
+int pthread_barrierattr_getpshared (const pthread_barrierattr_t *attr, int *pshared)
+{
+    // We don't support pshared attributes, since we don't have processes.
+    return EINVAL;
+}
+
+int pthread_barrierattr_setpshared (pthread_barrierattr_t *attr, int pshared)
+{
+    // We don't support pshared attributes, since we don't have processes.
+    return EINVAL;
+}
+
+typedef struct
+{
+    mutex_t mutex;
+    condition_t released;
+    unsigned int count;
+    unsigned int waiting;
+    unsigned int generation;
+} pthread_barrier_internal_t;
+
+int pthread_barrier_init (pthread_barrier_t *barrier, const pthread_barrierattr_t *attr, unsigned count)
+{
+    if (barrier == NULL || count == 0)
+    {
+        return EINVAL;
+    }
+
+    if (attr)
+    {
+        if (attr->is_initialized == 0)
+        {
+            return EINVAL;
+        }
+    }
+
+    pthread_barrier_internal_t *lnbarrier = malloc(sizeof(pthread_barrier_internal_t));
+    if (lnbarrier == 0)
+    {
+        return ENOMEM;
+    }
+
+    // Initialize the barrier.
+    mutex_init(&lnbarrier->mutex);
+    condition_init(&lnbarrier->released);
+    lnbarrier->count = count;
+    lnbarrier->waiting = 0;
+    lnbarrier->generation = 0;
+
+    // Return a pointer aliased to the barrier type.
+    *barrier = (pthread_barrier_t)lnbarrier;
+    return 0;
+}
+
+int pthread_barrier_destroy (pthread_barrier_t *barrier)
+{
+    if (barrier == NULL)
+    {
+        return EINVAL;
+    }
+
+    // Alias back to a pointer.
+    pthread_barrier_internal_t *lnbarrier = (pthread_barrier_internal_t *)(*barrier);
+
+    mutex_lock(&lnbarrier->mutex);
+    if (lnbarrier->waiting > 0)
+    {
+        mutex_unlock(&lnbarrier->mutex);
+        return EBUSY;
+    }
+    mutex_unlock(&lnbarrier->mutex);
+
+    // Free the underlying primitives and the memory for the barrier.
+    condition_free(&lnbarrier->released);
+    mutex_free(&lnbarrier->mutex);
+    free(lnbarrier);
+    return 0;
+}
+
+int pthread_barrier_wait (pthread_barrier_t *barrier)
+{
+    if (barrier == NULL)
+    {
+        return EINVAL;
+    }
+
+    // Alias back to a pointer.
+    pthread_barrier_internal_t *lnbarrier = (pthread_barrier_internal_t *)(*barrier);
+
+    mutex_lock(&lnbarrier->mutex);
+    unsigned int generation = lnbarrier->generation;
+    lnbarrier->waiting++;
+
+    if (lnbarrier->waiting == lnbarrier->count)
+    {
+        // We're the last one here, so let everyone go and reset for the next round.
+        lnbarrier->generation++;
+        lnbarrier->waiting = 0;
+        condition_broadcast(&lnbarrier->released);
+        mutex_unlock(&lnbarrier->mutex);
+        return PTHREAD_BARRIER_SERIAL_THREAD;
+    }
+
+    // Wait until the last thread lets this round go.
+    while (generation == lnbarrier->generation)
+    {
+        condition_wait(&lnbarrier->released, &lnbarrier->mutex);
+    }
+    mutex_unlock(&lnbarrier->mutex);
+    return 0;
+}
+
+int pthread_rwlockattr_init (pthread_rwlockattr_t *attr)
+{
+    memset(attr, 0, sizeof(pthread_rwlockattr_t));
+    attr->is_initialized = 1;
+    return 0;
+}
+
+int pthread_rwlockattr_destroy (pthread_rwlockattr_t *attr)
+{
+    attr->is_initialized = 0;
+    return 0;
+}
+
+int pthread_rwlockattr_getpshared (const pthread_rwlockattr_t *attr, int *pshared)
+{
+    // We don't support pshared attributes, since we don't have processes.
+    return EINVAL;
+}
+
+int pthread_rwlockattr_setpshared (pthread_rwlockattr_t *attr, int pshared)
+{
+    // We don't support pshared attributes, since we don't have processes.
+    return EINVAL;
+}
+
+// Reader/writer locks prefer writers, so that a steady stream of readers can't starve
+// out a thread that wants to update the protected state.
+typedef struct
+{
+    mutex_t mutex;
+    condition_t readable;
+    condition_t writable;
+    unsigned int readers;
+    unsigned int writers_waiting;
+    uint32_t writer;
+} pthread_rwlock_internal_t;
+
+int pthread_rwlock_init (pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr)
+{
+    if (rwlock == NULL)
+    {
+        return EINVAL;
+    }
+
+    if (attr)
+    {
+        if (attr->is_initialized == 0)
+        {
+            return EINVAL;
+        }
+    }
+
+    pthread_rwlock_internal_t *lnrwlock = malloc(sizeof(pthread_rwlock_internal_t));
+    if (lnrwlock == 0)
+    {
+        return ENOMEM;
+    }
+
+    // Initialize the lock.
+    mutex_init(&lnrwlock->mutex);
+    condition_init(&lnrwlock->readable);
+    condition_init(&lnrwlock->writable);
+    lnrwlock->readers = 0;
+    lnrwlock->writers_waiting = 0;
+    lnrwlock->writer = 0;
+
+    // Return a pointer aliased to the rwlock type.
+    *rwlock = (pthread_rwlock_t)lnrwlock;
+    return 0;
+}
+
+int pthread_rwlock_destroy (pthread_rwlock_t *rwlock)
+{
+    if (rwlock == NULL)
+    {
+        return EINVAL;
+    }
+    if (*rwlock == PTHREAD_RWLOCK_INITIALIZER)
+    {
+        return 0;
+    }
+
+    // Alias back to a pointer.
+    pthread_rwlock_internal_t *lnrwlock = (pthread_rwlock_internal_t *)(*rwlock);
+
+    mutex_lock(&lnrwlock->mutex);
+    if (lnrwlock->readers > 0 || lnrwlock->writer != 0 || lnrwlock->writers_waiting > 0)
+    {
+        mutex_unlock(&lnrwlock->mutex);
+        return EBUSY;
+    }
+    mutex_unlock(&lnrwlock->mutex);
+
+    // Free the underlying primitives and the memory for the lock.
+    condition_free(&lnrwlock->writable);
+    condition_free(&lnrwlock->readable);
+    mutex_free(&lnrwlock->mutex);
+    free(lnrwlock);
+    return 0;
+}
+
+pthread_rwlock_internal_t *_pthread_rwlock_get(pthread_rwlock_t *rwlock)
+{
+    // First, figure out if we need to initialize this lock.
+    mutex_lock(&static_mutex);
+    if (*rwlock == PTHREAD_RWLOCK_INITIALIZER)
+    {
+        pthread_rwlock_init(rwlock, NULL);
+    }
+    mutex_unlock(&static_mutex);
+
+    if (*rwlock == PTHREAD_RWLOCK_INITIALIZER)
+    {
+        return 0;
+    }
+
+    // Alias back to a pointer.
+    return (pthread_rwlock_internal_t *)(*rwlock);
+}
+
+// Shared implementation of all the read lock variants. A blocking lock with no deadline
+// waits forever.
+int _pthread_rwlock_rdlock(pthread_rwlock_t *rwlock, int blocking, const struct timespec *abstime)
+{
+    if (rwlock == NULL)
+    {
+        return EINVAL;
+    }
+
+    pthread_rwlock_internal_t *lnrwlock = _pthread_rwlock_get(rwlock);
+    if (lnrwlock == 0)
+    {
+        return EINVAL;
+    }
+
+    int retval = 0;
+    mutex_lock(&lnrwlock->mutex);
+    if (lnrwlock->writer == thread_id())
+    {
+        // We would wait on ourselves forever.
+        retval = EDEADLK;
+    }
+    else
+    {
+        while (lnrwlock->writer != 0 || lnrwlock->writers_waiting > 0)
+        {
+            if (!blocking)
+            {
+                retval = EBUSY;
+                break;
+            }
+            if (abstime == NULL)
+            {
+                condition_wait(&lnrwlock->readable, &lnrwlock->mutex);
+                continue;
+            }
+
+            // Work out how much time is left every time, since we can be woken up
+            // and then lose the race for the lock, or time out of a capped wait.
+            uint32_t us = _pthread_abstime_to_us(abstime);
+            if (us == 0)
+            {
+                retval = ETIMEDOUT;
+                break;
+            }
+            condition_wait_timeout(&lnrwlock->readable, &lnrwlock->mutex, us);
+        }
+
+        if (retval == 0)
+        {
+            lnrwlock->readers++;
+        }
+    }
+    mutex_unlock(&lnrwlock->mutex);
+
+    return retval;
+}
+
+// Shared implementation of all the write lock variants.
+int _pthread_rwlock_wrlock(pthread_rwlock_t *rwlock, int blocking, const struct timespec *abstime)
+{
+    if (rwlock == NULL)
+    {
+        return EINVAL;
+    }
+
+    pthread_rwlock_internal_t *lnrwlock = _pthread_rwlock_get(rwlock);
+    if (lnrwlock == 0)
+    {
+        return EINVAL;
+    }
+
+    int retval = 0;
+    mutex_lock(&lnrwlock->mutex);
+    if (lnrwlock->writer == thread_id())
+    {
+        // We would wait on ourselves forever.
+        retval = EDEADLK;
+    }
+    else
+    {
+        lnrwlock->writers_waiting++;
+        while (lnrwlock->writer != 0 || lnrwlock->readers > 0)
+        {
+            if (!blocking)
+            {
+                retval = EBUSY;
+                break;
+            }
+            if (abstime == NULL)
+            {
+                condition_wait(&lnrwlock->writable, &lnrwlock->mutex);
+                continue;
+            }
+
+            // Work out how much time is left every time, since we can be woken up
+            // and then lose the race for the lock, or time out of a capped wait.
+            uint32_t us = _pthread_abstime_to_us(abstime);
+            if (us == 0)
+            {
+                retval = ETIMEDOUT;
+                break;
+            }
+            condition_wait_timeout(&lnrwlock->writable, &lnrwlock->mutex, us);
+        }
+        lnrwlock->writers_waiting--;
+
+        if (retval == 0)
+        {
+            lnrwlock->writer = thread_id();
+        }
+        else if (lnrwlock->writers_waiting == 0 && lnrwlock->writer == 0)
+        {
+            // We were the only thing holding back readers, so let them in.
+            condition_broadcast(&lnrwlock->readable);
+        }
+    }
+    mutex_unlock(&lnrwlock->mutex);
+
+    return retval;
+}
+
+int pthread_rwlock_rdlock (pthread_rwlock_t *rwlock)
+{
+    return _pthread_rwlock_rdlock(rwlock, 1, NULL);
+}
+
+int pthread_rwlock_tryrdlock (pthread_rwlock_t *rwlock)
+{
+    return _pthread_rwlock_rdlock(rwlock, 0, NULL);
+}
+
+int pthread_rwlock_timedrdlock (pthread_rwlock_t *rwlock, const struct timespec *abstime)
+{
+    if (abstime == NULL || abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000)
+    {
+        return EINVAL;
+    }
+
+    // If the deadline already passed, we still get to try once.
+    return _pthread_rwlock_rdlock(rwlock, 1, abstime);
+}
+
+int pthread_rwlock_wrlock (pthread_rwlock_t *rwlock)
+{
+    return _pthread_rwlock_wrlock(rwlock, 1, NULL);
+}
+
+int pthread_rwlock_trywrlock (pthread_rwlock_t *rwlock)
+{
+    return _pthread_rwlock_wrlock(rwlock, 0, NULL);
+}
+
+int pthread_rwlock_timedwrlock (pthread_rwlock_t *rwlock, const struct timespec *abstime)
+{
+    if (abstime == NULL || abstime->tv_nsec < 0 || abstime->tv_nsec >= 1000000000)
+    {
+        return EINVAL;
+    }
+
+    // If the deadline already passed, we still get to try once.
+    return _pthread_rwlock_wrlock(rwlock, 1, abstime);
+}
+
+int pthread_rwlock_unlock (pthread_rwlock_t *rwlock)
+{
+    if (rwlock == NULL || *rwlock == PTHREAD_RWLOCK_INITIALIZER)
+    {
+        return EINVAL;
+    }
+
+    // Alias back to a pointer.
+    pthread_rwlock_internal_t *lnrwlock = (pthread_rwlock_internal_t *)(*rwlock);
+
+    int retval = 0;
+    mutex_lock(&lnrwlock->mutex);
+    if (lnrwlock->writer == thread_id())
+    {
+        lnrwlock->writer = 0;
+    }
+    else if (lnrwlock->readers > 0)
+    {
+        lnrwlock->readers--;
+    }
+    else
+    {
+        // We don't hold this lock at all.
+        retval = EPERM;
+    }
+
+    if (retval == 0)
+    {
+        if (lnrwlock->writers_waiting > 0)
+        {
+            // Writers get priority, but only once every reader is out.
+            if (lnrwlock->readers == 0)
+            {
+                condition_signal(&lnrwlock->writable);
+            }
+        }
+        else
+        {
+            // Nobody wants to write, so let every waiting reader in.
+            condition_broadcast(&lnrwlock->readable);
+        }
+    }
+    mutex_unlock(&lnrwlock->mutex);
+
+    return retval;
+}
+
 int pthread_once (pthread_once_t *__once_control, void (*__init_routine)(void))
 {
     // First, validate inputs.
@@ -352,6 +352,18 @@ _irq_base_handler:
     add #0x44,r0
     sts.l fpul,@-r0
     sts.l fpscr,@-r0
+
+    # The interrupted code could have been in the middle of a paired move (such as
+    # loading XMTRX in matrix.c) or running in double precision mode. Force single
+    # precision and single moves so the below stores always store exactly one 32-bit
+    # register each, but leave the bank select alone so "fr" is the current bank and
+    # "frbank" is the back bank (XMTRX) of the interrupted code. This also makes sure
+    # the C code below runs with the FPU in the mode it was compiled for.
+    sts fpscr,r1
+    mov.l fpscr_single_mask,r2
+    and r2,r1
+    lds r1,fpscr
+
     fmov.s fr15,@-r0
     fmov.s fr14,@-r0
     fmov.s fr13,@-r0
@@ -442,6 +454,18 @@ _irq_base_handler:
     lds.l @r0+,macl
     ldc.l @r0+,ssr
 
+    # Now, switch to the same bank select that the state we're restoring had when
+    # it was saved, again forcing single precision and single moves. If we didn't do
+    # this, switching between two threads with different bank selects would swap their
+    # XMTRX with their regular floating point registers. The saved FPSCR lives right
+    # after the 32 floating point registers.
+    mov #0x20,r1
+    shll2 r1
+    mov.l @(r0,r1),r1
+    mov.l fpscr_single_mask,r2
+    and r2,r1
+    lds r1,fpscr
+
     # Now, grab the banked registers for floating-point restoration.
     frchg
     fmov.s @r0+,fr0
@@ -489,6 +513,13 @@ _irq_base_handler:
     nop
 
     .align 4
+
+fpscr_single_mask:
+    # Clears the SZ (paired move) and PR (double precision) bits in FPSCR,
+    # leaving everything else including the FR bank select bit alone.
+    .long   0xffe7ffff
+
+    .align 4
     .globl _irq_stack
 
 _irq_stack:
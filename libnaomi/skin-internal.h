@@ -0,0 +1,21 @@
+#ifndef __SKIN_INTERNAL_H
+#define __SKIN_INTERNAL_H
+
+#include <stdint.h>
+#include "naomi/matrix.h"
+#include "naomi/skin.h"
+
+// A single bone's pull on a single vertex. These are stored grouped by bone so
+// that every vertex a bone touches can be run through XMTRX back to back.
+typedef struct
+{
+    uint32_t vertex;
+    float weight;
+} skin_influence_t;
+
+// Copy texture coordinates over and start each skinned vertex at the origin, ready
+// for the weighted results of each bone to be accumulated into it. Shared between
+// the XMTRX path in skin-xmtrx.c and the portable reference in skin.c.
+void _skin_prepare(skin_t *skin, textured_vertex_t *src, textured_vertex_t *dest);
+
+#endif
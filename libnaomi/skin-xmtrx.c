@@ -0,0 +1,53 @@
+#include "naomi/matrix.h"
+#include "naomi/skin.h"
+#include "skin-internal.h"
+
+// The fast path for skinning lives on its own since it needs the SH-4 FPU, which
+// lets skin.c be built for the host and checked against this on the target.
+void skin_transform(skin_t *skin, matrix_t *bones, textured_vertex_t *src, textured_vertex_t *dest)
+{
+    skin_influence_t *influences = skin->influences;
+    matrix_t sysmatrix;
+
+    _skin_prepare(skin, src, dest);
+
+    matrix_get(&sysmatrix);
+
+    for (unsigned int bone = 0; bone < skin->bonecount; bone++)
+    {
+        unsigned int start = skin->offsets[bone];
+        unsigned int end = skin->offsets[bone + 1];
+        if (start == end)
+        {
+            continue;
+        }
+
+        // Load this bone into XMTRX once, and then run every vertex it pulls on
+        // through it, accumulating the weighted result.
+        matrix_set(&bones[bone]);
+
+        for (unsigned int i = start; i < end; i++)
+        {
+            textured_vertex_t *in = &src[influences[i].vertex];
+            textured_vertex_t *out = &dest[influences[i].vertex];
+            float weight = influences[i].weight;
+
+            register float x asm("fr0") = in->x;
+            register float y asm("fr1") = in->y;
+            register float z asm("fr2") = in->z;
+            register float w asm("fr3") = 1.0;
+
+            asm volatile(" \
+                ftrv xmtrx,fv0\n \
+                " :
+                "+f" (x), "+f" (y), "+f" (z), "+f" (w)
+            );
+
+            out->x += x * weight;
+            out->y += y * weight;
+            out->z += z * weight;
+        }
+    }
+
+    matrix_set(&sysmatrix);
+}
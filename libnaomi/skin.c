@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "naomi/matrix.h"
+#include "naomi/skin.h"
+#include "skin-internal.h"
+
+skin_t *skin_create(skin_weight_t *weights, unsigned int vertexcount, unsigned int bonecount)
+{
+    if (weights == 0 || vertexcount == 0 || bonecount == 0 || bonecount > SKIN_MAX_BONES)
+    {
+        return 0;
+    }
+
+    // First, count up how many verticies each bone influences so we know where
+    // each bone's run of influences starts.
+    unsigned int counts[SKIN_MAX_BONES];
+    unsigned int total = 0;
+    memset(counts, 0, sizeof(counts));
+    for (unsigned int i = 0; i < vertexcount; i++)
+    {
+        for (int j = 0; j < SKIN_MAX_INFLUENCES; j++)
+        {
+            if (weights[i].weights[j] <= 0.0)
+            {
+                continue;
+            }
+            if (weights[i].bones[j] >= bonecount)
+            {
+                return 0;
+            }
+
+            counts[weights[i].bones[j]]++;
+            total++;
+        }
+    }
+
+    skin_t *skin = malloc(sizeof(skin_t));
+    if (skin == 0)
+    {
+        return 0;
+    }
+
+    skin->vertexcount = vertexcount;
+    skin->bonecount = bonecount;
+    skin->influences = malloc(sizeof(skin_influence_t) * (total ? total : 1));
+    skin->offsets = malloc(sizeof(unsigned int) * (bonecount + 1));
+    skin->skinned = malloc(vertexcount);
+
+    if (skin->influences == 0 || skin->offsets == 0 || skin->skinned == 0)
+    {
+        skin_free(skin);
+        return 0;
+    }
+
+    skin->offsets[0] = 0;
+    for (unsigned int i = 0; i < bonecount; i++)
+    {
+        skin->offsets[i + 1] = skin->offsets[i] + counts[i];
+        counts[i] = skin->offsets[i];
+    }
+
+    // Now, scatter each vertex's influences into its bones' runs, normalizing the
+    // weights as we go so that the blended result never needs a divide.
+    skin_influence_t *influences = skin->influences;
+    for (unsigned int i = 0; i < vertexcount; i++)
+    {
+        float sum = 0.0;
+        for (int j = 0; j < SKIN_MAX_INFLUENCES; j++)
+        {
+            if (weights[i].weights[j] > 0.0)
+            {
+                sum += weights[i].weights[j];
+            }
+        }
+
+        skin->skinned[i] = sum > 0.0;
+        if (!skin->skinned[i])
+        {
+            continue;
+        }
+
+        for (int j = 0; j < SKIN_MAX_INFLUENCES; j++)
+        {
+            if (weights[i].weights[j] > 0.0)
+            {
+                skin_influence_t *influence = &influences[counts[weights[i].bones[j]]++];
+                influence->vertex = i;
+                influence->weight = weights[i].weights[j] / sum;
+            }
+        }
+    }
+
+    return skin;
+}
+
+void skin_free(skin_t *skin)
+{
+    if (skin)
+    {
+        free(skin->influences);
+        free(skin->offsets);
+        free(skin->skinned);
+        free(skin);
+    }
+}
+
+void _skin_prepare(skin_t *skin, textured_vertex_t *src, textured_vertex_t *dest)
+{
+    // Skinned verticies are accumulated into, so start them at the origin. Anything
+    // with no weight at all stays in its bind pose.
+    for (unsigned int i = 0; i < skin->vertexcount; i++)
+    {
+        dest[i].u = src[i].u;
+        dest[i].v = src[i].v;
+
+        if (skin->skinned[i])
+        {
+            dest[i].x = 0.0;
+            dest[i].y = 0.0;
+            dest[i].z = 0.0;
+        }
+        else
+        {
+            dest[i].x = src[i].x;
+            dest[i].y = src[i].y;
+            dest[i].z = src[i].z;
+        }
+    }
+}
+
+void skin_transform_reference(skin_t *skin, matrix_t *bones, textured_vertex_t *src, textured_vertex_t *dest)
+{
+    skin_influence_t *influences = skin->influences;
+
+    _skin_prepare(skin, src, dest);
+
+    for (unsigned int bone = 0; bone < skin->bonecount; bone++)
+    {
+        matrix_t *m = &bones[bone];
+
+        for (unsigned int i = skin->offsets[bone]; i < skin->offsets[bone + 1]; i++)
+        {
+            textured_vertex_t *in = &src[influences[i].vertex];
+            textured_vertex_t *out = &dest[influences[i].vertex];
+            float weight = influences[i].weight;
+
+            // Same row-vector convention that XMTRX uses, with an implied w of 1.0.
+            out->x += ((in->x * m->a11) + (in->y * m->a21) + (in->z * m->a31) + m->a41) * weight;
+            out->y += ((in->x * m->a12) + (in->y * m->a22) + (in->z * m->a32) + m->a42) * weight;
+            out->z += ((in->x * m->a13) + (in->y * m->a23) + (in->z * m->a33) + m->a43) * weight;
+        }
+    }
+}
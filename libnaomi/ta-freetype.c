@@ -1,14 +1,14 @@
-#ifdef FEATURE_FREETYPE
-// Only build this stuff if freetype is installed. Otherwise just don't do anything with it.
-// This is so that stage 1 libnaomi.a can be built, and then freetype built against it, before
-// libnaomi is built again.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include <math.h>
 #include "naomi/video.h"
 #include "naomi/ta.h"
 #include "naomi/font.h"
+#include "naomi/ta-freetype.h"
+#include "naomi/utf8.h"
 #include "video-internal.h"
 #include "font-internal.h"
 
@@ -16,53 +16,289 @@
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 #endif
 
-// The UVsize of a sprite sheet. Note that this must be kept in sync with the
-// draw function U and V sizes below.
-#define SPRITEMAP_UVSIZE 256
+// The default UVsize of a glyph sheet, for when ta_font_set_sheet_size() hasn't
+// been called.
+#define TA_SHEET_DEFAULT_UVSIZE 256
 
 // Definition of quad Z location shared between us and sprite renderer.
 float __ta_quad_z_location();
+uint32_t _ta_texture_desc_uvsize(int uvsize);
+
+// Prototypes from ta.c so we know when a glyph's display list has been rendered.
+uint32_t _ta_frame();
+int _ta_frame_rendered(uint32_t frame);
+
+// Glyphs are packed into sheets using a skyline packer. The skyline is the list of
+// horizontal segments making up the top edge of everything placed so far, sorted
+// left to right, and each new glyph goes wherever it ends up lowest on the sheet.
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+} ta_skyline_node_t;
+
+typedef struct ta_sheet
+{
+    void *texture;
+    int uvsize;
+    int glyphs;
+    unsigned int used;
+    ta_skyline_node_t *skyline;
+    int nodes;
+    struct ta_sheet *next;
+} ta_sheet_t;
 
 typedef struct
 {
     void *texture;
+    ta_sheet_t *sheet;
     int u;
     int v;
+
+    // The last frame this glyph was drawn into, so it isn't evicted while that frame's
+    // display list still points the TA at its sheet.
+    uint32_t frame;
 } ta_cache_entry_t;
 
-void *curtex = 0;
-static int uloc = 0;
-static int vloc = 0;
-static int vsize = -1;
-static void **allocated_textures = 0;
-static int num_allocated_textures = 0;
+// All sheets we own, newest first.
+static ta_sheet_t *sheets = 0;
+static int sheet_uvsize = TA_SHEET_DEFAULT_UVSIZE;
+
+void _ta_sheet_reset(ta_sheet_t *sheet)
+{
+    sheet->skyline[0].x = 0;
+    sheet->skyline[0].y = 0;
+    sheet->skyline[0].width = sheet->uvsize;
+    sheet->nodes = 1;
+    sheet->glyphs = 0;
+    sheet->used = 0;
+}
+
+ta_sheet_t *_ta_sheet_alloc(int uvsize)
+{
+    ta_sheet_t *sheet = malloc(sizeof(ta_sheet_t));
+    if (sheet == 0)
+    {
+        return 0;
+    }
+
+    // There can never be more skyline segments than there are columns.
+    sheet->skyline = malloc(sizeof(ta_skyline_node_t) * uvsize);
+    if (sheet->skyline == 0)
+    {
+        free(sheet);
+        return 0;
+    }
+
+    sheet->texture = ta_texture_malloc(uvsize, 16);
+    if (sheet->texture == 0)
+    {
+        free(sheet->skyline);
+        free(sheet);
+        return 0;
+    }
+
+    sheet->uvsize = uvsize;
+    _ta_sheet_reset(sheet);
+    sheet->next = sheets;
+    sheets = sheet;
+
+    return sheet;
+}
+
+void _ta_sheet_free(ta_sheet_t *sheet)
+{
+    ta_sheet_t **link = &sheets;
+    while (*link)
+    {
+        if (*link == sheet)
+        {
+            *link = sheet->next;
+            break;
+        }
+
+        link = &((*link)->next);
+    }
+
+    ta_texture_free(sheet->texture);
+    free(sheet->skyline);
+    free(sheet);
+}
+
+int _ta_skyline_fit(ta_sheet_t *sheet, int index, int width, int height)
+{
+    // Returns the lowest y a glyph can sit at when its left edge is at this node,
+    // or -1 if it would run off the side or the bottom of the sheet.
+    int x = sheet->skyline[index].x;
+    if (x + width > sheet->uvsize)
+    {
+        return -1;
+    }
+
+    int y = 0;
+    int remaining = width;
+    while (remaining > 0)
+    {
+        y = sheet->skyline[index].y > y ? sheet->skyline[index].y : y;
+        if (y + height > sheet->uvsize)
+        {
+            return -1;
+        }
+
+        remaining -= sheet->skyline[index].width;
+        index++;
+    }
+
+    return y;
+}
+
+int _ta_skyline_find(ta_sheet_t *sheet, int width, int height, int *best_index, int *best_y)
+{
+    int best_top = sheet->uvsize + 1;
+    int best_width = sheet->uvsize + 1;
+
+    *best_index = -1;
+    for (int i = 0; i < sheet->nodes; i++)
+    {
+        int y = _ta_skyline_fit(sheet, i, width, height);
+        if (y < 0)
+        {
+            continue;
+        }
+
+        // Prefer the spot that leaves the lowest top edge, and then the narrowest
+        // segment so that wide gaps are saved for wide glyphs.
+        if (y + height < best_top || (y + height == best_top && sheet->skyline[i].width < best_width))
+        {
+            best_top = y + height;
+            best_width = sheet->skyline[i].width;
+            *best_index = i;
+            *best_y = y;
+        }
+    }
+
+    return *best_index >= 0;
+}
+
+void _ta_skyline_insert(ta_sheet_t *sheet, int index, int y, int width, int height)
+{
+    ta_skyline_node_t *skyline = sheet->skyline;
+    int x = skyline[index].x;
+
+    // Add the new segment for the top of this glyph.
+    memmove(&skyline[index + 1], &skyline[index], sizeof(ta_skyline_node_t) * (sheet->nodes - index));
+    skyline[index].x = x;
+    skyline[index].y = y + height;
+    skyline[index].width = width;
+    sheet->nodes++;
+
+    // Trim or remove whatever segments are now underneath it.
+    for (int i = index + 1; i < sheet->nodes; i++)
+    {
+        int overlap = (skyline[index].x + skyline[index].width) - skyline[i].x;
+        if (overlap <= 0)
+        {
+            break;
+        }
+
+        if (overlap < skyline[i].width)
+        {
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            break;
+        }
+
+        memmove(&skyline[i], &skyline[i + 1], sizeof(ta_skyline_node_t) * (sheet->nodes - i - 1));
+        sheet->nodes--;
+        i--;
+    }
+
+    // Merge neighbors that ended up at the same height.
+    for (int i = 0; i < sheet->nodes - 1; i++)
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            memmove(&skyline[i + 1], &skyline[i + 2], sizeof(ta_skyline_node_t) * (sheet->nodes - i - 2));
+            sheet->nodes--;
+            i--;
+        }
+    }
+}
+
+ta_sheet_t *_ta_sheet_place(int width, int height, int *u, int *v)
+{
+    // Try every sheet we already have before spending TEXRAM on a new one.
+    int index;
+    int y;
+    for (ta_sheet_t *sheet = sheets; sheet != 0; sheet = sheet->next)
+    {
+        if (_ta_skyline_find(sheet, width, height, &index, &y))
+        {
+            *u = sheet->skyline[index].x;
+            *v = y;
+            _ta_skyline_insert(sheet, index, y, width, height);
+            return sheet;
+        }
+    }
+
+    if (width > sheet_uvsize || height > sheet_uvsize)
+    {
+        // Can't cache this character at all!
+        return 0;
+    }
+
+    ta_sheet_t *sheet = _ta_sheet_alloc(sheet_uvsize);
+    if (sheet == 0)
+    {
+        return 0;
+    }
+
+    *u = 0;
+    *v = 0;
+    _ta_skyline_insert(sheet, 0, 0, width, height);
+    return sheet;
+}
 
-void __ta_font_cache_discard()
+void _ta_cache_discard(font_cache_entry_t *entry)
 {
-    // We've been instructed to kill off the font cache. So, free all the texture
-    // sheets that we allocated.
-    if (allocated_textures)
+    ta_cache_entry_t *ta_entry = entry->data;
+    ta_sheet_t *sheet = ta_entry->sheet;
+
+    if (sheet)
     {
-        for (int i = 0; i < num_allocated_textures; i++)
+        // This glyph is going away, so once nothing else lives on its sheet we can
+        // give the texture back. A skyline can't reclaim space from the middle, so
+        // the newest sheet just gets rewound instead, since we'd only allocate a
+        // fresh one next time anyway.
+        sheet->glyphs--;
+        sheet->used -= entry->width * entry->height;
+        if (sheet->glyphs <= 0)
         {
-            if (allocated_textures[i])
+            if (sheet == sheets)
+            {
+                _ta_sheet_reset(sheet);
+            }
+            else
             {
-                ta_texture_free(allocated_textures[i]);
+                _ta_sheet_free(sheet);
             }
         }
-
-        free(allocated_textures);
-        allocated_textures = 0;
     }
 
-    num_allocated_textures = 0;
-    curtex = 0;
-    uloc = 0;
-    vloc = 0;
-    vsize = -1;
+    free(ta_entry);
 }
 
-font_cache_entry_t *_ta_cache_create(uint32_t index, int advancex, int advancey, int bitmap_left, int bitmap_top, int width, int height, int mode, uint8_t *buffer)
+int _ta_cache_busy(font_cache_entry_t *entry)
+{
+    // Freeing sheet space out from under a display list that hasn't been rendered would
+    // let the next glyph or texture allocation overwrite what the TA is about to sample.
+    ta_cache_entry_t *ta_entry = entry->data;
+    return ta_entry->sheet != 0 && !_ta_frame_rendered(ta_entry->frame);
+}
+
+font_cache_entry_t *_ta_cache_create_namespace(uint32_t index, int advancex, int advancey, int bitmap_left, int bitmap_top, int width, int height, int mode, uint8_t *buffer, int cache_namespace)
 {
     font_cache_entry_t *entry = malloc(sizeof(font_cache_entry_t));
     if (entry == 0)
@@ -70,7 +306,7 @@ font_cache_entry_t *_ta_cache_create(uint32_t index, int advancex, int advancey,
         return 0;
     }
     entry->index = index;
-    entry->cache_namespace = FONT_CACHE_TA;
+    entry->cache_namespace = cache_namespace;
     entry->advancex = advancex;
     entry->advancey = advancey;
     entry->bitmap_left = bitmap_left;
@@ -78,6 +314,8 @@ font_cache_entry_t *_ta_cache_create(uint32_t index, int advancex, int advancey,
     entry->mode = mode;
     entry->width = width;
     entry->height = height;
+    entry->discard = &_ta_cache_discard;
+    entry->busy = &_ta_cache_busy;
     ta_cache_entry_t *ta_entry = malloc(sizeof(ta_cache_entry_t));
     entry->data = ta_entry;
     if (entry->data == 0)
@@ -86,80 +324,26 @@ font_cache_entry_t *_ta_cache_create(uint32_t index, int advancex, int advancey,
         return 0;
     }
 
-    if (width > 0 && height > 0 && mode == FT_PIXEL_MODE_GRAY)
-    {
-        // Let's try to find a spritemap to add this character to.
-        if (curtex == 0 || ((uloc + width) >= SPRITEMAP_UVSIZE && (vloc + vsize + height) >= SPRITEMAP_UVSIZE))
-        {
-            // We ran out of room, we need a new spritemap.
-            curtex = ta_texture_malloc(SPRITEMAP_UVSIZE, 16);
-            if (curtex == 0)
-            {
-                free(entry->data);
-                free(entry);
-                return 0;
-            }
-
-            // Remember we allocated this so we can kill it when the time comes.
-            if (num_allocated_textures == 0)
-            {
-                allocated_textures = malloc(sizeof(void *));
-                if (allocated_textures == 0)
-                {
-                    ta_texture_free(curtex);
-                    free(entry->data);
-                    free(entry);
-                    curtex = 0;
-                    return 0;
-                }
-                else
-                {
-                    num_allocated_textures = 1;
-                    allocated_textures[0] = curtex;
-                }
-            }
-            else
-            {
-                void ** new_allocated_textures = realloc(allocated_textures, sizeof(void *) * (num_allocated_textures + 1));
-                if (new_allocated_textures == 0)
-                {
-                    ta_texture_free(curtex);
-                    free(entry->data);
-                    free(entry);
-                    curtex = 0;
-                    return 0;
-                }
-                else
-                {
-                    allocated_textures = new_allocated_textures;
-                    allocated_textures[num_allocated_textures] = curtex;
-                    num_allocated_textures ++;
-                }
-            }
+    // We're almost always created to be drawn right away, so count as part of this frame.
+    ta_entry->frame = _ta_frame();
 
-            uloc = 0;
-            vloc = 0;
-            vsize = -1;
-        }
-        else if((uloc + width) >= SPRITEMAP_UVSIZE)
+    if (width > 0 && height > 0 && mode == FONT_PIXEL_MODE_GRAY)
+    {
+        uint16_t *created_buffer = malloc(sizeof(uint16_t) * width * height);
+        if (created_buffer == 0)
         {
-            if (vsize == -1)
-            {
-                // Can't cache this character at all!
-                free(entry->data);
-                free(entry);
-                return 0;
-            }
-
-            uloc = 0;
-            vloc = vloc + vsize;
-            vsize = -1;
+            free(entry->data);
+            free(entry);
+            return 0;
         }
 
-        // If we reach here, we have room in the spritesheet for this character copy it over.
-        uint16_t *created_buffer = malloc(sizeof(uint16_t) * width * height);
-        if (created_buffer == 0)
+        // Let's try to find a spritemap to add this character to.
+        int u;
+        int v;
+        ta_sheet_t *sheet = _ta_sheet_place(width, height, &u, &v);
+        if (sheet == 0)
         {
+            free(created_buffer);
             free(entry->data);
             free(entry);
             return 0;
@@ -176,20 +360,21 @@ font_cache_entry_t *_ta_cache_create(uint32_t index, int advancex, int advancey,
         }
 
         /* Load this created sprite into the spritemap, save the cache pointer. */
-        ta_texture_load_sprite(curtex, SPRITEMAP_UVSIZE, 16, uloc, vloc, width, height, created_buffer);
+        ta_texture_load_sprite(sheet->texture, sheet->uvsize, 16, u, v, width, height, created_buffer);
         free(created_buffer);
 
-        ta_entry->texture = curtex;
-        ta_entry->u = uloc;
-        ta_entry->v = vloc;
+        ta_entry->texture = sheet->texture;
+        ta_entry->sheet = sheet;
+        ta_entry->u = u;
+        ta_entry->v = v;
 
-        /* Adjust where the next character will be stored. */
-        uloc += width;
-        vsize = height > vsize ? height : vsize;
+        sheet->glyphs++;
+        sheet->used += width * height;
     }
     else
     {
         ta_entry->texture = 0;
+        ta_entry->sheet = 0;
         ta_entry->u = 0;
         ta_entry->v = 0;
     }
@@ -198,6 +383,48 @@ font_cache_entry_t *_ta_cache_create(uint32_t index, int advancex, int advancey,
     return entry;
 }
 
+int ta_font_set_sheet_size(int uvsize)
+{
+    if (_ta_texture_desc_uvsize(uvsize) == 0xFFFFFFFF)
+    {
+        return -1;
+    }
+
+    sheet_uvsize = uvsize;
+    return 0;
+}
+
+int ta_font_sheet_stats(ta_font_sheet_stats_t *stats, int maxsheets)
+{
+    int count = 0;
+    for (ta_sheet_t *sheet = sheets; sheet != 0; sheet = sheet->next)
+    {
+        if (stats && count < maxsheets)
+        {
+            // Everything under the skyline is spoken for, whether a glyph lives there or not.
+            unsigned int allocated = 0;
+            for (int i = 0; i < sheet->nodes; i++)
+            {
+                allocated += sheet->skyline[i].y * sheet->skyline[i].width;
+            }
+
+            stats[count].uvsize = sheet->uvsize;
+            stats[count].glyphs = sheet->glyphs;
+            stats[count].used = sheet->used;
+            stats[count].allocated = allocated;
+            stats[count].total = sheet->uvsize * sheet->uvsize;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+font_cache_entry_t *_ta_cache_create(uint32_t index, int advancex, int advancey, int bitmap_left, int bitmap_top, int width, int height, int mode, uint8_t *buffer)
+{
+    return _ta_cache_create_namespace(index, advancex, advancey, bitmap_left, bitmap_top, width, height, mode, buffer, FONT_CACHE_TA);
+}
+
 // Forward definitions of stuff we don't want in public headers.
 extern unsigned int global_video_vertical;
 extern unsigned int global_video_width;
@@ -211,227 +438,158 @@ void _ta_draw_uncached_bitmap(int x, int y, unsigned int width, unsigned int hei
     // we might schedule a framebuffer fallback? Not sure.
 }
 
-void _ta_draw_cached_bitmap_horiz(int x, int y, unsigned int width, unsigned int height, void *data, color_t color)
+void _ta_glyph_quad(float xlow, float ylow, float xhigh, float yhigh, float ulow, float vlow, float uhigh, float vhigh, struct vertex_list_quad *myvertex)
 {
-    ta_cache_entry_t *ta_entry = data;
-    if (ta_entry->texture)
-    {
-        int low_x = 0;
-        int high_x = width;
-        int low_y = 0;
-        int high_y = height;
+    textured_vertex_t verticies[4] = {
+        { xlow, yhigh, 0.0, ulow, vhigh },
+        { xlow, ylow, 0.0, ulow, vlow },
+        { xhigh, ylow, 0.0, uhigh, vlow },
+        { xhigh, yhigh, 0.0, uhigh, vhigh },
+    };
 
-        if (x < 0)
+    myvertex->cmd = TA_CMD_VERTEX | TA_CMD_VERTEX_END_OF_STRIP;
+    if (global_video_vertical)
+    {
+        float vwidth = (float)global_video_width - 1.0;
+        for (int i = 0; i < 4; i++)
         {
-            if (x + width <= 0)
-            {
-                return;
-            }
-
-            low_x = -x;
+            float vx = vwidth - verticies[i].y;
+            verticies[i].y = verticies[i].x;
+            verticies[i].x = vx;
         }
-        if (y < 0)
-        {
-            if (y + height <= 0)
-            {
-                return;
-            }
+    }
+    myvertex->ax = verticies[0].x;
+    myvertex->ay = verticies[0].y;
+    myvertex->bx = verticies[1].x;
+    myvertex->by = verticies[1].y;
+    myvertex->cx = verticies[2].x;
+    myvertex->cy = verticies[2].y;
+    myvertex->dx = verticies[3].x;
+    myvertex->dy = verticies[3].y;
+    myvertex->au_av = (_ta_16bit_uv(verticies[0].u) << 16) | _ta_16bit_uv(verticies[0].v);
+    myvertex->bu_bv = (_ta_16bit_uv(verticies[1].u) << 16) | _ta_16bit_uv(verticies[1].v);
+    myvertex->cu_cv = (_ta_16bit_uv(verticies[2].u) << 16) | _ta_16bit_uv(verticies[2].v);
 
-            low_y = -y;
-        }
-        if ((x + width) >= cached_actual_width)
+    // Z is filled in by whoever submits this, since it depends on draw order.
+    myvertex->az = 0.0;
+    myvertex->bz = 0.0;
+    myvertex->cz = 0.0;
+}
+
+int _ta_glyph_vertex(int x, int y, unsigned int width, unsigned int height, ta_cache_entry_t *ta_entry, struct vertex_list_quad *myvertex)
+{
+    int low_x = 0;
+    int high_x = width;
+    int low_y = 0;
+    int high_y = height;
+
+    if (x < 0)
+    {
+        if (x + width <= 0)
         {
-            if (x >= cached_actual_width)
-            {
-                return;
-            }
+            return 0;
+        }
 
-            high_x = cached_actual_width - x;
+        low_x = -x;
+    }
+    if (y < 0)
+    {
+        if (y + height <= 0)
+        {
+            return 0;
         }
-        if (y + height >= cached_actual_height)
+
+        low_y = -y;
+    }
+    if ((x + width) >= cached_actual_width)
+    {
+        if (x >= cached_actual_width)
         {
-            if (y >= cached_actual_height)
-            {
-                return;
-            }
+            return 0;
+        }
 
-            high_y = cached_actual_height - y;
+        high_x = cached_actual_width - x;
+    }
+    if (y + height >= cached_actual_height)
+    {
+        if (y >= cached_actual_height)
+        {
+            return 0;
         }
 
-        float ulow = (float)(ta_entry->u + low_x) / (float)SPRITEMAP_UVSIZE;
-        float vlow = (float)(ta_entry->v + low_y) / (float)SPRITEMAP_UVSIZE;
-        float uhigh = (float)(ta_entry->u + high_x) / (float)SPRITEMAP_UVSIZE;
-        float vhigh = (float)(ta_entry->v + high_y) / (float)SPRITEMAP_UVSIZE;
+        high_y = cached_actual_height - y;
+    }
 
-        float z = __ta_quad_z_location();
-        textured_vertex_t verticies[4] = {
-            { (float)(x + low_x), (float)(y + high_y), z, ulow, vhigh },
-            { (float)(x + low_x), (float)(y + low_y), z, ulow, vlow },
-            { (float)(x + high_x), (float)(y + low_y), z, uhigh, vlow },
-            { (float)(x + high_x), (float)(y + high_y), z, uhigh, vhigh },
-        };
-
-        // This doesn't use the quad draw routines as it is slightly different
-        // (modulates the color against an all-white quad instead of just using
-        // decal mode).
-        struct polygon_list_quad mypoly;
-        struct vertex_list_quad myvertex;
+    _ta_glyph_quad(
+        (float)(x + low_x),
+        (float)(y + low_y),
+        (float)(x + high_x),
+        (float)(y + high_y),
+        (float)(ta_entry->u + low_x) / (float)ta_entry->sheet->uvsize,
+        (float)(ta_entry->v + low_y) / (float)ta_entry->sheet->uvsize,
+        (float)(ta_entry->u + high_x) / (float)ta_entry->sheet->uvsize,
+        (float)(ta_entry->v + high_y) / (float)ta_entry->sheet->uvsize,
+        myvertex
+    );
+    return 1;
+}
 
-        mypoly.cmd =
-            TA_CMD_SPRITE |
-            TA_CMD_POLYGON_TYPE_TRANSPARENT |
-            TA_CMD_POLYGON_SUBLIST |
-            TA_CMD_POLYGON_PACKED_COLOR |
-            TA_CMD_POLYGON_16BIT_UV |
-            TA_CMD_POLYGON_TEXTURED;
-        mypoly.mode1 =
-            TA_POLYMODE1_Z_GREATEREQUAL |
-            TA_POLYMODE1_CULL_DISABLED;
-        mypoly.mode2 =
-            TA_POLYMODE2_MIPMAP_D_1_00 |
-            TA_POLYMODE2_TEXTURE_MODULATE |
-            TA_POLYMODE2_U_SIZE_256 |
-            TA_POLYMODE2_V_SIZE_256 |
-            TA_POLYMODE2_TEXTURE_CLAMP_U |
-            TA_POLYMODE2_TEXTURE_CLAMP_V |
-            TA_POLYMODE2_FOG_DISABLED |
-            TA_POLYMODE2_SRC_BLEND_SRC_ALPHA |
-            TA_POLYMODE2_DST_BLEND_INV_SRC_ALPHA;
-        mypoly.texture =
-            TA_TEXTUREMODE_ARGB4444 |
-            TA_TEXTUREMODE_ADDRESS(ta_entry->texture);
-        mypoly.mult_color = RGB0888(color.r, color.g, color.b);
-        mypoly.add_color = 0;
-        ta_commit_list(&mypoly, TA_LIST_SHORT);
+void _ta_glyph_header(ta_cache_entry_t *ta_entry, color_t color, uint32_t type, uint32_t filter, struct polygon_list_quad *mypoly)
+{
+    // This doesn't use the quad draw routines as it is slightly different
+    // (modulates the color against an all-white quad instead of just using
+    // decal mode).
+    mypoly->cmd =
+        TA_CMD_SPRITE |
+        type |
+        TA_CMD_POLYGON_SUBLIST |
+        TA_CMD_POLYGON_PACKED_COLOR |
+        TA_CMD_POLYGON_16BIT_UV |
+        TA_CMD_POLYGON_TEXTURED;
+    mypoly->mode1 =
+        TA_POLYMODE1_Z_GREATEREQUAL |
+        TA_POLYMODE1_CULL_DISABLED;
+    mypoly->mode2 =
+        TA_POLYMODE2_MIPMAP_D_1_00 |
+        TA_POLYMODE2_TEXTURE_MODULATE |
+        filter |
+        _ta_texture_desc_uvsize(ta_entry->sheet->uvsize) |
+        TA_POLYMODE2_TEXTURE_CLAMP_U |
+        TA_POLYMODE2_TEXTURE_CLAMP_V |
+        TA_POLYMODE2_FOG_DISABLED |
+        TA_POLYMODE2_SRC_BLEND_SRC_ALPHA |
+        TA_POLYMODE2_DST_BLEND_INV_SRC_ALPHA;
+    mypoly->texture =
+        TA_TEXTUREMODE_ARGB4444 |
+        TA_TEXTUREMODE_ADDRESS(ta_entry->texture);
+    mypoly->mult_color = RGB0888(color.r, color.g, color.b);
+    mypoly->add_color = 0;
 
-        myvertex.cmd = TA_CMD_VERTEX | TA_CMD_VERTEX_END_OF_STRIP;
-        myvertex.ax = verticies[0].x;
-        myvertex.ay = verticies[0].y;
-        myvertex.az = verticies[0].z;
-        myvertex.bx = verticies[1].x;
-        myvertex.by = verticies[1].y;
-        myvertex.bz = verticies[1].z;
-        myvertex.cx = verticies[2].x;
-        myvertex.cy = verticies[2].y;
-        myvertex.cz = verticies[2].z;
-        myvertex.dx = verticies[3].x;
-        myvertex.dy = verticies[3].y;
-        myvertex.au_av = (_ta_16bit_uv(verticies[0].u) << 16) | _ta_16bit_uv(verticies[0].v);
-        myvertex.bu_bv = (_ta_16bit_uv(verticies[1].u) << 16) | _ta_16bit_uv(verticies[1].v);
-        myvertex.cu_cv = (_ta_16bit_uv(verticies[2].u) << 16) | _ta_16bit_uv(verticies[2].v);
-        ta_commit_list(&myvertex, TA_LIST_LONG);
-    }
+    // Everything that draws a glyph goes through here, so this is where we find out that
+    // the current frame's display list uses it.
+    ta_entry->frame = _ta_frame();
 }
 
-void _ta_draw_cached_bitmap_vert(int x, int y, unsigned int width, unsigned int height, void *data, color_t color)
+void _ta_draw_cached_bitmap(int x, int y, unsigned int width, unsigned int height, void *data, color_t color)
 {
     ta_cache_entry_t *ta_entry = data;
     if (ta_entry->texture)
     {
-        int low_x = 0;
-        int high_x = width;
-        int low_y = 0;
-        int high_y = height;
-
-        if (x < 0)
-        {
-            if (x + width <= 0)
-            {
-                return;
-            }
-
-            low_x = -x;
-        }
-        if (y < 0)
-        {
-            if (y + height <= 0)
-            {
-                return;
-            }
-
-            low_y = -y;
-        }
-        if ((x + width) >= cached_actual_width)
-        {
-            if (x >= cached_actual_width)
-            {
-                return;
-            }
+        struct polygon_list_quad mypoly;
+        struct vertex_list_quad myvertex;
 
-            high_x = cached_actual_width - x;
-        }
-        if (y + height >= cached_actual_height)
+        if (!_ta_glyph_vertex(x, y, width, height, ta_entry, &myvertex))
         {
-            if (y >= cached_actual_height)
-            {
-                return;
-            }
-
-            high_y = cached_actual_height - y;
+            return;
         }
 
-        float ulow = (float)(ta_entry->u + low_x) / (float)SPRITEMAP_UVSIZE;
-        float vlow = (float)(ta_entry->v + low_y) / (float)SPRITEMAP_UVSIZE;
-        float uhigh = (float)(ta_entry->u + high_x) / (float)SPRITEMAP_UVSIZE;
-        float vhigh = (float)(ta_entry->v + high_y) / (float)SPRITEMAP_UVSIZE;
-
         float z = __ta_quad_z_location();
-        textured_vertex_t verticies[4] = {
-            { (float)(x + low_x), (float)(y + high_y), z, ulow, vhigh },
-            { (float)(x + low_x), (float)(y + low_y), z, ulow, vlow },
-            { (float)(x + high_x), (float)(y + low_y), z, uhigh, vlow },
-            { (float)(x + high_x), (float)(y + high_y), z, uhigh, vhigh },
-        };
-
-        // This doesn't use the quad draw routines as it is slightly different
-        // (modulates the color against an all-white quad instead of just using
-        // decal mode).
-        struct polygon_list_quad mypoly;
-        struct vertex_list_quad myvertex;
+        myvertex.az = z;
+        myvertex.bz = z;
+        myvertex.cz = z;
 
-        mypoly.cmd =
-            TA_CMD_SPRITE |
-            TA_CMD_POLYGON_TYPE_TRANSPARENT |
-            TA_CMD_POLYGON_SUBLIST |
-            TA_CMD_POLYGON_PACKED_COLOR |
-            TA_CMD_POLYGON_16BIT_UV |
-            TA_CMD_POLYGON_TEXTURED;
-        mypoly.mode1 =
-            TA_POLYMODE1_Z_GREATEREQUAL |
-            TA_POLYMODE1_CULL_DISABLED;
-        mypoly.mode2 =
-            TA_POLYMODE2_MIPMAP_D_1_00 |
-            TA_POLYMODE2_TEXTURE_MODULATE |
-            TA_POLYMODE2_U_SIZE_256 |
-            TA_POLYMODE2_V_SIZE_256 |
-            TA_POLYMODE2_TEXTURE_CLAMP_U |
-            TA_POLYMODE2_TEXTURE_CLAMP_V |
-            TA_POLYMODE2_FOG_DISABLED |
-            TA_POLYMODE2_SRC_BLEND_SRC_ALPHA |
-            TA_POLYMODE2_DST_BLEND_INV_SRC_ALPHA;
-        mypoly.texture =
-            TA_TEXTUREMODE_ARGB4444 |
-            TA_TEXTUREMODE_ADDRESS(ta_entry->texture);
-        mypoly.mult_color = RGB0888(color.r, color.g, color.b);
-        mypoly.add_color = 0;
+        _ta_glyph_header(ta_entry, color, TA_CMD_POLYGON_TYPE_TRANSPARENT, 0, &mypoly);
         ta_commit_list(&mypoly, TA_LIST_SHORT);
-
-        myvertex.cmd = TA_CMD_VERTEX | TA_CMD_VERTEX_END_OF_STRIP;
-        float vwidth = (float)global_video_width - 1.0;
-        myvertex.ax = vwidth - verticies[0].y;
-        myvertex.ay = verticies[0].x;
-        myvertex.az = verticies[0].z;
-        myvertex.bx = vwidth - verticies[1].y;
-        myvertex.by = verticies[1].x;
-        myvertex.bz = verticies[1].z;
-        myvertex.cx = vwidth - verticies[2].y;
-        myvertex.cy = verticies[2].x;
-        myvertex.cz = verticies[2].z;
-        myvertex.dx = vwidth - verticies[3].y;
-        myvertex.dy = verticies[3].x;
-        myvertex.au_av = (_ta_16bit_uv(verticies[0].u) << 16) | _ta_16bit_uv(verticies[0].v);
-        myvertex.bu_bv = (_ta_16bit_uv(verticies[1].u) << 16) | _ta_16bit_uv(verticies[1].v);
-        myvertex.cu_cv = (_ta_16bit_uv(verticies[2].u) << 16) | _ta_16bit_uv(verticies[2].v);
         ta_commit_list(&myvertex, TA_LIST_LONG);
     }
 }
@@ -448,7 +606,7 @@ int ta_draw_character(int x, int y, font_t *fontface, color_t color, int ch)
         &_ta_cache_create,
         FONT_CACHE_TA,
         &_ta_draw_uncached_bitmap,
-        global_video_vertical ? &_ta_draw_cached_bitmap_vert : &_ta_draw_cached_bitmap_horiz
+        &_ta_draw_cached_bitmap
     );
 }
 
@@ -475,7 +633,7 @@ int ta_draw_text(int x, int y, font_t *fontface, color_t color, const char * con
                 &_ta_cache_create,
                 FONT_CACHE_TA,
                 &_ta_draw_uncached_bitmap,
-                global_video_vertical ? &_ta_draw_cached_bitmap_vert : &_ta_draw_cached_bitmap_horiz
+                &_ta_draw_cached_bitmap
             );
         }
         else if (length == 0)
@@ -492,4 +650,658 @@ int ta_draw_text(int x, int y, font_t *fontface, color_t color, const char * con
         return 0;
     }
 }
-#endif
+
+// A single laid out codepoint inside a text object. Every slot holds a pin on the
+// cache entry it was laid out with, so its texture sheet space can't be recycled
+// while the prebuilt vertex still points at it.
+typedef struct
+{
+    uint32_t ch;
+    int x;
+    int y;
+    font_cache_entry_t *entry;
+    int visible;
+    struct vertex_list_quad vertex;
+} ta_text_glyph_t;
+
+// Worst case, every glyph lands on a different sheet than the one before it and
+// needs its own sprite header.
+#define TA_TEXT_GLYPH_COMMAND_SIZE (sizeof(struct polygon_list_quad) + sizeof(struct vertex_list_quad))
+
+void _ta_text_release(ta_text_glyph_t *glyph)
+{
+    if (glyph->entry)
+    {
+        glyph->entry->pins--;
+        glyph->entry = 0;
+    }
+    glyph->ch = 0;
+    glyph->visible = 0;
+}
+
+void _ta_text_layout(ta_text_t *text, uint32_t *codepoints, int force)
+{
+    ta_text_glyph_t *glyphs = text->glyphs;
+    font_t *fontface = text->fontface;
+    unsigned int lineheight = fontface->lineheight;
+    unsigned int count = 0;
+    int tx = text->x;
+    int ty = text->y;
+
+    while (count < text->maxlength && codepoints[count])
+    {
+        uint32_t ch = codepoints[count];
+        ta_text_glyph_t *glyph = &glyphs[count];
+        font_cache_entry_t *entry = 0;
+        int gx = tx;
+        int gy = ty;
+
+        switch (ch)
+        {
+            case '\r':
+            case '\n':
+            {
+                tx = text->x;
+                ty += lineheight;
+                break;
+            }
+            case '\t':
+            {
+                // Every font should have a space, so size tabs based on that.
+                font_cache_entry_t *space = _font_cache_get(fontface, ' ', &_ta_cache_create, FONT_CACHE_TA);
+                if (space)
+                {
+                    tx += space->advancex * 5;
+                    ty += space->advancey * 5;
+                }
+                break;
+            }
+            default:
+            {
+                // Anything we can't load or cache just takes up no space, the same
+                // as it would if we tried to draw it directly.
+                entry = _font_cache_get(fontface, ch, &_ta_cache_create, FONT_CACHE_TA);
+                if (entry)
+                {
+                    tx += entry->advancex;
+                    ty += entry->advancey;
+                }
+                break;
+            }
+        }
+
+        // Only rebuild the vertex for glyphs that actually changed, so updating a
+        // score or timer only touches the digits that rolled over.
+        if (force || glyph->ch != ch || glyph->entry != entry || glyph->x != gx || glyph->y != gy)
+        {
+            if (entry)
+            {
+                entry->pins++;
+            }
+            _ta_text_release(glyph);
+
+            glyph->ch = ch;
+            glyph->x = gx;
+            glyph->y = gy;
+            glyph->entry = entry;
+            if (entry && entry->mode == FONT_PIXEL_MODE_GRAY && ((ta_cache_entry_t *)entry->data)->texture)
+            {
+                glyph->visible = _ta_glyph_vertex(
+                    gx + entry->bitmap_left,
+                    gy + lineheight - entry->bitmap_top,
+                    entry->width,
+                    entry->height,
+                    entry->data,
+                    &glyph->vertex
+                );
+            }
+            text->dirty = 1;
+        }
+
+        count++;
+    }
+
+    // Anything past the new end of the string no longer needs its glyph.
+    for (unsigned int i = count; i < text->length; i++)
+    {
+        _ta_text_release(&glyphs[i]);
+        text->dirty = 1;
+    }
+
+    text->length = count;
+}
+
+void _ta_text_build(ta_text_t *text, float z)
+{
+    ta_text_glyph_t *glyphs = text->glyphs;
+    uint8_t *commands = text->commands;
+    unsigned int location = 0;
+    ta_sheet_t *cursheet = 0;
+
+    for (unsigned int i = 0; i < text->length; i++)
+    {
+        if (!glyphs[i].visible)
+        {
+            continue;
+        }
+
+        // Consecutive glyphs on the same sheet can share a sprite header.
+        ta_cache_entry_t *ta_entry = glyphs[i].entry->data;
+        if (ta_entry->sheet != cursheet)
+        {
+            _ta_glyph_header(ta_entry, text->color, TA_CMD_POLYGON_TYPE_TRANSPARENT, 0, (struct polygon_list_quad *)(commands + location));
+            location += sizeof(struct polygon_list_quad);
+            cursheet = ta_entry->sheet;
+        }
+
+        struct vertex_list_quad *vertex = (struct vertex_list_quad *)(commands + location);
+        memcpy(vertex, &glyphs[i].vertex, sizeof(struct vertex_list_quad));
+        vertex->az = z;
+        vertex->bz = z;
+        vertex->cz = z;
+        location += sizeof(struct vertex_list_quad);
+    }
+
+    text->commandlength = location;
+    text->z = z;
+    text->dirty = 0;
+}
+
+void _ta_text_set_z(ta_text_t *text, float z)
+{
+    uint8_t *commands = text->commands;
+    unsigned int location = 0;
+
+    while (location < text->commandlength)
+    {
+        if ((((uint32_t *)(commands + location))[0] & 0xE0000000) == TA_CMD_VERTEX)
+        {
+            struct vertex_list_quad *vertex = (struct vertex_list_quad *)(commands + location);
+            vertex->az = z;
+            vertex->bz = z;
+            vertex->cz = z;
+            location += sizeof(struct vertex_list_quad);
+        }
+        else
+        {
+            location += sizeof(struct polygon_list_quad);
+        }
+    }
+
+    text->z = z;
+}
+
+ta_text_t *ta_text_create(font_t *fontface, unsigned int maxlength)
+{
+    if (fontface == 0 || maxlength == 0)
+    {
+        return 0;
+    }
+
+    ta_text_t *text = malloc(sizeof(ta_text_t));
+    if (text == 0)
+    {
+        return 0;
+    }
+
+    text->glyphs = malloc(sizeof(ta_text_glyph_t) * maxlength);
+    text->commands = malloc(TA_TEXT_GLYPH_COMMAND_SIZE * maxlength);
+    if (text->glyphs == 0 || text->commands == 0)
+    {
+        free(text->glyphs);
+        free(text->commands);
+        free(text);
+        return 0;
+    }
+
+    memset(text->glyphs, 0, sizeof(ta_text_glyph_t) * maxlength);
+    text->fontface = fontface;
+    text->maxlength = maxlength;
+    text->length = 0;
+    text->x = 0;
+    text->y = 0;
+    text->color = rgb(255, 255, 255);
+    text->commandlength = 0;
+    text->z = 0.0;
+    text->vertical = global_video_vertical;
+    text->dirty = 0;
+
+    return text;
+}
+
+int ta_text_set(ta_text_t *text, int x, int y, color_t color, const char * const msg, ...)
+{
+    if (text == 0)
+    {
+        return -1;
+    }
+
+    char buffer[2048];
+    buffer[0] = 0;
+    if (msg)
+    {
+        va_list args;
+        va_start(args, msg);
+        int length = vsnprintf(buffer, 2047, msg, args);
+        va_end(args);
+
+        if (length < 0)
+        {
+            return -1;
+        }
+        buffer[min(length, 2047)] = 0;
+    }
+
+    uint32_t *codepoints = utf8_convert(buffer);
+    if (codepoints == 0)
+    {
+        return -1;
+    }
+
+    // Moving the whole string or changing orientation means every glyph moves,
+    // but a color change only touches the sprite headers.
+    int force = (text->x != x || text->y != y || text->vertical != global_video_vertical);
+    if (text->color.r != color.r || text->color.g != color.g || text->color.b != color.b || text->color.a != color.a)
+    {
+        text->dirty = 1;
+    }
+
+    text->x = x;
+    text->y = y;
+    text->color = color;
+    text->vertical = global_video_vertical;
+    _ta_text_layout(text, codepoints, force);
+
+    free(codepoints);
+    return 0;
+}
+
+void ta_text_draw(ta_text_t *text)
+{
+    if (text == 0 || text->length == 0)
+    {
+        return;
+    }
+
+    if (text->vertical != global_video_vertical)
+    {
+        // The orientation changed out from under us, so re-lay out what we have.
+        uint32_t *codepoints = malloc(sizeof(uint32_t) * (text->length + 1));
+        if (codepoints == 0)
+        {
+            return;
+        }
+
+        ta_text_glyph_t *glyphs = text->glyphs;
+        for (unsigned int i = 0; i < text->length; i++)
+        {
+            codepoints[i] = glyphs[i].ch;
+        }
+        codepoints[text->length] = 0;
+
+        text->vertical = global_video_vertical;
+        _ta_text_layout(text, codepoints, 1);
+        free(codepoints);
+    }
+
+    // The whole string shares a single Z, so when nothing else changed since last
+    // frame, all we have to do is patch that before re-submitting.
+    float z = __ta_quad_z_location();
+    if (text->dirty)
+    {
+        _ta_text_build(text, z);
+    }
+    else if (text->z != z)
+    {
+        _ta_text_set_z(text, z);
+    }
+
+    if (text->commandlength)
+    {
+        // The prebuilt commands skip _ta_glyph_header() when nothing changed, so mark
+        // our glyphs as drawn this frame here instead. Otherwise a ta_text_set() later
+        // in the frame could unpin one and let it get evicted before it is rendered.
+        ta_text_glyph_t *glyphs = text->glyphs;
+        uint32_t frame = _ta_frame();
+        for (unsigned int i = 0; i < text->length; i++)
+        {
+            if (glyphs[i].entry)
+            {
+                ((ta_cache_entry_t *)glyphs[i].entry->data)->frame = frame;
+            }
+        }
+
+        ta_commit_list(text->commands, text->commandlength);
+    }
+}
+
+void ta_text_free(ta_text_t *text)
+{
+    if (text)
+    {
+        ta_text_glyph_t *glyphs = text->glyphs;
+        for (unsigned int i = 0; i < text->length; i++)
+        {
+            _ta_text_release(&glyphs[i]);
+        }
+
+        free(text->glyphs);
+        free(text->commands);
+        free(text);
+    }
+}
+
+// Signed distance field glyphs are rasterized once at the font's SDF size and then
+// scaled to whatever size they are drawn at. The spread is how many pixels (at the
+// SDF size) away from an edge the field still encodes distance for.
+#define TA_SDF_DEFAULT_SIZE 32
+#define TA_SDF_SPREAD 4
+
+void _ta_sdf_generate(uint8_t *src, int width, int height, uint8_t *dst)
+{
+    int dwidth = width + (TA_SDF_SPREAD * 2);
+    int dheight = height + (TA_SDF_SPREAD * 2);
+
+    for (int dy = 0; dy < dheight; dy++)
+    {
+        for (int dx = 0; dx < dwidth; dx++)
+        {
+            int sx = dx - TA_SDF_SPREAD;
+            int sy = dy - TA_SDF_SPREAD;
+            int inside = (sx >= 0 && sy >= 0 && sx < width && sy < height && src[sx + (sy * width)] >= 128);
+            int best = (TA_SDF_SPREAD + 1) * (TA_SDF_SPREAD + 1);
+
+            // Find the closest pixel on the other side of the edge. Glyphs are small and
+            // this only happens once per glyph, so a bounded brute force search is fine.
+            for (int oy = -TA_SDF_SPREAD; oy <= TA_SDF_SPREAD; oy++)
+            {
+                int py = sy + oy;
+                for (int ox = -TA_SDF_SPREAD; ox <= TA_SDF_SPREAD; ox++)
+                {
+                    int distance = (ox * ox) + (oy * oy);
+                    if (distance >= best)
+                    {
+                        continue;
+                    }
+
+                    int px = sx + ox;
+                    int other = (px >= 0 && py >= 0 && px < width && py < height && src[px + (py * width)] >= 128);
+                    if (other != inside)
+                    {
+                        best = distance;
+                    }
+                }
+            }
+
+            // The edge itself is halfway between the two pixels, and maps to 128.
+            float edge = sqrtf((float)best) - 0.5;
+            if (edge > (float)TA_SDF_SPREAD)
+            {
+                edge = (float)TA_SDF_SPREAD;
+            }
+
+            int value = 128 + (int)((inside ? edge : -edge) * 127.0 / (float)TA_SDF_SPREAD);
+            dst[dx + (dy * dwidth)] = value < 0 ? 0 : (value > 255 ? 255 : value);
+        }
+    }
+}
+
+font_cache_entry_t *_ta_sdf_cache_create(uint32_t index, int advancex, int advancey, int bitmap_left, int bitmap_top, int width, int height, int mode, uint8_t *buffer)
+{
+    if (width > 0 && height > 0 && mode == FONT_PIXEL_MODE_GRAY)
+    {
+        // The field extends past the glyph's coverage so that edges survive filtering.
+        int dwidth = width + (TA_SDF_SPREAD * 2);
+        int dheight = height + (TA_SDF_SPREAD * 2);
+        uint8_t *field = malloc(dwidth * dheight);
+        if (field == 0)
+        {
+            return 0;
+        }
+
+        _ta_sdf_generate(buffer, width, height, field);
+        font_cache_entry_t *entry = _ta_cache_create_namespace(
+            index,
+            advancex,
+            advancey,
+            bitmap_left - TA_SDF_SPREAD,
+            bitmap_top + TA_SDF_SPREAD,
+            dwidth,
+            dheight,
+            mode,
+            field,
+            FONT_CACHE_TA_SDF
+        );
+        free(field);
+        return entry;
+    }
+    else
+    {
+        return _ta_cache_create_namespace(index, advancex, advancey, bitmap_left, bitmap_top, width, height, mode, buffer, FONT_CACHE_TA_SDF);
+    }
+}
+
+font_cache_entry_t *_ta_sdf_get(font_t *fontface, uint32_t ch, unsigned int sdfsize, int *resized)
+{
+    font_cache_entry_t *entry = _font_cache_lookup_size(fontface, FONT_CACHE_TA_SDF, ch, sdfsize);
+    if (entry)
+    {
+        return entry;
+    }
+
+    // Only switch the backend over to the SDF size when we actually need to rasterize
+    // something, the caller switches it back once it is done drawing.
+    const font_backend_t *backend = fontface->backend;
+    if (!(*resized))
+    {
+        if (backend->set_size(fontface, sdfsize))
+        {
+            return 0;
+        }
+        *resized = 1;
+    }
+
+    font_glyph_t glyph;
+    if (backend->load_glyph(fontface, ch, &glyph))
+    {
+        return 0;
+    }
+
+    entry = _ta_sdf_cache_create(
+        ch,
+        glyph.advancex,
+        glyph.advancey,
+        glyph.bitmap_left,
+        glyph.bitmap_top,
+        glyph.width,
+        glyph.height,
+        glyph.mode,
+        glyph.buffer
+    );
+    _font_cache_add_size(fontface, entry, sdfsize);
+    return entry;
+}
+
+void _ta_draw_sdf_glyph(float x, float y, float scale, font_cache_entry_t *entry, color_t color)
+{
+    ta_cache_entry_t *ta_entry = entry->data;
+    if (ta_entry->texture == 0 || entry->mode != FONT_PIXEL_MODE_GRAY)
+    {
+        return;
+    }
+
+    float xlow = x;
+    float ylow = y;
+    float xhigh = x + ((float)entry->width * scale);
+    float yhigh = y + ((float)entry->height * scale);
+    float uvsize = (float)ta_entry->sheet->uvsize;
+    float ulow = (float)ta_entry->u / uvsize;
+    float vlow = (float)ta_entry->v / uvsize;
+    float uhigh = (float)(ta_entry->u + entry->width) / uvsize;
+    float vhigh = (float)(ta_entry->v + entry->height) / uvsize;
+    float screen_width = (float)cached_actual_width;
+    float screen_height = (float)cached_actual_height;
+
+    if (xhigh <= 0.0 || yhigh <= 0.0 || xlow >= screen_width || ylow >= screen_height)
+    {
+        return;
+    }
+
+    // Clip to the screen the same way integer glyphs do, adjusting the UVs to match.
+    if (xlow < 0.0)
+    {
+        ulow += (uhigh - ulow) * (-xlow / (xhigh - xlow));
+        xlow = 0.0;
+    }
+    if (ylow < 0.0)
+    {
+        vlow += (vhigh - vlow) * (-ylow / (yhigh - ylow));
+        ylow = 0.0;
+    }
+    if (xhigh > screen_width)
+    {
+        uhigh -= (uhigh - ulow) * ((xhigh - screen_width) / (xhigh - xlow));
+        xhigh = screen_width;
+    }
+    if (yhigh > screen_height)
+    {
+        vhigh -= (vhigh - vlow) * ((yhigh - screen_height) / (yhigh - ylow));
+        yhigh = screen_height;
+    }
+
+    struct polygon_list_quad mypoly;
+    struct vertex_list_quad myvertex;
+
+    _ta_glyph_quad(xlow, ylow, xhigh, yhigh, ulow, vlow, uhigh, vhigh, &myvertex);
+    float z = __ta_quad_z_location();
+    myvertex.az = z;
+    myvertex.bz = z;
+    myvertex.cz = z;
+
+    // Bilinear filtering interpolates the distance between texels, and the punch-through
+    // alpha test then cuts the edge at the midpoint, so the glyph stays sharp at any scale.
+    _ta_glyph_header(ta_entry, color, TA_CMD_POLYGON_TYPE_PUNCHTHRU, TA_POLYMODE2_BILINEAR_FILTER, &mypoly);
+    ta_commit_list(&mypoly, TA_LIST_SHORT);
+    ta_commit_list(&myvertex, TA_LIST_LONG);
+}
+
+int _ta_draw_sdf_calc_text(int x, int y, font_t *fontface, float size, color_t color, uint32_t *text)
+{
+    if (fontface == 0 || size <= 0.0)
+    {
+        return -1;
+    }
+
+    unsigned int sdfsize = fontface->sdfsize ? fontface->sdfsize : TA_SDF_DEFAULT_SIZE;
+    float scale = size / (float)sdfsize;
+    float tx = (float)x;
+    float ty = (float)y;
+    int resized = 0;
+    int error = 0;
+
+    while (*text)
+    {
+        switch (*text)
+        {
+            case '\r':
+            case '\n':
+            {
+                tx = (float)x;
+                ty += size;
+                break;
+            }
+            case '\t':
+            {
+                // Every font should have a space, so size tabs based on that.
+                font_cache_entry_t *entry = _ta_sdf_get(fontface, ' ', sdfsize, &resized);
+                if (entry)
+                {
+                    tx += (float)(entry->advancex * 5) * scale;
+                    ty += (float)(entry->advancey * 5) * scale;
+                }
+                break;
+            }
+            default:
+            {
+                font_cache_entry_t *entry = _ta_sdf_get(fontface, *text, sdfsize, &resized);
+                if (entry == 0)
+                {
+                    error = -1;
+                    break;
+                }
+
+                _ta_draw_sdf_glyph(
+                    tx + ((float)entry->bitmap_left * scale),
+                    ty + size - ((float)entry->bitmap_top * scale),
+                    scale,
+                    entry,
+                    color
+                );
+
+                // Advance the pen based on this glyph.
+                tx += (float)entry->advancex * scale;
+                ty += (float)entry->advancey * scale;
+                break;
+            }
+        }
+
+        if (error)
+        {
+            break;
+        }
+        text++;
+    }
+
+    if (resized)
+    {
+        // Put the font back the way the caller had it.
+        ((const font_backend_t *)fontface->backend)->set_size(fontface, fontface->lineheight);
+    }
+
+    return error;
+}
+
+int ta_draw_sdf_character(int x, int y, font_t *fontface, float size, color_t color, int ch)
+{
+    uint32_t text[2] = { ch, 0 };
+    return _ta_draw_sdf_calc_text(x, y, fontface, size, color, text);
+}
+
+int ta_draw_sdf_text(int x, int y, font_t *fontface, float size, color_t color, const char * const msg, ...)
+{
+    if (msg)
+    {
+        char buffer[2048];
+        va_list args;
+        va_start(args, msg);
+        int length = vsnprintf(buffer, 2047, msg, args);
+        va_end(args);
+
+        if (length > 0)
+        {
+            buffer[min(length, 2047)] = 0;
+
+            uint32_t *text = utf8_convert(buffer);
+            if (text == 0)
+            {
+                return -1;
+            }
+
+            int error = _ta_draw_sdf_calc_text(x, y, fontface, size, color, text);
+            free(text);
+            return error;
+        }
+        else if (length == 0)
+        {
+            return 0;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+}
@@ -1,3 +1,5 @@
+#include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include "naomi/video.h"
 #include "naomi/system.h"
@@ -8,6 +10,11 @@
 #include "irqinternal.h"
 #include "holly.h"
 #include "video-internal.h"
+#include "font.h"
+
+#ifndef min
+#define min(a,b) (((a) < (b)) ? (a) : (b))
+#endif
 
 #define WAITING_LIST_OPAQUE 0x1
 #define WAITING_LIST_TRANSPARENT 0x2
@@ -327,6 +334,7 @@ extern unsigned int global_video_depth;
 extern unsigned int global_video_width;
 extern unsigned int global_video_height;
 extern unsigned int global_video_vertical;
+extern unsigned int cached_actual_width;
 
 void _ta_set_background_color(struct ta_buffers *buffers, uint32_t rgba)
 {
@@ -397,6 +405,9 @@ extern uint32_t global_buffer_offset[3];
 // Prototype from texture.c for managing textures in VRAM.
 void _ta_init_texture_allocator(void *base, unsigned int size);
 
+// The debug font texture, lazily uploaded the first time debug text is drawn.
+static void *debug_font_texture = 0;
+
 void _ta_init_buffers()
 {
     // Where we start with our buffers. Its important that BUFLOC is aligned
@@ -459,6 +470,9 @@ void _ta_init_buffers()
 
     // Now, ask the texture allocator to initialize based on our known texture location.
     _ta_init_texture_allocator(ta_working_buffers.texture_ram, ta_working_buffers.texture_ram_size);
+
+    // The allocator was just wiped, so any debug font we uploaded is gone.
+    debug_font_texture = 0;
 }
 
 void ta_commit_begin()
@@ -582,8 +596,35 @@ void _ta_begin_render(struct ta_buffers *buffers, void *scrn)
     populated_lists = 0;
 }
 
+// Whether ta_render() was called since video.c last asked, so that the hybrid
+// background mode knows whether the TA is already painting the background plane.
+static unsigned int rendered_this_frame = 0;
+
+// Prototype from video.c so we don't render on top of an in-progress background clear.
+void _video_wait_background();
+
+// The frame whose display list is currently being built, and how many frames have finished
+// rendering. Code that points the TA at texture RAM can compare these to find out whether a
+// display list that might still use that memory is waiting to be rendered.
+static uint32_t ta_frame = 0;
+static uint32_t ta_frames_rendered = 0;
+
+uint32_t _ta_frame()
+{
+    return ta_frame;
+}
+
+int _ta_frame_rendered(uint32_t frame)
+{
+    return (int32_t)(ta_frames_rendered - frame) > 0;
+}
+
 void ta_render()
 {
+    _video_wait_background();
+    rendered_this_frame = 1;
+    uint32_t frame = ta_frame++;
+
     if (_irq_is_disabled(_irq_get_sr()))
     {
         /* Start rendering the new command list to the screen */
@@ -598,6 +639,30 @@ void ta_render()
         /* Start rendering and park this thread until the HW is finished. */
         _thread_ta_render(&ta_working_buffers, buffer_base);
     }
+
+    ta_frames_rendered = frame + 1;
+}
+
+int _ta_consume_rendered()
+{
+    int rendered = rendered_this_frame;
+    rendered_this_frame = 0;
+    return rendered;
+}
+
+int _ta_render_background()
+{
+    if (populated_lists != 0 || ta_working_buffers.background_list == 0)
+    {
+        // Somebody has lists pending for this frame, so we can't render just the
+        // background without also rendering their half-finished scene.
+        return 0;
+    }
+
+    // With no lists populated every tile is empty, so this only draws the background plane.
+    ta_render();
+    rendered_this_frame = 0;
+    return 1;
 }
 
 // Prototype for initializing texture twiddle tables in texture.c
@@ -664,6 +729,10 @@ void _ta_init()
     // Set up palettes to match videomode so that we can use rgb()/rgba() to fill palettes
     videobase[POWERVR2_PALETTE_MODE] = global_video_depth == 2 ? PALETTE_CFG_ARGB1555 : PALETTE_CFG_ARGB8888;
 
+    // Punch-through polygons discard anything below half alpha, which is also where
+    // signed distance field glyphs put their edges.
+    videobase[POWERVR2_PT_ALPHA_REF] = 0x80;
+
     // Wait for vblank.
     while(!(videobase[POWERVR2_SYNC_STAT] & 0x1FF)) { ; }
     while((videobase[POWERVR2_SYNC_STAT] & 0x1FF)) { ; }
@@ -1504,3 +1573,212 @@ float __ta_quad_z_location()
     quad_zloc += Z_INCREMENT;
     return cur_z;
 }
+
+// The debug font is 256 8x8 characters, laid out as a 16x16 grid of characters on
+// a single texture. Each pixel is stored as pure white with the alpha channel set
+// to on or off so we can modulate it by whatever color is requested.
+#define DEBUG_FONT_UVSIZE 128
+#define DEBUG_FONT_CHARS_PER_ROW (DEBUG_FONT_UVSIZE / 8)
+
+static void *_ta_debug_font_texture()
+{
+    if (debug_font_texture == 0)
+    {
+        void *texture = ta_texture_malloc(DEBUG_FONT_UVSIZE, 16);
+        if (texture == 0)
+        {
+            return 0;
+        }
+
+        uint16_t *buffer = malloc(sizeof(uint16_t) * DEBUG_FONT_UVSIZE * DEBUG_FONT_UVSIZE);
+        if (buffer == 0)
+        {
+            ta_texture_free(texture);
+            return 0;
+        }
+
+        for (int ch = 0; ch < 256; ch++)
+        {
+            int xloc = (ch % DEBUG_FONT_CHARS_PER_ROW) * 8;
+            int yloc = (ch / DEBUG_FONT_CHARS_PER_ROW) * 8;
+
+            for (int row = 0; row < 8; row++)
+            {
+                uint8_t c = __font_data[(ch * 8) + row];
+                for (int col = 0; col < 8; col++)
+                {
+                    buffer[(xloc + col) + ((yloc + row) * DEBUG_FONT_UVSIZE)] = (c & (0x80 >> col)) ? 0xFFFF : 0x0FFF;
+                }
+            }
+        }
+
+        ta_texture_load(texture, DEBUG_FONT_UVSIZE, 16, buffer);
+        free(buffer);
+
+        debug_font_texture = texture;
+    }
+
+    return debug_font_texture;
+}
+
+int _ta_debug_font_begin(color_t color)
+{
+    void *texture = _ta_debug_font_texture();
+    if (texture == 0)
+    {
+        return 0;
+    }
+
+    // All characters drawn after this share a single sprite header, so each
+    // character only costs one vertex packet to the TA.
+    struct polygon_list_quad mypoly;
+
+    mypoly.cmd =
+        TA_CMD_SPRITE |
+        TA_CMD_POLYGON_TYPE_TRANSPARENT |
+        TA_CMD_POLYGON_SUBLIST |
+        TA_CMD_POLYGON_PACKED_COLOR |
+        TA_CMD_POLYGON_16BIT_UV |
+        TA_CMD_POLYGON_TEXTURED;
+    mypoly.mode1 =
+        TA_POLYMODE1_Z_GREATEREQUAL |
+        TA_POLYMODE1_CULL_DISABLED;
+    mypoly.mode2 =
+        TA_POLYMODE2_MIPMAP_D_1_00 |
+        TA_POLYMODE2_TEXTURE_MODULATE |
+        TA_POLYMODE2_U_SIZE_128 |
+        TA_POLYMODE2_V_SIZE_128 |
+        TA_POLYMODE2_TEXTURE_CLAMP_U |
+        TA_POLYMODE2_TEXTURE_CLAMP_V |
+        TA_POLYMODE2_FOG_DISABLED |
+        TA_POLYMODE2_SRC_BLEND_SRC_ALPHA |
+        TA_POLYMODE2_DST_BLEND_INV_SRC_ALPHA;
+    mypoly.texture =
+        TA_TEXTUREMODE_ARGB4444 |
+        TA_TEXTUREMODE_ADDRESS(texture);
+    mypoly.mult_color = RGB0888(color.r, color.g, color.b);
+    mypoly.add_color = 0;
+    ta_commit_list(&mypoly, TA_LIST_SHORT);
+
+    return 1;
+}
+
+void _ta_debug_font_character(int x, int y, float z, char ch)
+{
+    struct vertex_list_quad myvertex;
+
+    float ulow = (float)(((unsigned char)ch % DEBUG_FONT_CHARS_PER_ROW) * 8) / (float)DEBUG_FONT_UVSIZE;
+    float vlow = (float)(((unsigned char)ch / DEBUG_FONT_CHARS_PER_ROW) * 8) / (float)DEBUG_FONT_UVSIZE;
+    float uhigh = ulow + (8.0 / (float)DEBUG_FONT_UVSIZE);
+    float vhigh = vlow + (8.0 / (float)DEBUG_FONT_UVSIZE);
+
+    myvertex.cmd = TA_CMD_VERTEX | TA_CMD_VERTEX_END_OF_STRIP;
+    if (global_video_vertical)
+    {
+        float width = (float)global_video_width - 1.0;
+        myvertex.ax = width - (float)(y + 8);
+        myvertex.ay = (float)x;
+        myvertex.az = z;
+        myvertex.bx = width - (float)y;
+        myvertex.by = (float)x;
+        myvertex.bz = z;
+        myvertex.cx = width - (float)y;
+        myvertex.cy = (float)(x + 8);
+        myvertex.cz = z;
+        myvertex.dx = width - (float)(y + 8);
+        myvertex.dy = (float)(x + 8);
+    }
+    else
+    {
+        myvertex.ax = (float)x;
+        myvertex.ay = (float)(y + 8);
+        myvertex.az = z;
+        myvertex.bx = (float)x;
+        myvertex.by = (float)y;
+        myvertex.bz = z;
+        myvertex.cx = (float)(x + 8);
+        myvertex.cy = (float)y;
+        myvertex.cz = z;
+        myvertex.dx = (float)(x + 8);
+        myvertex.dy = (float)(y + 8);
+    }
+    myvertex.au_av = (_ta_16bit_uv(ulow) << 16) | _ta_16bit_uv(vhigh);
+    myvertex.bu_bv = (_ta_16bit_uv(ulow) << 16) | _ta_16bit_uv(vlow);
+    myvertex.cu_cv = (_ta_16bit_uv(uhigh) << 16) | _ta_16bit_uv(vlow);
+    ta_commit_list(&myvertex, TA_LIST_LONG);
+}
+
+void ta_draw_debug_character(int x, int y, color_t color, char ch)
+{
+    if (ch < 0x20 || ch > 0x7F)
+    {
+        return;
+    }
+
+    if (_ta_debug_font_begin(color))
+    {
+        _ta_debug_font_character(x, y, __ta_quad_z_location(), ch);
+    }
+}
+
+void __ta_draw_debug_text(int x, int y, color_t color, const char * const msg)
+{
+    if( msg == 0 ) { return; }
+    if (!_ta_debug_font_begin(color)) { return; }
+
+    int tx = x;
+    int ty = y;
+    float z = __ta_quad_z_location();
+    const char *text = (const char *)msg;
+
+    while( *text )
+    {
+        switch( *text )
+        {
+            case '\r':
+            case '\n':
+                tx = x;
+                ty += 8;
+                break;
+            case ' ':
+                tx += 8;
+                break;
+            case '\t':
+                tx += 8 * 5;
+                break;
+            default:
+                if (*text >= 0x20 && *text <= 0x7F)
+                {
+                    _ta_debug_font_character(tx, ty, z, *text);
+                }
+                tx += 8;
+                break;
+        }
+
+        if ((tx + 8) >= cached_actual_width)
+        {
+            tx = 0;
+            ty += 8;
+        }
+
+        text++;
+    }
+}
+
+void ta_draw_debug_text(int x, int y, color_t color, const char * const msg, ...)
+{
+    if (msg)
+    {
+        char buffer[2048];
+        va_list args;
+        va_start(args, msg);
+        int length = vsnprintf(buffer, 2047, msg, args);
+        va_end(args);
+
+        if (length > 0)
+        {
+            buffer[min(length, 2047)] = 0;
+            __ta_draw_debug_text(x, y, color, buffer);
+        }
+    }
+}
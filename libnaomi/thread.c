@@ -7,7 +7,9 @@
 #include "naomi/interrupt.h"
 #include "naomi/thread.h"
 #include "naomi/timer.h"
+#include "naomi/trace.h"
 #include "irqstate.h"
+#include "irqinternal.h"
 
 // Memory range validation functions, because invalid pointers can cause reboot
 // crashes on real hardware.
@@ -22,9 +24,20 @@ void _ta_begin_render(void *buffers, void *scrn);
 
 #define SEM_TYPE_MUTEX 1
 #define SEM_TYPE_SEMAPHORE 2
-#define MAX_SEM_AND_MUTEX (MAX_SEMAPHORES + MAX_MUTEXES)
+#define SEM_TYPE_CONDITION 3
 
-typedef struct
+// Semaphores, mutexes and conditions all live in a single object table which grows by
+// a slab of objects at a time. A handle's ID is the object's slot in the table in the
+// low bits and a per-slot generation in the high bits, so lookups are a single index and
+// a stale handle to a slot that was freed and reused will not find the new object.
+#define SEM_SLAB_SIZE 32
+#define SEM_SLOT_BITS 16
+#define SEM_SLOT_MASK ((1 << SEM_SLOT_BITS) - 1)
+#define SEM_MAX_SLOTS (1 << SEM_SLOT_BITS)
+
+struct thread;
+
+typedef struct semaphore_internal
 {
     void *public;
     uint32_t id;
@@ -35,12 +48,33 @@ typedef struct
     int others_waiting;
     uint32_t heldby;
     int recursive_count;
+
+    // Threads waiting on a condition, in the order they started waiting.
+    struct thread *wait_head;
+    struct thread *wait_tail;
+
+    // Where this object lives in the table, and how many times that slot was handed out.
+    unsigned int slot;
+    uint32_t generation;
+    struct semaphore_internal *next_free;
 } semaphore_internal_t;
 
-static semaphore_internal_t *semaphores[MAX_SEM_AND_MUTEX];
-static uint32_t semaphore_counter = MAX_SEM_AND_MUTEX;
-static int global_semaphore_count = 0;
-static int global_mutex_count = 0;
+static semaphore_internal_t **semaphores = 0;
+static unsigned int semaphore_slots = 0;
+static unsigned int semaphore_capacity = 0;
+static semaphore_internal_t *semaphore_free_list = 0;
+
+semaphore_internal_t *_semaphore_lookup(uint32_t id, unsigned int type)
+{
+    // IDs are never zero, so a zeroed out or freed handle never matches a free slot.
+    unsigned int slot = id & SEM_SLOT_MASK;
+    if (id != 0 && slot < semaphore_slots && semaphores[slot]->id == id && semaphores[slot]->type == type)
+    {
+        return semaphores[slot];
+    }
+
+    return 0;
+}
 
 semaphore_internal_t *_semaphore_find(void * semaphore, unsigned int type)
 {
@@ -55,17 +89,96 @@ semaphore_internal_t *_semaphore_find(void * semaphore, unsigned int type)
         {
             id = ((semaphore_t *)semaphore)->id;
         }
-        unsigned int slot = id % MAX_SEM_AND_MUTEX;
-
-        if (semaphores[slot] != 0 && semaphores[slot]->id == id && semaphores[slot]->type == type)
+        else if (type == SEM_TYPE_CONDITION)
         {
-            return semaphores[slot];
+            id = ((condition_t *)semaphore)->id;
         }
+
+        return _semaphore_lookup(id, type);
     }
 
     return 0;
 }
 
+int _semaphore_grow()
+{
+    if (semaphore_slots + SEM_SLAB_SIZE > SEM_MAX_SLOTS)
+    {
+        return 0;
+    }
+
+    // Make room in the table itself, doubling it so that growing stays cheap.
+    if (semaphore_slots + SEM_SLAB_SIZE > semaphore_capacity)
+    {
+        unsigned int capacity = semaphore_capacity ? semaphore_capacity * 2 : SEM_SLAB_SIZE * 4;
+        semaphore_internal_t **table = realloc(semaphores, sizeof(semaphore_internal_t *) * capacity);
+        if (table == 0)
+        {
+            return 0;
+        }
+
+        semaphores = table;
+        semaphore_capacity = capacity;
+    }
+
+    // Now, carve a new slab of objects into free slots.
+    semaphore_internal_t *slab = malloc(sizeof(semaphore_internal_t) * SEM_SLAB_SIZE);
+    if (slab == 0)
+    {
+        return 0;
+    }
+    memset(slab, 0, sizeof(semaphore_internal_t) * SEM_SLAB_SIZE);
+
+    for (int i = SEM_SLAB_SIZE - 1; i >= 0; i--)
+    {
+        slab[i].slot = semaphore_slots + i;
+        slab[i].next_free = semaphore_free_list;
+        semaphore_free_list = &slab[i];
+        semaphores[semaphore_slots + i] = &slab[i];
+    }
+    semaphore_slots += SEM_SLAB_SIZE;
+
+    return 1;
+}
+
+semaphore_internal_t *_semaphore_alloc(void *public, unsigned int type)
+{
+    if (semaphore_free_list == 0 && !_semaphore_grow())
+    {
+        return 0;
+    }
+
+    semaphore_internal_t *internal = semaphore_free_list;
+    semaphore_free_list = internal->next_free;
+
+    // Start from a clean object, but remember where it lives and bump its generation
+    // so that handles to the last object in this slot stop working.
+    unsigned int slot = internal->slot;
+    uint32_t generation = (internal->generation + 1) & (0xFFFFFFFF >> SEM_SLOT_BITS);
+    if (generation == 0)
+    {
+        generation = 1;
+    }
+
+    memset(internal, 0, sizeof(semaphore_internal_t));
+    internal->slot = slot;
+    internal->generation = generation;
+    internal->id = (generation << SEM_SLOT_BITS) | slot;
+    internal->public = public;
+    internal->type = type;
+
+    return internal;
+}
+
+void _semaphore_release(semaphore_internal_t *internal)
+{
+    internal->id = 0;
+    internal->type = 0;
+    internal->public = 0;
+    internal->next_free = semaphore_free_list;
+    semaphore_free_list = internal;
+}
+
 // Thread-local variables that we save/restore every context switch.
 static uint32_t current_thread_id = 0;
 
@@ -84,14 +197,20 @@ static uint32_t current_thread_id = 0;
 // Thread is waiting for a resource.
 #define THREAD_STATE_WAITING 4
 
-// Waiting TA interrupt values.
+#if THREAD_STATE_STOPPED != TRACE_STATE_STOPPED || THREAD_STATE_RUNNING != TRACE_STATE_RUNNING || THREAD_STATE_WAITING != TRACE_STATE_WAITING
+#error "Thread states do not line up with trace states!"
+#endif
+
+// Waiting TA interrupt values. The deferred background clear in video.c uses the same
+// counters, since it also needs to be armed before the hardware can finish.
 #define WAITING_TA_RENDER_FINISHED 0
 #define WAITING_TA_LOAD_OPAQUE_FINISHED 1
 #define WAITING_TA_LOAD_TRANSPARENT_FINISHED 2
 #define WAITING_TA_LOAD_PUNCHTHRU_FINISHED 3
-#define WAITING_TA_MAX 4
+#define WAITING_BACKGROUND_DMA_FINISHED 4
+#define WAITING_TA_MAX 5
 
-typedef struct
+typedef struct thread
 {
     // Basic thread stuff.
     char name[64];
@@ -119,24 +238,51 @@ typedef struct
     // Any resources this thread is waiting on.
     semaphore_internal_t * waiting_semaphore;
     uint32_t waiting_thread;
-    uint32_t waiting_timer;
+    uint64_t waiting_timer;
     unsigned int waiting_interrupt;
     unsigned int perform_additional_on_wake;
 
+    // Nonzero if this thread is in thread_wait_any(), and so is waiting on several of the
+    // above at once and wants to know which one woke it up.
+    int waiting_any;
+
+    // The condition this thread is waiting to be signalled on, the mutex it gave up to
+    // do so, and how many times it had that mutex recursively locked.
+    semaphore_internal_t * waiting_condition;
+    semaphore_internal_t * condition_mutex;
+    int waiting_recursive;
+    struct thread *wait_prev;
+    struct thread *wait_next;
+
     // Counters for TA resources this thread is waiting on.
     int waiting_irq[WAITING_TA_MAX];
 
     // The actual context of the thread, including all of the registers and such.
     irq_state_t *context;
     uint8_t *stack;
+    uint32_t stack_size;
     void *retval;
+
+    // Position in the run queue for our priority band, valid only while running.
+    int band;
+    struct thread *ready_prev;
+    struct thread *ready_next;
+
+    // Position in the sleep queue, valid only while waiting on a timer.
+    struct thread *sleep_prev;
+    struct thread *sleep_next;
 } thread_t;
 
-// Waiting interupt values.
+// Waiting interupt values. A thread's waiting_interrupt is a mask of (1 << value), which
+// lines up with the WAIT_ANY_* masks passed to thread_wait_any().
 #define WAITING_IRQ_VBLANK_IN 1
 #define WAITING_IRQ_VBLANK_OUT 2
 #define WAITING_IRQ_HBLANK 3
 
+#if (1 << WAITING_IRQ_VBLANK_IN) != WAIT_ANY_VBLANK_IN || (1 << WAITING_IRQ_VBLANK_OUT) != WAIT_ANY_VBLANK_OUT || (1 << WAITING_IRQ_HBLANK) != WAIT_ANY_HBLANK
+#error "Waiting interrupt values do not line up with wait any masks!"
+#endif
+
 // Priority for the idle thread. This is chosen to always be lower than the lowest
 // priority possible to request, and never possible to bump past the minimum priority
 // even with inversions.
@@ -157,6 +303,280 @@ static uint64_t current_profile = 0;
 static unsigned int highest_thread = 0;
 static thread_t *threads[MAX_THREADS];
 
+// Every effective priority that a thread can have gets its own run queue. That is the
+// idle thread, each priority from MIN_PRIORITY to MAX_PRIORITY, and each of those same
+// priorities again when bumped by an inversion, which always outranks every unbumped
+// priority. Band 0 is the idle thread, and higher bands are scheduled first.
+#define PRIORITY_BANDS ((MAX_PRIORITY - MIN_PRIORITY) + 1)
+#define READY_BANDS ((PRIORITY_BANDS * 2) + 1)
+
+// A three-level bitmap of which bands have runnable threads, so that finding the highest
+// one is three count-leading-zeros operations regardless of how many threads exist.
+#define READY_WORDS ((READY_BANDS + 31) / 32)
+#define READY_GROUPS ((READY_WORDS + 31) / 32)
+
+#if READY_GROUPS > 32
+#error "Too many priority bands for the run queue bitmap!"
+#endif
+
+typedef struct
+{
+    thread_t *head;
+    thread_t *tail;
+} ready_queue_t;
+
+static ready_queue_t *ready_queues = 0;
+static uint32_t ready_words[READY_WORDS];
+static uint32_t ready_groups[READY_GROUPS];
+static uint32_t ready_summary = 0;
+
+int _thread_band(thread_t *thread)
+{
+    if (thread->priority < MIN_PRIORITY)
+    {
+        // Idle thread priority band.
+        return 0;
+    }
+    if (thread->priority_bump > 0)
+    {
+        // Bumped priority band.
+        return 1 + PRIORITY_BANDS + (thread->priority - MIN_PRIORITY);
+    }
+
+    // Normal band.
+    return 1 + (thread->priority - MIN_PRIORITY);
+}
+
+void _thread_ready_insert(thread_t *thread)
+{
+    // New arrivals go to the back of their band, so they take their turn after
+    // everyone already waiting there.
+    int band = _thread_band(thread);
+    ready_queue_t *queue = &ready_queues[band];
+
+    thread->band = band;
+    thread->ready_next = 0;
+    thread->ready_prev = queue->tail;
+    if (queue->tail)
+    {
+        queue->tail->ready_next = thread;
+    }
+    else
+    {
+        queue->head = thread;
+    }
+    queue->tail = thread;
+
+    ready_words[band >> 5] |= 1 << (band & 31);
+    ready_groups[band >> 10] |= 1 << ((band >> 5) & 31);
+    ready_summary |= 1 << (band >> 10);
+}
+
+void _thread_ready_remove(thread_t *thread)
+{
+    int band = thread->band;
+    ready_queue_t *queue = &ready_queues[band];
+
+    if (thread->ready_prev)
+    {
+        thread->ready_prev->ready_next = thread->ready_next;
+    }
+    else
+    {
+        queue->head = thread->ready_next;
+    }
+    if (thread->ready_next)
+    {
+        thread->ready_next->ready_prev = thread->ready_prev;
+    }
+    else
+    {
+        queue->tail = thread->ready_prev;
+    }
+    thread->ready_prev = 0;
+    thread->ready_next = 0;
+
+    if (queue->head == 0)
+    {
+        // Band is empty now, so clear it out of the bitmap as well.
+        ready_words[band >> 5] &= ~(1 << (band & 31));
+        if (ready_words[band >> 5] == 0)
+        {
+            ready_groups[band >> 10] &= ~(1 << ((band >> 5) & 31));
+            if (ready_groups[band >> 10] == 0)
+            {
+                ready_summary &= ~(1 << (band >> 10));
+            }
+        }
+    }
+}
+
+int _thread_ready_highest()
+{
+    if (ready_summary == 0)
+    {
+        // Nothing is runnable at all.
+        return -1;
+    }
+
+    unsigned int group = 31 - __builtin_clz(ready_summary);
+    unsigned int word = (group << 5) + (31 - __builtin_clz(ready_groups[group]));
+    return (word << 5) + (31 - __builtin_clz(ready_words[word]));
+}
+
+// Threads waiting on a timer, sorted by the absolute time (in profile microseconds) that
+// they should wake up at, so that only the front of the queue is ever looked at when
+// deciding who to wake.
+static thread_t *sleep_head = 0;
+static thread_t *sleep_tail = 0;
+
+void _thread_sleep_insert(thread_t *thread, uint64_t deadline)
+{
+    // Walk backwards from the end, since threads tend to sleep for similar amounts of
+    // time and new deadlines are usually later than the existing ones. Threads with
+    // equal deadlines wake in the order they went to sleep.
+    thread_t *prev = sleep_tail;
+    while (prev && prev->waiting_timer > deadline)
+    {
+        prev = prev->sleep_prev;
+    }
+
+    thread->waiting_timer = deadline;
+    thread->sleep_prev = prev;
+    thread->sleep_next = prev ? prev->sleep_next : sleep_head;
+    if (thread->sleep_next)
+    {
+        thread->sleep_next->sleep_prev = thread;
+    }
+    else
+    {
+        sleep_tail = thread;
+    }
+    if (prev)
+    {
+        prev->sleep_next = thread;
+    }
+    else
+    {
+        sleep_head = thread;
+    }
+}
+
+void _thread_sleep_remove(thread_t *thread)
+{
+    if (thread->sleep_prev)
+    {
+        thread->sleep_prev->sleep_next = thread->sleep_next;
+    }
+    else
+    {
+        sleep_head = thread->sleep_next;
+    }
+    if (thread->sleep_next)
+    {
+        thread->sleep_next->sleep_prev = thread->sleep_prev;
+    }
+    else
+    {
+        sleep_tail = thread->sleep_prev;
+    }
+
+    thread->sleep_prev = 0;
+    thread->sleep_next = 0;
+    thread->waiting_timer = 0;
+}
+
+void _thread_condition_insert(semaphore_internal_t *condition, thread_t *thread)
+{
+    thread->waiting_condition = condition;
+    thread->wait_next = 0;
+    thread->wait_prev = condition->wait_tail;
+    if (condition->wait_tail)
+    {
+        condition->wait_tail->wait_next = thread;
+    }
+    else
+    {
+        condition->wait_head = thread;
+    }
+    condition->wait_tail = thread;
+}
+
+void _thread_condition_remove(thread_t *thread)
+{
+    semaphore_internal_t *condition = thread->waiting_condition;
+
+    if (thread->wait_prev)
+    {
+        thread->wait_prev->wait_next = thread->wait_next;
+    }
+    else
+    {
+        condition->wait_head = thread->wait_next;
+    }
+    if (thread->wait_next)
+    {
+        thread->wait_next->wait_prev = thread->wait_prev;
+    }
+    else
+    {
+        condition->wait_tail = thread->wait_prev;
+    }
+
+    thread->wait_prev = 0;
+    thread->wait_next = 0;
+    thread->waiting_condition = 0;
+}
+
+void _thread_set_state(thread_t *thread, int state)
+{
+    // A thread that stops waiting for any reason, such as being cancelled, timing out or
+    // being woken by one of several things it was waiting on, can no longer be woken by
+    // anything else it was waiting on.
+    if (thread->state == THREAD_STATE_WAITING && state != THREAD_STATE_WAITING)
+    {
+        if (thread->waiting_timer != 0)
+        {
+            _thread_sleep_remove(thread);
+        }
+        if (thread->waiting_condition != 0)
+        {
+            _thread_condition_remove(thread);
+        }
+        if (thread->waiting_semaphore != 0)
+        {
+            thread->waiting_semaphore->others_waiting--;
+            thread->waiting_semaphore = 0;
+        }
+        thread->waiting_interrupt = 0;
+        thread->perform_additional_on_wake = 0;
+        thread->waiting_any = 0;
+    }
+
+    // A thread is in a run queue exactly when it is in the running state, including
+    // the thread that currently owns the CPU.
+    if (thread->state == THREAD_STATE_RUNNING && state != THREAD_STATE_RUNNING)
+    {
+        _thread_ready_remove(thread);
+    }
+    else if (thread->state != THREAD_STATE_RUNNING && state == THREAD_STATE_RUNNING)
+    {
+        _thread_ready_insert(thread);
+    }
+
+    thread->state = state;
+}
+
+void _thread_ready_requeue(thread_t *thread)
+{
+    // Call whenever a thread's priority or bump changes, to move it to its new band.
+    if (thread->state == THREAD_STATE_RUNNING && thread->band != _thread_band(thread))
+    {
+        _thread_ready_remove(thread);
+        _thread_ready_insert(thread);
+    }
+}
+
 thread_t *_thread_find_by_id(uint32_t id)
 {
     unsigned int slot = id % MAX_THREADS;
@@ -247,6 +667,41 @@ void _thread_check_waiting(thread_t *thread)
     {
         _irq_display_invariant("resource wait failure", "thread %lu is already waiting for a hardware interrupt!", thread->id);
     }
+    if (thread->waiting_condition != 0)
+    {
+        _irq_display_invariant("resource wait failure", "thread %lu is already waiting for a condition!", thread->id);
+    }
+}
+
+void _thread_condition_wake(thread_t *thread, int signalled)
+{
+    // Stop waiting on the condition and any timeout for it, and report whether we
+    // were signalled or timed out as the return value of the wait.
+    semaphore_internal_t *mutex = thread->condition_mutex;
+    _thread_condition_remove(thread);
+    if (thread->waiting_timer != 0)
+    {
+        _thread_sleep_remove(thread);
+    }
+    thread->condition_mutex = 0;
+    thread->context->gp_regs[0] = signalled;
+    _trace_record(TRACE_EVENT_WAKE, thread->id, TRACE_WAKE_CONDITION, signalled);
+
+    // Now, we need the mutex back before we can return. Either grab it right now, or
+    // move over to waiting on the mutex instead of waking up just to block again.
+    if (mutex->current > 0)
+    {
+        mutex->current--;
+        mutex->heldby = thread->id;
+        mutex->recursive_count = thread->waiting_recursive;
+        thread->waiting_recursive = 0;
+        _thread_set_state(thread, THREAD_STATE_RUNNING);
+    }
+    else
+    {
+        thread->waiting_semaphore = mutex;
+        mutex->others_waiting++;
+    }
 }
 
 typedef struct
@@ -328,8 +783,159 @@ thread_t *_thread_create(char *name, int priority)
     return thread;
 }
 
+// Stacks up to THREAD_STACK_SIZE are handed out in power of two size classes starting at
+// THREAD_STACK_SIZE_MIN. Freed stacks of a size class are kept on a free list, threaded
+// through the first word of each stack, up to a per-class and overall limit so that a burst
+// of threads doesn't pin memory forever. Anything bigger is only rounded up to a multiple of
+// THREAD_STACK_SIZE_MIN and goes straight back to the heap when freed, since a power of two
+// would waste up to half of an already large allocation.
+#define STACK_POOL_CLASSES 6
+#define STACK_POOL_DEPTH 4
+#define STACK_POOL_MAX_BYTES (512 * 1024)
+
+static uint8_t *stack_pool[STACK_POOL_CLASSES];
+static unsigned int stack_pool_count[STACK_POOL_CLASSES];
+static uint32_t stack_pool_bytes = 0;
+
+uint32_t _thread_stack_size(uint32_t stack_size)
+{
+    if (stack_size == 0)
+    {
+        return THREAD_STACK_SIZE;
+    }
+    if (stack_size > THREAD_STACK_SIZE)
+    {
+        if (stack_size > (0xFFFFFFFF - (THREAD_STACK_SIZE_MIN - 1)))
+        {
+            return 0xFFFFFFFF & ~(THREAD_STACK_SIZE_MIN - 1);
+        }
+        return (stack_size + (THREAD_STACK_SIZE_MIN - 1)) & ~(THREAD_STACK_SIZE_MIN - 1);
+    }
+
+    uint32_t actual = THREAD_STACK_SIZE_MIN;
+    while (actual < stack_size)
+    {
+        actual <<= 1;
+    }
+    return actual;
+}
+
+int _thread_stack_class(uint32_t stack_size)
+{
+    for (int class = 0; class < STACK_POOL_CLASSES; class++)
+    {
+        if (stack_size == (THREAD_STACK_SIZE_MIN << class))
+        {
+            return class;
+        }
+    }
+
+    // Too big to be worth keeping around.
+    return -1;
+}
+
+uint8_t *_thread_stack_alloc(uint32_t stack_size)
+{
+    uint8_t *stack = 0;
+    int class = _thread_stack_class(stack_size);
+
+    if (class >= 0)
+    {
+        uint32_t old_interrupts = irq_disable();
+        if (stack_pool[class])
+        {
+            stack = stack_pool[class];
+            stack_pool[class] = *((uint8_t **)stack);
+            stack_pool_count[class]--;
+            stack_pool_bytes -= stack_size;
+        }
+        irq_restore(old_interrupts);
+    }
+
+    if (stack == 0)
+    {
+        stack = malloc(stack_size);
+    }
+    return stack;
+}
+
+void _thread_stack_free(uint8_t *stack, uint32_t stack_size)
+{
+    int class = _thread_stack_class(stack_size);
+
+    if (class >= 0)
+    {
+        uint32_t old_interrupts = irq_disable();
+        if (stack_pool_count[class] < STACK_POOL_DEPTH && (stack_pool_bytes + stack_size) <= STACK_POOL_MAX_BYTES)
+        {
+            *((uint8_t **)stack) = stack_pool[class];
+            stack_pool[class] = stack;
+            stack_pool_count[class]++;
+            stack_pool_bytes += stack_size;
+            stack = 0;
+        }
+        irq_restore(old_interrupts);
+    }
+
+    if (stack)
+    {
+        free(stack);
+    }
+}
+
+uint32_t thread_stack_trim()
+{
+    uint32_t freed = 0;
+
+    for (int class = 0; class < STACK_POOL_CLASSES; class++)
+    {
+        while (1)
+        {
+            // Pull stacks off one at a time so that we don't call free() with interrupts
+            // disabled, and so that a thread created in the meantime can still get one.
+            uint32_t old_interrupts = irq_disable();
+            uint8_t *stack = stack_pool[class];
+            if (stack)
+            {
+                stack_pool[class] = *((uint8_t **)stack);
+                stack_pool_count[class]--;
+                stack_pool_bytes -= THREAD_STACK_SIZE_MIN << class;
+            }
+            irq_restore(old_interrupts);
+
+            if (stack == 0)
+            {
+                break;
+            }
+
+            free(stack);
+            freed += THREAD_STACK_SIZE_MIN << class;
+        }
+    }
+
+    return freed;
+}
+
+void _thread_stack_pool_free()
+{
+    for (int class = 0; class < STACK_POOL_CLASSES; class++)
+    {
+        while (stack_pool[class])
+        {
+            uint8_t *stack = stack_pool[class];
+            stack_pool[class] = *((uint8_t **)stack);
+            free(stack);
+        }
+        stack_pool_count[class] = 0;
+    }
+    stack_pool_bytes = 0;
+}
+
 void _thread_destroy(thread_t *thread)
 {
+    // Make sure the scheduler can't pick a thread that no longer exists.
+    _thread_set_state(thread, THREAD_STATE_STOPPED);
+
     if (thread->context)
     {
         _irq_free_state(thread->context);
@@ -337,7 +943,7 @@ void _thread_destroy(thread_t *thread)
     }
     if (thread->stack)
     {
-        free(thread->stack);
+        _thread_stack_free(thread->stack, thread->stack_size);
         thread->stack = 0;
     }
     free(thread);
@@ -349,7 +955,7 @@ void _thread_register_main(irq_state_t *state)
 
     thread_t *main_thread = _thread_create("main", 0);
     main_thread->context = state;
-    main_thread->state = THREAD_STATE_RUNNING;
+    _thread_set_state(main_thread, THREAD_STATE_RUNNING);
     state->threadptr = main_thread;
     current_thread_id = main_thread->id;
 
@@ -366,7 +972,7 @@ void _thread_create_idle()
         _irq_display_invariant("memory failure", "could not get memory for idle thread!");
     }
     idle_thread->context = _irq_new_state(_idle_thread, 0, idle_thread->stack + 64, idle_thread);
-    idle_thread->state = THREAD_STATE_RUNNING;
+    _thread_set_state(idle_thread, THREAD_STATE_RUNNING);
 }
 
 uint32_t _thread_time_elapsed()
@@ -389,6 +995,7 @@ int _thread_enable_inversion(thread_t *thread, uint32_t reason, unsigned int amo
         thread->priority_reason = reason;
         thread->running_time_inversion = 0;
         thread->inversion_timeout = PRIORITY_INVERSION_TIME + _thread_time_elapsed();
+        _thread_ready_requeue(thread);
 
         return 1;
     }
@@ -403,6 +1010,7 @@ int _thread_disable_inversion(thread_t *thread, uint32_t reason, unsigned int am
         thread->priority_bump = 0;
         thread->priority_reason = 0;
         thread->running_time_inversion = 0;
+        _thread_ready_requeue(thread);
         return 1;
     }
 
@@ -459,29 +1067,71 @@ int _thread_check_and_disable_timed_bumps(thread_t *thread)
     return retval;
 }
 
-typedef struct
-{
-    uint32_t last_thread;
-} last_thread_t;
+// How long a thread gets to run before another thread in the same priority band gets a turn.
+#define TIMESLICE_MICROSECONDS (MICROSECONDS_IN_ONE_SECOND / PREEMPTION_HZ)
 
-static last_thread_t *round_robin = 0;
-static unsigned int round_robin_count = 0;
+// Absolute time in profile microseconds that the preemption timer is programmed to fire
+// at, or 0 if it is stopped. This is set to PREEMPT_UNKNOWN when the timer fires or has
+// not been programmed by us yet, so that we always reprogram it on the next schedule.
+#define PREEMPT_UNKNOWN 0xFFFFFFFFFFFFFFFFULL
+static uint64_t preempt_deadline = PREEMPT_UNKNOWN;
+static uint64_t timeslice_deadline = 0;
 
-last_thread_t *last_thread_for_band(int priority)
+void _thread_program_preemption(thread_t *current_thread, thread_t *next_thread)
 {
-    if (priority < MIN_PRIORITY)
+    // The preemption timer only needs to fire when something could change which thread
+    // should be running without any other interrupt or syscall happening first. That is
+    // when another thread shares our band and we need to time slice with it, when we are
+    // running on a temporary priority bump that will run out, or when a sleeping thread is
+    // due to wake up. A single busy thread, or an idle system, never takes an interrupt.
+    uint64_t now = _profile_get_current();
+    uint64_t deadline = 0;
+
+    ready_queue_t *queue = &ready_queues[next_thread->band];
+    if (queue->head != queue->tail)
     {
-        // Idle thread priority band.
-        return &round_robin[0];
+        // Start a new timeslice whenever we switch threads, otherwise keep the existing
+        // one so that frequent syscalls can't push back our peers' turn forever.
+        if (next_thread != current_thread || timeslice_deadline <= now)
+        {
+            timeslice_deadline = now + TIMESLICE_MICROSECONDS;
+        }
+        deadline = timeslice_deadline;
     }
-    if (priority > MAX_PRIORITY)
+    else
     {
-        // Bumped priority band.
-        return &round_robin[1];
+        timeslice_deadline = 0;
     }
 
-    // Normal band.
-    return &round_robin[(priority - MIN_PRIORITY) + 2];
+    if (next_thread->priority_reason > 0 && next_thread->running_time_inversion < next_thread->inversion_timeout)
+    {
+        uint64_t bump_deadline = now + (next_thread->inversion_timeout - next_thread->running_time_inversion);
+        if (deadline == 0 || bump_deadline < deadline)
+        {
+            deadline = bump_deadline;
+        }
+    }
+
+    if (sleep_head)
+    {
+        if (deadline == 0 || sleep_head->waiting_timer < deadline)
+        {
+            deadline = sleep_head->waiting_timer;
+        }
+    }
+
+    if (deadline != preempt_deadline)
+    {
+        preempt_deadline = deadline;
+        if (deadline == 0)
+        {
+            _preempt_next(0);
+        }
+        else
+        {
+            _preempt_next(deadline > now ? deadline - now : 1);
+        }
+    }
 }
 
 // Prefer the current thread, unless it is not runnable.
@@ -522,119 +1172,54 @@ irq_state_t *_thread_schedule(irq_state_t *state, int request)
         if (current_thread->state == THREAD_STATE_RUNNING && current_thread->priority != IDLE_THREAD_PRIORITY)
         {
             // It is, just return it.
+            _thread_program_preemption(current_thread, current_thread);
             errno = current_thread->saved_errno;
             current_thread_id = current_thread->id;
             return current_thread->context;
         }
     }
 
-    // Set the max priority to the idle thread, so if we don't find any
-    // applicable threads then we will choose the idle thread instead.
-    int priority = IDLE_THREAD_PRIORITY;
-    int self_priority = IDLE_THREAD_PRIORITY;
-
-    // Go through and find the highest priority that is schedulable.
-    for (unsigned int i = 0; i < highest_thread; i++)
+    // The thread we were running goes to the back of its band, so that the next thread
+    // in round-robin order is at the front. If we were asked to run somebody else, find
+    // the highest band without counting ourselves, and only keep running ourselves if
+    // there is nothing but the idle thread left.
+    thread_t *next_thread = 0;
+    int band;
+    if (current_thread->state == THREAD_STATE_RUNNING)
     {
-        if (threads[i] == 0)
-        {
-            // Not a real thread.
-            continue;
-        }
-
-        if (threads[i]->state != THREAD_STATE_RUNNING)
+        _thread_ready_remove(current_thread);
+        band = _thread_ready_highest();
+        if (request == THREAD_SCHEDULE_OTHER && band <= 0)
         {
-            // This thread isn't runnable.
-            continue;
+            next_thread = current_thread;
         }
+        _thread_ready_insert(current_thread);
 
-        if (request == THREAD_SCHEDULE_OTHER && threads[i] == current_thread)
+        if (request != THREAD_SCHEDULE_OTHER)
         {
-            // Don't include this thread, we specifically requested going to the next thread.
-            self_priority = self_priority > (threads[i]->priority + threads[i]->priority_bump) ? self_priority : (threads[i]->priority + threads[i]->priority_bump);
-            continue;
+            band = _thread_ready_highest();
         }
-
-        // Bump the max priority based on this schedulable thread.
-        priority = priority > (threads[i]->priority + threads[i]->priority_bump) ? priority : (threads[i]->priority + threads[i]->priority_bump);
     }
-
-    if (priority == IDLE_THREAD_PRIORITY)
+    else
     {
-        // We couldn't schedule any thread. However, if we requested to schedule another
-        // thread aside from ourselves but we were the only one available, take that choice.
-        priority = self_priority;
+        band = _thread_ready_highest();
     }
 
-    // Now, round robin within the priority band.
-    last_thread_t *last_thread = last_thread_for_band(priority);
-    if (last_thread->last_thread == 0 && priority == (current_thread->priority + current_thread->priority_bump))
+    if (next_thread == 0 && band >= 0)
     {
-        // Short circuit to getting this set up.
-        last_thread->last_thread = current_thread->id;
+        next_thread = ready_queues[band].head;
     }
 
-    // Go through the loop the first time, seeing if we can locate the current thread, and
-    // if so, choose the next thread after it. If this fails we will go through the loop
-    // again and choose the very first applicable thread.
-    int found = 0;
-    thread_t *first_thread = 0;
-    for (unsigned int i = 0; i < highest_thread; i++)
+    if (next_thread)
     {
-        if (threads[i] == 0)
+        if (next_thread != current_thread)
         {
-            // Not a real thread.
-            continue;
-        }
-
-        if (threads[i]->state != THREAD_STATE_RUNNING)
-        {
-            // This thread isn't runnable.
-            continue;
-        }
-
-        if ((threads[i]->priority + threads[i]->priority_bump) != priority)
-        {
-            // Don't care, not the band we're after.
-            continue;
-        }
-
-        if (first_thread == 0)
-        {
-            // Remember this just in case we don't find a thread.
-            first_thread = threads[i];
-        }
-
-        if (found)
-        {
-            // Okay, we found our current thread last iteration, so this is
-            // the next applicable thread in a round-robin scheduler.
-            last_thread->last_thread = threads[i]->id;
-            errno = threads[i]->saved_errno;
-            current_thread_id = threads[i]->id;
-            return threads[i]->context;
+            _trace_record(TRACE_EVENT_SWITCH, current_thread->id, next_thread->id, current_thread->state);
         }
-
-        if (threads[i]->id == last_thread->last_thread)
-        {
-            // We found our thread, return the next thread on the next iteration.
-            found = 1;
-        }
-    }
-
-    // If we got here, then the next available thread is before our current thread.
-    // We already saved the first applicable thread in the previous loop, so we can
-    // use that here as long as it is not null. This has the chance of selecting
-    // ourselves if there is no applicable other thread, even if the request is
-    // THREAD_SCHEDULE_OTHER. That should only happen when it is the idle thread,
-    // however, since at any other moment we would have chosen a different priority band.
-    if (first_thread)
-    {
-        // Okay, we found an applicable thread, return it as the scheduled thread.
-        last_thread->last_thread = first_thread->id;
-        errno = first_thread->saved_errno;
-        current_thread_id = first_thread->id;
-        return first_thread->context;
+        _thread_program_preemption(current_thread, next_thread);
+        errno = next_thread->saved_errno;
+        current_thread_id = next_thread->id;
+        return next_thread->context;
     }
 
     // We should never ever get here, so display a failure message.
@@ -648,10 +1233,11 @@ void _thread_init()
 
     thread_counter = MAX_THREADS;
     global_counter_counter = MAX_GLOBAL_COUNTERS;
-    semaphore_counter = MAX_SEM_AND_MUTEX;
-    global_semaphore_count = 0;
-    global_mutex_count = 0;
     current_profile = 0;
+    sleep_head = 0;
+    sleep_tail = 0;
+    preempt_deadline = PREEMPT_UNKNOWN;
+    timeslice_deadline = 0;
     running_time_denominator = 0;
     interruptions = 0;
     last_second_interruptions = 0;
@@ -659,20 +1245,23 @@ void _thread_init()
     threads_disabled = 0;
     current_thread_id = 0;
     memset(global_counters, 0, sizeof(uint32_t *) * MAX_GLOBAL_COUNTERS);
-    memset(semaphores, 0, sizeof(semaphore_internal_t *) * MAX_SEM_AND_MUTEX);
+    semaphores = 0;
+    semaphore_slots = 0;
+    semaphore_capacity = 0;
+    semaphore_free_list = 0;
     memset(threads, 0, sizeof(thread_t *) * MAX_THREADS);
 
-    // Set up per-priority round robin positions by adding the bumped
-    // priority as well as the idle thread priority, and making sure
-    // that there's enough for MIN_PRIORITY all the way up to MAX_PRIORITY
-    // inclusive.
-    round_robin = malloc(sizeof(last_thread_t) * ((MAX_PRIORITY - MIN_PRIORITY) + 3));
-    if (round_robin == 0)
+    // Set up per-priority run queues for every band, including the bumped
+    // priorities as well as the idle thread priority.
+    ready_queues = malloc(sizeof(ready_queue_t) * READY_BANDS);
+    if (ready_queues == 0)
     {
         _irq_display_invariant("memory failure", "could not get memory for round robin scheduling!");
     }
-    round_robin_count = (MAX_PRIORITY - MIN_PRIORITY) + 3;
-    memset(round_robin, 0, sizeof(last_thread_t) * round_robin_count);
+    memset(ready_queues, 0, sizeof(ready_queue_t) * READY_BANDS);
+    memset(ready_words, 0, sizeof(ready_words));
+    memset(ready_groups, 0, sizeof(ready_groups));
+    ready_summary = 0;
 
     irq_restore(old_interrupts);
 }
@@ -681,6 +1270,18 @@ void _thread_free()
 {
     uint32_t old_interrupts = irq_disable();
 
+    // Threads go first, since stopping a thread that is still blocked on a semaphore
+    // or condition takes it back out of that object's wait bookkeeping.
+    for (unsigned int i = 0; i < MAX_THREADS; i++)
+    {
+        if (threads[i] != 0)
+        {
+            _thread_destroy(threads[i]);
+            threads[i] = 0;
+        }
+    }
+    _thread_stack_pool_free();
+
     for (unsigned int i = 0; i < MAX_GLOBAL_COUNTERS; i++)
     {
         if (global_counters[i] != 0)
@@ -690,40 +1291,43 @@ void _thread_free()
         }
     }
 
-    for (unsigned int i = 0; i < MAX_SEM_AND_MUTEX; i++)
+    for (unsigned int i = 0; i < semaphore_slots; i++)
     {
-        if (semaphores[i] != 0)
+        if (semaphores[i]->type == SEM_TYPE_MUTEX)
         {
-            if (semaphores[i]->type == SEM_TYPE_MUTEX)
-            {
-                ((mutex_t *)semaphores[i]->public)->id = 0;
-            }
-            else if (semaphores[i]->type == SEM_TYPE_SEMAPHORE)
-            {
-                ((semaphore_t *)semaphores[i]->public)->id = 0;
-            }
-            free(semaphores[i]);
-            semaphores[i] = 0;
+            ((mutex_t *)semaphores[i]->public)->id = 0;
         }
-    }
-
-    for (unsigned int i = 0; i < MAX_THREADS; i++)
-    {
-        if (threads[i] != 0)
+        else if (semaphores[i]->type == SEM_TYPE_SEMAPHORE)
         {
-            _thread_destroy(threads[i]);
-            threads[i] = 0;
+            ((semaphore_t *)semaphores[i]->public)->id = 0;
+        }
+        else if (semaphores[i]->type == SEM_TYPE_CONDITION)
+        {
+            ((condition_t *)semaphores[i]->public)->id = 0;
         }
     }
+    for (unsigned int i = 0; i < semaphore_slots; i += SEM_SLAB_SIZE)
+    {
+        // Each slab was allocated in one go, starting at its first slot.
+        free(semaphores[i]);
+    }
+    if (semaphores)
+    {
+        free(semaphores);
+        semaphores = 0;
+    }
+    semaphore_slots = 0;
+    semaphore_capacity = 0;
+    semaphore_free_list = 0;
 
-    if (round_robin)
+    if (ready_queues)
     {
-        free(round_robin);
-        round_robin = 0;
+        free(ready_queues);
+        ready_queues = 0;
     }
-    round_robin_count = 0;
-    global_semaphore_count = 0;
-    global_mutex_count = 0;
+    memset(ready_words, 0, sizeof(ready_words));
+    memset(ready_groups, 0, sizeof(ready_groups));
+    ready_summary = 0;
     current_thread_id = 0;
 
     irq_restore(old_interrupts);
@@ -797,7 +1401,8 @@ void _thread_wake_waiting_threadid(thread_t *thread)
             // for the thread_join() syscall to the thread's retval, and
             // set the current thread to a zombie since it's been waited on.
             threads[i]->waiting_thread = 0;
-            threads[i]->state = THREAD_STATE_RUNNING;
+            _thread_set_state(threads[i], THREAD_STATE_RUNNING);
+            _trace_record(TRACE_EVENT_WAKE, threads[i]->id, TRACE_WAKE_JOIN, thread->id);
             if (thread->state == THREAD_STATE_ZOMBIE)
             {
                 // Already outputted the result to another join.
@@ -806,7 +1411,7 @@ void _thread_wake_waiting_threadid(thread_t *thread)
             else
             {
                 threads[i]->context->gp_regs[0] = (uint32_t )thread->retval;
-                thread->state = THREAD_STATE_ZOMBIE;
+                _thread_set_state(thread, THREAD_STATE_ZOMBIE);
             }
         }
     }
@@ -842,7 +1447,8 @@ int _thread_wake_waiting_semaphore(semaphore_internal_t *semaphore)
             // Yup, the other thread was waiting on this semaphore! Wake it up,
             // and set it as not waiting for this semaphore anymore.
             threads[i]->waiting_semaphore = 0;
-            threads[i]->state = THREAD_STATE_RUNNING;
+            _thread_set_state(threads[i], THREAD_STATE_RUNNING);
+            _trace_record(TRACE_EVENT_WAKE, threads[i]->id, TRACE_WAKE_SEMAPHORE, semaphore->id);
             scheduled = 1;
 
             // Now, since this was an acquire, we need to bookkeep the current
@@ -861,7 +1467,8 @@ int _thread_wake_waiting_semaphore(semaphore_internal_t *semaphore)
                 if (semaphore->type == SEM_TYPE_MUTEX)
                 {
                     semaphore->heldby = threads[i]->id;
-                    semaphore->recursive_count = 0;
+                    semaphore->recursive_count = threads[i]->waiting_recursive;
+                    threads[i]->waiting_recursive = 0;
                 }
                 break;
             }
@@ -882,43 +1489,30 @@ uint32_t _thread_wake_waiting_timer()
     }
     current_profile = new_profile;
 
-    if (time_elapsed == 0)
-    {
-        // Nothing to do here!
-        return 0;
-    }
-
-    for (unsigned int i = 0; i < highest_thread; i++)
+    // Wake everyone at the front of the queue whose timeout has passed.
+    while (sleep_head && sleep_head->waiting_timer <= new_profile)
     {
-        if (threads[i] == 0)
-        {
-            // Not a real thread.
-            continue;
-        }
-
-        if (threads[i]->state != THREAD_STATE_WAITING)
-        {
-            // Not waiting on any resources.
-            continue;
-        }
-
-        if (threads[i]->waiting_timer == 0)
+        thread_t *thread = sleep_head;
+        if (thread->waiting_condition)
         {
-            // Not waiting on a timer.
-            continue;
+            // This was a timed condition wait that nobody signalled in time.
+            _thread_condition_wake(thread, 0);
         }
-
-        if (threads[i]->waiting_timer <= time_elapsed)
+        else if (thread->waiting_semaphore || thread->waiting_any)
         {
-            // We hit our timeout, this thread is now wakeable!
-            threads[i]->waiting_timer = 0;
-            threads[i]->state = THREAD_STATE_RUNNING;
-            _thread_enable_priority(threads[i]);
+            // This was a timed acquire or wait that nothing satisfied in time, so
+            // report the timeout as the return value of the wait.
+            thread->context->gp_regs[0] = 0;
+            _thread_set_state(thread, THREAD_STATE_RUNNING);
+            _trace_record(TRACE_EVENT_WAKE, thread->id, TRACE_WAKE_TIMEOUT, 0);
         }
         else
         {
-            // This thread hasn't hit our timeout yet.
-            threads[i]->waiting_timer -= time_elapsed;
+            // We hit our timeout, this thread is now wakeable! Changing its state
+            // takes it off of the sleep queue.
+            _thread_set_state(thread, THREAD_STATE_RUNNING);
+            _thread_enable_priority(thread);
+            _trace_record(TRACE_EVENT_WAKE, thread->id, TRACE_WAKE_TIMER, 0);
         }
     }
 
@@ -948,7 +1542,7 @@ int _thread_wake_waiting_irq(unsigned int which)
             continue;
         }
 
-        if (threads[i]->waiting_interrupt == which)
+        if (threads[i]->waiting_interrupt & (1 << which))
         {
             // This thread is waiting on the resource that just became available!
             if (threads[i]->perform_additional_on_wake)
@@ -971,10 +1565,17 @@ int _thread_wake_waiting_irq(unsigned int which)
                 _thread_enable_critical(threads[i]);
             }
 
-            // Mark ourselves as handling this, let the thread wake up.
-            threads[i]->waiting_interrupt = 0;
-            threads[i]->perform_additional_on_wake = 0;
-            threads[i]->state = THREAD_STATE_RUNNING;
+            // If we were waiting on more than just this interrupt, report which one it
+            // was as the return value of the wait.
+            if (threads[i]->waiting_any)
+            {
+                threads[i]->context->gp_regs[0] = 1 << which;
+            }
+
+            // Mark ourselves as handling this, let the thread wake up. Changing its
+            // state stops it waiting on anything else.
+            _thread_set_state(threads[i], THREAD_STATE_RUNNING);
+            _trace_record(TRACE_EVENT_WAKE, threads[i]->id, TRACE_WAKE_INTERRUPT, 1 << which);
             scheduled = 1;
         }
     }
@@ -1016,8 +1617,9 @@ int _thread_wake_waiting_ta(unsigned int which)
         {
             // This thread is waiting on the resource that just became available!
             threads[i]->waiting_irq[which] = -1;
-            threads[i]->state = THREAD_STATE_RUNNING;
+            _thread_set_state(threads[i], THREAD_STATE_RUNNING);
             _thread_enable_critical(threads[i]);
+            _trace_record(TRACE_EVENT_WAKE, threads[i]->id, TRACE_WAKE_TA, which);
             scheduled = 1;
         }
     }
@@ -1102,7 +1704,8 @@ irq_state_t *_syscall_timer(irq_state_t *current, int timer)
 
     if (timer < 0)
     {
-        // Periodic preemption timer.
+        // Preemption timer, which has now reloaded its default period.
+        preempt_deadline = PREEMPT_UNKNOWN;
         uint64_t start = _profile_get_current();
         uint32_t elapsed = _thread_wake_waiting_timer();
         interruptions ++;
@@ -1167,6 +1770,11 @@ irq_state_t *_syscall_holly(irq_state_t *current, uint32_t serviced_holly_interr
         // Wake any threads waiting for TA lists to finish.
         should_schedule = should_schedule | _thread_wake_waiting_ta(WAITING_TA_LOAD_PUNCHTHRU_FINISHED);
     }
+    if (serviced_holly_interrupts & HOLLY_SERVICED_BACKGROUND_DMA_FINISHED)
+    {
+        // Wake any threads waiting to draw over a deferred background clear.
+        should_schedule = should_schedule | _thread_wake_waiting_ta(WAITING_BACKGROUND_DMA_FINISHED);
+    }
 
     if (should_schedule)
     {
@@ -1243,7 +1851,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                 if (thread->cancellable != 0 && thread->cancel_queued != 0)
                 {
                     thread->cancel_queued = 0;
-                    thread->state = THREAD_STATE_FINISHED;
+                    _thread_set_state(thread, THREAD_STATE_FINISHED);
                     thread->retval = THREAD_CANCELLED;
                     _thread_wake_waiting_threadid(thread);
                     schedule = THREAD_SCHEDULE_OTHER;
@@ -1266,7 +1874,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
             thread_t *thread = _thread_find_by_id(current->gp_regs[4]);
             if (thread && thread->state == THREAD_STATE_STOPPED)
             {
-                thread->state = THREAD_STATE_RUNNING;
+                _thread_set_state(thread, THREAD_STATE_RUNNING);
             }
 
             schedule = THREAD_SCHEDULE_ANY;
@@ -1278,7 +1886,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
             thread_t *thread = _thread_find_by_id(current->gp_regs[4]);
             if (thread && thread->state == THREAD_STATE_RUNNING)
             {
-                thread->state = THREAD_STATE_STOPPED;
+                _thread_set_state(thread, THREAD_STATE_STOPPED);
             }
 
             schedule = THREAD_SCHEDULE_ANY;
@@ -1300,6 +1908,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                     priority = MIN_PRIORITY;
                 }
                 thread->priority = priority;
+                _thread_ready_requeue(thread);
             }
 
             schedule = THREAD_SCHEDULE_ANY;
@@ -1325,7 +1934,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                         if (thread == myself || (thread->cancellable != 0 && thread->cancel_async != 0))
                         {
                             // Cancel it, it can be cancelled at any time.
-                            thread->state = THREAD_STATE_FINISHED;
+                            _thread_set_state(thread, THREAD_STATE_FINISHED);
                             thread->retval = THREAD_CANCELLED;
                             _thread_wake_waiting_threadid(thread);
                         }
@@ -1384,7 +1993,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                             // Need to stick this thread into waiting until
                             // the other thread is finished.
                             _thread_check_waiting(myself);
-                            myself->state = THREAD_STATE_WAITING;
+                            _thread_set_state(myself, THREAD_STATE_WAITING);
                             myself->waiting_thread = other->id;
                             schedule = THREAD_SCHEDULE_OTHER;
                             break;
@@ -1393,7 +2002,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                         {
                             // Thread is already done! We can return immediately.
                             current->gp_regs[0] = (uint32_t )other->retval;
-                            other->state = THREAD_STATE_ZOMBIE;
+                            _thread_set_state(other, THREAD_STATE_ZOMBIE);
                             break;
                         }
                         case THREAD_STATE_ZOMBIE:
@@ -1418,7 +2027,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
             thread_t *thread = (thread_t *)current->threadptr;
             if (thread)
             {
-                thread->state = THREAD_STATE_FINISHED;
+                _thread_set_state(thread, THREAD_STATE_FINISHED);
                 thread->retval = (void *)current->gp_regs[4];
             }
             else
@@ -1433,7 +2042,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
         }
         case 10:
         {
-            // semaphore_acquire, mutex_lock
+            // semaphore_acquire, semaphore_acquire_timeout, mutex_lock, mutex_lock_timeout
             semaphore_t *handle = (semaphore_t *)current->gp_regs[4];
             semaphore_internal_t *semaphore = _semaphore_find(handle, current->gp_regs[5]);
             if (semaphore)
@@ -1442,6 +2051,9 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
 
                 if (thread)
                 {
+                    // Assume success, the timeout path will overwrite this if we never get it.
+                    current->gp_regs[0] = 1;
+
                     if (semaphore->current > 0)
                     {
                         // Safely can acquire this.
@@ -1464,10 +2076,15 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                     }
                     else
                     {
-                        // Semaphore is used up, park ourselves until its ready.
+                        // Semaphore is used up, park ourselves until its ready or until
+                        // our timeout, if we were given one.
                         _thread_check_waiting(thread);
-                        thread->state = THREAD_STATE_WAITING;
+                        _thread_set_state(thread, THREAD_STATE_WAITING);
                         thread->waiting_semaphore = semaphore;
+                        if (current->gp_regs[6] != 0)
+                        {
+                            _thread_sleep_insert(thread, _profile_get_current() + current->gp_regs[6]);
+                        }
                         schedule = THREAD_SCHEDULE_OTHER;
 
                         // Track how many other threads are waiting for this semaphore.
@@ -1575,7 +2192,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                 if (thread->cancellable != 0 && thread->cancel_queued != 0)
                 {
                     thread->cancel_queued = 0;
-                    thread->state = THREAD_STATE_FINISHED;
+                    _thread_set_state(thread, THREAD_STATE_FINISHED);
                     thread->retval = THREAD_CANCELLED;
                     _thread_wake_waiting_threadid(thread);
                     schedule = THREAD_SCHEDULE_OTHER;
@@ -1583,12 +2200,11 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                 else
                 {
                     // Put the thread to sleep, waiting for the number of us requested.
-                    // Adjust that number based on how close to the periodic interrupt
-                    // we are, since when it fires it will not necessarily have lasted
-                    // the right amount of time for this particular timer.
+                    // The deadline is absolute, so it does not matter how close to the
+                    // next preemption interrupt we are.
                     _thread_check_waiting(thread);
-                    thread->state = THREAD_STATE_WAITING;
-                    thread->waiting_timer = current->gp_regs[4] + _thread_time_elapsed();
+                    _thread_set_state(thread, THREAD_STATE_WAITING);
+                    _thread_sleep_insert(thread, _profile_get_current() + current->gp_regs[4]);
                     schedule = THREAD_SCHEDULE_OTHER;
                 }
             }
@@ -1607,8 +2223,8 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
             {
                 // Put the thread to sleep, waiting for a specific interrupt.
                 _thread_check_waiting(thread);
-                thread->state = THREAD_STATE_WAITING;
-                thread->waiting_interrupt = current->gp_regs[4];
+                _thread_set_state(thread, THREAD_STATE_WAITING);
+                thread->waiting_interrupt = 1 << current->gp_regs[4];
                 thread->perform_additional_on_wake = current->gp_regs[5];
                 schedule = THREAD_SCHEDULE_OTHER;
             }
@@ -1640,7 +2256,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                     {
                         // Put the thread to sleep, waiting for the specific interrupt.
                         _thread_check_waiting(thread);
-                        thread->state = THREAD_STATE_WAITING;
+                        _thread_set_state(thread, THREAD_STATE_WAITING);
                         schedule = THREAD_SCHEDULE_OTHER;
                     }
                 }
@@ -1673,7 +2289,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                 if (thread->cancellable != 0 && thread->cancel_queued != 0 && thread->cancel_async != 0)
                 {
                     thread->cancel_queued = 0;
-                    thread->state = THREAD_STATE_FINISHED;
+                    _thread_set_state(thread, THREAD_STATE_FINISHED);
                     thread->retval = THREAD_CANCELLED;
                     _thread_wake_waiting_threadid(thread);
                 }
@@ -1710,7 +2326,7 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                 if (thread->cancellable != 0 && thread->cancel_queued != 0 && thread->cancel_async != 0)
                 {
                     thread->cancel_queued = 0;
-                    thread->state = THREAD_STATE_FINISHED;
+                    _thread_set_state(thread, THREAD_STATE_FINISHED);
                     thread->retval = THREAD_CANCELLED;
                     _thread_wake_waiting_threadid(thread);
                 }
@@ -1740,11 +2356,12 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
                 void *buffers = (void *)current->gp_regs[4];
                 void *scrn = (void *)current->gp_regs[5];
                 _ta_begin_render(buffers, scrn);
+                _trace_record(TRACE_EVENT_TA, thread->id, TRACE_TA_RENDER_BEGIN, 0);
 
                 // Put the thread to sleep, waiting for the render finished interrupt.
                 _thread_check_waiting(thread);
                 thread->waiting_irq[WAITING_TA_RENDER_FINISHED] = 0;
-                thread->state = THREAD_STATE_WAITING;
+                _thread_set_state(thread, THREAD_STATE_WAITING);
                 schedule = THREAD_SCHEDULE_OTHER;
             }
             else
@@ -1754,6 +2371,148 @@ irq_state_t *_syscall_trapa(irq_state_t *current, unsigned int which)
             }
             break;
         }
+        case 19:
+        {
+            // condition_wait, condition_wait_timeout
+            condition_t *handle = (condition_t *)current->gp_regs[4];
+            semaphore_internal_t *condition = _semaphore_find(handle, SEM_TYPE_CONDITION);
+            semaphore_internal_t *mutex = _semaphore_find((mutex_t *)current->gp_regs[5], SEM_TYPE_MUTEX);
+            thread_t *thread = (thread_t *)current->threadptr;
+
+            if (condition == 0)
+            {
+                uint32_t id = handle ? handle->id : 0;
+                _irq_display_exception(SIGABRT, current, "attempt wait on uninitialized condition", id);
+            }
+            else if (mutex == 0)
+            {
+                mutex_t *mhandle = (mutex_t *)current->gp_regs[5];
+                uint32_t id = mhandle ? mhandle->id : 0;
+                _irq_display_exception(SIGABRT, current, "attempt wait with uninitialized mutex", id);
+            }
+            else if (thread == 0)
+            {
+                // Should never happen.
+                _irq_display_exception(SIGABRT, current, "cannot locate thread object", which);
+            }
+            else if (mutex->heldby != thread->id || mutex->current > 0)
+            {
+                _irq_display_exception(SIGABRT, current, "attempt wait with unowned mutex", ((mutex_t *)current->gp_regs[5])->id);
+            }
+            else
+            {
+                // Give up the mutex entirely, even if we locked it recursively, and hand
+                // it to anyone waiting for it.
+                _thread_check_waiting(thread);
+                thread->condition_mutex = mutex;
+                thread->waiting_recursive = mutex->recursive_count;
+                mutex->heldby = 0;
+                mutex->recursive_count = 0;
+                mutex->current += 1;
+                _thread_wake_waiting_semaphore(mutex);
+
+                // Now park ourselves on the condition, optionally with a timeout.
+                _thread_set_state(thread, THREAD_STATE_WAITING);
+                _thread_condition_insert(condition, thread);
+                if (current->gp_regs[6] != 0)
+                {
+                    _thread_sleep_insert(thread, _profile_get_current() + current->gp_regs[6]);
+                }
+                schedule = THREAD_SCHEDULE_OTHER;
+            }
+
+            break;
+        }
+        case 20:
+        {
+            // condition_signal, condition_broadcast
+            condition_t *handle = (condition_t *)current->gp_regs[4];
+            semaphore_internal_t *condition = _semaphore_find(handle, SEM_TYPE_CONDITION);
+
+            if (condition)
+            {
+                while (condition->wait_head)
+                {
+                    thread_t *thread = condition->wait_head;
+                    _thread_condition_wake(thread, 1);
+                    if (thread->state == THREAD_STATE_RUNNING)
+                    {
+                        schedule = THREAD_SCHEDULE_OTHER;
+                    }
+
+                    if (current->gp_regs[5] == 0)
+                    {
+                        // Only signalling one thread.
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                uint32_t id = handle ? handle->id : 0;
+                _irq_display_exception(SIGABRT, current, "attempt signal uninitialized condition", id);
+            }
+
+            break;
+        }
+        case 21:
+        {
+            // thread_wait_any
+            semaphore_t *handle = (semaphore_t *)current->gp_regs[4];
+            semaphore_internal_t *semaphore = handle ? _semaphore_find(handle, SEM_TYPE_SEMAPHORE) : 0;
+            unsigned int interrupts = current->gp_regs[5];
+            thread_t *thread = (thread_t *)current->threadptr;
+
+            if (handle != 0 && semaphore == 0)
+            {
+                _irq_display_exception(SIGABRT, current, "attempt wait on uninitialized semaphore", handle->id);
+            }
+            else if (interrupts & ~(WAIT_ANY_VBLANK_IN | WAIT_ANY_VBLANK_OUT | WAIT_ANY_HBLANK))
+            {
+                _irq_display_exception(SIGABRT, current, "unrecognized IRQ wait value", interrupts);
+            }
+            else if (thread == 0)
+            {
+                // Should never happen.
+                _irq_display_exception(SIGABRT, current, "cannot locate thread object", which);
+            }
+            else if (semaphore && semaphore->current > 0)
+            {
+                // Semaphore is available right now, no need to wait on anything.
+                semaphore->current -= 1;
+                semaphore->irq_disabled = 0;
+                current->gp_regs[0] = WAIT_ANY_SEMAPHORE;
+            }
+            else if (semaphore == 0 && interrupts == 0 && current->gp_regs[6] == 0)
+            {
+                // Nothing to wait on, so we would never wake up.
+                current->gp_regs[0] = WAIT_ANY_TIMEOUT;
+            }
+            else
+            {
+                // Wait on everything at once. Whichever happens first wakes us up and
+                // takes us off of everything else, and the semaphore is what we report
+                // if we don't hear otherwise from the interrupt or timeout paths.
+                _thread_check_waiting(thread);
+                _thread_set_state(thread, THREAD_STATE_WAITING);
+                thread->waiting_any = 1;
+                current->gp_regs[0] = WAIT_ANY_SEMAPHORE;
+
+                if (semaphore)
+                {
+                    thread->waiting_semaphore = semaphore;
+                    semaphore->others_waiting++;
+                }
+                thread->waiting_interrupt = interrupts;
+                if (current->gp_regs[6] != 0)
+                {
+                    _thread_sleep_insert(thread, _profile_get_current() + current->gp_regs[6]);
+                }
+                schedule = THREAD_SCHEDULE_OTHER;
+            }
+
+            break;
+        }
         case 253:
         {
             // Reserved for GDB software breakpoints. Like the below, we should
@@ -1872,52 +2631,25 @@ void semaphore_init(semaphore_t *semaphore, uint32_t initial_value)
 
     if (_valid_memory_range(semaphore))
     {
-        // Enforce maximum, since we combine semaphores and mutexes.
-        if (global_semaphore_count >= MAX_SEMAPHORES)
+        // Create semaphore.
+        semaphore_internal_t *internal = _semaphore_alloc(semaphore, SEM_TYPE_SEMAPHORE);
+        if (internal == 0)
         {
-            return;
+            _irq_display_invariant("memory failure", "could not get memory for new semaphore!");
         }
 
-        for (unsigned int i = 0; i < MAX_SEM_AND_MUTEX; i++)
-        {
-            uint32_t semaphore_id = semaphore_counter + i;
-            unsigned int slot = semaphore_id % MAX_SEM_AND_MUTEX;
-
-            if (semaphores[slot] == 0)
-            {
-                // Create semaphore.
-                semaphore_internal_t *internal = malloc(sizeof(semaphore_internal_t));
-                if (internal == 0)
-                {
-                    _irq_display_invariant("memory failure", "could not get memory for new semaphore!");
-                }
+        // Set up the initial value.
+        internal->max = initial_value;
+        internal->current = initial_value;
 
-                // Set up the pointer and initial value.
-                internal->public = semaphore;
-                internal->id = semaphore_id;
-                internal->type = SEM_TYPE_SEMAPHORE;
-                internal->max = initial_value;
-                internal->current = initial_value;
-                internal->others_waiting = 0;
-                internal->heldby = 0;
-                internal->recursive_count = 0;
-
-                // Put it in our registry.
-                semaphores[slot] = internal;
-
-                // Assign an ID to this semaphore so we can look it up again later.
-                semaphore->id = semaphore_id;
-                semaphore_counter = semaphore_id + 1;
-                global_semaphore_count ++;
-                break;
-            }
-        }
+        // Assign an ID to this semaphore so we can look it up again later.
+        semaphore->id = internal->id;
     }
 
     irq_restore(old_interrupts);
 }
 
-void semaphore_acquire(semaphore_t * semaphore)
+int semaphore_acquire_timeout(semaphore_t * semaphore, uint32_t us)
 {
     // Attempt to acquire even without interrupts/threads running. If we succeed, then there
     // was no problem. However, if we fail, since we can't use syscalls we need to throw
@@ -1926,22 +2658,19 @@ void semaphore_acquire(semaphore_t * semaphore)
     int irq_disabled = _irq_is_disabled(old_interrupts);
     int acquired = 0;
 
-    if (_valid_memory_range(semaphore))
+    semaphore_internal_t *internal = _semaphore_find(semaphore, SEM_TYPE_SEMAPHORE);
+    if (internal)
     {
-        int slot = semaphore->id % MAX_SEM_AND_MUTEX;
-        if (semaphores[slot] != 0 && semaphores[slot]->id == semaphore->id && semaphores[slot]->type == SEM_TYPE_SEMAPHORE)
+        // This is the right semaphore. See if we can acquire it.
+        if (internal->current > 0)
         {
-            // This is the right semaphore. See if we can acquire it.
-            if (semaphores[slot]->current > 0)
-            {
-                acquired = 1;
-                semaphores[slot]->current --;
+            acquired = 1;
+            internal->current --;
 
-                // Keep track of whether this was acquired with interrupts disabled or not.
-                // This is because if it was, the subsequent release must be done without
-                // syscalls as well.
-                semaphores[slot]->irq_disabled = irq_disabled;
-            }
+            // Keep track of whether this was acquired with interrupts disabled or not.
+            // This is because if it was, the subsequent release must be done without
+            // syscalls as well.
+            internal->irq_disabled = irq_disabled;
         }
     }
 
@@ -1956,8 +2685,18 @@ void semaphore_acquire(semaphore_t * semaphore)
 
         register semaphore_t * syscall_param0 asm("r4") = semaphore;
         register unsigned int syscall_param1 asm("r5") = SEM_TYPE_SEMAPHORE;
-        asm("trapa #10" : : "r" (syscall_param0), "r" (syscall_param1));
+        register uint32_t syscall_param2 asm("r6") = us;
+        register int syscall_return asm("r0");
+        asm("trapa #10" : "=r" (syscall_return) : "r" (syscall_param0), "r" (syscall_param1), "r" (syscall_param2));
+        acquired = syscall_return;
     }
+
+    return acquired;
+}
+
+void semaphore_acquire(semaphore_t * semaphore)
+{
+    semaphore_acquire_timeout(semaphore, 0);
 }
 
 void semaphore_release(semaphore_t * semaphore)
@@ -1969,22 +2708,15 @@ void semaphore_release(semaphore_t * semaphore)
     // amount of time.
     uint32_t old_interrupts = irq_disable();
 
-    if (_valid_memory_range(semaphore))
+    semaphore_internal_t *internal = _semaphore_find(semaphore, SEM_TYPE_SEMAPHORE);
+    if (internal && (internal->irq_disabled || internal->others_waiting == 0))
     {
-        int slot = semaphore->id % MAX_SEM_AND_MUTEX;
-        if (
-            semaphores[slot] != 0 &&
-            semaphores[slot]->id == semaphore->id &&
-            semaphores[slot]->type == SEM_TYPE_SEMAPHORE &&
-            (semaphores[slot]->irq_disabled || semaphores[slot]->others_waiting == 0)
-        ) {
-            // Release the semaphore, exit without doing a syscall.
-            semaphores[slot]->current ++;
-            semaphores[slot]->irq_disabled = 0;
+        // Release the semaphore, exit without doing a syscall.
+        internal->current ++;
+        internal->irq_disabled = 0;
 
-            irq_restore(old_interrupts);
-            return;
-        }
+        irq_restore(old_interrupts);
+        return;
     }
 
     // This was acquired normally, release using a syscall to wake any other threads.
@@ -1998,16 +2730,11 @@ void semaphore_free(semaphore_t *semaphore)
 {
     uint32_t old_interrupts = irq_disable();
 
-    if (_valid_memory_range(semaphore))
+    semaphore_internal_t *internal = _semaphore_find(semaphore, SEM_TYPE_SEMAPHORE);
+    if (internal)
     {
-        int slot = semaphore->id % MAX_SEM_AND_MUTEX;
-        if (semaphores[slot] != 0 && semaphores[slot]->id == semaphore->id && semaphores[slot]->type == SEM_TYPE_SEMAPHORE)
-        {
-            free(semaphores[slot]);
-            semaphores[slot] = 0;
-            semaphore->id = 0;
-            global_semaphore_count --;
-        }
+        _semaphore_release(internal);
+        semaphore->id = 0;
     }
 
     irq_restore(old_interrupts);
@@ -2019,46 +2746,19 @@ void mutex_init(mutex_t *mutex)
 
     if (_valid_memory_range(mutex))
     {
-        // Enforce maximum, since we combine semaphores and mutexes.
-        if (global_mutex_count >= MAX_MUTEXES)
+        // Create mutex.
+        semaphore_internal_t *internal = _semaphore_alloc(mutex, SEM_TYPE_MUTEX);
+        if (internal == 0)
         {
-            return;
+            _irq_display_invariant("memory failure", "could not get memory for new mutex!");
         }
 
-        for (unsigned int i = 0; i < MAX_SEM_AND_MUTEX; i++)
-        {
-            uint32_t mutex_id = semaphore_counter + i;
-            unsigned int slot = mutex_id % MAX_SEM_AND_MUTEX;
-
-            if (semaphores[slot] == 0)
-            {
-                // Create mutex.
-                semaphore_internal_t *internal = malloc(sizeof(semaphore_internal_t));
-                if (internal == 0)
-                {
-                    _irq_display_invariant("memory failure", "could not get memory for new mutex!");
-                }
+        // Set up the initial value.
+        internal->max = 1;
+        internal->current = 1;
 
-                // Set up the pointer and initial value.
-                internal->public = mutex;
-                internal->id = mutex_id;
-                internal->type = SEM_TYPE_MUTEX;
-                internal->max = 1;
-                internal->current = 1;
-                internal->others_waiting = 0;
-                internal->heldby = 0;
-                internal->recursive_count = 0;
-
-                // Put it in our registry.
-                semaphores[slot] = internal;
-
-                // Assign an ID to this semaphore so we can look it up again later.
-                mutex->id = mutex_id;
-                semaphore_counter = mutex_id + 1;
-                global_mutex_count ++;
-                break;
-            }
-        }
+        // Assign an ID to this mutex so we can look it up again later.
+        mutex->id = internal->id;
     }
 
     irq_restore(old_interrupts);
@@ -2071,31 +2771,28 @@ int mutex_try_lock(mutex_t *mutex)
     uint32_t old_interrupts = irq_disable();
     int acquired = 0;
 
-    if (_valid_memory_range(mutex))
+    semaphore_internal_t *internal = _semaphore_find(mutex, SEM_TYPE_MUTEX);
+    if (internal)
     {
-        int slot = mutex->id % MAX_SEM_AND_MUTEX;
-        if (semaphores[slot] != 0 && semaphores[slot]->id == mutex->id && semaphores[slot]->type == SEM_TYPE_MUTEX)
+        // This is the right mutex. See if we can acquire it.
+        if (internal->current > 0)
         {
-            // This is the right mutex. See if we can acquire it.
-            if (semaphores[slot]->current > 0)
-            {
-                acquired = 1;
-                semaphores[slot]->current --;
-                semaphores[slot]->heldby = current_thread_id;
-                semaphores[slot]->recursive_count = 0;
-
-                // Keep track of whether this was acquired with interrupts disabled or not.
-                // This is because if it was, the subsequent unlock must be done without
-                // syscalls as well.
-                semaphores[slot]->irq_disabled = _irq_is_disabled(old_interrupts);
-            }
-            else if (semaphores[slot]->heldby == current_thread_id)
-            {
-                // This is a recursively acquired mutex, don't deadlock, since we have the
-                // resource already.
-                acquired = 1;
-                semaphores[slot]->recursive_count ++;
-            }
+            acquired = 1;
+            internal->current --;
+            internal->heldby = current_thread_id;
+            internal->recursive_count = 0;
+
+            // Keep track of whether this was acquired with interrupts disabled or not.
+            // This is because if it was, the subsequent unlock must be done without
+            // syscalls as well.
+            internal->irq_disabled = _irq_is_disabled(old_interrupts);
+        }
+        else if (internal->heldby == current_thread_id)
+        {
+            // This is a recursively acquired mutex, don't deadlock, since we have the
+            // resource already.
+            acquired = 1;
+            internal->recursive_count ++;
         }
     }
 
@@ -2103,7 +2800,7 @@ int mutex_try_lock(mutex_t *mutex)
     return acquired;
 }
 
-void mutex_lock(mutex_t * mutex)
+int mutex_lock_timeout(mutex_t * mutex, uint32_t us)
 {
     // Attempt to lock even without interrupts/threads running. If we succeed, then there
     // was no problem. However, if we fail, since we can't use syscalls we need to throw
@@ -2112,31 +2809,28 @@ void mutex_lock(mutex_t * mutex)
     int irq_disabled = _irq_is_disabled(old_interrupts);
     int acquired = 0;
 
-    if (_valid_memory_range(mutex))
+    semaphore_internal_t *internal = _semaphore_find(mutex, SEM_TYPE_MUTEX);
+    if (internal)
     {
-        int slot = mutex->id % MAX_SEM_AND_MUTEX;
-        if (semaphores[slot] != 0 && semaphores[slot]->id == mutex->id && semaphores[slot]->type == SEM_TYPE_MUTEX)
+        // This is the right mutex. See if we can acquire it.
+        if (internal->current > 0)
         {
-            // This is the right mutex. See if we can acquire it.
-            if (semaphores[slot]->current > 0)
-            {
-                acquired = 1;
-                semaphores[slot]->current --;
-                semaphores[slot]->heldby = current_thread_id;
-                semaphores[slot]->recursive_count = 0;
-
-                // Keep track of whether this was acquired with interrupts disabled or not.
-                // This is because if it was, the subsequent unlock must be done without
-                // syscalls as well.
-                semaphores[slot]->irq_disabled = irq_disabled;
-            }
-            else if (semaphores[slot]->heldby == current_thread_id)
-            {
-                // This is a recursively acquired mutex, don't deadlock, since we have the
-                // resource already.
-                acquired = 1;
-                semaphores[slot]->recursive_count ++;
-            }
+            acquired = 1;
+            internal->current --;
+            internal->heldby = current_thread_id;
+            internal->recursive_count = 0;
+
+            // Keep track of whether this was acquired with interrupts disabled or not.
+            // This is because if it was, the subsequent unlock must be done without
+            // syscalls as well.
+            internal->irq_disabled = irq_disabled;
+        }
+        else if (internal->heldby == current_thread_id)
+        {
+            // This is a recursively acquired mutex, don't deadlock, since we have the
+            // resource already.
+            acquired = 1;
+            internal->recursive_count ++;
         }
     }
 
@@ -2151,8 +2845,18 @@ void mutex_lock(mutex_t * mutex)
 
         register mutex_t * syscall_param0 asm("r4") = mutex;
         register unsigned int syscall_param1 asm("r5") = SEM_TYPE_MUTEX;
-        asm("trapa #10" : : "r" (syscall_param0), "r" (syscall_param1));
+        register uint32_t syscall_param2 asm("r6") = us;
+        register int syscall_return asm("r0");
+        asm("trapa #10" : "=r" (syscall_return) : "r" (syscall_param0), "r" (syscall_param1), "r" (syscall_param2));
+        acquired = syscall_return;
     }
+
+    return acquired;
+}
+
+void mutex_lock(mutex_t * mutex)
+{
+    mutex_lock_timeout(mutex, 0);
 }
 
 void mutex_unlock(mutex_t * mutex)
@@ -2164,37 +2868,30 @@ void mutex_unlock(mutex_t * mutex)
     // amount of time.
     uint32_t old_interrupts = irq_disable();
 
-    if (_valid_memory_range(mutex))
+    semaphore_internal_t *internal = _semaphore_find(mutex, SEM_TYPE_MUTEX);
+    if (internal && (internal->irq_disabled || internal->others_waiting == 0 || internal->recursive_count > 0))
     {
-        int slot = mutex->id % MAX_SEM_AND_MUTEX;
-        if (
-            semaphores[slot] != 0 &&
-            semaphores[slot]->id == mutex->id &&
-            semaphores[slot]->type == SEM_TYPE_MUTEX &&
-            (semaphores[slot]->irq_disabled || semaphores[slot]->others_waiting == 0 || semaphores[slot]->recursive_count > 0)
-        ) {
-            if (semaphores[slot]->heldby != current_thread_id)
-            {
-                // Releasing a mutex we don't own?
-                _irq_display_invariant("mutex failure", "attempt release unowned mutex %lu", mutex->id);
-            }
-            else if (semaphores[slot]->recursive_count > 0)
-            {
-                // Recursively locked, just decrease the count.
-                semaphores[slot]->recursive_count --;
-            }
-            else
-            {
-                // Unlock the mutex, exit without doing a syscall.
-                semaphores[slot]->current ++;
-                semaphores[slot]->irq_disabled = 0;
-                semaphores[slot]->heldby = 0;
-                semaphores[slot]->recursive_count = 0;
-            }
-
-            irq_restore(old_interrupts);
-            return;
+        if (internal->heldby != current_thread_id)
+        {
+            // Releasing a mutex we don't own?
+            _irq_display_invariant("mutex failure", "attempt release unowned mutex %lu", mutex->id);
+        }
+        else if (internal->recursive_count > 0)
+        {
+            // Recursively locked, just decrease the count.
+            internal->recursive_count --;
+        }
+        else
+        {
+            // Unlock the mutex, exit without doing a syscall.
+            internal->current ++;
+            internal->irq_disabled = 0;
+            internal->heldby = 0;
+            internal->recursive_count = 0;
         }
+
+        irq_restore(old_interrupts);
+        return;
     }
 
     // This was locked normally, unlock using a syscall to wake any other threads.
@@ -2208,16 +2905,115 @@ void mutex_free(mutex_t *mutex)
 {
     uint32_t old_interrupts = irq_disable();
 
-    if (_valid_memory_range(mutex))
+    semaphore_internal_t *internal = _semaphore_find(mutex, SEM_TYPE_MUTEX);
+    if (internal)
+    {
+        _semaphore_release(internal);
+        mutex->id = 0;
+    }
+
+    irq_restore(old_interrupts);
+}
+
+void condition_init(condition_t *condition)
+{
+    uint32_t old_interrupts = irq_disable();
+
+    if (_valid_memory_range(condition))
+    {
+        // Create condition, which starts out with an empty wait queue.
+        semaphore_internal_t *internal = _semaphore_alloc(condition, SEM_TYPE_CONDITION);
+        if (internal == 0)
+        {
+            _irq_display_invariant("memory failure", "could not get memory for new condition!");
+        }
+
+        // Assign an ID to this condition so we can look it up again later.
+        condition->id = internal->id;
+    }
+
+    irq_restore(old_interrupts);
+}
+
+int condition_wait_timeout(condition_t *condition, mutex_t *mutex, uint32_t us)
+{
+    if (_irq_is_disabled(_irq_get_sr()))
+    {
+        _irq_display_invariant("condition failure", "interrupts are disabled but we need to make a syscall to wait on condition");
+    }
+
+    register condition_t * syscall_param0 asm("r4") = condition;
+    register mutex_t * syscall_param1 asm("r5") = mutex;
+    register uint32_t syscall_param2 asm("r6") = us;
+    register int syscall_return asm("r0");
+    asm("trapa #19" : "=r" (syscall_return) : "r" (syscall_param0), "r" (syscall_param1), "r" (syscall_param2));
+    return syscall_return;
+}
+
+void condition_wait(condition_t *condition, mutex_t *mutex)
+{
+    condition_wait_timeout(condition, mutex, 0);
+}
+
+int _condition_has_waiters(condition_t *condition)
+{
+    uint32_t old_interrupts = irq_disable();
+    int waiters = 0;
+
+    if (_valid_memory_range(condition))
+    {
+        semaphore_internal_t *internal = _semaphore_lookup(condition->id, SEM_TYPE_CONDITION);
+        if (internal)
+        {
+            waiters = internal->wait_head != 0;
+        }
+        else
+        {
+            // Let the syscall handle the invalid condition.
+            waiters = 1;
+        }
+    }
+
+    irq_restore(old_interrupts);
+    return waiters;
+}
+
+void condition_signal(condition_t *condition)
+{
+    // Signalling with nobody waiting is a no-op, so skip the syscall.
+    if (_condition_has_waiters(condition))
     {
-        int slot = mutex->id % MAX_SEM_AND_MUTEX;
-        if (semaphores[slot] != 0 && semaphores[slot]->id == mutex->id && semaphores[slot]->type == SEM_TYPE_MUTEX)
+        register condition_t * syscall_param0 asm("r4") = condition;
+        register uint32_t syscall_param1 asm("r5") = 0;
+        asm("trapa #20" : : "r" (syscall_param0), "r" (syscall_param1));
+    }
+}
+
+void condition_broadcast(condition_t *condition)
+{
+    // Signalling with nobody waiting is a no-op, so skip the syscall.
+    if (_condition_has_waiters(condition))
+    {
+        register condition_t * syscall_param0 asm("r4") = condition;
+        register uint32_t syscall_param1 asm("r5") = 1;
+        asm("trapa #20" : : "r" (syscall_param0), "r" (syscall_param1));
+    }
+}
+
+void condition_free(condition_t *condition)
+{
+    uint32_t old_interrupts = irq_disable();
+
+    semaphore_internal_t *internal = _semaphore_find(condition, SEM_TYPE_CONDITION);
+    if (internal)
+    {
+        if (internal->wait_head != 0)
         {
-            free(semaphores[slot]);
-            semaphores[slot] = 0;
-            mutex->id = 0;
-            global_mutex_count --;
+            _irq_display_invariant("condition failure", "attempt to free condition %lu with waiting threads", condition->id);
         }
+
+        _semaphore_release(internal);
+        condition->id = 0;
     }
 
     irq_restore(old_interrupts);
@@ -2248,6 +3044,11 @@ void * _thread_run(void *param)
 }
 
 uint32_t thread_create(char *name, thread_func_t function, void *param)
+{
+    return thread_create_ex(name, function, param, THREAD_STACK_SIZE);
+}
+
+uint32_t thread_create_ex(char *name, thread_func_t function, void *param, uint32_t stack_size)
 {
     // Create a new thread.
     thread_t *thread = _thread_create(name, 0);
@@ -2262,12 +3063,13 @@ uint32_t thread_create(char *name, thread_func_t function, void *param)
     ctx->param = param;
 
     // Set up the thread to be runnable.
-    thread->stack = malloc(THREAD_STACK_SIZE);
+    thread->stack_size = _thread_stack_size(stack_size);
+    thread->stack = _thread_stack_alloc(thread->stack_size);
     if (thread->stack == 0)
     {
         _irq_display_invariant("memory failure", "could not get memory for new thread stack!");
     }
-    thread->context = _irq_new_state(_thread_run, ctx, thread->stack + THREAD_STACK_SIZE, thread);
+    thread->context = _irq_new_state(_thread_run, ctx, thread->stack + thread->stack_size, thread);
 
     // Return the thread ID.
     return thread->id;
@@ -2331,6 +3133,7 @@ int thread_info(uint32_t tid, thread_info_t *info)
         // CPU stats.
         info->running_time = thread->running_time;
         info->cpu_percentage = thread->cpu_percentage;
+        info->stack_size = thread->stack_size;
     }
 
     irq_restore(old_interrupts);
@@ -2419,6 +3222,21 @@ void thread_wait_hblank()
     asm("trapa #13" : : "r" (syscall_param0), "r" (syscall_param1));
 }
 
+int thread_wait_any(semaphore_t *semaphore, unsigned int interrupts, uint32_t us)
+{
+    if (_irq_is_disabled(_irq_get_sr()))
+    {
+        _irq_display_invariant("wait failure", "interrupts are disabled but we need to make a syscall to wait");
+    }
+
+    register semaphore_t * syscall_param0 asm("r4") = semaphore;
+    register unsigned int syscall_param1 asm("r5") = interrupts;
+    register uint32_t syscall_param2 asm("r6") = us;
+    register int syscall_return asm("r0");
+    asm("trapa #21" : "=r" (syscall_return) : "r" (syscall_param0), "r" (syscall_param1), "r" (syscall_param2));
+    return syscall_return;
+}
+
 void _thread_notify_impl(int waiting_irq)
 {
     uint32_t old_interrupts = irq_disable();
@@ -2460,6 +3278,11 @@ void _thread_notify_wait_ta_load_punchthru()
     _thread_notify_impl(WAITING_TA_LOAD_PUNCHTHRU_FINISHED);
 }
 
+void _thread_notify_wait_background_dma()
+{
+    _thread_notify_impl(WAITING_BACKGROUND_DMA_FINISHED);
+}
+
 void _thread_ta_render(void *buffers, void *screen)
 {
     register void * syscall_param0 asm("r4") = buffers;
@@ -2484,3 +3307,9 @@ void _thread_wait_ta_load_punchthru()
     register uint32_t syscall_param0 asm("r4") = WAITING_TA_LOAD_PUNCHTHRU_FINISHED;
     asm("trapa #15" : : "r" (syscall_param0));
 }
+
+void _thread_wait_background_dma()
+{
+    register uint32_t syscall_param0 asm("r4") = WAITING_BACKGROUND_DMA_FINISHED;
+    asm("trapa #15" : : "r" (syscall_param0));
+}
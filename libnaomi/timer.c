@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include "naomi/timer.h"
 #include "naomi/interrupt.h"
@@ -68,7 +69,8 @@ void _timer_init()
     // Schedule the profiler timer.
     _profile_init();
 
-    // Schedule the periodic preemption timer.
+    // Schedule the preemption timer. This starts out periodic, and the scheduler
+    // reprograms it for its next deadline from then on.
     _preempt_init();
 
     // Initialize user timers.
@@ -77,6 +79,9 @@ void _timer_init()
 
 void _timer_free()
 {
+    // Kill the sampling profiler if somebody left it running.
+    profile_sample_stop();
+
     // Kill user timers.
     _user_timer_free();
 
@@ -135,6 +140,43 @@ void _preempt_init()
     irq_restore(old_interrupts);
 }
 
+void _preempt_next(uint32_t microseconds)
+{
+    if (preempt_timer < 0 || preempt_timer >= MAX_HW_TIMERS)
+    {
+        // No preemption timer to adjust.
+        return;
+    }
+
+    uint32_t old_interrupts = irq_disable();
+    TIMER_TSTR &= ~(1 << preempt_timer);
+
+    if (microseconds > 0)
+    {
+        // The scheduler reprograms us every time we fire, so there is no point in
+        // counting further than a second out.
+        if (microseconds > MICROSECONDS_IN_ONE_SECOND)
+        {
+            microseconds = MICROSECONDS_IN_ONE_SECOND;
+        }
+
+        // Same peripheral clock divided by 64 calculation as below, but in integer math
+        // since we get called from the scheduler. The constant register is left at the
+        // normal preemption period, so if the scheduler doesn't reprogram us after we
+        // fire we go back to periodic preemption.
+        uint32_t rate = (microseconds * 25) / 32;
+        if (rate == 0)
+        {
+            rate = 1;
+        }
+
+        TIMER_TCNT(preempt_timer) = rate;
+        TIMER_TSTR |= (1 << preempt_timer);
+    }
+
+    irq_restore(old_interrupts);
+}
+
 void _preempt_free()
 {
     if (preempt_timer >= 0 && preempt_timer < MAX_HW_TIMERS)
@@ -397,6 +439,48 @@ uint64_t _profile_get_current()
     return amount;
 }
 
+uint32_t _profile_ticks()
+{
+    // A raw count of profile timer ticks which wraps around every MAX_PROFILE_MICROSECONDS.
+    // This is much cheaper than _profile_get_current() since it is just a register read, which
+    // is what we want for timing every single interrupt.
+    if (profile_timer >= 0 && profile_timer < MAX_HW_TIMERS)
+    {
+        return TIMER_TCOR(profile_timer) - TIMER_TCNT(profile_timer);
+    }
+
+    return 0;
+}
+
+uint32_t _profile_ticks_elapsed(uint32_t start, uint32_t end)
+{
+    if (profile_timer < 0 || profile_timer >= MAX_HW_TIMERS)
+    {
+        return 0;
+    }
+
+    if (end < start)
+    {
+        // We wrapped around, which only works out for spans under a profile timer period.
+        end += TIMER_TCOR(profile_timer) + 1;
+    }
+
+    // Inverse of the peripheral clock divided by 64 calculation in _timer_start().
+    return ((end - start) * 32) / 25;
+}
+
+uint32_t _timer_latency(int timer)
+{
+    if (timer < 0 || timer >= MAX_HW_TIMERS || (!timers_used[timer]))
+    {
+        return 0;
+    }
+
+    // The count reloaded from the constant register when it underflowed and raised the
+    // interrupt, and has been counting down ever since.
+    return ((TIMER_TCOR(timer) - TIMER_TCNT(timer)) * 32) / 25;
+}
+
 int profile_start()
 {
     uint32_t old_interrupts = irq_disable();
@@ -435,6 +519,204 @@ uint64_t profile_end(int profile)
     return elapsed;
 }
 
+// How many histogram entries we look at for a sample before giving up on it.
+#define MAX_SAMPLE_PROBES 16
+
+// The fastest we will sample, since every sample costs an interrupt.
+#define MAX_SAMPLE_RATE 10000
+
+// Histograms are open addressed hash tables, where an entry with a count of zero is free.
+// There are two of them so that profile_sample_read() only has to swap which one the
+// interrupt handler records into with interrupts disabled, and can copy out and clear the
+// other one at its leisure.
+static profile_sample_t *sample_histograms[2];
+static profile_sample_t *sample_current = 0;
+static unsigned int sample_mask = 0;
+static unsigned int sample_limit = 0;
+static unsigned int sample_used = 0;
+static unsigned int sample_flags = 0;
+static uint32_t sample_dropped = 0;
+static int sample_timer = -1;
+
+uint32_t _thread_current_id(irq_state_t *cur_state);
+
+int _profile_sample_cb(int timer)
+{
+    // Inform the interrupt handler that it should take a sample.
+    return 1;
+}
+
+void _profile_sample(irq_state_t *cur_state)
+{
+    profile_sample_t *histogram = sample_current;
+    if (histogram == 0)
+    {
+        // Sampler was stopped while this interrupt was pending.
+        return;
+    }
+
+    uint32_t thread = _thread_current_id(cur_state);
+    uint32_t pc = cur_state->pc;
+    uint32_t pr = (sample_flags & PROFILE_SAMPLE_CALLER) ? cur_state->pr : 0;
+
+    // Instructions are two bytes, so the low bit of the PC never changes.
+    uint32_t hash = ((pc >> 1) ^ (pr * 31) ^ (thread * 131)) * 2654435761U;
+    hash ^= hash >> 16;
+
+    for (unsigned int probe = 0; probe < MAX_SAMPLE_PROBES; probe++)
+    {
+        profile_sample_t *entry = &histogram[(hash + probe) & sample_mask];
+        if (entry->count == 0)
+        {
+            if (sample_used >= sample_limit)
+            {
+                // Out of room for new locations.
+                break;
+            }
+
+            entry->thread = thread;
+            entry->pc = pc;
+            entry->pr = pr;
+            entry->count = 1;
+            sample_used++;
+            return;
+        }
+        if (entry->pc == pc && entry->pr == pr && entry->thread == thread)
+        {
+            entry->count++;
+            return;
+        }
+    }
+
+    sample_dropped++;
+}
+
+int profile_sample_start(unsigned int rate, unsigned int flags, unsigned int entries)
+{
+    if (rate == 0 || entries == 0)
+    {
+        return -1;
+    }
+    if (rate > MAX_SAMPLE_RATE)
+    {
+        rate = MAX_SAMPLE_RATE;
+    }
+
+    // Keep the tables at most half full so that probing stays short.
+    unsigned int size = 64;
+    while (size < (entries * 2) && size < 0x10000000)
+    {
+        size <<= 1;
+    }
+
+    profile_sample_t *first = malloc(sizeof(profile_sample_t) * size);
+    profile_sample_t *second = malloc(sizeof(profile_sample_t) * size);
+    if (first == 0 || second == 0)
+    {
+        free(first);
+        free(second);
+        return -1;
+    }
+    memset(first, 0, sizeof(profile_sample_t) * size);
+    memset(second, 0, sizeof(profile_sample_t) * size);
+
+    // Make sure that we safely ask for a new timer.
+    uint32_t old_interrupts = irq_disable();
+
+    int timer = sample_timer < 0 ? _timer_available() : -1;
+    if (timer < 0 || timer >= MAX_HW_TIMERS || _timer_start(timer, MICROSECONDS_IN_ONE_SECOND / rate, _profile_sample_cb) != 0)
+    {
+        // Already running, or no hardware timers left.
+        irq_restore(old_interrupts);
+        free(first);
+        free(second);
+        return -1;
+    }
+
+    sample_histograms[0] = first;
+    sample_histograms[1] = second;
+    sample_current = first;
+    sample_mask = size - 1;
+    sample_limit = entries;
+    sample_used = 0;
+    sample_flags = flags;
+    sample_dropped = 0;
+    sample_timer = timer;
+
+    // Enable interrupts again now that we're done.
+    irq_restore(old_interrupts);
+    return 0;
+}
+
+void profile_sample_stop()
+{
+    uint32_t old_interrupts = irq_disable();
+
+    if (sample_timer >= 0 && sample_timer < MAX_HW_TIMERS)
+    {
+        _timer_stop(sample_timer);
+    }
+
+    profile_sample_t *first = sample_histograms[0];
+    profile_sample_t *second = sample_histograms[1];
+    sample_histograms[0] = 0;
+    sample_histograms[1] = 0;
+    sample_current = 0;
+    sample_timer = -1;
+
+    irq_restore(old_interrupts);
+
+    free(first);
+    free(second);
+}
+
+unsigned int profile_sample_read(profile_sample_t *samples, unsigned int max, uint32_t *dropped)
+{
+    // Swap histograms so that the interrupt handler records into the empty one from
+    // now on, leaving us with the one it was using.
+    uint32_t old_interrupts = irq_disable();
+    profile_sample_t *histogram = sample_current;
+    uint32_t lost = sample_dropped;
+    unsigned int size = sample_mask + 1;
+    if (histogram)
+    {
+        sample_current = histogram == sample_histograms[0] ? sample_histograms[1] : sample_histograms[0];
+        sample_used = 0;
+        sample_dropped = 0;
+    }
+    irq_restore(old_interrupts);
+
+    unsigned int count = 0;
+    if (histogram)
+    {
+        for (unsigned int i = 0; i < size; i++)
+        {
+            if (histogram[i].count == 0)
+            {
+                continue;
+            }
+
+            if (samples && count < max)
+            {
+                samples[count++] = histogram[i];
+            }
+            else
+            {
+                lost += histogram[i].count;
+            }
+        }
+
+        // Leave it empty for the next swap.
+        memset(histogram, 0, sizeof(profile_sample_t) * size);
+    }
+
+    if (dropped)
+    {
+        *dropped = lost;
+    }
+    return count;
+}
+
 void timer_wait(uint32_t microseconds)
 {
     uint32_t old_interrupts = irq_disable();
@@ -461,9 +743,9 @@ typedef struct
     unsigned int handle;
     uint32_t microseconds;
     uint64_t profile_start;
-} timer_t;
+} user_timer_t;
 
-static timer_t timers[MAX_TIMERS];
+static user_timer_t timers[MAX_TIMERS];
 static unsigned int timer_counter = MAX_TIMERS;
 
 void _user_timer_init()
@@ -475,12 +757,12 @@ void _user_timer_init()
     // which was freed and another allocated at the same index does not
     // match.
     timer_counter = MAX_TIMERS;
-    memset(timers, 0, sizeof(timer_t) * MAX_TIMERS);
+    memset(timers, 0, sizeof(user_timer_t) * MAX_TIMERS);
 }
 
 void _user_timer_free()
 {
-    memset(timers, 0, sizeof(timer_t) * MAX_TIMERS);
+    memset(timers, 0, sizeof(user_timer_t) * MAX_TIMERS);
 }
 
 int timer_start(uint32_t microseconds)
@@ -1,11 +1,8 @@
 #include "naomi/vector.h"
 #include "naomi/matrix.h"
-#include "naomi/interrupt.h"
 
 float vector_length(vector_t *vec)
 {
-    uint32_t old_irq = irq_disable();
-
     register vector_t *vec_param asm("r4") = vec;
     register float retval asm("fr0");
     asm volatile(" \
@@ -22,7 +19,6 @@ float vector_length(vector_t *vec)
         "fr1", "fr2", "fr3"
     );
 
-    irq_restore(old_irq);
     return retval;
 }
 
@@ -49,8 +45,6 @@ void vector_cross(vector_t *cross, vector_t *a, vector_t *b)
 
 float vector_dot(vector_t *a, vector_t *b)
 {
-    uint32_t old_irq = irq_disable();
-
     register vector_t *a_param asm("r4") = a;
     register vector_t *b_param asm("r5") = b;
     register float retval asm("fr0");
@@ -71,7 +65,6 @@ float vector_dot(vector_t *a, vector_t *b)
         "fr1", "fr2", "fr3", "fr4", "fr5", "fr6", "fr7"
     );
 
-    irq_restore(old_irq);
     return retval;
 }
 
@@ -82,3 +75,87 @@ void vector_normalize(vector_t *vec)
     vec->y *= invlength;
     vec->z *= invlength;
 }
+
+void vector_normalize_array(vector_t *vecs, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        register float x asm("fr0") = vecs[i].x;
+        register float y asm("fr1") = vecs[i].y;
+        register float z asm("fr2") = vecs[i].z;
+        register float w asm("fr3") = 0.0;
+
+        // The dot product of fv0 with itself lands in fr3, and fsrra turns that into
+        // the reciprocal of the length without a separate square root and divide.
+        asm volatile(" \
+            fipr fv0,fv0\n \
+            fsrra fr3\n \
+            " :
+            "+f" (w) :
+            "f" (x), "f" (y), "f" (z)
+        );
+
+        vecs[i].x = x * w;
+        vecs[i].y = y * w;
+        vecs[i].z = z * w;
+    }
+}
+
+void vector_dot_array(float *dots, vector_t *a, vector_t *b, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        register float ax asm("fr0") = a[i].x;
+        register float ay asm("fr1") = a[i].y;
+        register float az asm("fr2") = a[i].z;
+        register float aw asm("fr3") = 0.0;
+        register float bx asm("fr4") = b[i].x;
+        register float by asm("fr5") = b[i].y;
+        register float bz asm("fr6") = b[i].z;
+        register float bw asm("fr7") = 0.0;
+
+        asm volatile(" \
+            fipr fv4,fv0\n \
+            " :
+            "+f" (aw) :
+            "f" (ax), "f" (ay), "f" (az), "f" (bx), "f" (by), "f" (bz), "f" (bw)
+        );
+
+        dots[i] = aw;
+    }
+}
+
+void vector_face_normals(vector_t *normals, vector_t *positions, uint16_t *indices, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        vector_t *p0 = &positions[indices[0]];
+        vector_t *p1 = &positions[indices[1]];
+        vector_t *p2 = &positions[indices[2]];
+        indices += 3;
+
+        float e1x = p1->x - p0->x;
+        float e1y = p1->y - p0->y;
+        float e1z = p1->z - p0->z;
+        float e2x = p2->x - p0->x;
+        float e2y = p2->y - p0->y;
+        float e2z = p2->z - p0->z;
+
+        register float x asm("fr0") = (e1y * e2z) - (e1z * e2y);
+        register float y asm("fr1") = (e1z * e2x) - (e1x * e2z);
+        register float z asm("fr2") = (e1x * e2y) - (e1y * e2x);
+        register float w asm("fr3") = 0.0;
+
+        asm volatile(" \
+            fipr fv0,fv0\n \
+            fsrra fr3\n \
+            " :
+            "+f" (w) :
+            "f" (x), "f" (y), "f" (z)
+        );
+
+        normals[i].x = x * w;
+        normals[i].y = y * w;
+        normals[i].z = z * w;
+    }
+}
@@ -1,11 +1,8 @@
-#ifdef FEATURE_FREETYPE
-// Only build this stuff if freetype is installed. Otherwise just don't do anything with it.
-// This is so that stage 1 libnaomi.a can be built, and then freetype built against it, before
-// libnaomi is built again.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
 #include "naomi/video.h"
 #include "naomi/font.h"
 #include "video-internal.h"
@@ -15,11 +12,6 @@
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 #endif
 
-void __video_font_cache_discard()
-{
-    // We don't need to do anything here at the moment.
-}
-
 font_cache_entry_t *__video_cache_create(uint32_t index, int advancex, int advancey, int bitmap_left, int bitmap_top, int width, int height, int mode, uint8_t *buffer)
 {
     font_cache_entry_t *entry = malloc(sizeof(font_cache_entry_t));
@@ -36,13 +28,15 @@ font_cache_entry_t *__video_cache_create(uint32_t index, int advancex, int advan
     entry->mode = mode;
     entry->width = width;
     entry->height = height;
+    entry->discard = 0;
+    entry->busy = 0;
     entry->data = malloc(width * height);
     if (entry->data == 0)
     {
         free(entry);
         return 0;
     }
-    if (mode == FT_PIXEL_MODE_GRAY)
+    if (mode == FONT_PIXEL_MODE_GRAY)
     {
         memcpy(entry->data, buffer, width * height);
     }
@@ -61,6 +55,9 @@ extern unsigned int global_video_vertical;
 extern unsigned int global_video_width;
 extern void * buffer_base;
 
+// Prototype from video.c so we don't draw while a deferred background clear is running.
+void _video_wait_background();
+
 // Alpha-blend the grayscale image with the destination. We only support 32 alpha levels here for speed.
 // Technically the destination r/g/b values should be divided by 255, but shifting right by 8 (divide by
 // 256) should be much much faster for an 0.4% accuracy loss.
@@ -90,6 +87,8 @@ extern void * buffer_base;
 
 void __video_draw_cached_bitmap(int x, int y, unsigned int width, unsigned int height, void *data, color_t color)
 {
+    _video_wait_background();
+
     uint8_t *buffer = data;
     int low_x = 0;
     int high_x = width;
@@ -241,4 +240,3 @@ int video_draw_text(int x, int y, font_t *fontface, color_t color, const char *
         return 0;
     }
 }
-#endif
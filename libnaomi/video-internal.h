@@ -107,6 +107,7 @@ void _ta_init_buffers();
 #define POWERVR2_SCALER (0x0F4 >> 2)
 #define POWERVR2_PALETTE_MODE (0x108 >> 2)
 #define POWERVR2_SYNC_STAT (0x10C >> 2)
+#define POWERVR2_PT_ALPHA_REF (0x11C >> 2)
 #define POWERVR2_OBJBUF_BASE (0x124 >> 2)
 #define POWERVR2_CMDLIST_BASE (0x128 >> 2)
 #define POWERVR2_OBJBUF_LIMIT (0x12C >> 2)
@@ -31,7 +31,23 @@ static uint32_t global_background_fill_start = 0;
 static uint32_t global_background_fill_end = 0;
 static uint32_t global_background_fill_color[8] = { 0 };
 static unsigned int global_background_set = 0;
+static unsigned int global_background_mode = VIDEO_BACKGROUND_SOFTWARE;
 static unsigned int global_video_15khz = 0;
+static unsigned int global_ta_initialized = 0;
+
+// The source pattern for DMA background clears. The DMAC cannot repeat a fixed
+// 32-byte source, so we keep a chunk of RAM filled with the background color and
+// stream it out repeatedly, chaining chunks from the DMA finished interrupt.
+#define BACKGROUND_DMA_CHUNK_SIZE (32 * 1024)
+static void *global_background_dma_alloc = 0;
+static uint32_t *global_background_dma_pattern = 0;
+static volatile uint32_t global_background_dma_next = 0;
+static volatile uint32_t global_background_dma_end = 0;
+
+// SH-4 DMAC channel 2, which feeds the PVR channel 2 DMA port in HOLLY.
+#define DMAC_SAR2 *((volatile uint32_t *)0xFFA00020)
+#define DMAC_DMATCR2 *((volatile uint32_t *)0xFFA00028)
+#define DMAC_CHCR2 *((volatile uint32_t *)0xFFA0002C)
 
 // We only use two of these for rendering. The third is so we can
 // give a pointer out to scratch VRAM for other code to use.
@@ -64,6 +80,106 @@ unsigned int buffer_loc = 0;
 // Defines in thread.c which help us to handle vblank interrupts.
 void _thread_wait_vblank_swapbuffers();
 
+// Defines in thread.c which let us sleep until a deferred background clear finishes.
+void _thread_notify_wait_background_dma();
+void _thread_wait_background_dma();
+
+// Defines in ta.c which help us to paint the background using the TA background plane.
+int _ta_consume_rendered();
+int _ta_render_background();
+
+void _video_background_dma_kick()
+{
+    uint32_t length = min(BACKGROUND_DMA_CHUNK_SIZE, global_background_dma_end - global_background_dma_next);
+
+    // Set up the SH-4 side of the transfer, streaming our pattern chunk out to the
+    // PVR DMA port in 32-byte bursts.
+    DMAC_CHCR2 = 0;
+    DMAC_SAR2 = ((uint32_t)global_background_dma_pattern) & 0x1FFFFFFF;
+    DMAC_DMATCR2 = length / 32;
+    DMAC_CHCR2 = 0x12C1;
+
+    // Now, set up the HOLLY side, targeting the 32-bit VRAM path that the framebuffer lives in.
+    HOLLY_CH2_DMA_LMMODE0 = 1;
+    HOLLY_CH2_DMA_DEST = (global_background_dma_next & 0xFFFFFF) | 0x11000000;
+    HOLLY_CH2_DMA_LEN = length;
+    HOLLY_CH2_DMA_START = 1;
+
+    global_background_dma_next += length;
+}
+
+int _video_background_dma_finished()
+{
+    // Called from the HOLLY interrupt handler when a chunk finishes. Either chain
+    // the next chunk or mark the clear as done so drawing can continue, returning
+    // nonzero in the latter case so that waiting threads get woken up.
+    if (global_background_dma_next < global_background_dma_end)
+    {
+        _video_background_dma_kick();
+        return 0;
+    }
+    else
+    {
+        global_background_dma_next = 0;
+        global_background_dma_end = 0;
+        return 1;
+    }
+}
+
+void _video_background_dma_refresh()
+{
+    // Refresh the DMA source pattern and make sure it is written back out of the
+    // cache so the DMAC sees the current background color.
+    for (int offset = 0; offset < (BACKGROUND_DMA_CHUNK_SIZE / 4); offset++)
+    {
+        global_background_dma_pattern[offset] = global_background_fill_color[offset & 7];
+    }
+    icache_flush_range(global_background_dma_pattern, BACKGROUND_DMA_CHUNK_SIZE);
+}
+
+void _video_wait_background()
+{
+    // Any code that touches the framebuffer must wait for a deferred background clear
+    // to finish, otherwise the DMA will stomp on whatever was drawn. This is called at
+    // the start of every drawing call, but only the first one after a flip that kicked
+    // off a clear gets past this check.
+    if (global_background_dma_end == 0)
+    {
+        return;
+    }
+
+    if (_irq_is_disabled(_irq_get_sr()))
+    {
+        // Nobody is going to service the interrupt for us, so chain the chunks ourselves.
+        while (global_background_dma_end != 0)
+        {
+            if (HOLLY_INTERNAL_IRQ_STATUS & HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED)
+            {
+                HOLLY_INTERNAL_IRQ_STATUS = HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED;
+                _video_background_dma_finished();
+            }
+        }
+    }
+    else
+    {
+        // Arm our wakeup with interrupts disabled, so that the clear can't finish in between
+        // checking on it and going to sleep. If it finishes after this, the wait below
+        // returns immediately.
+        uint32_t old_interrupts = irq_disable();
+        int pending = global_background_dma_end != 0;
+        if (pending)
+        {
+            _thread_notify_wait_background_dma();
+        }
+        irq_restore(old_interrupts);
+
+        if (pending)
+        {
+            _thread_wait_background_dma();
+        }
+    }
+}
+
 void _video_swap_vbuffers()
 {
     volatile unsigned int *videobase = (volatile unsigned int *)POWERVR2_BASE;
@@ -77,13 +193,61 @@ void _video_swap_vbuffers()
     buffer_base = (void *)((VRAM_BASE + global_buffer_offset[current_buffer_loc]) | UNCACHED_MIRROR);
 }
 
+uint32_t _video_vblank_latency(int out)
+{
+    volatile unsigned int *videobase = (volatile unsigned int *)POWERVR2_BASE;
+
+    // Work out how many lines the beam has moved past the line the interrupt fires on.
+    uint32_t position = (videobase[POWERVR2_VBLANK_INTERRUPT] >> (out ? 16 : 0)) & 0x3FF;
+    uint32_t current = videobase[POWERVR2_SYNC_STAT] & 0x3FF;
+    uint32_t load = videobase[POWERVR2_SYNC_LOAD];
+    uint32_t lines = ((load >> 16) & 0x3FF) + 1;
+    uint32_t clocks = (load & 0x3FF) + 1;
+    if (global_video_15khz)
+    {
+        // Interlaced, so we count lines per field, and the pixel clock is halved.
+        lines /= 2;
+        clocks *= 2;
+    }
+
+    uint32_t late = current >= position ? current - position : (current + lines) - position;
+
+    // Each line takes the horizontal count of 27MHz pixel clocks.
+    return (late * clocks) / 27;
+}
+
+void _video_background_dma_free()
+{
+    uint32_t old_interrupts = irq_disable();
+    if ((HOLLY_INTERNAL_IRQ_2_MASK & HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED) != 0)
+    {
+        HOLLY_INTERNAL_IRQ_2_MASK = HOLLY_INTERNAL_IRQ_2_MASK & (~HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED);
+    }
+    irq_restore(old_interrupts);
+
+    if (global_background_dma_alloc != 0)
+    {
+        free(global_background_dma_alloc);
+        global_background_dma_alloc = 0;
+        global_background_dma_pattern = 0;
+    }
+    global_background_mode = VIDEO_BACKGROUND_SOFTWARE;
+}
+
 void video_display_on_vblank()
 {
     volatile unsigned int *videobase = (volatile unsigned int *)POWERVR2_BASE;
 
+    // Make sure a previous deferred clear isn't still writing to the buffer we're about to show.
+    _video_wait_background();
+
     // Draw any registered console to the screen.
     console_render();
 
+    // Figure out whether the TA painted the frame we're about to display. If so,
+    // the next ta_render() will paint the background plane for us as well.
+    int ta_rendered = global_ta_initialized ? _ta_consume_rendered() : 0;
+
     // Handle filling the background of the other screen while we wait.
     if (global_background_set)
     {
@@ -114,6 +278,33 @@ void video_display_on_vblank()
         _thread_wait_vblank_swapbuffers();
     }
 
+    if (global_background_fill_start < global_background_fill_end)
+    {
+        if (global_background_mode == VIDEO_BACKGROUND_TA && global_ta_initialized)
+        {
+            // Let the TA background plane clear the buffer instead of the CPU. If the
+            // TA is being used every frame we don't need to do anything at all, since
+            // the next ta_render() covers the whole screen. Otherwise, render just the
+            // background plane so that software drawing starts on a clean slate.
+            if (ta_rendered || _ta_render_background())
+            {
+                global_background_fill_start = 0;
+                global_background_fill_end = 0;
+            }
+        }
+        else if (global_background_mode == VIDEO_BACKGROUND_DMA && global_background_dma_pattern != 0 && !_irq_is_disabled(_irq_get_sr()))
+        {
+            // Kick off the clear in the background and return immediately. Anything
+            // that touches the framebuffer will wait for this to finish first.
+            global_background_dma_next = global_background_fill_start & VRAM_MASK;
+            global_background_dma_end = global_background_fill_end & VRAM_MASK;
+            _video_background_dma_kick();
+
+            global_background_fill_start = 0;
+            global_background_fill_end = 0;
+        }
+    }
+
     // Finish filling in the background. Gotta do this now, fast or slow, because
     // when we exit this function the user is fully expected to start drawing new
     // graphics.
@@ -153,6 +344,8 @@ unsigned int video_depth()
 
 void *video_framebuffer()
 {
+    _video_wait_background();
+
     return buffer_base;
 }
 
@@ -294,6 +487,7 @@ void _video_init(int colordepth, int init_ta)
     {
         _ta_init();
     }
+    global_ta_initialized = init_ta ? 1 : 0;
 
     // Now, zero out the screen so there's no garbage if we never display.
     void *zero_base = (void *)((VRAM_BASE + global_buffer_offset[0]) | UNCACHED_MIRROR);
@@ -469,6 +663,10 @@ void video_init(int colordepth)
 
 void video_free()
 {
+    // Let any deferred clear finish and give back its resources before we tear down.
+    _video_wait_background();
+    _video_background_dma_free();
+
     uint32_t old_interrupts = irq_disable();
     volatile unsigned int *videobase = (volatile unsigned int *)POWERVR2_BASE;
 
@@ -484,6 +682,7 @@ void video_free()
 
     // Kill the tile accelerator.
     _ta_free();
+    global_ta_initialized = 0;
 
     // De-init our globals.
     global_video_width = 0;
@@ -501,6 +700,8 @@ void video_free()
 
 void video_fill_screen(color_t color)
 {
+    _video_wait_background();
+
     if(global_video_depth == 2)
     {
         uint32_t actualcolor = RGB0555(color.r, color.g, color.b);
@@ -542,10 +743,59 @@ void video_set_background_color(color_t color)
             global_background_fill_color[offset] = actualcolor;
         }
     }
+
+    if (global_ta_initialized)
+    {
+        // Keep the TA background plane in sync so hybrid rendering paints the same color.
+        ta_set_background_color(color);
+    }
+
+    if (global_background_dma_pattern != 0)
+    {
+        _video_background_dma_refresh();
+    }
+}
+
+void video_set_background_mode(int mode)
+{
+    // Don't change anything out from under an in-progress clear.
+    _video_wait_background();
+
+    if (mode == VIDEO_BACKGROUND_DMA)
+    {
+        if (global_background_dma_pattern == 0)
+        {
+            global_background_dma_alloc = malloc(BACKGROUND_DMA_CHUNK_SIZE + 32);
+            if (global_background_dma_alloc == 0)
+            {
+                // Can't get memory for the pattern, so stick with software clears.
+                global_background_mode = VIDEO_BACKGROUND_SOFTWARE;
+                return;
+            }
+
+            global_background_dma_pattern = (uint32_t *)((((uint32_t)global_background_dma_alloc) + 31) & 0xFFFFFFE0);
+            _video_background_dma_refresh();
+        }
+
+        uint32_t old_interrupts = irq_disable();
+        if ((HOLLY_INTERNAL_IRQ_2_MASK & HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED) == 0)
+        {
+            HOLLY_INTERNAL_IRQ_2_MASK = HOLLY_INTERNAL_IRQ_2_MASK | HOLLY_INTERNAL_INTERRUPT_CH2_DMA_FINISHED;
+        }
+        irq_restore(old_interrupts);
+    }
+    else if (mode != VIDEO_BACKGROUND_SOFTWARE && mode != VIDEO_BACKGROUND_TA)
+    {
+        return;
+    }
+
+    global_background_mode = mode;
 }
 
 void video_fill_box(int x0, int y0, int x1, int y1, color_t color)
 {
+    _video_wait_background();
+
     int low_x;
     int high_x;
     int low_y;
@@ -643,7 +893,7 @@ void video_fill_box(int x0, int y0, int x1, int y1, color_t color)
     }
 }
 
-void video_draw_pixel(int x, int y, color_t color)
+void _video_draw_pixel(int x, int y, color_t color)
 {
     // Let's do some basic bounds testing.
     if (((uint32_t)(x | y)) & 0x80000000) { return; }
@@ -675,8 +925,16 @@ void video_draw_pixel(int x, int y, color_t color)
     }
 }
 
+void video_draw_pixel(int x, int y, color_t color)
+{
+    _video_wait_background();
+    _video_draw_pixel(x, y, color);
+}
+
 color_t video_get_pixel(int x, int y)
 {
+    _video_wait_background();
+
     uint32_t color;
     color_t retval;
 
@@ -721,6 +979,9 @@ color_t video_get_pixel(int x, int y)
 
 void video_draw_line(int x0, int y0, int x1, int y1, color_t color)
 {
+    // Only check for a background clear once per line rather than once per pixel.
+    _video_wait_background();
+
     int dy = y1 - y0;
     int dx = x1 - x0;
     int sx, sy;
@@ -747,14 +1008,14 @@ void video_draw_line(int x0, int y0, int x1, int y1, color_t color)
 
     if (dx == 0 && dy == 0)
     {
-        video_draw_pixel(x0, y0, color);
+        _video_draw_pixel(x0, y0, color);
         return;
     }
 
     dy <<= 1;
     dx <<= 1;
 
-    video_draw_pixel(x0, y0, color);
+    _video_draw_pixel(x0, y0, color);
     if(dx > dy)
     {
         int frac = dy - (dx >> 1);
@@ -767,7 +1028,7 @@ void video_draw_line(int x0, int y0, int x1, int y1, color_t color)
             }
             x0 += sx;
             frac += dy;
-            video_draw_pixel(x0, y0, color);
+            _video_draw_pixel(x0, y0, color);
         }
     }
     else
@@ -782,7 +1043,7 @@ void video_draw_line(int x0, int y0, int x1, int y1, color_t color)
             }
             y0 += sy;
             frac += dx;
-            video_draw_pixel(x0, y0, color);
+            _video_draw_pixel(x0, y0, color);
         }
     }
 }
@@ -823,6 +1084,8 @@ void video_draw_box(int x0, int y0, int x1, int y1, color_t color)
 
 void video_draw_debug_character(int x, int y, color_t color, char ch)
 {
+    _video_wait_background();
+
     if (ch < 0x20 || ch > 0x7F)
     {
         return;
@@ -836,66 +1099,66 @@ void video_draw_debug_character(int x, int y, color_t color, char ch)
         switch( c & 0xF0 )
         {
             case 0x10:
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
             case 0x20:
-                video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x + 2, row, color );
                 break;
             case 0x30:
-                video_draw_pixel( x + 2, row, color );
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
             case 0x40:
-                video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x + 1, row, color );
                 break;
             case 0x50:
-                video_draw_pixel( x + 1, row, color );
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
             case 0x60:
-                video_draw_pixel( x + 1, row, color );
-                video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x + 2, row, color );
                 break;
             case 0x70:
-                video_draw_pixel( x + 1, row, color );
-                video_draw_pixel( x + 2, row, color );
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
             case 0x80:
-                video_draw_pixel( x, row, color );
+                _video_draw_pixel( x, row, color );
                 break;
             case 0x90:
-                video_draw_pixel( x, row, color );
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
             case 0xA0:
-                video_draw_pixel( x, row, color );
-                video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x, row, color );
+                _video_draw_pixel( x + 2, row, color );
                 break;
             case 0xB0:
-                video_draw_pixel( x, row, color );
-                video_draw_pixel( x + 2, row, color );
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x, row, color );
+                _video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
             case 0xC0:
-                video_draw_pixel( x, row, color );
-                video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x, row, color );
+                _video_draw_pixel( x + 1, row, color );
                 break;
             case 0xD0:
-                video_draw_pixel( x, row, color );
-                video_draw_pixel( x + 1, row, color );
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x, row, color );
+                _video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
             case 0xE0:
-                video_draw_pixel( x, row, color );
-                video_draw_pixel( x + 1, row, color );
-                video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x, row, color );
+                _video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x + 2, row, color );
                 break;
             case 0xF0:
-                video_draw_pixel( x, row, color );
-                video_draw_pixel( x + 1, row, color );
-                video_draw_pixel( x + 2, row, color );
-                video_draw_pixel( x + 3, row, color );
+                _video_draw_pixel( x, row, color );
+                _video_draw_pixel( x + 1, row, color );
+                _video_draw_pixel( x + 2, row, color );
+                _video_draw_pixel( x + 3, row, color );
                 break;
         }
 
@@ -903,66 +1166,66 @@ void video_draw_debug_character(int x, int y, color_t color, char ch)
         switch( c & 0x0F )
         {
             case 0x01:
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
             case 0x02:
-                video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 6, row, color );
                 break;
             case 0x03:
-                video_draw_pixel( x + 6, row, color );
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
             case 0x04:
-                video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 5, row, color );
                 break;
             case 0x05:
-                video_draw_pixel( x + 5, row, color );
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
             case 0x06:
-                video_draw_pixel( x + 5, row, color );
-                video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 6, row, color );
                 break;
             case 0x07:
-                video_draw_pixel( x + 5, row, color );
-                video_draw_pixel( x + 6, row, color );
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
             case 0x08:
-                video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 4, row, color );
                 break;
             case 0x09:
-                video_draw_pixel( x + 4, row, color );
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
             case 0x0A:
-                video_draw_pixel( x + 4, row, color );
-                video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 6, row, color );
                 break;
             case 0x0B:
-                video_draw_pixel( x + 4, row, color );
-                video_draw_pixel( x + 6, row, color );
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
             case 0x0C:
-                video_draw_pixel( x + 4, row, color );
-                video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 5, row, color );
                 break;
             case 0x0D:
-                video_draw_pixel( x + 4, row, color );
-                video_draw_pixel( x + 5, row, color );
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
             case 0x0E:
-                video_draw_pixel( x + 4, row, color );
-                video_draw_pixel( x + 5, row, color );
-                video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 6, row, color );
                 break;
             case 0x0F:
-                video_draw_pixel( x + 4, row, color );
-                video_draw_pixel( x + 5, row, color );
-                video_draw_pixel( x + 6, row, color );
-                video_draw_pixel( x + 7, row, color );
+                _video_draw_pixel( x + 4, row, color );
+                _video_draw_pixel( x + 5, row, color );
+                _video_draw_pixel( x + 6, row, color );
+                _video_draw_pixel( x + 7, row, color );
                 break;
         }
     }
@@ -1010,6 +1273,8 @@ void video_draw_debug_character(int x, int y, color_t color, char ch)
 
 void video_draw_sprite(int x, int y, int width, int height, void *data)
 {
+    _video_wait_background();
+
     int low_x = 0;
     int high_x = width;
     int low_y = 0;
@@ -20,7 +20,7 @@ def main() -> int:
 
     testsuite_files = [f for f in args.file if f == 'testsuite.c']
     output_files = [f for f in args.file if f.startswith("build/") and f.endswith(".c")]
-    input_files = [f for f in args.file if f.startswith("test_") and f.endswith(".c")]
+    input_files = [f for f in args.file if os.path.basename(f).startswith("test_") and f.endswith(".c")]
 
     if len(output_files) != 1:
         print("Could not determine output file from arguments!", file=sys.stderr)
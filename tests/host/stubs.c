@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "naomi/system.h"
+#include "naomi/interrupt.h"
+#include "naomi/thread.h"
+#include "naomi/maple.h"
+#include "naomi/cart.h"
+#include "naomi/dimmcomms.h"
+#include "naomi/posix.h"
+#include "stubs.h"
+
+// Where the library's texture RAM starts on the target once the framebuffers have been
+// carved out of VRAM, as seen through the uncached mirror.
+#define HOST_TEXTURE_RAM (UNCACHED_MIRROR | TEXRAM_BASE | 0x200000)
+#define HOST_TEXTURE_RAM_SIZE 0x800000
+
+static uint8_t *cart_image = 0;
+static unsigned int cart_size = 0;
+static peek_call_t dimm_peek = 0;
+static poke_call_t dimm_poke = 0;
+static void *texture_ram = 0;
+
+uint8_t host_eeprom[128];
+
+typedef struct
+{
+    char prefix[MAX_PREFIX_LEN + 1];
+    filesystem_t *filesystem;
+    void *fshandle;
+} host_filesystem_t;
+
+static host_filesystem_t filesystems[MAX_FILESYSTEMS];
+
+void _ta_init_twiddletab();
+void _ta_init_texture_allocator(void *base, unsigned int size);
+
+void host_init()
+{
+    // Map some memory where the allocator would hand out texture RAM on the target,
+    // since the allocator and loaders treat texture pointers as 32-bit addresses.
+    texture_ram = mmap(
+        (void *)HOST_TEXTURE_RAM,
+        HOST_TEXTURE_RAM_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE,
+        -1,
+        0
+    );
+    if (texture_ram != (void *)HOST_TEXTURE_RAM)
+    {
+        fprintf(stderr, "Could not map texture RAM at %08x!\n", HOST_TEXTURE_RAM);
+        exit(1);
+    }
+
+    _ta_init_twiddletab();
+    _ta_init_texture_allocator(texture_ram, HOST_TEXTURE_RAM_SIZE);
+
+    // A blank EEPROM, the same as a freshly erased chip.
+    memset(host_eeprom, 0xFF, sizeof(host_eeprom));
+    memset(filesystems, 0, sizeof(filesystems));
+}
+
+void *host_texture_ram()
+{
+    return texture_ram;
+}
+
+unsigned int host_texture_ram_size()
+{
+    return HOST_TEXTURE_RAM_SIZE;
+}
+
+int host_cart_load(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (fp == 0)
+    {
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t *image = malloc(size);
+    if (image == 0 || fread(image, 1, size, fp) != (size_t)size)
+    {
+        free(image);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    free(cart_image);
+    cart_image = image;
+    cart_size = size;
+    return 0;
+}
+
+filesystem_t *host_filesystem(const char *prefix, void **fshandle)
+{
+    for (int i = 0; i < MAX_FILESYSTEMS; i++)
+    {
+        if (filesystems[i].filesystem != 0 && strcmp(filesystems[i].prefix, prefix) == 0)
+        {
+            *fshandle = filesystems[i].fshandle;
+            return filesystems[i].filesystem;
+        }
+    }
+
+    *fshandle = 0;
+    return 0;
+}
+
+uint32_t host_dimm_peek(unsigned int address)
+{
+    return dimm_peek ? dimm_peek(address, 4) : 0xFFFFFFFF;
+}
+
+void host_dimm_poke(unsigned int address, uint32_t data)
+{
+    if (dimm_poke)
+    {
+        dimm_poke(address, 4, data);
+    }
+}
+
+// Interrupts don't exist on the host, so there is nothing to disable.
+uint32_t irq_disable()
+{
+    return 0;
+}
+
+void irq_restore(uint32_t oldstate)
+{
+    // Empty on purpose.
+}
+
+void _irq_display_invariant(char *msg, char *failure, ...)
+{
+    va_list args;
+    va_start(args, failure);
+    fprintf(stderr, "Invariant failure: %s\n", msg);
+    vfprintf(stderr, failure, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    abort();
+}
+
+// The suite is single threaded, so mutexes never need to wait.
+void mutex_init(mutex_t *mutex)
+{
+    mutex->id = 1;
+}
+
+int mutex_try_lock(mutex_t *mutex)
+{
+    return 1;
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+    // Empty on purpose.
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+    // Empty on purpose.
+}
+
+void mutex_free(mutex_t *mutex)
+{
+    mutex->id = 0;
+}
+
+int maple_request_eeprom_read(uint8_t *outbytes)
+{
+    memcpy(outbytes, host_eeprom, sizeof(host_eeprom));
+    return 0;
+}
+
+int maple_request_eeprom_write(uint8_t *inbytes)
+{
+    memcpy(host_eeprom, inbytes, sizeof(host_eeprom));
+    return 0;
+}
+
+void cart_read(void *dst, uint32_t src, unsigned int len)
+{
+    // Reads past the end of the cartridge come back as open bus.
+    memset(dst, 0xFF, len);
+    if (src < cart_size)
+    {
+        memcpy(dst, cart_image + src, (cart_size - src) < len ? (cart_size - src) : len);
+    }
+}
+
+void cart_read_serial(uint8_t *serial)
+{
+    memcpy(serial, "BHST", 4);
+}
+
+void cart_read_executable_info(executable_t *exe)
+{
+    // There is no executable on the host, so nothing to find a ROM FS after.
+    memset(exe, 0, sizeof(executable_t));
+}
+
+int attach_filesystem(const char * const prefix, filesystem_t *filesystem, void *fshandle)
+{
+    for (int i = 0; i < MAX_FILESYSTEMS; i++)
+    {
+        if (filesystems[i].filesystem != 0 && strcmp(filesystems[i].prefix, prefix) == 0)
+        {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < MAX_FILESYSTEMS; i++)
+    {
+        if (filesystems[i].filesystem == 0)
+        {
+            strncpy(filesystems[i].prefix, prefix, MAX_PREFIX_LEN);
+            filesystems[i].prefix[MAX_PREFIX_LEN] = 0;
+            filesystems[i].filesystem = filesystem;
+            filesystems[i].fshandle = fshandle;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int detach_filesystem(const char * const prefix)
+{
+    for (int i = 0; i < MAX_FILESYSTEMS; i++)
+    {
+        if (filesystems[i].filesystem != 0 && strcmp(filesystems[i].prefix, prefix) == 0)
+        {
+            memset(&filesystems[i], 0, sizeof(host_filesystem_t));
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+void * hook_stdio_calls( stdio_t *stdio_calls )
+{
+    // Leave host stdio alone.
+    return 0;
+}
+
+int unhook_stdio_calls( void *prevhook )
+{
+    return 0;
+}
+
+void dimm_comms_attach_hooks(peek_call_t peek_hook, poke_call_t poke_hook)
+{
+    dimm_peek = peek_hook;
+    dimm_poke = poke_hook;
+}
+
+void dimm_comms_detach_hooks()
+{
+    dimm_peek = 0;
+    dimm_poke = 0;
+}
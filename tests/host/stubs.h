@@ -0,0 +1,36 @@
+#ifndef __STUBS_H
+#define __STUBS_H
+
+#include <stdint.h>
+#include "naomi/posix.h"
+
+// Stand-ins for the hardware that the portable libnaomi modules talk to, so that
+// they can be built and run on the host. These are only what the modules under
+// test need, and are not a general purpose emulation of the system.
+
+// Set up everything below. Called once before the test suite runs.
+void host_init();
+
+// The ROM image that cart_read() and friends see. Loads a file from disk as the
+// entire cartridge, returning 0 on success or a negative number on failure.
+int host_cart_load(const char *filename);
+
+// The 128 byte EEPROM that maple_request_eeprom_read() and maple_request_eeprom_write()
+// operate on.
+extern uint8_t host_eeprom[128];
+
+// Grab the filesystem hooks and handle that were attached under a given prefix, or
+// a null pointer if nothing is attached there.
+filesystem_t *host_filesystem(const char *prefix, void **fshandle);
+
+// Act as the net dimm, peeking or poking the registers that a library module has
+// hooked with dimm_comms_attach_hooks().
+uint32_t host_dimm_peek(unsigned int address);
+void host_dimm_poke(unsigned int address, uint32_t data);
+
+// Texture RAM is mapped at the same uncached address that it lives at on the target,
+// so that the texture allocator and twiddled loads can run unmodified.
+void *host_texture_ram();
+unsigned int host_texture_ram_size();
+
+#endif
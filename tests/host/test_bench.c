@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "naomi/eeprom.h"
+#include "naomi/utf8.h"
+
+void test_bench_eeprom(test_context_t *context)
+{
+    eeprom_t eeprom;
+    memset(&eeprom, 0, sizeof(eeprom));
+    memcpy(eeprom.system.serial, "BHST", 4);
+    eeprom.system.players = 2;
+    eeprom.game.size = 42;
+
+    uint8_t data[128];
+    unparse_eeprom(data, &eeprom);
+
+    unsigned int iterations = 1000000;
+    volatile uint16_t crc = 0;
+    uint64_t start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        crc += eeprom_crc(data, 128);
+    }
+    BENCH_REPORT("eeprom_crc 128 bytes", iterations, bench_time() - start);
+
+    iterations = 200000;
+    start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        parse_eeprom(data, &eeprom);
+    }
+    BENCH_REPORT("parse_eeprom", iterations, bench_time() - start);
+
+    start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        unparse_eeprom(data, &eeprom);
+    }
+    BENCH_REPORT("unparse_eeprom", iterations, bench_time() - start);
+}
+
+void test_bench_utf8(test_context_t *context)
+{
+    const char *text = "The quick brown fox jumps over the lazy dog. こんにちは、世界! Καλημέρα κόσμε.";
+
+    unsigned int iterations = 500000;
+    volatile unsigned int length = 0;
+    uint64_t start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        length += utf8_strlen(text);
+    }
+    BENCH_REPORT("utf8_strlen", iterations, bench_time() - start);
+
+    start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        free(utf8_convert(text));
+    }
+    BENCH_REPORT("utf8_convert", iterations, bench_time() - start);
+}
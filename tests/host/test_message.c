@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "naomi/message/message.h"
+#include "naomi/message/packet.h"
+
+// The registers and checksum seeds that the host side of the protocol uses.
+#define HOST_DATA_REGISTER 0xC0DE10
+#define HOST_SEND_STATUS_REGISTER 0xC0DE20
+#define HOST_RECV_STATUS_REGISTER 0xC0DE30
+#define HOST_SEND_STATUS_SEED 3
+#define HOST_RECV_STATUS_SEED 7
+
+uint32_t checksum_add(uint32_t value, uint8_t seed);
+
+// Pull one pending packet from the Naomi side, the same way the host tools do over
+// the net dimm. Returns the length of the packet, or 0 if there was nothing to read.
+unsigned int host_read_packet(uint8_t *data)
+{
+    uint32_t status = host_dimm_peek(HOST_SEND_STATUS_REGISTER);
+    unsigned int size = (status >> 12) & 0xFFF;
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    for (unsigned int loc = 0; loc < size; loc += 3)
+    {
+        uint32_t word = host_dimm_peek(HOST_DATA_REGISTER);
+        for (unsigned int i = 0; i < 3 && (loc + i) < size; i++)
+        {
+            data[loc + i] = (word >> (16 - (i * 8))) & 0xFF;
+        }
+    }
+
+    // Acknowledge the packet by moving the location to the end.
+    host_dimm_poke(HOST_SEND_STATUS_REGISTER, checksum_add(size & 0xFFF, HOST_SEND_STATUS_SEED));
+    return size;
+}
+
+// Push one packet to the Naomi side, the same way the host tools do over the net dimm.
+void host_write_packet(uint8_t *data, unsigned int size)
+{
+    host_dimm_poke(HOST_RECV_STATUS_REGISTER, checksum_add((size << 12) & 0xFFF000, HOST_RECV_STATUS_SEED));
+
+    for (unsigned int loc = 0; loc < size; loc += 3)
+    {
+        uint32_t word = (((loc / 3) + 1) << 24) & 0xFF000000;
+        for (unsigned int i = 0; i < 3 && (loc + i) < size; i++)
+        {
+            word |= data[loc + i] << (16 - (i * 8));
+        }
+        host_dimm_poke(HOST_DATA_REGISTER, word);
+    }
+}
+
+void test_message_roundtrip(test_context_t *context)
+{
+    message_init();
+
+    uint8_t *original = malloc(2000);
+    for (int i = 0; i < 2000; i++)
+    {
+        original[i] = (i * 13) & 0xFF;
+    }
+    ASSERT(message_send(0x1234, original, 2000) == 0, "Failed to send message!");
+
+    // This should have been split up into multiple packets.
+    uint8_t packets[8][MAX_PACKET_LENGTH];
+    unsigned int lengths[8];
+    int count = 0;
+    while (count < 8 && (lengths[count] = host_read_packet(packets[count])) > 0)
+    {
+        count++;
+    }
+    ASSERT(count == 3, "Expected message to be split into 3 packets but got %d!", count);
+
+    packetlib_stats_t stats = packetlib_stats();
+    ASSERT(stats.packets_sent == 3, "Expected 3 packets sent but got %d!", stats.packets_sent);
+    ASSERT(stats.packets_pending_send == 0, "Expected no packets left to send!");
+
+    // Loop them back out of order, and make sure we get the original message.
+    for (int i = count - 1; i >= 0; i--)
+    {
+        host_write_packet(packets[i], lengths[i]);
+    }
+
+    uint16_t type = 0;
+    void *data = 0;
+    unsigned int length = 0;
+    ASSERT(message_recv(&type, &data, &length) == 0, "Failed to receive message!");
+    ASSERT(type == 0x1234, "Received message has wrong type %04x!", type);
+    ASSERT(length == 2000, "Received message has wrong length %d!", length);
+    ASSERT(memcmp(data, original, 2000) == 0, "Received message has wrong contents!");
+    free(data);
+
+    ASSERT(message_recv(&type, &data, &length) != 0, "Received a message that was never sent!");
+    free(original);
+    message_free();
+}
+
+void test_message_interleaved(test_context_t *context)
+{
+    message_init();
+
+    uint8_t first[1000];
+    uint8_t second[1600];
+    memset(first, 0xAA, sizeof(first));
+    memset(second, 0x55, sizeof(second));
+    ASSERT(message_send(0x0001, first, sizeof(first)) == 0, "Failed to send message!");
+    ASSERT(message_send(0x0002, second, sizeof(second)) == 0, "Failed to send message!");
+    ASSERT(message_send(0x0003, 0, 0) == 0, "Failed to send message!");
+
+    uint8_t packets[8][MAX_PACKET_LENGTH];
+    unsigned int lengths[8];
+    int count = 0;
+    while (count < 8 && (lengths[count] = host_read_packet(packets[count])) > 0)
+    {
+        count++;
+    }
+    ASSERT(count == 6, "Expected 6 packets but got %d!", count);
+
+    // Hold back the last part of the first message, so the others complete first.
+    host_write_packet(packets[0], lengths[0]);
+    host_write_packet(packets[3], lengths[3]);
+    host_write_packet(packets[2], lengths[2]);
+    host_write_packet(packets[5], lengths[5]);
+    host_write_packet(packets[4], lengths[4]);
+
+    uint16_t type = 0;
+    void *data = 0;
+    unsigned int length = 0;
+    int seen_second = 0;
+    int seen_empty = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        ASSERT(message_recv(&type, &data, &length) == 0, "Failed to receive message!");
+        if (type == 0x0002)
+        {
+            ASSERT(length == sizeof(second), "Received message has wrong length %d!", length);
+            ASSERT(memcmp(data, second, sizeof(second)) == 0, "Received message has wrong contents!");
+            seen_second = 1;
+        }
+        else
+        {
+            ASSERT(type == 0x0003, "Received message has wrong type %04x!", type);
+            ASSERT(length == 0, "Received message has wrong length %d!", length);
+            seen_empty = 1;
+        }
+        free(data);
+    }
+    ASSERT(seen_second && seen_empty, "Did not receive both complete messages!");
+    ASSERT(message_recv(&type, &data, &length) != 0, "Received an incomplete message!");
+
+    host_write_packet(packets[1], lengths[1]);
+    ASSERT(message_recv(&type, &data, &length) == 0, "Failed to receive message!");
+    ASSERT(type == 0x0001, "Received message has wrong type %04x!", type);
+    ASSERT(length == sizeof(first), "Received message has wrong length %d!", length);
+    ASSERT(memcmp(data, first, sizeof(first)) == 0, "Received message has wrong contents!");
+    free(data);
+
+    message_free();
+}
+
+void test_message_checksum(test_context_t *context)
+{
+    message_init();
+
+    packetlib_stats_t before = packetlib_stats();
+    host_dimm_poke(HOST_RECV_STATUS_REGISTER, checksum_add(10 << 12, HOST_RECV_STATUS_SEED) ^ 0x01000000);
+    host_dimm_poke(HOST_SEND_STATUS_REGISTER, checksum_add(0, HOST_SEND_STATUS_SEED) ^ 0x01000000);
+    packetlib_stats_t after = packetlib_stats();
+
+    ASSERT(after.checksum_errors == before.checksum_errors + 2, "Expected bad status writes to be counted!");
+    ASSERT(after.receive_in_progress == 0, "Bad status write started a transfer!");
+
+    message_free();
+}
+
+void test_bench_message_reassembly(test_context_t *context)
+{
+    message_init();
+
+    // A message that is the better part of the outstanding packet limit, since the
+    // reassembly cost grows with the number of parts.
+    unsigned int size = 32768;
+    uint8_t *original = malloc(size);
+    memset(original, 0x5A, size);
+    uint8_t (*packets)[MAX_PACKET_LENGTH] = malloc(64 * MAX_PACKET_LENGTH);
+    unsigned int lengths[64];
+
+    unsigned int iterations = 200;
+    uint64_t send = 0;
+    uint64_t recv = 0;
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        uint64_t start = bench_time();
+        message_send(0x1000, original, size);
+        int count = 0;
+        while (count < 64 && (lengths[count] = host_read_packet(packets[count])) > 0)
+        {
+            count++;
+        }
+        send += bench_time() - start;
+
+        for (int j = 0; j < count; j++)
+        {
+            host_write_packet(packets[j], lengths[j]);
+        }
+
+        uint16_t type;
+        void *data;
+        unsigned int length;
+        start = bench_time();
+        ASSERT(message_recv(&type, &data, &length) == 0, "Failed to receive message!");
+        recv += bench_time() - start;
+        free(data);
+    }
+
+    BENCH_REPORT("message_send 32KB + host read", iterations, send);
+    BENCH_REPORT("message_recv 32KB reassembly", iterations, recv);
+
+    free(packets);
+    free(original);
+    message_free();
+}
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include "naomi/romfs.h"
+
+// Read an entire file out of the ROM FS attached as "host", through the same hooks
+// that the POSIX layer calls. Returns the length read, or a negative errno.
+int romfs_read_file(const char *path, char *buffer, int len)
+{
+    void *fshandle;
+    filesystem_t *fs = host_filesystem("host:/", &fshandle);
+    if (fs == 0)
+    {
+        return -ENODEV;
+    }
+
+    void *file = fs->open(fshandle, path, O_RDONLY, 0);
+    if ((intptr_t)file < 0)
+    {
+        return (intptr_t)file;
+    }
+
+    memset(buffer, 0, len);
+    int actual = fs->read(fshandle, file, buffer, len);
+    fs->close(fshandle, file);
+    return actual;
+}
+
+void test_romfs_parse_files(test_context_t *context)
+{
+    ASSERT(host_cart_load("build/romfs.bin") == 0, "Could not load ROM FS image!");
+    ASSERT(romfs_init(0, "host") == 0, "ROMFS init failed!");
+
+    char buffer[128];
+    ASSERT(romfs_read_file("/test.txt", buffer, 128) == 19, "ROMFS returned wrong read length!");
+    ASSERT(strcmp(buffer, "This is test data.\n") == 0, "ROMFS returned data from wrong file!");
+    ASSERT(romfs_read_file("/subdir/test.txt", buffer, 128) == 20, "ROMFS returned wrong read length!");
+    ASSERT(strcmp(buffer, "This is other data!\n") == 0, "ROMFS returned data from wrong file!");
+    ASSERT(romfs_read_file("/./subdir/././////./test.txt", buffer, 128) == 20, "ROMFS returned wrong read length!");
+    ASSERT(romfs_read_file("/empty_dir/../subdir/../test.txt", buffer, 128) == 19, "ROMFS returned wrong read length!");
+    ASSERT(romfs_read_file("/../../../subdir/test.txt", buffer, 128) == 20, "ROMFS returned wrong read length!");
+
+    ASSERT(romfs_read_file("/file.txt", buffer, 128) == -ENOENT, "ROMFS opened nonexistent file!");
+    ASSERT(romfs_read_file("/empty_dir/test.txt", buffer, 128) == -ENOENT, "ROMFS opened nonexistent file!");
+    ASSERT(romfs_read_file("/subdir", buffer, 128) == -EISDIR, "ROMFS opened directory as file!");
+    ASSERT(romfs_read_file("/test.txt/test.txt", buffer, 128) == -ENOENT, "ROMFS traversed into a file!");
+    ASSERT(romfs_read_file("test.txt", buffer, 128) == -ENOENT, "ROMFS opened relative path!");
+
+    romfs_free("host");
+    ASSERT(romfs_read_file("/test.txt", buffer, 128) == -ENODEV, "ROMFS still attached after free!");
+}
+
+void test_romfs_parse_directory(test_context_t *context)
+{
+    ASSERT(host_cart_load("build/romfs.bin") == 0, "Could not load ROM FS image!");
+    ASSERT(romfs_init(0, "host") == 0, "ROMFS init failed!");
+
+    void *fshandle;
+    filesystem_t *fs = host_filesystem("host:/", &fshandle);
+    ASSERT(fs != 0, "ROMFS did not attach a filesystem!");
+
+    void *dir = fs->opendir(fshandle, "/subdir");
+    ASSERT((intptr_t)dir > 0, "ROMFS failed to open directory!");
+
+    struct dirent entry;
+    int files = 0;
+    int dirs = 0;
+    while (fs->readdir(fshandle, dir, &entry) > 0)
+    {
+        if (entry.d_type == DT_REG)
+        {
+            ASSERT(strcmp(entry.d_name, "test.txt") == 0 || strcmp(entry.d_name, "file.txt") == 0, "Unexpected file %s!", entry.d_name);
+            files++;
+        }
+        else if (entry.d_type == DT_DIR)
+        {
+            ASSERT(strcmp(entry.d_name, ".") == 0 || strcmp(entry.d_name, "..") == 0, "Unexpected directory %s!", entry.d_name);
+            dirs++;
+        }
+    }
+    fs->closedir(fshandle, dir);
+
+    ASSERT(files == 2, "Expected 2 files but found %d!", files);
+    ASSERT(dirs == 2, "Expected 2 directories but found %d!", dirs);
+    ASSERT((intptr_t)fs->opendir(fshandle, "/test.txt") == -ENOTDIR, "ROMFS opened file as directory!");
+
+    romfs_free("host");
+}
+
+void test_romfs_parse_invalid(test_context_t *context)
+{
+    ASSERT(host_cart_load("build/romfs.bin") == 0, "Could not load ROM FS image!");
+    ASSERT(romfs_init(4, "host") != 0, "ROMFS init succeeded on garbage!");
+    ASSERT(romfs_init(0x100000, "host") != 0, "ROMFS init succeeded past the end of the ROM!");
+}
+
+void test_bench_romfs_lookup(test_context_t *context)
+{
+    ASSERT(host_cart_load("build/romfs.bin") == 0, "Could not load ROM FS image!");
+    ASSERT(romfs_init(0, "host") == 0, "ROMFS init failed!");
+
+    char buffer[32];
+    unsigned int iterations = 100000;
+    uint64_t start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        romfs_read_file("/test.txt", buffer, sizeof(buffer));
+    }
+    BENCH_REPORT("open/read/close root file", iterations, bench_time() - start);
+
+    start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        romfs_read_file("/subdir/test.txt", buffer, sizeof(buffer));
+    }
+    BENCH_REPORT("open/read/close subdirectory file", iterations, bench_time() - start);
+
+    romfs_free("host");
+}
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <string.h>
+#include "naomi/matrix.h"
+#include "naomi/skin.h"
+
+// The same skin as the target's test_skin_transform, but with the bone matrices written
+// out by hand since the matrix stack needs XMTRX. The second bone turns 90 degrees about
+// Z and moves, in the row-vector layout that XMTRX uses.
+static matrix_t skin_bones[2] = {
+    {
+        1.0, 0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        0.0, 0.0, 0.0, 1.0,
+    },
+    {
+        0.0, -1.0, 0.0, 0.0,
+        1.0, 0.0, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        10.0, 20.0, 30.0, 1.0,
+    },
+};
+
+void test_skin_reference(test_context_t *context)
+{
+    textured_vertex_t bindpose[3] = {
+        { 1.0, 0.0, 0.0, 0.25, 0.5 },
+        { 0.0, 1.0, 0.0, 0.0, 1.0 },
+        { 5.0, 5.0, 5.0, 1.0, 1.0 },
+    };
+    skin_weight_t weights[3] = {
+        // Split evenly between both bones, with unnormalized weights.
+        { { 0, 1, 0, 0 }, { 2.0, 2.0, 0.0, 0.0 } },
+        // Entirely on the second bone.
+        { { 1, 0, 0, 0 }, { 1.0, 0.0, 0.0, 0.0 } },
+        // Not skinned at all.
+        { { 0, 0, 0, 0 }, { 0.0, 0.0, 0.0, 0.0 } },
+    };
+    textured_vertex_t expected[3] = {
+        { 5.5, 9.5, 15.0, 0.25, 0.5 },
+        { 11.0, 20.0, 30.0, 0.0, 1.0 },
+        { 5.0, 5.0, 5.0, 1.0, 1.0 },
+    };
+
+    skin_t *skin = skin_create(weights, 3, 2);
+    ASSERT(skin != 0, "Failed to create a valid skin!");
+
+    // Start from garbage so we know every field gets written.
+    textured_vertex_t posed[3];
+    memset(posed, 0xFF, sizeof(posed));
+    skin_transform_reference(skin, skin_bones, bindpose, posed);
+    skin_free(skin);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_APPROX(expected[i].x, posed[i].x, "Unexpected X value %f for vertex %d!", posed[i].x, i);
+        ASSERT_APPROX(expected[i].y, posed[i].y, "Unexpected Y value %f for vertex %d!", posed[i].y, i);
+        ASSERT_APPROX(expected[i].z, posed[i].z, "Unexpected Z value %f for vertex %d!", posed[i].z, i);
+        ASSERT_APPROX(expected[i].u, posed[i].u, "Unexpected U value %f for vertex %d!", posed[i].u, i);
+        ASSERT_APPROX(expected[i].v, posed[i].v, "Unexpected V value %f for vertex %d!", posed[i].v, i);
+    }
+}
+
+void test_skin_many_influences(test_context_t *context)
+{
+    // One vertex pulled on by four bones that each move it a different amount along X,
+    // so the result is the weighted average of where each bone puts it.
+    textured_vertex_t bindpose = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    skin_weight_t weight = { { 3, 2, 1, 0 }, { 1.0, 1.0, 1.0, 1.0 } };
+    matrix_t bones[4];
+    for (int i = 0; i < 4; i++)
+    {
+        memcpy(&bones[i], &skin_bones[0], sizeof(matrix_t));
+        bones[i].a41 = (float)(i * 4);
+    }
+
+    skin_t *skin = skin_create(&weight, 1, 4);
+    ASSERT(skin != 0, "Failed to create a valid skin!");
+
+    textured_vertex_t posed;
+    skin_transform_reference(skin, bones, &bindpose, &posed);
+    skin_free(skin);
+
+    ASSERT_APPROX(6.0, posed.x, "Unexpected X value %f!", posed.x);
+    ASSERT_APPROX(0.0, posed.y, "Unexpected Y value %f!", posed.y);
+    ASSERT_APPROX(0.0, posed.z, "Unexpected Z value %f!", posed.z);
+
+    // Too many bones for a skin is rejected outright.
+    ASSERT(skin_create(&weight, 1, SKIN_MAX_BONES + 1) == 0, "Created a skin with too many bones!");
+}
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <malloc.h>
+#include "naomi/ta.h"
+
+// Work out where a pixel lands in a twiddled texture, as a pixel index, the slow way.
+unsigned int twiddled_index(unsigned int u, unsigned int v)
+{
+    unsigned int index = 0;
+    for (int bit = 0; bit < 10; bit++)
+    {
+        index |= ((v >> bit) & 1) << (bit * 2);
+        index |= ((u >> bit) & 1) << ((bit * 2) + 1);
+    }
+    return index;
+}
+
+void test_texture_twiddle_16bit(test_context_t *context)
+{
+    int uvsize = 32;
+    uint16_t *tex = ta_texture_malloc(uvsize, 16);
+    ASSERT(tex != 0, "Failed to allocate texture!");
+
+    uint16_t *src = malloc(uvsize * uvsize * 2);
+    for (int i = 0; i < uvsize * uvsize; i++)
+    {
+        src[i] = (i * 7919) & 0xFFFF;
+    }
+
+    ASSERT(ta_texture_load(tex, uvsize, 16, src) == 0, "Failed to load texture!");
+
+    for (int v = 0; v < uvsize; v++)
+    {
+        for (int u = 0; u < uvsize; u++)
+        {
+            uint16_t actual = tex[twiddled_index(u, v)];
+            ASSERT(actual == src[u + (v * uvsize)], "Pixel %d,%d is %04x instead of %04x!", u, v, actual, src[u + (v * uvsize)]);
+        }
+    }
+
+    free(src);
+    ta_texture_free(tex);
+}
+
+void test_texture_twiddle_8bit(test_context_t *context)
+{
+    int uvsize = 64;
+    uint8_t *tex = ta_texture_malloc(uvsize, 8);
+    ASSERT(tex != 0, "Failed to allocate texture!");
+
+    uint8_t *src = malloc(uvsize * uvsize);
+    for (int i = 0; i < uvsize * uvsize; i++)
+    {
+        src[i] = (i * 31) & 0xFF;
+    }
+
+    ASSERT(ta_texture_load(tex, uvsize, 8, src) == 0, "Failed to load texture!");
+
+    for (int v = 0; v < uvsize; v++)
+    {
+        for (int u = 0; u < uvsize; u++)
+        {
+            uint8_t actual = tex[twiddled_index(u, v)];
+            ASSERT(actual == src[u + (v * uvsize)], "Pixel %d,%d is %02x instead of %02x!", u, v, actual, src[u + (v * uvsize)]);
+        }
+    }
+
+    free(src);
+    ta_texture_free(tex);
+}
+
+void test_texture_twiddle_4bit(test_context_t *context)
+{
+    int uvsize = 16;
+    uint8_t *tex = ta_texture_malloc(uvsize, 4);
+    ASSERT(tex != 0, "Failed to allocate texture!");
+
+    // Source data has the even pixel of each pair in the upper nibble.
+    uint8_t *src = malloc((uvsize * uvsize) / 2);
+    for (int i = 0; i < (uvsize * uvsize) / 2; i++)
+    {
+        src[i] = (i * 37) & 0xFF;
+    }
+
+    ASSERT(ta_texture_load(tex, uvsize, 4, src) == 0, "Failed to load texture!");
+
+    for (int v = 0; v < uvsize; v++)
+    {
+        for (int u = 0; u < uvsize; u++)
+        {
+            unsigned int pos = u + (v * uvsize);
+            uint8_t expected = (pos & 1) ? (src[pos >> 1] & 0xF) : (src[pos >> 1] >> 4);
+
+            unsigned int index = twiddled_index(u, v);
+            uint8_t actual = (index & 1) ? (tex[index >> 1] >> 4) : (tex[index >> 1] & 0xF);
+            ASSERT(actual == expected, "Pixel %d,%d is %x instead of %x!", u, v, actual, expected);
+        }
+    }
+
+    free(src);
+    ta_texture_free(tex);
+}
+
+void test_texture_load_sprite(test_context_t *context)
+{
+    int uvsize = 32;
+    uint16_t *tex = ta_texture_malloc(uvsize, 16);
+    ASSERT(tex != 0, "Failed to allocate texture!");
+    memset(tex, 0, uvsize * uvsize * 2);
+
+    // Load a sprite that hangs off the bottom right of the texture.
+    uint16_t sprite[12 * 12];
+    for (int i = 0; i < 12 * 12; i++)
+    {
+        sprite[i] = i + 1;
+    }
+
+    ASSERT(ta_texture_load_sprite(tex, uvsize, 16, 24, 26, 12, 12, sprite) == 0, "Failed to load sprite!");
+
+    for (int v = 0; v < uvsize; v++)
+    {
+        for (int u = 0; u < uvsize; u++)
+        {
+            uint16_t expected = 0;
+            if (u >= 24 && v >= 26)
+            {
+                expected = sprite[(u - 24) + ((v - 26) * 12)];
+            }
+
+            uint16_t actual = tex[twiddled_index(u, v)];
+            ASSERT(actual == expected, "Pixel %d,%d is %04x instead of %04x!", u, v, actual, expected);
+        }
+    }
+
+    ta_texture_free(tex);
+}
+
+void test_texture_allocator(test_context_t *context)
+{
+    struct mallinfo before = ta_texture_mallinfo();
+    ASSERT(before.uordblks == 0, "Expected no allocations in TEXRAM");
+
+    // Allocate a bunch of textures, make sure none of them overlap or run off the end.
+    uint8_t *textures[32];
+    int sizes[32];
+    for (int i = 0; i < 32; i++)
+    {
+        int uvsize = 8 << (i % 6);
+        textures[i] = ta_texture_malloc(uvsize, 16);
+        sizes[i] = uvsize * uvsize * 2;
+
+        ASSERT(textures[i] != 0, "Failed to allocate texture %d!", i);
+        ASSERT(textures[i] >= (uint8_t *)host_texture_ram(), "Texture %d is before texture RAM!", i);
+        ASSERT(textures[i] + sizes[i] <= (uint8_t *)host_texture_ram() + host_texture_ram_size(), "Texture %d is past texture RAM!", i);
+
+        for (int j = 0; j < i; j++)
+        {
+            ASSERT(textures[i] + sizes[i] <= textures[j] || textures[j] + sizes[j] <= textures[i], "Texture %d overlaps texture %d!", i, j);
+        }
+    }
+
+    // Free every other one, and then make sure the holes get reused.
+    struct mallinfo full = ta_texture_mallinfo();
+    for (int i = 0; i < 32; i += 2)
+    {
+        ta_texture_free(textures[i]);
+    }
+
+    for (int i = 0; i < 32; i += 2)
+    {
+        int uvsize = 8 << (i % 6);
+        textures[i] = ta_texture_malloc(uvsize, 16);
+        ASSERT(textures[i] != 0, "Failed to reallocate texture %d!", i);
+    }
+
+    struct mallinfo after = ta_texture_mallinfo();
+    ASSERT(after.uordblks == full.uordblks, "Reallocations did not account for the right amount of memory!");
+    ASSERT(after.fordblks == full.fordblks, "Reallocations did not account for the right amount of memory!");
+
+    for (int i = 0; i < 32; i++)
+    {
+        ta_texture_free(textures[i]);
+    }
+
+    // Everything should coalesce back into one free chunk.
+    after = ta_texture_mallinfo();
+    ASSERT(after.fordblks == before.fordblks, "Expected entire TEXRAM available");
+    ASSERT(after.uordblks == 0, "Expected no allocations in TEXRAM");
+    ASSERT(ta_texture_malloc(1024, 16) != 0, "Expected TEXRAM to be defragmented");
+    ta_texture_free(ta_texture_malloc(1024, 16));
+}
+
+void test_bench_texture_load(test_context_t *context)
+{
+    int bitsizes[3] = { 4, 8, 16 };
+    uint8_t *src = malloc(256 * 256 * 2);
+    for (int i = 0; i < 256 * 256 * 2; i++)
+    {
+        src[i] = i & 0xFF;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        void *tex = ta_texture_malloc(256, bitsizes[i]);
+        ASSERT(tex != 0, "Failed to allocate texture!");
+
+        unsigned int iterations = 500;
+        uint64_t start = bench_time();
+        for (unsigned int j = 0; j < iterations; j++)
+        {
+            ta_texture_load(tex, 256, bitsizes[i], src);
+        }
+
+        char what[64];
+        sprintf(what, "ta_texture_load 256x256 %dbpp", bitsizes[i]);
+        BENCH_REPORT(what, iterations, bench_time() - start);
+        ta_texture_free(tex);
+    }
+
+    free(src);
+}
+
+void test_bench_texture_allocator(test_context_t *context)
+{
+    // Churn a texture RAM that is already holding a bunch of textures, which is the
+    // worst case for the list walk in the allocator.
+    void *resident[128];
+    for (int i = 0; i < 128; i++)
+    {
+        resident[i] = ta_texture_malloc(64, 16);
+        ASSERT(resident[i] != 0, "Failed to allocate texture!");
+    }
+
+    unsigned int iterations = 100000;
+    uint64_t start = bench_time();
+    for (unsigned int i = 0; i < iterations; i++)
+    {
+        void *tex = ta_texture_malloc(8 << (i % 5), 16);
+        ta_texture_free(tex);
+    }
+    BENCH_REPORT("ta_texture_malloc/free, 128 resident", iterations, bench_time() - start);
+
+    for (int i = 0; i < 128; i++)
+    {
+        ta_texture_free(resident[i]);
+    }
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "stubs.h"
+
+typedef struct {
+    const char * name;
+    int result;
+    char *log;
+    int logleft;
+    char *reason;
+    int reasonleft;
+} test_context_t;
+
+typedef void (*test_func_t)(test_context_t *context);
+
+#define TEST_PASSED 0
+#define TEST_FAILED 1
+#define TEST_SKIPPED 2
+#define TEST_TOO_LONG 3
+
+#define LOG(msg, ...) \
+do { \
+    if (context->logleft) { \
+        int __len = snprintf(context->log, context->logleft, msg, ##__VA_ARGS__); \
+        context->log += __len; \
+        context->logleft -= __len; \
+    } \
+} while(0)
+
+#define ASSERT(condition, msg, ...) \
+do { \
+    if (!(condition)) { \
+        context->result = TEST_FAILED; \
+        int __len = snprintf(context->reason, context->reasonleft, "assertion failure"); \
+        context->reason += __len; \
+        context->reasonleft -= __len; \
+        LOG("%c[31mASSERTION FAILED (%s:%d)%c[0m:\n  %s,\n  ", 0x1B, context->name, __LINE__, 0x1B, #condition); \
+        LOG(msg, ##__VA_ARGS__); \
+        return; \
+    } \
+} while(0)
+
+#define ASSERT_EQUAL(expected, actual, msg, ...) \
+do { \
+    if (expected != actual) { \
+        context->result = TEST_FAILED; \
+        int __len = snprintf(context->reason, context->reasonleft, "assertion failure"); \
+        context->reason += __len; \
+        context->reasonleft -= __len; \
+        LOG("%c[31mASSERTION FAILED (%s:%d)%c[0m:\n  %s != %s,\n  ", 0x1B, context->name, __LINE__, 0x1B, #expected, #actual); \
+        LOG(msg, ##__VA_ARGS__); \
+        return; \
+    } \
+} while(0)
+
+#define SMALL_VALUE 0.0001
+
+#define ASSERT_APPROX(expected, actual, msg, ...) \
+do { \
+    if (fabs(expected - actual) > SMALL_VALUE) { \
+        context->result = TEST_FAILED; \
+        int __len = snprintf(context->reason, context->reasonleft, "assertion failure"); \
+        context->reason += __len; \
+        context->reasonleft -= __len; \
+        LOG("%c[31mASSERTION FAILED (%s:%d)%c[0m:\n  %s != %s,\n  ", 0x1B, context->name, __LINE__, 0x1B, #expected, #actual); \
+        LOG(msg, ##__VA_ARGS__); \
+        return; \
+    } \
+} while(0)
+
+#define ASSERT_ARRAYS_EQUAL(expected, actual, msg, ...) \
+do { \
+    for (unsigned int __pos = 0; __pos < (sizeof(expected) / sizeof((expected)[0])); __pos++) { \
+        if (expected[__pos] != actual[__pos]) { \
+            context->result = TEST_FAILED; \
+            int __len = snprintf(context->reason, context->reasonleft, "assertion failure"); \
+            context->reason += __len; \
+            context->reasonleft -= __len; \
+            LOG("%c[31mASSERTION FAILED (%s:%d)%c[0m:\n  %s[%d] != %s[%d],\n  ", 0x1B, context->name, __LINE__, 0x1B, #expected, __pos, #actual, __pos); \
+            LOG(msg, ##__VA_ARGS__); \
+            return; \
+        } \
+    } \
+} while(0)
+
+
+#define SKIP(msg, ...) \
+do { \
+    context->result = TEST_SKIPPED; \
+    int __len = snprintf(context->reason, context->reasonleft, msg, ##__VA_ARGS__); \
+    context->reason += __len; \
+    context->reasonleft -= __len; \
+    return; \
+} while(0)
+
+// Microbenchmarks are tests named test_bench_*, which are only run when the suite is
+// started with --bench. They time a loop with bench_time() and then print how long
+// each iteration took with BENCH_REPORT().
+uint64_t bench_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+#define BENCH_REPORT(what, iterations, nsec) \
+do { \
+    printf("\n  %-40s %10.1fns/iter", what, (double)(nsec) / (double)(iterations)); \
+} while(0)
+
+// =================================================
+// TEST FILES SECTION
+// =================================================
+
+// Note that this section will be automatically filled in by finding
+// test files that look like test_*.c.
+
+// =================================================
+// END TEST FILES SECTION
+// =================================================
+
+#define TESTCASE(file, fn, dur) { file, #fn, fn, dur }
+static const struct test_suite
+{
+    const char * const file;
+    const char * const name;
+    test_func_t main;
+    int duration;
+} tests[] = {
+// =================================================
+// TEST CASES SECTION
+// =================================================
+
+// Note that this section will be automatically filled in by finding
+// test files that look like test_*.c.
+
+// =================================================
+// END TEST CASES SECTION
+// =================================================
+};
+
+#define CYAN (char []){ 0x1B, '[', '3', '6', 'm', 0 }
+#define RED (char []){ 0x1B, '[', '3', '1', 'm', 0 }
+#define GREEN (char []){ 0x1B, '[', '3', '2', 'm', 0 }
+#define YELLOW (char []){ 0x1B, '[', '2', ';', '3', '3', 'm', 0 }
+#define RESET (char []){ 0x1B, '[', '0', 'm', 0 }
+
+int run_suite(int bench)
+{
+    printf("====================\n");
+    printf("Starting host tests\n%s%d tests to run%s\n", CYAN, (int)(sizeof(tests) / sizeof(tests[0])), RESET);
+    printf("====================\n\n");
+
+    // Run the tests!
+    char logbuffer[2048];
+    char reasonbuffer[128];
+    unsigned int passed = 0;
+    unsigned int failed = 0;
+    unsigned int skipped = 0;
+    uint64_t total_duration = 0;
+
+    for (unsigned int testno = 0; testno < (sizeof(tests) / sizeof(tests[0])); testno++)
+    {
+        // Set the test up to be run.
+        printf("%s...", tests[testno].name);
+        fflush(stdout);
+
+        test_context_t context;
+        context.name = tests[testno].file;
+        context.result = TEST_PASSED;
+        context.log = logbuffer;
+        context.logleft = sizeof(logbuffer);
+        context.reason = reasonbuffer;
+        context.reasonleft = sizeof(reasonbuffer);
+
+        logbuffer[0] = 0;
+        reasonbuffer[0] = 0;
+
+        // Durations are budgets for the SH-4 with interrupts disabled, so they mean
+        // nothing here. Just run everything as a regular test.
+        uint64_t nsec = 0;
+        int isbench = strncmp(tests[testno].name, "test_bench_", 11) == 0;
+        if (isbench && !bench)
+        {
+            context.result = TEST_SKIPPED;
+            snprintf(reasonbuffer, sizeof(reasonbuffer), "run with --bench");
+        }
+        else
+        {
+            uint64_t start = bench_time();
+            tests[testno].main(&context);
+            nsec = bench_time() - start;
+        }
+        total_duration += nsec;
+
+        if (context.result == TEST_PASSED)
+        {
+            printf("%s%sPASSED%s, %s%luns%s\n", isbench ? "\n" : "", GREEN, RESET, CYAN, (unsigned long)nsec, RESET);
+            passed ++;
+        }
+        else if (context.result == TEST_SKIPPED)
+        {
+            if (strlen(reasonbuffer))
+            {
+                printf("%sSKIPPED%s (%s)\n", YELLOW, RESET, reasonbuffer);
+            }
+            else
+            {
+                printf("%sSKIPPED%s\n", YELLOW, RESET);
+            }
+            skipped ++;
+        }
+        else
+        {
+            if (strlen(reasonbuffer))
+            {
+                printf("%sFAILED%s, %s%luns%s (%s)\n", RED, RESET, CYAN, (unsigned long)nsec, RESET, reasonbuffer);
+            }
+            else
+            {
+                printf("%sFAILED%s, %s%luns%s\n", RED, RESET, CYAN, (unsigned long)nsec, RESET);
+            }
+            failed ++;
+
+            if (strlen(logbuffer))
+            {
+                printf("%s\n", logbuffer);
+            }
+        }
+    }
+
+    printf("\n====================\n");
+    printf("Finished\n%s%d pass%s, %s%d fail%s, %s%d skip%s\n%s%luns total duration%s\n", GREEN, passed, RESET, RED, failed, RESET, YELLOW, skipped, RESET, CYAN, (unsigned long)total_duration, RESET);
+    printf("====================\n");
+
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int bench = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--bench") == 0)
+        {
+            bench = 1;
+        }
+    }
+
+    // Set up the fake hardware that the library modules under test expect.
+    host_init();
+
+    return run_suite(bench);
+}
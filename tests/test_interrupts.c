@@ -33,3 +33,39 @@ void test_interrupts_basic(test_context_t *context)
     newstats = irq_stats();
     ASSERT(oldstats.num_interrupts < newstats.num_interrupts, "Didn't get any interrupts!");
 }
+
+void test_interrupts_timing(test_context_t *context)
+{
+    irq_timing_t timing;
+    ASSERT(irq_timing(IRQ_TIMING_MAX, &timing) == 0, "Got timing for an invalid source!");
+
+    irq_timing_reset();
+    ASSERT(irq_timing(IRQ_TIMING_SYSCALL, &timing) != 0, "Could not get syscall timing!");
+    ASSERT(timing.duration.count < 5, "Syscall timing was not reset!");
+
+    // Every yield is a syscall, so it should be timed.
+    for (int i = 0; i < 10; i++)
+    {
+        thread_yield();
+    }
+
+    // Sleep long enough to see at least one vblank as well.
+    thread_sleep(50000);
+
+    ASSERT(irq_timing(IRQ_TIMING_SYSCALL, &timing) != 0, "Could not get syscall timing!");
+    ASSERT(timing.duration.count >= 10, "Expected at least 10 syscalls but got %lu!", timing.duration.count);
+    ASSERT(timing.latency.count == 0, "Got latency for syscalls which can't be measured!");
+
+    uint32_t total = 0;
+    for (int i = 0; i < IRQ_HISTOGRAM_BUCKETS; i++)
+    {
+        total += timing.duration.buckets[i];
+    }
+    ASSERT(total == timing.duration.count, "Histogram buckets don't add up to the count!");
+    ASSERT(timing.duration.total <= (uint64_t)timing.duration.max * timing.duration.count, "Longest syscall is shorter than the average!");
+
+    ASSERT(irq_timing(IRQ_TIMING_VBLANK_IN, &timing) != 0, "Could not get vblank timing!");
+    ASSERT(timing.latency.count > 0, "Expected to see vblank in latency!");
+    ASSERT(timing.duration.count == timing.latency.count, "Vblank in latency and duration counts don't match!");
+    ASSERT(timing.latency.max < 16667, "Vblank latency is longer than a frame!");
+}
@@ -0,0 +1,116 @@
+// vim: set fileencoding=utf-8
+#include <stdlib.h>
+#include "naomi/color.h"
+#include "naomi/matrix.h"
+#include "naomi/vector.h"
+#include "naomi/light.h"
+
+void test_light_colors(test_context_t *context)
+{
+    vertex_t verticies[3] = {
+        { 0.0, 0.0, 0.0 },
+        { 0.0, 0.0, 0.0 },
+        { 0.0, 0.0, 0.0 },
+    };
+    vector_t normals[3] = {
+        { 0.0, 0.0, 1.0 },
+        { 0.0, 0.0, -1.0 },
+        { 0.0, 1.0, 0.0 },
+    };
+    color_t base = rgba(200, 100, 50, 255);
+    uint32_t colors[3];
+
+    // A directional light shining straight at the first vertex only.
+    light_t directional = { LIGHT_TYPE_DIRECTIONAL, rgb(255, 255, 255), { 0.0, 0.0, -5.0 }, 0.0 };
+    light_vertex_colors(&directional, 1, base, verticies, normals, colors, 3);
+    ASSERT_EQUAL(colors[0], 0xFFC86432, "Unexpected color for lit vertex!");
+    ASSERT_EQUAL(colors[1], 0xFF000000, "Unexpected color for vertex facing away!");
+    ASSERT_EQUAL(colors[2], 0xFF000000, "Unexpected color for vertex facing sideways!");
+
+    // Ambient light adds to everything equally.
+    light_t lights[2] = {
+        directional,
+        { LIGHT_TYPE_AMBIENT, rgb(51, 51, 51), { 0.0, 0.0, 0.0 }, 0.0 },
+    };
+    light_vertex_colors(lights, 2, base, verticies, normals, colors, 3);
+    ASSERT_EQUAL(colors[0], 0xFFC86432, "Unexpected color for saturated vertex!");
+    ASSERT_EQUAL(colors[1], 0xFF28140A, "Unexpected color for ambient vertex!");
+    ASSERT_EQUAL(colors[2], 0xFF28140A, "Unexpected color for ambient vertex!");
+
+    // A point light halfway to its radius contributes half its color.
+    light_t point = { LIGHT_TYPE_POINT, rgb(255, 255, 255), { 0.0, 0.0, 2.0 }, 4.0 };
+    light_vertex_colors(&point, 1, rgba(200, 100, 50, 128), verticies, normals, colors, 3);
+    ASSERT_EQUAL(colors[0], 0x80643219, "Unexpected color for point lit vertex!");
+    ASSERT_EQUAL(colors[1], 0x80000000, "Unexpected color for vertex facing away!");
+
+    // And nothing at all past its radius.
+    point.radius = 1.5;
+    light_vertex_colors(&point, 1, base, verticies, normals, colors, 1);
+    ASSERT_EQUAL(colors[0], 0xFF000000, "Unexpected color for vertex outside of radius!");
+}
+
+void test_light_intensities(test_context_t *context)
+{
+    vertex_t verticies[2] = {
+        { 0.0, 0.0, 0.0 },
+        { 1.0, 1.0, 1.0 },
+    };
+    vector_t normals[2] = {
+        { 0.0, 0.0, 1.0 },
+        { 0.0, 0.0, 1.0 },
+    };
+    float intensities[2];
+
+    light_t lights[2] = {
+        { LIGHT_TYPE_DIRECTIONAL, rgb(255, 255, 255), { 0.0, -1.0, -1.0 }, 0.0 },
+        { LIGHT_TYPE_DIRECTIONAL, rgb(255, 0, 0), { 0.0, 0.0, -1.0 }, 0.0 },
+    };
+
+    light_vertex_intensities(lights, 1, verticies, normals, intensities, 2);
+    ASSERT_APPROX(intensities[0], 0.7071, "Unexpected intensity %f for angled light!", intensities[0]);
+    ASSERT_APPROX(intensities[1], 0.7071, "Unexpected intensity %f for angled light!", intensities[1]);
+
+    light_vertex_intensities(&lights[1], 1, verticies, normals, intensities, 2);
+    ASSERT_APPROX(intensities[0], 0.3333, "Unexpected intensity %f for colored light!", intensities[0]);
+}
+
+void test_light_transform(test_context_t *context)
+{
+    vertex_t verticies[3] = {
+        { 0.0, 0.0, -1.0 },
+        { 1.0, 0.0, -2.0 },
+        { 0.0, 1.0, -3.0 },
+    };
+    vector_t normals[3] = {
+        { 0.0, 0.0, 1.0 },
+        { 1.0, 0.0, 0.0 },
+        { 0.0, 0.0, -1.0 },
+    };
+    light_t lights[2] = {
+        { LIGHT_TYPE_DIRECTIONAL, rgb(255, 255, 255), { -1.0, 0.0, -1.0 }, 0.0 },
+        { LIGHT_TYPE_POINT, rgb(0, 255, 0), { 0.0, 0.0, 1.0 }, 10.0 },
+    };
+    color_t base = rgb(255, 255, 255);
+
+    vertex_t expected[3];
+    uint32_t expectedcolors[3];
+    vertex_t actual[3];
+    uint32_t actualcolors[3];
+
+    matrix_push();
+    matrix_init_identity();
+    matrix_scale(2.0, 3.0, 1.0);
+    matrix_perspective_transform_vertex(verticies, expected, 3);
+    light_vertex_colors(lights, 2, base, verticies, normals, expectedcolors, 3);
+    light_perspective_transform_vertex(lights, 2, base, verticies, normals, actual, actualcolors, 3);
+    matrix_pop();
+
+    // Fusing the two passes should give the same answer as doing them separately.
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_APPROX(actual[i].x, expected[i].x, "Unexpected X value %f for vertex %d!", actual[i].x, i);
+        ASSERT_APPROX(actual[i].y, expected[i].y, "Unexpected Y value %f for vertex %d!", actual[i].y, i);
+        ASSERT_APPROX(actual[i].z, expected[i].z, "Unexpected Z value %f for vertex %d!", actual[i].z, i);
+        ASSERT_EQUAL(actualcolors[i], expectedcolors[i], "Unexpected color for vertex %d!", i);
+    }
+}
@@ -1,6 +1,7 @@
 // vim: set fileencoding=utf-8
 #include <stdlib.h>
 #include "naomi/matrix.h"
+#include "naomi/thread.h"
 
 void test_matrix_get_set(test_context_t *context)
 {
@@ -280,3 +281,144 @@ void test_matrix_invert(test_context_t *context)
         ASSERT(matrix_index(result, y, x) == matrix_index(expected, y, x), "Expected value %f but got %f for [%d][%d]!", matrix_index(expected, y, x), matrix_index(result, y, x), y, x);
     }
 }
+
+void test_matrix_sincos(test_context_t *context)
+{
+    float sine;
+    float cosine;
+
+    matrix_sincos(0.0, &sine, &cosine);
+    ASSERT_APPROX(sine, 0.0, "Unexpected sine value!");
+    ASSERT_APPROX(cosine, 1.0, "Unexpected cosine value!");
+
+    matrix_sincos(30.0, &sine, &cosine);
+    ASSERT_APPROX(sine, 0.5, "Unexpected sine value!");
+    ASSERT_APPROX(cosine, 0.8660, "Unexpected cosine value!");
+
+    matrix_sincos(-90.0, &sine, &cosine);
+    ASSERT_APPROX(sine, -1.0, "Unexpected sine value!");
+    ASSERT_APPROX(cosine, 0.0, "Unexpected cosine value!");
+
+    matrix_sincos(405.0, &sine, &cosine);
+    ASSERT_APPROX(sine, 0.7071, "Unexpected sine value!");
+    ASSERT_APPROX(cosine, 0.7071, "Unexpected cosine value!");
+}
+
+void test_matrix_quaternion(test_context_t *context)
+{
+    vertex_t axes[3] = {
+        { 1.0, 0.0, 0.0 },
+        { 0.0, 1.0, 0.0 },
+        { 0.0, 0.0, 1.0 },
+    };
+
+    // A quaternion about each axis should match the equivalent rotate call.
+    for (int axis = 0; axis < 3; axis++)
+    {
+        matrix_t expected;
+        matrix_t actual;
+        quaternion_t quat;
+
+        matrix_push();
+        matrix_init_identity();
+        if (axis == 0) { matrix_rotate_x(30.0); }
+        if (axis == 1) { matrix_rotate_y(30.0); }
+        if (axis == 2) { matrix_rotate_z(30.0); }
+        matrix_get(&expected);
+        matrix_pop();
+
+        quaternion_from_axis_angle(&quat, &axes[axis], 30.0);
+        quaternion_to_matrix(&actual, &quat);
+
+        for (int i = 0; i < 16; i++)
+        {
+            int x = i % 4;
+            int y = i / 4;
+            ASSERT_APPROX(matrix_index(actual, y, x), matrix_index(expected, y, x), "Unexpected value %f for [%d][%d] about axis %d!", matrix_index(actual, y, x), y, x, axis);
+        }
+    }
+
+    // Combining two rotations about the same axis adds the angles.
+    quaternion_t first;
+    quaternion_t second;
+    quaternion_t combined;
+    quaternion_from_axis_angle(&first, &axes[2], 30.0);
+    quaternion_from_axis_angle(&second, &axes[2], 60.0);
+    quaternion_multiply(&combined, &first, &second);
+    ASSERT_APPROX(combined.z, 0.7071, "Unexpected Z value for combined rotation!");
+    ASSERT_APPROX(combined.w, 0.7071, "Unexpected W value for combined rotation!");
+
+    // Halfway between no rotation and 90 degrees is 45 degrees.
+    quaternion_t identity;
+    quaternion_t halfway;
+    quaternion_identity(&identity);
+    quaternion_slerp(&halfway, &identity, &combined, 0.5);
+    ASSERT_APPROX(halfway.x, 0.0, "Unexpected X value for interpolated rotation!");
+    ASSERT_APPROX(halfway.y, 0.0, "Unexpected Y value for interpolated rotation!");
+    ASSERT_APPROX(halfway.z, 0.3827, "Unexpected Z value for interpolated rotation!");
+    ASSERT_APPROX(halfway.w, 0.9239, "Unexpected W value for interpolated rotation!");
+
+    // Normalizing should fix up drift.
+    halfway.z *= 2.0;
+    halfway.w *= 2.0;
+    quaternion_normalize(&halfway);
+    ASSERT_APPROX(halfway.z, 0.3827, "Unexpected Z value for normalized rotation!");
+    ASSERT_APPROX(halfway.w, 0.9239, "Unexpected W value for normalized rotation!");
+}
+
+void *matrix_context_thread(void *param)
+{
+    float scale = *((float *)param);
+    int mismatches = 0;
+
+    // Every thread gets its own system matrix, so nothing another thread
+    // does in between yields should show up here.
+    matrix_init_identity();
+    matrix_scale(scale, scale, scale);
+
+    for (int i = 0; i < 100; i++)
+    {
+        thread_yield();
+
+        vertex_t point = { 1.0, 2.0, 3.0 };
+        matrix_affine_transform_vertex(&point, &point, 1);
+        if (point.x != scale || point.y != (scale * 2.0) || point.z != (scale * 3.0))
+        {
+            mismatches++;
+        }
+    }
+
+    return (void *)mismatches;
+}
+
+void test_matrix_thread_context(test_context_t *context)
+{
+    float scales[2] = { 2.0, 5.0 };
+    uint32_t threads[2];
+
+    matrix_push();
+    matrix_init_identity();
+    matrix_translate(1.0, 1.0, 1.0);
+
+    for (int i = 0; i < 2; i++)
+    {
+        threads[i] = thread_create("matrix", matrix_context_thread, &scales[i]);
+        thread_start(threads[i]);
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        int mismatches = (int)thread_join(threads[i]);
+        thread_destroy(threads[i]);
+        ASSERT(mismatches == 0, "Thread %d saw another thread's system matrix %d times!", i, mismatches);
+    }
+
+    // Our own matrix should have survived as well.
+    vertex_t point = { 0.0, 0.0, 0.0 };
+    matrix_affine_transform_vertex(&point, &point, 1);
+    matrix_pop();
+
+    ASSERT_APPROX(point.x, 1.0, "Unexpected X value %f after threads ran!", point.x);
+    ASSERT_APPROX(point.y, 1.0, "Unexpected Y value %f after threads ran!", point.y);
+    ASSERT_APPROX(point.z, 1.0, "Unexpected Z value %f after threads ran!", point.z);
+}
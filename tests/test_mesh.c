@@ -0,0 +1,171 @@
+// vim: set fileencoding=utf-8
+#include <stdlib.h>
+#include <stddef.h>
+#include "naomi/matrix.h"
+#include "naomi/mesh.h"
+
+void test_mesh_create(test_context_t *context)
+{
+    textured_vertex_t verticies[4] = {
+        { 0.0, 0.0, -1.0, 0.0, 0.0 },
+        { 1.0, 0.0, -1.0, 1.0, 0.0 },
+        { 0.0, 1.0, -1.0, 0.0, 1.0 },
+        { 1.0, 1.0, -1.0, 1.0, 1.0 },
+    };
+    uint16_t indices[4] = { 0, 1, 2, 3 };
+    uint16_t strips[1] = { 4 };
+
+    mesh_t *mesh = mesh_create(verticies, 4, indices, strips, 1);
+    ASSERT(mesh != 0, "Failed to create a valid mesh!");
+    ASSERT(mesh->indexcount == 4, "Mesh has %d indexes instead of 4!", mesh->indexcount);
+    ASSERT_APPROX(mesh->center.x, 0.5, "Unexpected bounding sphere X coordinate %f!", mesh->center.x);
+    ASSERT_APPROX(mesh->center.y, 0.5, "Unexpected bounding sphere Y coordinate %f!", mesh->center.y);
+    ASSERT_APPROX(mesh->center.z, -1.0, "Unexpected bounding sphere Z coordinate %f!", mesh->center.z);
+    ASSERT_APPROX(mesh->radius, 0.7071, "Unexpected bounding sphere radius %f!", mesh->radius);
+    ASSERT(mesh->colors == 0, "Mesh should start out unlit!");
+    mesh_free(mesh);
+
+    // Strips shorter than a triangle aren't valid.
+    uint16_t shortstrips[2] = { 2, 2 };
+    ASSERT(mesh_create(verticies, 4, indices, shortstrips, 2) == 0, "Created a mesh with degenerate strips!");
+
+    // Neither are indexes past the end of the vertex array.
+    uint16_t badindices[4] = { 0, 1, 2, 4 };
+    ASSERT(mesh_create(verticies, 4, badindices, strips, 1) == 0, "Created a mesh with out of bounds indexes!");
+}
+
+void test_mesh_transform(test_context_t *context)
+{
+    // Two strips sharing an edge, one in front of the camera and one behind it.
+    textured_vertex_t verticies[6] = {
+        { 0.0, 0.0, -1.0, 0.0, 0.0 },
+        { 1.0, 0.0, -1.0, 1.0, 0.0 },
+        { 0.0, 1.0, -1.0, 0.0, 1.0 },
+        { 1.0, 1.0, -1.0, 1.0, 1.0 },
+        { 2.0, 0.0, 1.0, 0.0, 0.0 },
+        { 2.0, 1.0, 1.0, 0.0, 1.0 },
+    };
+    uint16_t indices[8] = { 0, 1, 2, 3, 1, 4, 3, 5 };
+    uint16_t strips[2] = { 4, 4 };
+
+    mesh_t *mesh = mesh_create(verticies, 6, indices, strips, 2);
+    ASSERT(mesh != 0, "Failed to create a valid mesh!");
+
+    // Each unique vertex should come out exactly as the flat transform would give us.
+    vertex_t expected[6];
+    for (int i = 0; i < 6; i++)
+    {
+        expected[i].x = verticies[i].x;
+        expected[i].y = verticies[i].y;
+        expected[i].z = verticies[i].z;
+    }
+
+    matrix_push();
+    matrix_init_identity();
+    matrix_scale(2.0, 3.0, 1.0);
+    matrix_perspective_transform_vertex(expected, expected, 6);
+    int visible = mesh_transform(mesh);
+    matrix_pop();
+
+    ASSERT(visible == 1, "Expected one visible strip but got %d!", visible);
+    for (int i = 0; i < 6; i++)
+    {
+        ASSERT_APPROX(mesh->transformed[i].x, expected[i].x, "Unexpected X coordinate for vertex %d!", i);
+        ASSERT_APPROX(mesh->transformed[i].y, expected[i].y, "Unexpected Y coordinate for vertex %d!", i);
+        ASSERT_APPROX(mesh->transformed[i].z, expected[i].z, "Unexpected Z coordinate for vertex %d!", i);
+    }
+
+    mesh_free(mesh);
+}
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t strip_count;
+    uint32_t index_count;
+    uint32_t position_offset;
+    uint32_t uv_offset;
+    uint32_t normal_offset;
+    uint32_t strip_offset;
+    uint32_t index_offset;
+    float center[3];
+    float radius;
+    vertex_t positions[4];
+    uint32_t uvs[4];
+    uint16_t strips[2];
+    uint16_t indices[4];
+} test_mesh_asset_t;
+
+void test_mesh_load(test_context_t *context)
+{
+    // A single quad as tools/meshgen.py would lay it out, without normals.
+    test_mesh_asset_t asset = {
+        0x48534D4E,
+        1,
+        4,
+        1,
+        4,
+        offsetof(test_mesh_asset_t, positions),
+        offsetof(test_mesh_asset_t, uvs),
+        0,
+        offsetof(test_mesh_asset_t, strips),
+        offsetof(test_mesh_asset_t, indices),
+        { 0.5, 0.5, -1.0 },
+        0.7071,
+        {
+            { 0.0, 0.0, -1.0 },
+            { 1.0, 0.0, -1.0 },
+            { 0.0, 1.0, -1.0 },
+            { 1.0, 1.0, -1.0 },
+        },
+        { 0x00000000, 0x3F800000, 0x00003F80, 0x3F803F80 },
+        { 4, 0 },
+        { 0, 1, 2, 3 },
+    };
+
+    mesh_t *mesh = mesh_load(&asset, sizeof(asset));
+    ASSERT(mesh != 0, "Failed to load a valid mesh!");
+    ASSERT(mesh->verticies == 0, "Loaded mesh should not have textured verticies!");
+    ASSERT(mesh->positions == asset.positions, "Loaded mesh did not use positions in place!");
+    ASSERT(mesh->uvs == asset.uvs, "Loaded mesh did not use texture coordinates in place!");
+    ASSERT(mesh->normals == 0, "Loaded mesh should not have normals!");
+    ASSERT(mesh->indexcount == 4, "Mesh has %d indexes instead of 4!", mesh->indexcount);
+    ASSERT_APPROX(mesh->radius, 0.7071, "Unexpected bounding sphere radius %f!", mesh->radius);
+
+    // Loaded meshes should transform the same as ones built by hand.
+    vertex_t expected[4];
+    for (int i = 0; i < 4; i++)
+    {
+        expected[i] = asset.positions[i];
+    }
+
+    matrix_push();
+    matrix_init_identity();
+    matrix_scale(2.0, 3.0, 1.0);
+    matrix_perspective_transform_vertex(expected, expected, 4);
+    int visible = mesh_transform(mesh);
+    matrix_pop();
+
+    ASSERT(visible == 1, "Expected one visible strip but got %d!", visible);
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_APPROX(mesh->transformed[i].x, expected[i].x, "Unexpected X coordinate for vertex %d!", i);
+        ASSERT_APPROX(mesh->transformed[i].y, expected[i].y, "Unexpected Y coordinate for vertex %d!", i);
+        ASSERT_APPROX(mesh->transformed[i].z, expected[i].z, "Unexpected Z coordinate for vertex %d!", i);
+    }
+    mesh_free(mesh);
+
+    // Truncated data shouldn't load.
+    ASSERT(mesh_load(&asset, offsetof(test_mesh_asset_t, indices)) == 0, "Loaded a truncated mesh!");
+
+    // Neither should out of bounds indexes.
+    asset.indices[3] = 4;
+    ASSERT(mesh_load(&asset, sizeof(asset)) == 0, "Loaded a mesh with out of bounds indexes!");
+    asset.indices[3] = 3;
+
+    // Or something that isn't a mesh at all.
+    asset.magic = 0;
+    ASSERT(mesh_load(&asset, sizeof(asset)) == 0, "Loaded a mesh with a bad magic!");
+}
@@ -0,0 +1,41 @@
+// vim: set fileencoding=utf-8
+#include <stdlib.h>
+#include "naomi/thread.h"
+#include "naomi/timer.h"
+
+void test_profile_sample(test_context_t *context)
+{
+    profile_sample_t samples[64];
+    uint32_t dropped = 0;
+
+    ASSERT(profile_sample_start(1000, PROFILE_SAMPLE_CALLER, 64) == 0, "Could not start sampling profiler!");
+    ASSERT(profile_sample_start(1000, 0, 64) != 0, "Started sampling profiler twice!");
+
+    // Spin for a while so that the samples land on us.
+    timer_wait(50000);
+
+    unsigned int count = profile_sample_read(samples, 64, &dropped);
+    ASSERT(count > 0, "Sampling profiler did not record anything!");
+
+    uint32_t total = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        ASSERT(samples[i].count > 0, "Sampling profiler returned an empty entry!");
+        ASSERT(samples[i].pc != 0, "Sampling profiler recorded a null PC!");
+        ASSERT(samples[i].thread == thread_id(), "Sampling profiler recorded the wrong thread!");
+        total += samples[i].count;
+    }
+    ASSERT(total + dropped >= 25 && total + dropped <= 75, "Expected about 50 samples but got %lu!", total + dropped);
+
+    // Reading again should start over.
+    count = profile_sample_read(samples, 64, &dropped);
+    total = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        total += samples[i].count;
+    }
+    ASSERT(total + dropped < 10, "Sampling profiler did not start over after reading!");
+
+    profile_sample_stop();
+    ASSERT(profile_sample_read(samples, 64, &dropped) == 0, "Read samples after stopping the profiler!");
+}
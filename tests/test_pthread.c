@@ -0,0 +1,114 @@
+// vim: set fileencoding=utf-8
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/errno.h>
+#include <sys/time.h>
+#include "naomi/thread.h"
+
+typedef struct
+{
+    pthread_barrier_t barrier;
+    void *arrived;
+    void *serial;
+} barrier_test_t;
+
+void *barrier_thread(void *param)
+{
+    barrier_test_t *test = param;
+
+    for (int round = 0; round < 3; round++)
+    {
+        global_counter_increment(test->arrived);
+        if (pthread_barrier_wait(&test->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            global_counter_increment(test->serial);
+        }
+    }
+
+    return 0;
+}
+
+void test_pthread_barrier(test_context_t *context)
+{
+    barrier_test_t test;
+    test.arrived = global_counter_init(0);
+    test.serial = global_counter_init(0);
+    ASSERT(pthread_barrier_init(&test.barrier, NULL, 4) == 0, "Failed to create barrier!");
+
+    pthread_t threads[3];
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT(pthread_create(&threads[i], NULL, barrier_thread, &test) == 0, "Failed to create thread!");
+    }
+
+    for (int round = 0; round < 3; round++)
+    {
+        global_counter_increment(test.arrived);
+        if (pthread_barrier_wait(&test.barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            global_counter_increment(test.serial);
+        }
+
+        // Nobody gets through a round until everyone has arrived for it.
+        ASSERT(global_counter_value(test.arrived) >= (round + 1) * 4, "Got through barrier before all threads arrived!");
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    ASSERT(global_counter_value(test.serial) == 3, "Expected one serial thread per round, got %lu!", global_counter_value(test.serial));
+    ASSERT(pthread_barrier_destroy(&test.barrier) == 0, "Failed to destroy barrier!");
+    global_counter_free(test.arrived);
+    global_counter_free(test.serial);
+}
+
+void *rwlock_writer_thread(void *param)
+{
+    pthread_rwlock_t *rwlock = param;
+
+    pthread_rwlock_wrlock(rwlock);
+    pthread_rwlock_unlock(rwlock);
+
+    return 0;
+}
+
+void test_pthread_rwlock(test_context_t *context)
+{
+    pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+    // Any number of readers can hold the lock at once, but not a writer.
+    ASSERT(pthread_rwlock_rdlock(&rwlock) == 0, "Failed to read lock!");
+    ASSERT(pthread_rwlock_tryrdlock(&rwlock) == 0, "Failed to read lock a second time!");
+    ASSERT(pthread_rwlock_trywrlock(&rwlock) == EBUSY, "Write locked while readers hold lock!");
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    struct timespec deadline = { now.tv_sec, (now.tv_usec + 5000) * 1000 };
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    ASSERT(pthread_rwlock_timedwrlock(&rwlock, &deadline) == ETIMEDOUT, "Write locked while readers hold lock!");
+
+    // A writer that is waiting keeps new readers out.
+    pthread_t writer;
+    pthread_create(&writer, NULL, rwlock_writer_thread, &rwlock);
+    pthread_yield();
+    ASSERT(pthread_rwlock_tryrdlock(&rwlock) == EBUSY, "Read locked while writer was waiting!");
+
+    // Once the readers are gone, the writer gets through.
+    ASSERT(pthread_rwlock_unlock(&rwlock) == 0, "Failed to unlock!");
+    ASSERT(pthread_rwlock_unlock(&rwlock) == 0, "Failed to unlock!");
+    pthread_join(writer, NULL);
+
+    ASSERT(pthread_rwlock_wrlock(&rwlock) == 0, "Failed to write lock!");
+    ASSERT(pthread_rwlock_wrlock(&rwlock) == EDEADLK, "Recursively write locked!");
+    ASSERT(pthread_rwlock_tryrdlock(&rwlock) == EDEADLK, "Read locked while holding write lock!");
+    ASSERT(pthread_rwlock_unlock(&rwlock) == 0, "Failed to unlock!");
+    ASSERT(pthread_rwlock_unlock(&rwlock) == EPERM, "Unlocked a lock we don't hold!");
+
+    ASSERT(pthread_rwlock_destroy(&rwlock) == 0, "Failed to destroy lock!");
+}
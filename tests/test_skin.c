@@ -0,0 +1,96 @@
+// vim: set fileencoding=utf-8
+#include <stdlib.h>
+#include "naomi/matrix.h"
+#include "naomi/skin.h"
+
+void test_skin_create(test_context_t *context)
+{
+    skin_weight_t weights[2] = {
+        { { 0, 1, 0, 0 }, { 1.0, 1.0, 0.0, 0.0 } },
+        { { 1, 0, 0, 0 }, { 1.0, 0.0, 0.0, 0.0 } },
+    };
+
+    skin_t *skin = skin_create(weights, 2, 2);
+    ASSERT(skin != 0, "Failed to create a valid skin!");
+    skin_free(skin);
+
+    // Influences must refer to a bone we were given.
+    weights[1].bones[0] = 2;
+    ASSERT(skin_create(weights, 2, 2) == 0, "Created a skin with out of bounds bones!");
+
+    // Unless they have no weight, in which case they are ignored.
+    weights[1].weights[0] = 0.0;
+    skin = skin_create(weights, 2, 2);
+    ASSERT(skin != 0, "Failed to create a skin with an unweighted vertex!");
+    skin_free(skin);
+}
+
+void test_skin_transform(test_context_t *context)
+{
+    textured_vertex_t bindpose[3] = {
+        { 1.0, 0.0, 0.0, 0.25, 0.5 },
+        { 0.0, 1.0, 0.0, 0.0, 1.0 },
+        { 5.0, 5.0, 5.0, 1.0, 1.0 },
+    };
+    skin_weight_t weights[3] = {
+        // Split evenly between both bones, with unnormalized weights.
+        { { 0, 1, 0, 0 }, { 2.0, 2.0, 0.0, 0.0 } },
+        // Entirely on the second bone.
+        { { 1, 0, 0, 0 }, { 1.0, 0.0, 0.0, 0.0 } },
+        // Not skinned at all.
+        { { 0, 0, 0, 0 }, { 0.0, 0.0, 0.0, 0.0 } },
+    };
+    textured_vertex_t expected[3] = {
+        { 5.5, 9.5, 15.0, 0.25, 0.5 },
+        { 11.0, 20.0, 30.0, 0.0, 1.0 },
+        { 5.0, 5.0, 5.0, 1.0, 1.0 },
+    };
+
+    // The first bone stays put, the second turns 90 degrees about Z and moves.
+    matrix_t bones[2];
+    matrix_t sysmatrix;
+
+    matrix_push();
+    matrix_init_identity();
+    matrix_get(&bones[0]);
+    matrix_translate(10.0, 20.0, 30.0);
+    matrix_rotate_z(90.0);
+    matrix_get(&bones[1]);
+
+    // Make sure the system matrix survives skinning.
+    matrix_init_identity();
+    matrix_scale(2.0, 3.0, 4.0);
+    matrix_get(&sysmatrix);
+
+    skin_t *skin = skin_create(weights, 3, 2);
+    ASSERT(skin != 0, "Failed to create a valid skin!");
+
+    textured_vertex_t fast[3];
+    textured_vertex_t reference[3];
+    skin_transform(skin, bones, bindpose, fast);
+    skin_transform_reference(skin, bones, bindpose, reference);
+
+    matrix_t after;
+    matrix_get(&after);
+    matrix_pop();
+    skin_free(skin);
+
+    for (int i = 0; i < 16; i++)
+    {
+        int x = i % 4;
+        int y = i / 4;
+        ASSERT_APPROX(matrix_index(after, y, x), matrix_index(sysmatrix, y, x), "System matrix was modified at [%d][%d]!", y, x);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_APPROX(reference[i].x, expected[i].x, "Unexpected reference X value %f for vertex %d!", reference[i].x, i);
+        ASSERT_APPROX(reference[i].y, expected[i].y, "Unexpected reference Y value %f for vertex %d!", reference[i].y, i);
+        ASSERT_APPROX(reference[i].z, expected[i].z, "Unexpected reference Z value %f for vertex %d!", reference[i].z, i);
+        ASSERT_APPROX(fast[i].x, reference[i].x, "Unexpected X value %f for vertex %d!", fast[i].x, i);
+        ASSERT_APPROX(fast[i].y, reference[i].y, "Unexpected Y value %f for vertex %d!", fast[i].y, i);
+        ASSERT_APPROX(fast[i].z, reference[i].z, "Unexpected Z value %f for vertex %d!", fast[i].z, i);
+        ASSERT_APPROX(fast[i].u, expected[i].u, "Unexpected U value %f for vertex %d!", fast[i].u, i);
+        ASSERT_APPROX(fast[i].v, expected[i].v, "Unexpected V value %f for vertex %d!", fast[i].v, i);
+    }
+}
@@ -38,6 +38,66 @@ void test_threads_basic(test_context_t *context)
     global_counter_free(counter);
 }
 
+// Roughly where the last stack_thread's stack lived.
+static volatile uint32_t stack_thread_location = 0;
+
+void *stack_thread(void *param)
+{
+    volatile uint32_t local = 0;
+    stack_thread_location = (uint32_t)&local;
+    return 0;
+}
+
+void test_threads_stack_size(test_context_t *context)
+{
+    thread_info_t info;
+
+    uint32_t thread = thread_create("test", stack_thread, 0);
+    thread_info(thread, &info);
+    ASSERT(info.stack_size == THREAD_STACK_SIZE, "Default thread has wrong stack size %lu!", info.stack_size);
+    thread_destroy(thread);
+
+    // Odd sizes should be rounded up to the next size class.
+    thread = thread_create_ex("test", stack_thread, 0, 5000);
+    thread_info(thread, &info);
+    ASSERT(info.stack_size == 8192, "Small thread has wrong stack size %lu!", info.stack_size);
+
+    thread_start(thread);
+    thread_join(thread);
+    uint32_t first = stack_thread_location;
+    thread_destroy(thread);
+
+    // The stack we just gave back should be handed out again for the same size class.
+    thread = thread_create_ex("test", stack_thread, 0, 8192);
+    thread_start(thread);
+    thread_join(thread);
+    uint32_t second = stack_thread_location;
+    thread_destroy(thread);
+
+    ASSERT(first == second, "Stack of destroyed thread was not reused!");
+
+    // And it should not be handed out for a different size class.
+    thread = thread_create_ex("test", stack_thread, 0, THREAD_STACK_SIZE_MIN);
+    thread_info(thread, &info);
+    ASSERT(info.stack_size == THREAD_STACK_SIZE_MIN, "Minimum thread has wrong stack size %lu!", info.stack_size);
+    thread_start(thread);
+    thread_join(thread);
+    uint32_t third = stack_thread_location;
+    thread_destroy(thread);
+
+    ASSERT(first != third, "Stack was reused for the wrong size class!");
+
+    // Big stacks aren't rounded all the way up to the next power of two.
+    thread = thread_create_ex("test", stack_thread, 0, (130 * 1024) + 1);
+    thread_info(thread, &info);
+    ASSERT(info.stack_size == 132 * 1024, "Large thread has wrong stack size %lu!", info.stack_size);
+    thread_destroy(thread);
+
+    // Trimming gives back everything we were holding on to, so there's nothing left after.
+    ASSERT(thread_stack_trim() > 0, "Trimming did not free any pooled stacks!");
+    ASSERT(thread_stack_trim() == 0, "Trimming twice freed stacks the second time!");
+}
+
 void *semaphore_thread(void *param)
 {
     int profile = profile_start();
@@ -223,6 +283,13 @@ void *sleep_thread(void *param)
     return ((void *)(uint32_t)profile_end(profile));
 }
 
+void *sleep_thread_short(void *param)
+{
+    int profile = profile_start();
+    thread_sleep(2000);
+    return ((void *)(uint32_t)profile_end(profile));
+}
+
 void test_threads_sleep(test_context_t *context)
 {
     // First test wait.
@@ -248,6 +315,61 @@ void test_threads_sleep(test_context_t *context)
     ASSERT(time_spent < 261000, "Spent too much time (%lu) bookkeeping!", time_spent);
 }
 
+typedef struct
+{
+    uint32_t us;
+    void *counter;
+} sleep_order_t;
+
+void *sleep_order_thread(void *param)
+{
+    sleep_order_t *order = param;
+
+    thread_sleep(order->us);
+    global_counter_increment(order->counter);
+    return (void *)global_counter_value(order->counter);
+}
+
+void test_threads_sleep_order(test_context_t *context)
+{
+    // Threads should wake in deadline order, regardless of the order they went to sleep in.
+    void *counter = global_counter_init(0);
+    sleep_order_t orders[3] = {
+        { 30000, counter },
+        { 10000, counter },
+        { 20000, counter },
+    };
+    uint32_t threads[3];
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        threads[i] = thread_create("test", sleep_order_thread, &orders[i]);
+        thread_priority(threads[i], MAX_PRIORITY - 1);
+        thread_start(threads[i]);
+    }
+
+    uint32_t woken[3];
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        woken[i] = (uint32_t)thread_join(threads[i]);
+        thread_destroy(threads[i]);
+    }
+    global_counter_free(counter);
+
+    ASSERT(woken[0] == 3, "Longest sleep woke up in position %lu!", woken[0]);
+    ASSERT(woken[1] == 1, "Shortest sleep woke up in position %lu!", woken[1]);
+    ASSERT(woken[2] == 2, "Middle sleep woke up in position %lu!", woken[2]);
+
+    // A sleep much shorter than the preemption period should not have to wait for it.
+    uint32_t thread = thread_create("test", sleep_thread_short, 0);
+    thread_priority(thread, MAX_PRIORITY - 1);
+    thread_start(thread);
+    uint32_t time_spent = (uint32_t)thread_join(thread);
+    thread_destroy(thread);
+
+    ASSERT(time_spent > 2000, "Did not wait enough time (%lu) in thread!", time_spent);
+    ASSERT(time_spent < 4000, "Spent too much time (%lu) waiting for the next preemption!", time_spent);
+}
+
 typedef struct
 {
     int req_errno;
@@ -465,3 +587,326 @@ void test_threads_cancellation(test_context_t *context)
     ASSERT(retval == THREAD_CANCELLED, "Thread ended naturally when it should have been cancelled!");
     ASSERT(duration >= 100000, "Thread appears to have been async-cancelled instead of defer-cancelled!");
 }
+
+void *parked_thread(void *param)
+{
+    semaphore_t *semaphore = param;
+
+    semaphore_acquire(semaphore);
+    semaphore_release(semaphore);
+
+    return 0;
+}
+
+void *busy_thread(void *param)
+{
+    while (global_counter_value(param) == 0) { ; }
+
+    return 0;
+}
+
+void *yield_thread(void *param)
+{
+    for (unsigned int i = 0; i < 1000; i++)
+    {
+        global_counter_increment(param);
+        thread_yield();
+    }
+
+    return 0;
+}
+
+void test_threads_scheduling_latency(test_context_t *context)
+{
+    // Load the scheduler up with a bunch of threads that are blocked, as well as a bunch of
+    // lower priority threads that are runnable, so that a scheduler which has to look at
+    // every thread to make a decision would show up here.
+    semaphore_t semaphore;
+    semaphore_init(&semaphore, 1);
+    semaphore_acquire(&semaphore);
+
+    void *done = global_counter_init(0);
+    uint32_t parked[40];
+    uint32_t busy[8];
+    for (unsigned int i = 0; i < (sizeof(parked) / sizeof(parked[0])); i++)
+    {
+        parked[i] = thread_create("parked", parked_thread, &semaphore);
+        thread_start(parked[i]);
+    }
+    for (unsigned int i = 0; i < (sizeof(busy) / sizeof(busy[0])); i++)
+    {
+        busy[i] = thread_create("busy", busy_thread, done);
+        thread_priority(busy[i], -10);
+        thread_start(busy[i]);
+    }
+
+    // Now, ping-pong between two threads that share the highest band, and time how long
+    // each trip through the scheduler takes.
+    void *counter = global_counter_init(0);
+    uint32_t threads[2];
+    threads[0] = thread_create("ping", yield_thread, counter);
+    threads[1] = thread_create("pong", yield_thread, counter);
+    thread_priority(threads[0], MAX_PRIORITY - 1);
+    thread_priority(threads[1], MAX_PRIORITY - 1);
+
+    int profile = profile_start();
+    thread_start(threads[0]);
+    thread_start(threads[1]);
+    thread_join(threads[0]);
+    thread_join(threads[1]);
+    uint32_t duration = profile_end(profile);
+
+    ASSERT(global_counter_value(counter) == 2000, "Yield threads did not run to completion!");
+    ASSERT((duration / 2000) < 100, "Spent too much time (%lu) per context switch!", duration / 2000);
+
+    // Now, let everyone go so we can clean up.
+    global_counter_increment(done);
+    semaphore_release(&semaphore);
+    for (unsigned int i = 0; i < (sizeof(busy) / sizeof(busy[0])); i++)
+    {
+        thread_join(busy[i]);
+        thread_destroy(busy[i]);
+    }
+    for (unsigned int i = 0; i < (sizeof(parked) / sizeof(parked[0])); i++)
+    {
+        thread_join(parked[i]);
+        thread_destroy(parked[i]);
+    }
+    thread_destroy(threads[0]);
+    thread_destroy(threads[1]);
+
+    global_counter_free(counter);
+    global_counter_free(done);
+    semaphore_free(&semaphore);
+}
+
+typedef struct
+{
+    mutex_t mutex;
+    condition_t condition;
+    int value;
+    int woken;
+} condition_test_t;
+
+void *condition_thread(void *param)
+{
+    condition_test_t *test = param;
+
+    mutex_lock(&test->mutex);
+    while (test->value == 0)
+    {
+        condition_wait(&test->condition, &test->mutex);
+    }
+    test->woken++;
+    mutex_unlock(&test->mutex);
+
+    return 0;
+}
+
+void test_threads_condition(test_context_t *context)
+{
+    condition_test_t test;
+    mutex_init(&test.mutex);
+    condition_init(&test.condition);
+    test.value = 0;
+    test.woken = 0;
+
+    uint32_t threads[3];
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        threads[i] = thread_create("test", condition_thread, &test);
+        thread_priority(threads[i], 1);
+        thread_start(threads[i]);
+    }
+
+    // Since they're higher priority, they should all be parked on the condition by now.
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        thread_info_t info;
+        thread_info(threads[i], &info);
+        ASSERT(info.running == 0, "Thread %d is not waiting on the condition!", i);
+    }
+
+    // Signalling without changing the state should wake one thread which goes back to sleep.
+    condition_signal(&test.condition);
+    ASSERT(test.woken == 0, "Thread got past the condition without the state changing!");
+
+    // Now, wake them all up for real.
+    mutex_lock(&test.mutex);
+    test.value = 1;
+    condition_broadcast(&test.condition);
+    mutex_unlock(&test.mutex);
+
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        thread_join(threads[i]);
+        thread_destroy(threads[i]);
+    }
+    ASSERT(test.woken == 3, "Only %d threads were woken by broadcast!", test.woken);
+
+    condition_free(&test.condition);
+    mutex_free(&test.mutex);
+}
+
+void test_threads_condition_timeout(test_context_t *context)
+{
+    mutex_t mutex;
+    condition_t condition;
+    mutex_init(&mutex);
+    condition_init(&condition);
+
+    // Nobody will signal us, so we should time out with the mutex held again.
+    mutex_lock(&mutex);
+    int profile = profile_start();
+    int signalled = condition_wait_timeout(&condition, &mutex, 5000);
+    uint32_t duration = profile_end(profile);
+
+    ASSERT(signalled == 0, "Condition wait did not report a timeout!");
+    ASSERT(duration >= 5000, "Did not wait enough time (%lu) on condition!", duration);
+    ASSERT(duration < 7000, "Spent too much time (%lu) waiting on condition!", duration);
+    ASSERT(mutex_try_lock(&mutex), "We do not hold the mutex after timing out!");
+    mutex_unlock(&mutex);
+    mutex_unlock(&mutex);
+
+    condition_free(&condition);
+    mutex_free(&mutex);
+}
+
+void *release_thread(void *param)
+{
+    thread_sleep(2000);
+    semaphore_release(param);
+
+    return 0;
+}
+
+void *mutex_timeout_thread(void *param)
+{
+    if (mutex_lock_timeout(param, 2000))
+    {
+        mutex_unlock(param);
+        return (void *)1;
+    }
+
+    return 0;
+}
+
+void test_threads_acquire_timeout(test_context_t *context)
+{
+    semaphore_t semaphore;
+    semaphore_init(&semaphore, 1);
+    semaphore_acquire(&semaphore);
+
+    // Nobody will release it, so we should time out.
+    int profile = profile_start();
+    int acquired = semaphore_acquire_timeout(&semaphore, 5000);
+    uint32_t duration = profile_end(profile);
+    ASSERT(acquired == 0, "Acquired a semaphore that nobody released!");
+    ASSERT(duration >= 5000, "Did not wait enough time (%lu) on semaphore!", duration);
+    ASSERT(duration < 7000, "Spent too much time (%lu) waiting on semaphore!", duration);
+
+    // Now, have somebody release it before our timeout.
+    uint32_t thread = thread_create("test", release_thread, &semaphore);
+    thread_start(thread);
+    profile = profile_start();
+    acquired = semaphore_acquire_timeout(&semaphore, 50000);
+    duration = profile_end(profile);
+    ASSERT(acquired != 0, "Timed out on a semaphore that was released!");
+    ASSERT(duration < 5000, "Spent too much time (%lu) waiting on semaphore!", duration);
+    thread_join(thread);
+    thread_destroy(thread);
+
+    semaphore_release(&semaphore);
+    semaphore_free(&semaphore);
+
+    // Mutexes should time out when held by another thread, but not by us.
+    mutex_t mutex;
+    mutex_init(&mutex);
+    mutex_lock(&mutex);
+    ASSERT(mutex_lock_timeout(&mutex, 1000) != 0, "Could not recursively lock mutex!");
+    mutex_unlock(&mutex);
+
+    thread = thread_create("test", mutex_timeout_thread, &mutex);
+    thread_start(thread);
+    ASSERT((int)thread_join(thread) == 0, "Other thread acquired our mutex!");
+    thread_destroy(thread);
+
+    mutex_unlock(&mutex);
+    thread = thread_create("test", mutex_timeout_thread, &mutex);
+    thread_start(thread);
+    ASSERT((int)thread_join(thread) == 1, "Other thread timed out on a free mutex!");
+    thread_destroy(thread);
+    mutex_free(&mutex);
+}
+
+void test_threads_wait_any(test_context_t *context)
+{
+    semaphore_t semaphore;
+    semaphore_init(&semaphore, 1);
+
+    // An available semaphore is returned right away.
+    ASSERT(thread_wait_any(&semaphore, 0, 5000) == WAIT_ANY_SEMAPHORE, "Did not acquire available semaphore!");
+
+    // With nothing to acquire, we should wake up on our timeout.
+    int profile = profile_start();
+    int woken = thread_wait_any(&semaphore, 0, 5000);
+    uint32_t duration = profile_end(profile);
+    ASSERT(woken == WAIT_ANY_TIMEOUT, "Did not wake up on timeout!");
+    ASSERT(duration >= 5000, "Did not wait enough time (%lu) for timeout!", duration);
+    ASSERT(duration < 7000, "Spent too much time (%lu) waiting for timeout!", duration);
+
+    // And if somebody releases it first, we should get the semaphore.
+    uint32_t thread = thread_create("test", release_thread, &semaphore);
+    thread_start(thread);
+    profile = profile_start();
+    woken = thread_wait_any(&semaphore, 0, 50000);
+    duration = profile_end(profile);
+    ASSERT(woken == WAIT_ANY_SEMAPHORE, "Did not wake up on semaphore release!");
+    ASSERT(duration < 5000, "Spent too much time (%lu) waiting on semaphore!", duration);
+    thread_join(thread);
+    thread_destroy(thread);
+
+    // Timing out should have left no stale waiters behind, so a release and acquire
+    // should go through without blocking.
+    semaphore_release(&semaphore);
+    ASSERT(semaphore_acquire_timeout(&semaphore, 1000) != 0, "Semaphore was left in a bad state!");
+    semaphore_release(&semaphore);
+    semaphore_free(&semaphore);
+}
+
+void test_threads_many_mutexes(test_context_t *context)
+{
+    // Well past what used to be a fixed limit on the number of live mutexes.
+    unsigned int count = 500;
+    mutex_t *mutexes = malloc(sizeof(mutex_t) * count);
+    ASSERT(mutexes != 0, "Failed to allocate mutexes!");
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        mutex_init(&mutexes[i]);
+        ASSERT(mutexes[i].id != 0, "Failed to initialize mutex %d!", i);
+    }
+    for (unsigned int i = 0; i < count; i++)
+    {
+        ASSERT(mutex_try_lock(&mutexes[i]), "Failed to lock mutex %d!", i);
+    }
+    for (unsigned int i = 0; i < count; i++)
+    {
+        mutex_unlock(&mutexes[i]);
+    }
+
+    // A stale copy of a freed handle must not find whatever object reuses its slot.
+    mutex_t stale = mutexes[10];
+    mutex_free(&mutexes[10]);
+    mutex_init(&mutexes[10]);
+    ASSERT(mutexes[10].id != stale.id, "Reused the ID of a freed mutex!");
+    ASSERT(mutex_try_lock(&stale) == 0, "Locked a mutex through a stale handle!");
+    ASSERT(mutex_try_lock(&mutexes[10]), "Failed to lock reinitialized mutex!");
+    mutex_unlock(&mutexes[10]);
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        mutex_free(&mutexes[i]);
+    }
+    free(mutexes);
+}
@@ -0,0 +1,134 @@
+// vim: set fileencoding=utf-8
+#include <stdlib.h>
+#include "naomi/thread.h"
+#include "naomi/trace.h"
+
+void *trace_thread(void *param)
+{
+    thread_sleep(1000);
+    return 0;
+}
+
+void test_trace_markers(test_context_t *context)
+{
+    trace_event_t events[64];
+    uint32_t cursor = 0;
+    uint32_t dropped = 0;
+
+    trace_init(256);
+    trace_marker_begin(1);
+    trace_marker(2, 1234);
+    trace_marker_end(1);
+
+    // Interrupts may have been recorded in between, so pick out just the markers.
+    unsigned int count = trace_read(&cursor, events, 64, &dropped);
+    ASSERT(dropped == 0, "Trace dropped events on a mostly empty buffer!");
+
+    unsigned int markers = 0;
+    uint64_t last = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        ASSERT(events[i].timestamp >= last, "Trace events are not in order!");
+        last = events[i].timestamp;
+
+        if (events[i].type == TRACE_EVENT_MARKER_BEGIN || events[i].type == TRACE_EVENT_MARKER || events[i].type == TRACE_EVENT_MARKER_END)
+        {
+            ASSERT(events[i].thread == thread_id(), "Marker recorded against the wrong thread!");
+            switch (markers)
+            {
+                case 0:
+                    ASSERT_EQUAL(TRACE_EVENT_MARKER_BEGIN, events[i].type, "Wrong first marker type!");
+                    ASSERT_EQUAL(1, events[i].arg0, "Wrong first marker ID!");
+                    break;
+                case 1:
+                    ASSERT_EQUAL(TRACE_EVENT_MARKER, events[i].type, "Wrong second marker type!");
+                    ASSERT_EQUAL(2, events[i].arg0, "Wrong second marker ID!");
+                    ASSERT_EQUAL(1234, events[i].arg1, "Wrong second marker value!");
+                    break;
+                case 2:
+                    ASSERT_EQUAL(TRACE_EVENT_MARKER_END, events[i].type, "Wrong third marker type!");
+                    ASSERT_EQUAL(1, events[i].arg0, "Wrong third marker ID!");
+                    break;
+            }
+            markers++;
+        }
+    }
+    ASSERT_EQUAL(3, markers, "Wrong number of markers read back!");
+
+    // Reading again should only give us what happened since.
+    count = trace_read(&cursor, events, 64, &dropped);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        ASSERT(events[i].type != TRACE_EVENT_MARKER, "Read the same marker twice!");
+    }
+
+    trace_free();
+    ASSERT_EQUAL(0, trace_read(&cursor, events, 64, &dropped), "Read events after freeing the trace!");
+}
+
+void test_trace_overflow(test_context_t *context)
+{
+    trace_event_t events[16];
+    uint32_t cursor = 0;
+    uint32_t dropped = 0;
+
+    trace_init(256);
+    for (unsigned int i = 0; i < 1000; i++)
+    {
+        trace_marker(3, i);
+    }
+
+    // We should only get the newest events, and be told about the rest.
+    unsigned int count = trace_read(&cursor, events, 16, &dropped);
+    ASSERT_EQUAL(16, count, "Wrong number of events read back!");
+    ASSERT(dropped >= 1000 - 256, "Trace did not report dropped events!");
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (events[i].type == TRACE_EVENT_MARKER)
+        {
+            ASSERT(events[i].arg1 >= 1000 - 256, "Read an event that should have been overwritten!");
+        }
+    }
+
+    trace_free();
+}
+
+void test_trace_switches(test_context_t *context)
+{
+    trace_event_t *events = malloc(sizeof(trace_event_t) * 1024);
+    uint32_t cursor = 0;
+
+    trace_init(1024);
+    uint32_t thread = thread_create("trace", trace_thread, 0);
+    thread_start(thread);
+    thread_join(thread);
+
+    // We should see ourselves switch to the thread, the thread being woken from its
+    // sleep, and switching back to us once it exits.
+    unsigned int count = trace_read(&cursor, events, 1024, 0);
+    int switched_to = 0;
+    int woken = 0;
+    int switched_back = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (events[i].type == TRACE_EVENT_SWITCH && events[i].arg0 == thread)
+        {
+            switched_to = 1;
+        }
+        if (events[i].type == TRACE_EVENT_WAKE && events[i].thread == thread && events[i].arg0 == TRACE_WAKE_TIMER)
+        {
+            woken = 1;
+        }
+        if (events[i].type == TRACE_EVENT_SWITCH && events[i].thread == thread && events[i].arg0 == thread_id())
+        {
+            switched_back = 1;
+        }
+    }
+
+    ASSERT(switched_to, "Trace did not record a switch to the new thread!");
+    ASSERT(woken, "Trace did not record the new thread waking up!");
+    ASSERT(switched_back, "Trace did not record a switch back to us!");
+
+    trace_free();
+    free(events);
+}
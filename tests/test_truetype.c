@@ -1,6 +1,8 @@
 // vim: set fileencoding=utf-8
 #include <stdlib.h>
+#include "naomi/video.h"
 #include "naomi/font.h"
+#include "naomi/ta-freetype.h"
 
 void test_truetype_metrics(test_context_t *context)
 {
@@ -37,3 +39,215 @@ void test_truetype_metrics(test_context_t *context)
     SKIP("freetype is not installed");
 #endif
 }
+
+void test_truetype_cache_eviction(test_context_t *context)
+{
+#ifdef FEATURE_FREETYPE
+    extern uint8_t *dejavusans_ttf_data;
+    extern unsigned int dejavusans_ttf_len;
+    font_t *font_12pt = font_add(dejavusans_ttf_data, dejavusans_ttf_len);
+    font_set_size(font_12pt, 12);
+
+    // Shrink the cache so we can watch it evict. Draw everything off-screen so
+    // we don't stomp on the test output.
+    font_12pt->cachesize = 8;
+    for (int ch = 'A'; ch <= 'Z'; ch++)
+    {
+        video_draw_character(-1000, -1000, font_12pt, rgb(255, 255, 255), ch);
+        ASSERT(font_12pt->cacheloc <= 8, "Cache grew to %d entries past its size!", font_12pt->cacheloc);
+    }
+    ASSERT(font_12pt->cacheloc == 8, "Cache has %d entries instead of being full!", font_12pt->cacheloc);
+
+    // Glyphs at a different size get their own entries instead of wiping the cache.
+    font_set_size(font_12pt, 14);
+    ASSERT(font_12pt->cacheloc == 8, "Changing size discarded the cache, %d entries left!", font_12pt->cacheloc);
+    video_draw_character(-1000, -1000, font_12pt, rgb(255, 255, 255), 'H');
+    ASSERT(font_12pt->cacheloc == 8, "Cache has %d entries after evicting for a new size!", font_12pt->cacheloc);
+
+    // Metrics should be unaffected by any of the above.
+    font_set_size(font_12pt, 12);
+    font_metrics_t metrics = font_get_text_metrics(font_12pt, "Hello!");
+    ASSERT(metrics.width == 34, "Invalid width %d returned from metrics!", metrics.width);
+    ASSERT(metrics.height == 12, "Invalid height %d returned from metrics!", metrics.height);
+
+    font_discard(font_12pt);
+#else
+    SKIP("freetype is not installed");
+#endif
+}
+
+void test_truetype_bitmap_metrics(test_context_t *context)
+{
+    extern uint8_t *dejavusans_ttf_bitmap_data;
+    extern unsigned int dejavusans_ttf_bitmap_len;
+    font_t *font_12pt = font_add_bitmap(dejavusans_ttf_bitmap_data, dejavusans_ttf_bitmap_len);
+    ASSERT(font_12pt != 0, "Failed to load pre-rasterized font!");
+
+    // These should match what freetype gives us for the same font at runtime.
+    font_metrics_t metrics = font_get_text_metrics(font_12pt, "Hello!");
+    ASSERT(metrics.width == 34, "Invalid width %d returned from metrics!", metrics.width);
+    ASSERT(metrics.height == 12, "Invalid height %d returned from metrics!", metrics.height);
+
+    metrics = font_get_text_metrics(font_12pt, "γεια σας!");
+    ASSERT(metrics.width == 57, "Invalid width %d returned from metrics!", metrics.width);
+    ASSERT(metrics.height == 12, "Invalid height %d returned from metrics!", metrics.height);
+
+    metrics = font_get_character_metrics(font_12pt, 'H');
+    ASSERT(metrics.width == 9, "Invalid width %d returned from metrics!", metrics.width);
+    ASSERT(metrics.height == 12, "Invalid height %d returned from metrics!", metrics.height);
+
+    // Only baked sizes can be selected.
+    ASSERT(font_set_size(font_12pt, 16) == 0, "Failed to select baked font size!");
+    metrics = font_get_text_metrics(font_12pt, "Hello!\n123");
+    ASSERT(metrics.height == 32, "Invalid height %d returned from metrics!", metrics.height);
+    ASSERT(font_set_size(font_12pt, 13) != 0, "Selected a font size that wasn't baked!");
+
+    font_discard(font_12pt);
+
+    // Garbage should be rejected outright.
+    uint32_t garbage[16] = { 0 };
+    ASSERT(font_add_bitmap(garbage, sizeof(garbage)) == 0, "Loaded a garbage font!");
+
+    // So should a strike count that wraps around when multiplied by the strike size.
+    garbage[0] = 0x544E464E;
+    garbage[1] = 1;
+    garbage[2] = 0x15555556;
+    ASSERT(font_add_bitmap(garbage, sizeof(garbage)) == 0, "Loaded a font with too many strikes!");
+
+    // And a glyph whose bitmap can't possibly fit in the file.
+    garbage[2] = 1;
+    garbage[4] = 12;
+    garbage[5] = 1;
+    garbage[6] = 28;
+    garbage[10] = 0xFFFFFFFF;
+    garbage[11] = 0;
+    ASSERT(font_add_bitmap(garbage, sizeof(garbage)) == 0, "Loaded a font with an oversized glyph!");
+}
+
+void test_truetype_text_object(test_context_t *context)
+{
+    extern uint8_t *dejavusans_ttf_bitmap_data;
+    extern unsigned int dejavusans_ttf_bitmap_len;
+    font_t *font_12pt = font_add_bitmap(dejavusans_ttf_bitmap_data, dejavusans_ttf_bitmap_len);
+    ASSERT(font_12pt != 0, "Failed to load pre-rasterized font!");
+
+    ta_text_t *text = ta_text_create(font_12pt, 16);
+    ASSERT(text != 0, "Failed to create text object!");
+
+    ASSERT(ta_text_set(text, 10, 10, rgb(255, 255, 255), "Score: %d", 100) == 0, "Failed to lay out text!");
+    ASSERT(text->length == 10, "Text object has %d codepoints instead of 10!", text->length);
+    ASSERT(text->dirty, "Text object wasn't marked for rebuilding!");
+
+    // Laying out the same thing again shouldn't need a rebuild, but changing a digit should.
+    text->dirty = 0;
+    ta_text_set(text, 10, 10, rgb(255, 255, 255), "Score: %d", 100);
+    ASSERT(!text->dirty, "Unchanged text was marked for rebuilding!");
+    ta_text_set(text, 10, 10, rgb(255, 255, 255), "Score: %d", 101);
+    ASSERT(text->dirty, "Changed text wasn't marked for rebuilding!");
+
+    // Glyphs in use by the text object must survive cache eviction.
+    font_12pt->cachesize = 4;
+    for (int ch = 'A'; ch <= 'Z'; ch++)
+    {
+        video_draw_character(-1000, -1000, font_12pt, rgb(255, 255, 255), ch);
+    }
+    text->dirty = 0;
+    ta_text_set(text, 10, 10, rgb(255, 255, 255), "Score: %d", 101);
+    ASSERT(!text->dirty, "Pinned glyphs were evicted from the cache!");
+
+    // Strings are truncated to the maximum length.
+    ta_text_set(text, 10, 10, rgb(255, 255, 255), "This string is far too long");
+    ASSERT(text->length == 16, "Text object has %d codepoints instead of 16!", text->length);
+
+    ta_text_free(text);
+    font_discard(font_12pt);
+}
+
+void test_truetype_sheet_packing(test_context_t *context)
+{
+    extern uint8_t *dejavusans_ttf_bitmap_data;
+    extern unsigned int dejavusans_ttf_bitmap_len;
+    font_t *font_12pt = font_add_bitmap(dejavusans_ttf_bitmap_data, dejavusans_ttf_bitmap_len);
+    ASSERT(font_12pt != 0, "Failed to load pre-rasterized font!");
+    ASSERT(ta_font_set_sheet_size(300) != 0, "Accepted an invalid sheet size!");
+
+    // Laying out text caches glyphs onto sheets without needing to draw anything.
+    ta_text_t *text = ta_text_create(font_12pt, 128);
+    ASSERT(text != 0, "Failed to create text object!");
+    ta_text_set(text, 0, 0, rgb(255, 255, 255), "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789");
+
+    ta_font_sheet_stats_t stats[4];
+    int count = ta_font_sheet_stats(stats, 4);
+    ASSERT(count == 1, "Expected glyphs to fit on one sheet, but got %d!", count);
+    ASSERT(stats[0].uvsize == 256, "Sheet has unexpected size %d!", stats[0].uvsize);
+    ASSERT(stats[0].glyphs >= 62, "Sheet only has %d glyphs on it!", stats[0].glyphs);
+    ASSERT(stats[0].used > 0 && stats[0].used <= stats[0].allocated, "Sheet used %d pixels but only allocated %d!", stats[0].used, stats[0].allocated);
+    ASSERT(stats[0].allocated <= stats[0].total, "Sheet allocated %d pixels out of %d!", stats[0].allocated, stats[0].total);
+
+    ta_text_free(text);
+    font_discard(font_12pt);
+}
+
+// Internal to ta-freetype.c, but the distance field math is worth checking on its own.
+void _ta_sdf_generate(uint8_t *src, int width, int height, uint8_t *dst);
+
+void test_truetype_sdf_generate(test_context_t *context)
+{
+    // A solid 4x4 square in the middle of an 8x8 glyph. The field is padded by the
+    // spread (4 pixels) on every side.
+    uint8_t src[8 * 8];
+    uint8_t field[16 * 16];
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            src[x + (y * 8)] = (x >= 2 && x <= 5 && y >= 2 && y <= 5) ? 0xFF : 0x00;
+        }
+    }
+
+    _ta_sdf_generate(src, 8, 8, field);
+
+    // Everything covered by the glyph lands on or above the edge, everything else below.
+    for (int y = 0; y < 16; y++)
+    {
+        for (int x = 0; x < 16; x++)
+        {
+            int inside = (x >= 6 && x <= 9 && y >= 6 && y <= 9);
+            uint8_t value = field[x + (y * 16)];
+            if (inside)
+            {
+                ASSERT(value >= 0x80, "Inside pixel %d,%d has distance %02x!", x, y, value);
+            }
+            else
+            {
+                ASSERT(value < 0x80, "Outside pixel %d,%d has distance %02x!", x, y, value);
+            }
+        }
+    }
+
+    // Distances should grow moving away from the edge in either direction, and clamp
+    // once they are past the spread.
+    ASSERT(field[7 + (7 * 16)] > field[6 + (6 * 16)], "Center of glyph isn't further inside than its edge!");
+    ASSERT(field[5 + (5 * 16)] > field[3 + (3 * 16)], "Distance doesn't fall off outside of the glyph!");
+    ASSERT(field[0] < 0x08, "Far corner has distance %02x instead of being clamped!", field[0]);
+}
+
+void test_truetype_sdf_invalid(test_context_t *context)
+{
+    extern uint8_t *dejavusans_ttf_bitmap_data;
+    extern unsigned int dejavusans_ttf_bitmap_len;
+    font_t *font_12pt = font_add_bitmap(dejavusans_ttf_bitmap_data, dejavusans_ttf_bitmap_len);
+    ASSERT(font_12pt != 0, "Failed to load pre-rasterized font!");
+
+    // None of these should get far enough to draw anything.
+    ASSERT(ta_draw_sdf_character(0, 0, 0, 12.0, rgb(255, 255, 255), 'A') != 0, "Drew SDF text without a font!");
+    ASSERT(ta_draw_sdf_character(0, 0, font_12pt, 0.0, rgb(255, 255, 255), 'A') != 0, "Drew SDF text at zero size!");
+    ASSERT(ta_draw_sdf_text(0, 0, font_12pt, -12.0, rgb(255, 255, 255), "Hello!") != 0, "Drew SDF text at negative size!");
+
+    // Bitmap fonts can only be converted from one of their baked sizes.
+    font_12pt->sdfsize = 13;
+    ASSERT(ta_draw_sdf_character(0, 0, font_12pt, 12.0, rgb(255, 255, 255), 'A') != 0, "Drew SDF text from a size that wasn't baked!");
+    ASSERT(font_12pt->lineheight == 12, "Failed SDF draw changed the font size to %d!", font_12pt->lineheight);
+
+    font_discard(font_12pt);
+}
@@ -127,3 +127,54 @@ void test_vector_dot(test_context_t *context)
     ASSERT_APPROX(second.z, 0.0, "Unexpected coordinate for vector!");
     ASSERT_APPROX(vector_dot(&first, &second), 0.7071, "Unexpected dot product value!");
 }
+
+void test_vector_arrays(test_context_t *context)
+{
+    vector_t vecs[3] = {
+        { 3.0, 4.0, 0.0 },
+        { 0.0, 3.0, 4.0 },
+        { 2.0, 3.0, 6.0 },
+    };
+
+    vector_normalize_array(vecs, 3);
+    ASSERT_APPROX(vecs[0].x, 0.6, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[0].y, 0.8, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[0].z, 0.0, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[1].x, 0.0, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[1].y, 0.6, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[1].z, 0.8, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[2].x, 0.2857, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[2].y, 0.4286, "Unexpected coordinate for vector!");
+    ASSERT_APPROX(vecs[2].z, 0.8571, "Unexpected coordinate for vector!");
+
+    vector_t a[2] = {
+        { 1.0, 2.0, 3.0 },
+        { 1.0, 0.0, 0.0 },
+    };
+    vector_t b[2] = {
+        { 4.0, 5.0, 6.0 },
+        { 0.0, 1.0, 0.0 },
+    };
+    float dots[2];
+
+    vector_dot_array(dots, a, b, 2);
+    ASSERT_APPROX(dots[0], 32.0, "Unexpected dot product value!");
+    ASSERT_APPROX(dots[1], 0.0, "Unexpected dot product value!");
+
+    vector_t positions[4] = {
+        { 0.0, 0.0, 0.0 },
+        { 2.0, 0.0, 0.0 },
+        { 0.0, 2.0, 0.0 },
+        { 0.0, 0.0, 2.0 },
+    };
+    uint16_t indices[6] = { 0, 1, 2, 0, 2, 3 };
+    vector_t normals[2];
+
+    vector_face_normals(normals, positions, indices, 2);
+    ASSERT_APPROX(normals[0].x, 0.0, "Unexpected X value for face normal!");
+    ASSERT_APPROX(normals[0].y, 0.0, "Unexpected Y value for face normal!");
+    ASSERT_APPROX(normals[0].z, 1.0, "Unexpected Z value for face normal!");
+    ASSERT_APPROX(normals[1].x, 1.0, "Unexpected X value for face normal!");
+    ASSERT_APPROX(normals[1].y, 0.0, "Unexpected Y value for face normal!");
+    ASSERT_APPROX(normals[1].z, 0.0, "Unexpected Z value for face normal!");
+}
@@ -0,0 +1,156 @@
+#! /usr/bin/env python3
+import argparse
+import os
+import os.path
+import struct
+import sys
+import textwrap
+from PIL import Image, ImageDraw, ImageFont  # type: ignore
+from typing import List, Tuple
+
+
+# Must be kept in sync with the loader in libnaomi/font-bitmap.c.
+FONT_MAGIC = b"NFNT"
+FONT_VERSION = 1
+HEADER_SIZE = 16
+STRIKE_SIZE = 12
+GLYPH_SIZE = 20
+
+# The codepoint we store the font's missing glyph under.
+MISSING_GLYPH = 0
+
+
+def parse_range(rng: str) -> Tuple[int, int]:
+    if "-" in rng:
+        low, high = rng.split("-", 1)
+        return int(low, 0), int(high, 0)
+    else:
+        return int(rng, 0), int(rng, 0)
+
+
+def rasterize(font: ImageFont.FreeTypeFont, ch: str) -> Tuple[int, int, int, int, int, int, bytes]:
+    # Measure relative to the baseline so we get freetype-style bitmap_left/bitmap_top.
+    left, top, right, bottom = font.getbbox(ch, anchor="ls")
+    width = max(right - left, 0)
+    height = max(bottom - top, 0)
+    advance = int(font.getlength(ch))
+
+    if width == 0 or height == 0:
+        return advance, 0, left, -top, 0, 0, b""
+
+    img = Image.new("L", (width, height), 0)
+    ImageDraw.Draw(img).text((-left, -top), ch, font=font, fill=255, anchor="ls")
+    return advance, 0, left, -top, width, height, img.tobytes()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description=(
+            "Utility for pre-rasterizing a TrueType/OpenType font into a bitmap font that "
+            "can be loaded with font_add_bitmap() without needing freetype at runtime."
+        )
+    )
+    parser.add_argument(
+        'file',
+        metavar='FILE',
+        type=str,
+        help='The output file we should generate.',
+    )
+    parser.add_argument(
+        'ttf',
+        metavar='TTF',
+        type=str,
+        help='The font file we should rasterize.',
+    )
+    parser.add_argument(
+        '--size',
+        metavar='SIZE',
+        type=int,
+        action='append',
+        help='A pixel size to rasterize at. Can be specified multiple times. Defaults to 12.',
+    )
+    parser.add_argument(
+        '--range',
+        metavar='RANGE',
+        type=str,
+        action='append',
+        help=(
+            'A codepoint or inclusive codepoint range to include, such as "0x20-0x7E" or "0x3042". '
+            'Can be specified multiple times. Defaults to printable ASCII.'
+        ),
+    )
+    parser.add_argument(
+        '--raw',
+        action="store_true",
+        help='Output a raw font file instead of a C include file.',
+    )
+    args = parser.parse_args()
+
+    sizes: List[int] = sorted(set(args.size or [12]))
+    codepoints = set()
+    for rng in (args.range or ["0x20-0x7E"]):
+        low, high = parse_range(rng)
+        if low > high or low < 0 or high > 0x10FFFF:
+            raise Exception(f"Invalid codepoint range {rng}!")
+        codepoints.update(range(low, high + 1))
+    codepoints.discard(MISSING_GLYPH)
+
+    # Lay out the header and strike table first, then each strike's glyph
+    # records followed by the glyph bitmaps themselves.
+    strikes: List[bytes] = []
+    chunks: List[bytes] = []
+    offset = HEADER_SIZE + (STRIKE_SIZE * len(sizes))
+
+    for size in sizes:
+        font = ImageFont.truetype(args.ttf, size)
+
+        # Nonexistent characters render as the font's missing glyph, so grab a
+        # noncharacter to get a copy of it.
+        glyphs = [(MISSING_GLYPH, rasterize(font, "\uffff"))]
+        for cp in sorted(codepoints):
+            glyphs.append((cp, rasterize(font, chr(cp))))
+
+        glyph_offset = offset
+        bitmap_offset = glyph_offset + (GLYPH_SIZE * len(glyphs))
+        records: List[bytes] = []
+        bitmaps: List[bytes] = []
+
+        for cp, (advancex, advancey, left, top, width, height, data) in glyphs:
+            records.append(struct.pack("<IhhhhHHI", cp, advancex, advancey, left, top, width, height, bitmap_offset))
+            bitmaps.append(data)
+            bitmap_offset += len(data)
+
+        # Keep the next strike's records 4-byte aligned.
+        strikedata = b"".join(records) + b"".join(bitmaps)
+        while len(strikedata) & 3:
+            strikedata += b"\0"
+
+        strikes.append(struct.pack("<III", size, len(glyphs), glyph_offset))
+        chunks.append(strikedata)
+        offset += len(strikedata)
+
+    bindata = struct.pack("<4sIII", FONT_MAGIC, FONT_VERSION, len(sizes), 0) + b"".join(strikes) + b"".join(chunks)
+
+    if args.raw:
+        with open(args.file, "wb") as bfp:
+            bfp.write(bindata)
+    else:
+        name = os.path.basename(args.ttf).replace('.', '_')
+        cfile = f"""
+        #include <stdint.h>
+
+        uint8_t __{name}_bitmap_data[{len(bindata)}] __attribute__ ((aligned (4))) = {{
+            {", ".join(hex(b) for b in bindata)}
+        }};
+        unsigned int {name}_bitmap_len = {len(bindata)};
+        uint8_t *{name}_bitmap_data = __{name}_bitmap_data;
+        """
+
+        with open(args.file, "w") as sfp:
+            sfp.write(textwrap.dedent(cfile))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
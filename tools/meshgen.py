@@ -0,0 +1,429 @@
+#! /usr/bin/env python3
+import argparse
+import base64
+import json
+import math
+import os
+import os.path
+import struct
+import sys
+import textwrap
+from typing import Dict, List, Optional, Sequence, Tuple
+
+
+# Must be kept in sync with the loader in libnaomi/mesh.c.
+MESH_MAGIC = b"NMSH"
+MESH_VERSION = 1
+HEADER_SIZE = 56
+
+# Indexes are 16-bit at runtime.
+MAX_VERTICIES = 65536
+
+Position = Tuple[float, float, float]
+UV = Tuple[float, float]
+Vertex = Tuple[Position, UV, Optional[Position]]
+Triangle = Tuple[int, int, int]
+
+
+def load_obj(filename: str) -> Tuple[List[Vertex], List[Triangle]]:
+    positions: List[Position] = []
+    uvs: List[UV] = []
+    normals: List[Position] = []
+    verticies: List[Vertex] = []
+    lookup: Dict[Tuple[int, int, int], int] = {}
+    triangles: List[Triangle] = []
+
+    def resolve(index: str, count: int) -> int:
+        # OBJ indexes are one-based, and negative indexes count back from the end.
+        value = int(index)
+        return value - 1 if value > 0 else count + value
+
+    with open(filename, "r") as fp:
+        for line in fp:
+            parts = line.split()
+            if not parts:
+                continue
+
+            if parts[0] == "v":
+                positions.append((float(parts[1]), float(parts[2]), float(parts[3])))
+            elif parts[0] == "vt":
+                # OBJ puts V=0 at the bottom of the texture, but the TA puts it at the top.
+                uvs.append((float(parts[1]), 1.0 - float(parts[2]) if len(parts) > 2 else 1.0))
+            elif parts[0] == "vn":
+                normals.append((float(parts[1]), float(parts[2]), float(parts[3])))
+            elif parts[0] == "f":
+                face: List[int] = []
+                for corner in parts[1:]:
+                    pieces = corner.split("/")
+                    pos = resolve(pieces[0], len(positions))
+                    uv = resolve(pieces[1], len(uvs)) if len(pieces) > 1 and pieces[1] else -1
+                    normal = resolve(pieces[2], len(normals)) if len(pieces) > 2 and pieces[2] else -1
+
+                    key = (pos, uv, normal)
+                    if key not in lookup:
+                        lookup[key] = len(verticies)
+                        verticies.append((
+                            positions[pos],
+                            uvs[uv] if uv >= 0 else (0.0, 0.0),
+                            normals[normal] if normal >= 0 else None,
+                        ))
+                    face.append(lookup[key])
+
+                # Triangulate any polygons as a fan, which is what exporters expect.
+                for i in range(1, len(face) - 1):
+                    triangles.append((face[0], face[i], face[i + 1]))
+
+    return verticies, triangles
+
+
+def load_gltf(filename: str) -> Tuple[List[Vertex], List[Triangle]]:
+    buffers: List[bytes] = []
+
+    if filename.lower().endswith(".glb"):
+        with open(filename, "rb") as bfp:
+            data = bfp.read()
+
+        magic, _, length = struct.unpack("<4sII", data[0:12])
+        if magic != b"glTF":
+            raise Exception(f"{filename} is not a valid binary glTF file!")
+
+        gltf = None
+        binchunk = b""
+        offset = 12
+        while offset < length:
+            chunklength, chunktype = struct.unpack("<II", data[offset:(offset + 8)])
+            chunk = data[(offset + 8):(offset + 8 + chunklength)]
+            if chunktype == 0x4E4F534A:
+                gltf = json.loads(chunk.decode("utf-8"))
+            elif chunktype == 0x004E4942:
+                binchunk = chunk
+            offset += 8 + chunklength
+
+        if gltf is None:
+            raise Exception(f"{filename} has no JSON chunk!")
+    else:
+        with open(filename, "r") as fp:
+            gltf = json.load(fp)
+        binchunk = b""
+
+    for buf in gltf.get("buffers", []):
+        uri = buf.get("uri")
+        if uri is None:
+            buffers.append(binchunk)
+        elif uri.startswith("data:"):
+            buffers.append(base64.b64decode(uri.split(",", 1)[1]))
+        else:
+            with open(os.path.join(os.path.dirname(filename), uri), "rb") as bfp:
+                buffers.append(bfp.read())
+
+    componentformats = {5120: "b", 5121: "B", 5122: "h", 5123: "H", 5125: "I", 5126: "f"}
+    componentcounts = {"SCALAR": 1, "VEC2": 2, "VEC3": 3, "VEC4": 4}
+
+    def read_accessor(index: int) -> List[Tuple[float, ...]]:
+        accessor = gltf["accessors"][index]
+        view = gltf["bufferViews"][accessor["bufferView"]]
+        fmt = componentformats[accessor["componentType"]]
+        count = componentcounts[accessor["type"]]
+        size = struct.calcsize("<" + fmt)
+        stride = view.get("byteStride", size * count)
+        start = view.get("byteOffset", 0) + accessor.get("byteOffset", 0)
+        data = buffers[view["buffer"]]
+
+        scale = 1.0
+        if accessor.get("normalized", False):
+            scale = float({"b": 127, "B": 255, "h": 32767, "H": 65535}[fmt])
+
+        values: List[Tuple[float, ...]] = []
+        for i in range(accessor["count"]):
+            element = struct.unpack_from("<" + (fmt * count), data, start + (i * stride))
+            values.append(tuple(v / scale for v in element) if scale != 1.0 else element)
+        return values
+
+    verticies: List[Vertex] = []
+    triangles: List[Triangle] = []
+
+    # Node transforms are not applied, every triangle primitive is merged as-is.
+    for mesh in gltf.get("meshes", []):
+        for primitive in mesh.get("primitives", []):
+            if primitive.get("mode", 4) != 4:
+                continue
+
+            attributes = primitive["attributes"]
+            positions = read_accessor(attributes["POSITION"])
+            uvs = read_accessor(attributes["TEXCOORD_0"]) if "TEXCOORD_0" in attributes else None
+            normals = read_accessor(attributes["NORMAL"]) if "NORMAL" in attributes else None
+
+            base = len(verticies)
+            for i in range(len(positions)):
+                verticies.append((
+                    (positions[i][0], positions[i][1], positions[i][2]),
+                    (uvs[i][0], uvs[i][1]) if uvs else (0.0, 0.0),
+                    (normals[i][0], normals[i][1], normals[i][2]) if normals else None,
+                ))
+
+            if "indices" in primitive:
+                indices = [int(v[0]) + base for v in read_accessor(primitive["indices"])]
+            else:
+                indices = list(range(base, base + len(positions)))
+
+            for i in range(0, len(indices) - 2, 3):
+                triangles.append((indices[i], indices[i + 1], indices[i + 2]))
+
+    return verticies, triangles
+
+
+def stripify(triangles: Sequence[Triangle]) -> List[List[int]]:
+    # Throw away degenerate triangles, they can't contribute anything.
+    triangles = [t for t in triangles if len(set(t)) == 3]
+
+    # Map every directed edge to the triangle it belongs to. A triangle (a, b, c) can
+    # continue a strip ending in (p, q) if it contains the edge in the right winding.
+    edges: Dict[Tuple[int, int], List[int]] = {}
+    for i, (a, b, c) in enumerate(triangles):
+        for edge in ((a, b), (b, c), (c, a)):
+            edges.setdefault(edge, []).append(i)
+
+    used = [False] * len(triangles)
+
+    def third(tri: int, p: int, q: int) -> int:
+        for v in triangles[tri]:
+            if v != p and v != q:
+                return v
+        raise Exception("Triangle does not contain edge!")
+
+    def neighbors(tri: int) -> int:
+        a, b, c = triangles[tri]
+        return sum(
+            1 for (p, q) in ((b, a), (c, b), (a, c))
+            for other in edges.get((p, q), [])
+            if not used[other]
+        )
+
+    def grow(start: int, rotation: int) -> Tuple[List[int], List[int]]:
+        a, b, c = triangles[start]
+        strip = [[a, b, c], [b, c, a], [c, a, b]][rotation]
+        claimed = [start]
+        taken = {start}
+
+        while True:
+            # Every odd triangle in a strip has its winding flipped relative to the
+            # strip order, so look up the shared edge in the direction it needs.
+            p, q = strip[-2], strip[-1]
+            edge = (p, q) if (len(strip) - 2) % 2 == 0 else (q, p)
+
+            candidate = None
+            for other in edges.get(edge, []):
+                if not used[other] and other not in taken:
+                    candidate = other
+                    break
+            if candidate is None:
+                break
+
+            strip.append(third(candidate, p, q))
+            claimed.append(candidate)
+            taken.add(candidate)
+
+        return strip, claimed
+
+    strips: List[List[int]] = []
+    cursor = 0
+    while True:
+        while cursor < len(triangles) and used[cursor]:
+            cursor += 1
+        if cursor == len(triangles):
+            break
+
+        # Start from the triangle with the fewest free neighbors, since it is the
+        # hardest to pick up later, and try each rotation to get the longest strip.
+        # Only look a short way ahead so that large models don't take forever.
+        window = [i for i in range(cursor, min(cursor + 64, len(triangles))) if not used[i]]
+        start = min(window, key=neighbors)
+        best: Tuple[List[int], List[int]] = ([], [])
+        for rotation in range(3):
+            strip, claimed = grow(start, rotation)
+            if len(claimed) > len(best[1]):
+                best = (strip, claimed)
+
+        for tri in best[1]:
+            used[tri] = True
+        strips.append(best[0])
+
+    return strips
+
+
+def bounding_sphere(positions: Sequence[Position]) -> Tuple[Position, float]:
+    # Ritter's algorithm, which is fast and usually within a few percent of optimal.
+    def dist(a: Position, b: Position) -> float:
+        return math.sqrt(sum((a[i] - b[i]) ** 2 for i in range(3)))
+
+    first = positions[0]
+    second = max(positions, key=lambda p: dist(p, first))
+    third = max(positions, key=lambda p: dist(p, second))
+
+    center = [(second[i] + third[i]) / 2.0 for i in range(3)]
+    radius = dist(second, third) / 2.0
+
+    for p in positions:
+        d = dist(p, (center[0], center[1], center[2]))
+        if d > radius:
+            newradius = (radius + d) / 2.0
+            for i in range(3):
+                center[i] += ((p[i] - center[i]) * (newradius - radius)) / d
+            radius = newradius
+
+    return (center[0], center[1], center[2]), radius
+
+
+def pack_uv(u: float, v: float) -> int:
+    # The TA's 16-bit UVs are the top half of a float. Round to nearest instead of
+    # truncating so we don't consistently sample a tiny bit up and to the left.
+    def half(value: float) -> int:
+        bits = struct.unpack("<I", struct.pack("<f", value))[0]
+        return ((bits + 0x8000) >> 16) & 0xFFFF
+
+    return (half(u) << 16) | half(v)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description=(
+            "Utility for converting OBJ and glTF models into pre-stripified meshes that can be "
+            "loaded in place with mesh_load() and drawn with ta_draw_mesh()."
+        )
+    )
+    parser.add_argument(
+        'file',
+        metavar='FILE',
+        type=str,
+        help='The output file we should generate.',
+    )
+    parser.add_argument(
+        'model',
+        metavar='MODEL',
+        type=str,
+        help='The model file we should convert. Supports .obj, .gltf and .glb files.',
+    )
+    parser.add_argument(
+        '--normals',
+        action="store_true",
+        help='Include per-vertex normals for lighting. Models without normals get face-averaged normals.',
+    )
+    parser.add_argument(
+        '--raw',
+        action="store_true",
+        help='Output a raw mesh file instead of a C include file.',
+    )
+    args = parser.parse_args()
+
+    if args.model.lower().endswith(".obj"):
+        verticies, triangles = load_obj(args.model)
+    elif args.model.lower().endswith(".gltf") or args.model.lower().endswith(".glb"):
+        verticies, triangles = load_gltf(args.model)
+    else:
+        raise Exception(f"Unsupported model format for {args.model}!")
+
+    strips = stripify(triangles)
+    if not strips:
+        raise Exception(f"{args.model} has no triangles in it!")
+
+    # Reorder verticies by first use, so that transforming walks memory in the same
+    # order that drawing does. Anything no strip refers to gets dropped.
+    remap: Dict[int, int] = {}
+    for strip in strips:
+        for index in strip:
+            if index not in remap:
+                remap[index] = len(remap)
+    if len(remap) > MAX_VERTICIES:
+        raise Exception(f"{args.model} has {len(remap)} unique verticies, but only {MAX_VERTICIES} are supported!")
+
+    ordered: List[Vertex] = [verticies[0]] * len(remap)
+    for old, new in remap.items():
+        ordered[new] = verticies[old]
+    strips = [[remap[index] for index in strip] for strip in strips]
+
+    normals: Optional[List[Position]] = None
+    if args.normals:
+        # Fill in any missing normals by averaging the faces that touch the vertex.
+        accum = [[0.0, 0.0, 0.0] for _ in ordered]
+        for a, b, c in triangles:
+            if a not in remap or b not in remap or c not in remap:
+                continue
+            pa, pb, pc = verticies[a][0], verticies[b][0], verticies[c][0]
+            e1 = [pb[i] - pa[i] for i in range(3)]
+            e2 = [pc[i] - pa[i] for i in range(3)]
+            cross = (e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0])
+            for index in (a, b, c):
+                for i in range(3):
+                    accum[remap[index]][i] += cross[i]
+
+        normals = []
+        for i, (_, _, normal) in enumerate(ordered):
+            value = normal if normal is not None else (accum[i][0], accum[i][1], accum[i][2])
+            length = math.sqrt(sum(v * v for v in value)) or 1.0
+            normals.append((value[0] / length, value[1] / length, value[2] / length))
+
+    center, radius = bounding_sphere([v[0] for v in ordered])
+
+    # Lay out the arrays after the header, 4-byte aligned arrays first so the 16-bit
+    # strips and indexes at the end don't need any padding in between.
+    positiondata = b"".join(struct.pack("<fff", *v[0]) for v in ordered)
+    uvdata = b"".join(struct.pack("<I", pack_uv(*v[1])) for v in ordered)
+    normaldata = b"".join(struct.pack("<fff", *n) for n in normals) if normals is not None else b""
+    stripdata = b"".join(struct.pack("<H", len(strip)) for strip in strips)
+    indexdata = b"".join(struct.pack("<H", index) for strip in strips for index in strip)
+
+    position_offset = HEADER_SIZE
+    uv_offset = position_offset + len(positiondata)
+    normal_offset = uv_offset + len(uvdata)
+    strip_offset = normal_offset + len(normaldata)
+    index_offset = strip_offset + len(stripdata)
+
+    bindata = struct.pack(
+        "<4sIIIIIIIIIffff",
+        MESH_MAGIC,
+        MESH_VERSION,
+        len(ordered),
+        len(strips),
+        sum(len(strip) for strip in strips),
+        position_offset,
+        uv_offset,
+        normal_offset if normals is not None else 0,
+        strip_offset,
+        index_offset,
+        center[0],
+        center[1],
+        center[2],
+        radius,
+    ) + positiondata + uvdata + normaldata + stripdata + indexdata
+    while len(bindata) & 3:
+        bindata += b"\0"
+
+    print(
+        f"{len(triangles)} triangles, {len(ordered)} verticies, {len(strips)} strips, "
+        f"{sum(len(strip) for strip in strips)} strip verticies sent to the TA instead of {len(triangles) * 3}.",
+        file=sys.stderr,
+    )
+
+    if args.raw:
+        with open(args.file, "wb") as bfp:
+            bfp.write(bindata)
+    else:
+        name = os.path.basename(args.model).replace('.', '_')
+        cfile = f"""
+        #include <stdint.h>
+
+        uint8_t __{name}_mesh_data[{len(bindata)}] __attribute__ ((aligned (4))) = {{
+            {", ".join(hex(b) for b in bindata)}
+        }};
+        unsigned int {name}_mesh_len = {len(bindata)};
+        uint8_t *{name}_mesh_data = __{name}_mesh_data;
+        """
+
+        with open(args.file, "w") as sfp:
+            sfp.write(textwrap.dedent(cfile))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+import argparse
+import os
+import struct
+import subprocess
+import sys
+import time
+from typing import Dict, List, Tuple
+
+from netdimm import NetDimm, receive_message
+
+
+# Keep these in sync with libnaomi/message/profile.c.
+MESSAGE_HOST_PROFILE = 0x7FFC
+PROFILE_RECORD_SAMPLES = 1
+PROFILE_RECORD_THREAD_NAME = 2
+
+# Keep this in sync with profile_sample_t in libnaomi/naomi/timer.h.
+SAMPLE_FORMAT = "<IIII"
+SAMPLE_SIZE = struct.calcsize(SAMPLE_FORMAT)
+
+# The PR register points past the call instruction and its delay slot, so back up to the
+# call itself so that we land on the right line.
+CALL_SIZE = 4
+
+
+class ProfileCollector:
+    def __init__(self) -> None:
+        self.thread_names: Dict[int, str] = {}
+        self.samples: Dict[Tuple[int, int, int], int] = {}
+        self.dropped = 0
+        self.total = 0
+
+    def add_name(self, data: bytes) -> None:
+        tid, = struct.unpack("<I", data[0:4])
+        self.thread_names[tid] = data[4:68].split(b"\0", 1)[0].decode("utf-8", errors="replace")
+
+    def add_samples(self, data: bytes) -> None:
+        dropped, = struct.unpack("<I", data[0:4])
+        self.dropped += dropped
+        data = data[4:]
+
+        for off in range(0, len(data) - (SAMPLE_SIZE - 1), SAMPLE_SIZE):
+            thread, pc, pr, count = struct.unpack(SAMPLE_FORMAT, data[off:(off + SAMPLE_SIZE)])
+            key = (thread, pc, pr)
+            self.samples[key] = self.samples.get(key, 0) + count
+            self.total += count
+
+
+class Symbolizer:
+    def __init__(self, addr2line: str, elf: str, lines: bool) -> None:
+        self.addr2line = addr2line
+        self.elf = elf
+        self.lines = lines
+
+    def symbolize(self, addresses: List[int]) -> Dict[int, str]:
+        if not addresses:
+            return {}
+
+        # One addr2line run for everything, which prints a function name line and a
+        # file:line line per address.
+        result = subprocess.run(
+            [self.addr2line, "-f", "-C", "-e", self.elf] + [hex(a) for a in addresses],
+            stdout=subprocess.PIPE,
+            check=True,
+        )
+        output = result.stdout.decode("utf-8", errors="replace").splitlines()
+
+        symbols: Dict[int, str] = {}
+        for i, address in enumerate(addresses):
+            function = output[i * 2].strip() if (i * 2) < len(output) else "??"
+            location = output[i * 2 + 1].strip() if (i * 2 + 1) < len(output) else "??:0"
+            if function == "??":
+                function = f"0x{address:08x}"
+            if self.lines:
+                location = os.path.basename(location.split(" ", 1)[0])
+                function = f"{function} ({location})"
+
+            # Semicolons separate frames in folded stacks.
+            symbols[address] = function.replace(";", ":")
+        return symbols
+
+
+def fold(collector: ProfileCollector, symbolizer: Symbolizer) -> List[str]:
+    addresses = set()
+    for (_, pc, pr) in collector.samples:
+        addresses.add(pc)
+        if pr:
+            addresses.add(pr - CALL_SIZE)
+    symbols = symbolizer.symbolize(sorted(addresses))
+
+    stacks: Dict[str, int] = {}
+    for (thread, pc, pr), count in collector.samples.items():
+        frames = [collector.thread_names.get(thread, f"thread {thread}")]
+        if pr:
+            caller = symbols[pr - CALL_SIZE]
+            function = symbols[pc]
+
+            # In functions that call others PR is left over from an earlier call, so it
+            # can point back into the same function. Don't show it calling itself.
+            if caller != function:
+                frames.append(caller)
+        frames.append(symbols[pc])
+
+        stack = ";".join(frames)
+        stacks[stack] = stacks.get(stack, 0) + count
+
+    return [f"{stack} {count}" for stack, count in sorted(stacks.items())]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=(
+        "Receive sampling profiler results from a Naomi binary running libnaomimessage with "
+        "message_profile_redirect_init(), symbolize them and write them out as folded stacks "
+        "suitable for flamegraph.pl, speedscope or similar."
+    ))
+    parser.add_argument(
+        "ip",
+        metavar="IP",
+        type=str,
+        help="The IP address that the NetDimm is configured on.",
+    )
+    parser.add_argument(
+        "output",
+        metavar="OUTPUT",
+        type=str,
+        help="The file to write folded stacks to.",
+    )
+    parser.add_argument(
+        '--elf',
+        type=str,
+        default=os.path.join("build", "naomi.elf"),
+        help="The ELF file with debugging information for the running program. Defaults to %(default)s.",
+    )
+    parser.add_argument(
+        '--addr2line',
+        type=str,
+        default=os.path.join(os.environ.get("NAOMI_SH_BASE", "/opt/toolchains/naomi/sh-elf"), "bin", "sh-elf-addr2line"),
+        help="The addr2line executable to symbolize with. Defaults to %(default)s.",
+    )
+    parser.add_argument(
+        '--lines',
+        action="store_true",
+        help="Include file and line numbers in each frame, instead of only function names.",
+    )
+    parser.add_argument(
+        '--duration',
+        type=float,
+        default=None,
+        help="Stop after this many seconds instead of waiting for Ctrl+C.",
+    )
+    parser.add_argument(
+        '--verbose',
+        action="store_true",
+        help="Display verbose debugging information.",
+    )
+
+    args = parser.parse_args()
+    verbose = args.verbose
+
+    collector = ProfileCollector()
+    start = time.monotonic()
+
+    netdimm = NetDimm(args.ip, log=print)
+    try:
+        with netdimm.connection():
+            while args.duration is None or (time.monotonic() - start) < args.duration:
+                msg = receive_message(netdimm, verbose=verbose)
+                if msg and msg.id == MESSAGE_HOST_PROFILE and len(msg.data) >= 4:
+                    kind, = struct.unpack("<I", msg.data[0:4])
+                    if kind == PROFILE_RECORD_SAMPLES:
+                        collector.add_samples(msg.data[4:])
+                    elif kind == PROFILE_RECORD_THREAD_NAME:
+                        collector.add_name(msg.data[4:])
+    except KeyboardInterrupt:
+        pass
+
+    lines = fold(collector, Symbolizer(args.addr2line, args.elf, args.lines))
+    with open(args.output, "w") as fp:
+        for line in lines:
+            fp.write(line + "\n")
+
+    print(f"Wrote {collector.total} samples to {args.output}", end="")
+    if collector.dropped:
+        print(f", {collector.dropped} samples were dropped", end="")
+    print(".")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
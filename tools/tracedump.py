@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+import argparse
+import json
+import struct
+import sys
+import time
+from typing import Any, Dict, List, Optional
+
+from netdimm import NetDimm, receive_message
+
+
+# Keep these in sync with libnaomi/message/trace.c.
+MESSAGE_HOST_TRACE = 0x7FFD
+TRACE_RECORD_EVENTS = 1
+TRACE_RECORD_THREAD_NAME = 2
+
+# Keep these in sync with libnaomi/naomi/trace.h.
+TRACE_EVENT_SWITCH = 1
+TRACE_EVENT_WAKE = 2
+TRACE_EVENT_IRQ_ENTER = 3
+TRACE_EVENT_IRQ_EXIT = 4
+TRACE_EVENT_TA = 5
+TRACE_EVENT_VIDEO = 6
+TRACE_EVENT_MARKER = 7
+TRACE_EVENT_MARKER_BEGIN = 8
+TRACE_EVENT_MARKER_END = 9
+
+STATES = {
+    0: "stopped",
+    1: "preempted",
+    2: "finished",
+    3: "finished",
+    4: "waiting",
+}
+
+WAKE_REASONS = {
+    1: "sleep",
+    2: "timeout",
+    3: "semaphore",
+    4: "condition",
+    5: "join",
+    6: "interrupt",
+    7: "ta",
+}
+
+TA_EVENTS = {
+    1: "render begin",
+    2: "render finished",
+    3: "opaque list loaded",
+    4: "transparent list loaded",
+    5: "punch-through list loaded",
+}
+
+VIDEO_EVENTS = {
+    1: "vblank in",
+    2: "vblank out",
+}
+
+# Keep these in sync with libnaomi/naomi/interrupt.h.
+IRQ_EVENTS = {
+    0x0E0: "memory read error",
+    0x100: "memory write error",
+    0x120: "fpu exception",
+    0x160: "syscall",
+    0x180: "illegal instruction",
+    0x1A0: "illegal slot instruction",
+    0x1C0: "nmi",
+    0x320: "holly level 6",
+    0x360: "holly level 4",
+    0x3A0: "holly level 2",
+    0x400: "tmu0",
+    0x420: "tmu1",
+    0x440: "tmu2",
+}
+
+EVENT_FORMAT = "<QIIII"
+EVENT_SIZE = struct.calcsize(EVENT_FORMAT)
+
+# Chrome trace process and thread IDs. Naomi thread IDs are never zero, so interrupts get
+# their own track at zero.
+PID = 1
+IRQ_TID = 0
+
+
+class TraceConverter:
+    def __init__(self, marker_names: Dict[int, str]) -> None:
+        self.marker_names = marker_names
+        self.thread_names: Dict[int, str] = {}
+        self.events: List[Dict[str, Any]] = []
+        self.running: Optional[int] = None
+        self.in_irq: Optional[str] = None
+        self.last_timestamp = 0
+        self.dropped = 0
+        self.count = 0
+
+    def __marker(self, marker: int) -> str:
+        return self.marker_names.get(marker, f"marker {marker}")
+
+    def __add(self, ph: str, name: str, ts: int, tid: int, **kwargs: Any) -> None:
+        event: Dict[str, Any] = {"ph": ph, "name": name, "ts": ts, "pid": PID, "tid": tid}
+        event.update(kwargs)
+        self.events.append(event)
+
+    def add_name(self, data: bytes) -> None:
+        tid, = struct.unpack("<I", data[0:4])
+        self.thread_names[tid] = data[4:68].split(b"\0", 1)[0].decode("utf-8", errors="replace")
+
+    def add_events(self, data: bytes) -> None:
+        dropped, = struct.unpack("<I", data[0:4])
+        data = data[4:]
+
+        if dropped:
+            # We can't trust any open slices across a gap, so close them out.
+            self.dropped += dropped
+            self.__close(self.last_timestamp)
+            self.__add("i", f"dropped {dropped} events", self.last_timestamp, IRQ_TID, s="g")
+
+        for off in range(0, len(data) - (EVENT_SIZE - 1), EVENT_SIZE):
+            timestamp, kind, thread, arg0, arg1 = struct.unpack(EVENT_FORMAT, data[off:(off + EVENT_SIZE)])
+            self.__add_event(timestamp, kind, thread, arg0, arg1)
+            self.last_timestamp = timestamp
+            self.count += 1
+
+    def __add_event(self, ts: int, kind: int, thread: int, arg0: int, arg1: int) -> None:
+        if kind == TRACE_EVENT_SWITCH:
+            if self.running is not None:
+                self.__add("E", "running", ts, self.running, args={"left": STATES.get(arg1, str(arg1))})
+            self.__add("B", "running", ts, arg0)
+            self.running = arg0
+        elif kind == TRACE_EVENT_WAKE:
+            reason = WAKE_REASONS.get(arg0, str(arg0))
+            self.__add("i", f"woken by {reason}", ts, thread, s="t", args={"reason": reason, "detail": arg1})
+        elif kind == TRACE_EVENT_IRQ_ENTER:
+            name = IRQ_EVENTS.get(arg0, f"irq {arg0:03x}")
+            if arg0 == 0x160:
+                name = f"syscall {arg1}"
+            if self.in_irq is not None:
+                self.__add("E", self.in_irq, ts, IRQ_TID)
+            self.__add("B", name, ts, IRQ_TID, args={"thread": thread})
+            self.in_irq = name
+        elif kind == TRACE_EVENT_IRQ_EXIT:
+            if self.in_irq is not None:
+                self.__add("E", self.in_irq, ts, IRQ_TID, args={"thread": thread})
+                self.in_irq = None
+        elif kind == TRACE_EVENT_TA:
+            self.__add("i", TA_EVENTS.get(arg0, f"ta {arg0}"), ts, IRQ_TID, s="p")
+        elif kind == TRACE_EVENT_VIDEO:
+            self.__add("i", VIDEO_EVENTS.get(arg0, f"video {arg0}"), ts, IRQ_TID, s="g")
+        elif kind == TRACE_EVENT_MARKER:
+            self.__add("i", self.__marker(arg0), ts, thread, s="t", args={"value": arg1})
+        elif kind == TRACE_EVENT_MARKER_BEGIN:
+            # Spans can cross context switches, so they go on their own async tracks.
+            self.__add("b", self.__marker(arg0), ts, thread, cat="marker", id=f"{thread}.{arg0}")
+        elif kind == TRACE_EVENT_MARKER_END:
+            self.__add("e", self.__marker(arg0), ts, thread, cat="marker", id=f"{thread}.{arg0}")
+
+    def __close(self, ts: int) -> None:
+        if self.running is not None:
+            self.__add("E", "running", ts, self.running)
+            self.running = None
+        if self.in_irq is not None:
+            self.__add("E", self.in_irq, ts, IRQ_TID)
+            self.in_irq = None
+
+    def finish(self) -> Dict[str, Any]:
+        self.__close(self.last_timestamp)
+
+        metadata: List[Dict[str, Any]] = [
+            {"ph": "M", "name": "process_name", "pid": PID, "tid": IRQ_TID, "args": {"name": "naomi"}},
+            {"ph": "M", "name": "thread_name", "pid": PID, "tid": IRQ_TID, "args": {"name": "interrupts"}},
+            {"ph": "M", "name": "thread_sort_index", "pid": PID, "tid": IRQ_TID, "args": {"sort_index": -1}},
+        ]
+        for tid, name in sorted(self.thread_names.items()):
+            metadata.append({"ph": "M", "name": "thread_name", "pid": PID, "tid": tid, "args": {"name": f"{name} ({tid})"}})
+
+        return {"traceEvents": metadata + self.events, "displayTimeUnit": "ms"}
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=(
+        "Receive a scheduler trace from a Naomi binary running libnaomimessage with "
+        "message_trace_redirect_init() and write it out as a Chrome trace, which can be "
+        "opened in chrome://tracing or ui.perfetto.dev."
+    ))
+    parser.add_argument(
+        "ip",
+        metavar="IP",
+        type=str,
+        help="The IP address that the NetDimm is configured on.",
+    )
+    parser.add_argument(
+        "output",
+        metavar="OUTPUT",
+        type=str,
+        help="The JSON file to write the trace to.",
+    )
+    parser.add_argument(
+        '--duration',
+        type=float,
+        default=None,
+        help="Stop after this many seconds instead of waiting for Ctrl+C.",
+    )
+    parser.add_argument(
+        '--marker-name',
+        metavar="ID=NAME",
+        type=str,
+        action="append",
+        default=[],
+        help="Give a name to a marker ID used with trace_marker() and friends. Can be given more than once.",
+    )
+    parser.add_argument(
+        '--verbose',
+        action="store_true",
+        help="Display verbose debugging information.",
+    )
+
+    args = parser.parse_args()
+    verbose = args.verbose
+
+    marker_names: Dict[int, str] = {}
+    for marker in args.marker_name:
+        if "=" not in marker:
+            print(f"Invalid marker name {marker}, expected ID=NAME!", file=sys.stderr)
+            return 1
+        marker_id, name = marker.split("=", 1)
+        marker_names[int(marker_id, 0)] = name
+
+    converter = TraceConverter(marker_names)
+    start = time.monotonic()
+
+    netdimm = NetDimm(args.ip, log=print)
+    try:
+        with netdimm.connection():
+            while args.duration is None or (time.monotonic() - start) < args.duration:
+                msg = receive_message(netdimm, verbose=verbose)
+                if msg and msg.id == MESSAGE_HOST_TRACE and len(msg.data) >= 4:
+                    kind, = struct.unpack("<I", msg.data[0:4])
+                    if kind == TRACE_RECORD_EVENTS:
+                        converter.add_events(msg.data[4:])
+                    elif kind == TRACE_RECORD_THREAD_NAME:
+                        converter.add_name(msg.data[4:])
+    except KeyboardInterrupt:
+        pass
+
+    with open(args.output, "w") as fp:
+        json.dump(converter.finish(), fp)
+
+    print(f"Wrote {converter.count} events to {args.output}", end="")
+    if converter.dropped:
+        print(f", {converter.dropped} events were dropped", end="")
+    print(".")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())